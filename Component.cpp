@@ -1,8 +1,6 @@
 #include "Component.h"
 
-using namespace std;
-
-Component* Component::Create(const wstring& className)
+Component* Component::Create(StringId className)
 {
 	detail::ComponentRegistry& reg = detail::GetComponentRegistry();
     detail::ComponentRegistry::iterator it = reg.find(className);
@@ -6,12 +6,11 @@ class Component;
 
 #include "utilities/Textblock.h"
 
-#include <string>
-
 class Component
 {
 public:
-	static Component* Create(const std::wstring& className);
+	// by the name given to COMPONENT_REGISTER, as "name"_id
+	static Component* Create(StringId className);
 	static void Destroy(Component* component);
 
 	Component();
@@ -35,7 +34,7 @@ public:
                                                                               \
         const ::detail::RegistryEntry<TYPE>&								  \
             ComponentRegistration<TYPE>::reg =                                \
-                ::detail::RegistryEntry<TYPE>::Instance(NAME);				  \
+                ::detail::RegistryEntry<TYPE>::Instance(intern_string(NAME)); \
     }}
 
 #endif
@@ -1,13 +1,14 @@
 #ifndef COMPONENT_REGISTRY_H
 #define COMPONENT_REGISTRY_H
 
-#include <string>
+#include "utilities/StringId.h"
+
 #include <map>
 
 namespace detail
 {
     typedef Component* (*CreateComponentFunc)();
-    typedef std::map<std::wstring, CreateComponentFunc> ComponentRegistry;
+    typedef std::map<StringId, CreateComponentFunc> ComponentRegistry;
 
     inline ComponentRegistry& GetComponentRegistry()
     {
@@ -28,14 +29,14 @@ namespace detail
     struct RegistryEntry
     {
 	public:
-        static RegistryEntry<T>& Instance(const std::wstring& name)
+        static RegistryEntry<T>& Instance(StringId name)
         {
             static RegistryEntry<T> inst(name);
             return inst;
         }
 
     private:
-        RegistryEntry(const std::wstring& name)
+        RegistryEntry(StringId name)
         {
             ComponentRegistry& reg = GetComponentRegistry();
             CreateComponentFunc func = CreateComponent<T>;
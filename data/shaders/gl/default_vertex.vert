@@ -4,6 +4,7 @@ uniform layout(std140);
 uniform ObjectBlock
 {
 	mat4 model_view_projection;
+	vec4 texcoord_transform; // scale in xy, offset in zw
 };
 
 in vec4 position;
@@ -13,6 +14,6 @@ out vec2 texCoord;
 
 void main(void)
 {
-	texCoord = textureCoordinate;
+	texCoord = textureCoordinate * texcoord_transform.xy + texcoord_transform.zw;
 	gl_Position = model_view_projection * position;
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#version 150
+uniform layout(std140);
+
+uniform TerrainBlock
+{
+	mat4 model_view_projection;
+	vec4 view_position;
+	vec4 lod; // spacing of the level drawn, where its morph starts, and one over the morph's length
+};
+
+in vec4 position; // with the height to slide to in w
+in vec2 textureCoordinate;
+in float morph; // the spacing of the level that slides
+
+out vec2 texCoord;
+
+void main(void)
+{
+	// only vertices that the next level up leaves out have to move, and
+	// they finish by the end of the level's range
+	float t = clamp((distance(position.xyz, view_position.xyz) - lod.y) * lod.z, 0.0, 1.0);
+	t *= float(morph == lod.x);
+
+	vec4 morphed = vec4(position.xyz, 1.0);
+	morphed.y = mix(position.y, position.w, t);
+
+	texCoord = textureCoordinate;
+	gl_Position = model_view_projection * morphed;
+}
@@ -3,7 +3,13 @@
 #include "DXUtils.h"
 
 #include "../utilities/MeshLoading.h"
+#include "../utilities/MeshFile.h"
+#include "../utilities/MeshProcessing.h"
 #include "../utilities/Logging.h"
+#include "../utilities/Timer.h"
+#include "../utilities/NumberMacros.h"
+
+#include <cstring>
 
 DXModel::DXModel()
 {
@@ -32,20 +38,34 @@ void DXModel::SetDefaults()
 
 	numVertices = 0;
 	numIndices = 0;
+	indexFormat = DXGI_FORMAT_R16_UINT;
 }
 
 void DXModel::LoadAsMesh(const String& filename, ModelUsage usage)
 {
+	double startTime = Timer::GetTime();
+
 	String path("data/meshes/");
 	path.Append(filename);
 
+	// a copy baked by MeshBaker next to the model is used instead, if there is one
+	String bakedPath("data/meshes/");
+	const char* dot = strrchr(filename.Data(), '.');
+	bakedPath.Append(filename.Data(), (dot)? dot : filename.Data() + filename.Size());
+	bakedPath.Append(".mesh");
+	if(LoadBaked(bakedPath.Data(), usage))
+	{
+		LOG_INFO("%s mapped in %.2f ms", bakedPath.Data(), Timer::GetTime() - startTime);
+		return;
+	}
+
 	AutoArray<vec4> vertices;
 	AutoArray<vec3> normals;
 	AutoArray<vec2> texcoords;
-	AutoArray<unsigned short> elements;
+	AutoArray<uint32_t> elements;
 
 	MaterialInfo matInfo[MAX_MATERIALS];
-	numMaterials = load_obj(path.Data(), vertices, normals, texcoords, elements, matInfo);
+	numMaterials = load_obj(path.Data(), vertices, normals, texcoords, elements, matInfo, MAX_MATERIALS);
 
 	for(int i = 0; i < numMaterials; i++)
 	{
@@ -55,12 +75,92 @@ void DXModel::LoadAsMesh(const String& filename, ModelUsage usage)
 		materials[i].texture.Load(matInfo[i].texName);
 	}
 
-	numVertices = vertices.Count();
+	int startIndices[MAX_MATERIALS];
+	for(int i = 0; i < numMaterials; i++)
+		startIndices[i] = matInfo[i].startIndex;
+
+	numVertices = optimize_mesh(vertices.First(), normals.First(), texcoords.First(), vertices.Count(),
+		elements.First(), elements.Count(), startIndices, numMaterials);
 	numIndices = elements.Count();
 
 	BufferData(vertices.First(), texcoords.First(), elements.First(), usage);
 
 	isLoaded = true;
+
+	LOG_INFO("%s parsed in %.2f ms", path.Data(), Timer::GetTime() - startTime);
+}
+
+bool DXModel::LoadBaked(const char* path, ModelUsage usage)
+{
+	MappedMesh mesh;
+	if(!map_mesh_file(path, &mesh)) return false;
+
+	// each submesh has a material of its own, so a file with more than there
+	// is room for can't be drawn as it was baked
+	const MeshFileHeader* header = mesh.header;
+	if(header->numSubmeshes > uint32_t(MAX_MATERIALS))
+	{
+		LOG_ISSUE("%s has %u materials, more than the %d a model can have", path, header->numSubmeshes, MAX_MATERIALS);
+		unmap_mesh_file(&mesh);
+		return false;
+	}
+
+	// only the full detail level is drawn so far
+	const MeshFileLod& lod = mesh.lods[0];
+	numVertices = header->numVertices;
+	numIndices = lod.numIndices;
+	numMaterials = header->numSubmeshes;
+	for(int i = 0; i < numMaterials; i++)
+	{
+		const MeshFileSubmesh& submesh = mesh.submeshes[lod.firstSubmesh + i];
+		materials[i].startIndex = submesh.startIndex - lod.startIndex;
+		materials[i].phase = (submesh.alpha < 1.0f)? PHASE_TRANSPARENT : PHASE_SOLID;
+		materials[i].color = VEC4_ONE;
+		materials[i].texture.Load(submesh.textureName);
+	}
+
+	indexFormat = (header->indexSize == 2)? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	const char* indices = (const char*) mesh.indices + lod.startIndex * header->indexSize;
+	if(header->vertexFormat == MESH_VERTEX_PACKED)
+	{
+		// the input layouts only take floats, so packed vertices are opened
+		// back up on the way in
+		vec4* positions = new vec4[numVertices];
+		vec3* normals = new vec3[numVertices];
+		vec2* texcoords = new vec2[numVertices];
+		unpack_vertices(positions, normals, texcoords, (const PackedVertex*) mesh.vertices, numVertices,
+			get_vertex_quantization(header));
+
+		vertexSize = 4 + 2;
+		vertexWidth = sizeof(float) * vertexSize;
+		float* vertices = new float[numVertices * vertexSize];
+		for(int i = 0; i < numVertices; i++)
+		{
+			float* vertex = vertices + i * vertexSize;
+			vertex[0] = positions[i].x;
+			vertex[1] = positions[i].y;
+			vertex[2] = positions[i].z;
+			vertex[3] = positions[i].w;
+			vertex[4] = texcoords[i].x;
+			vertex[5] = texcoords[i].y;
+		}
+		CreateBuffers(vertices, indices, header->indexSize, usage);
+
+		delete[] vertices;
+		delete[] texcoords;
+		delete[] normals;
+		delete[] positions;
+	}
+	else
+	{
+		vertexWidth = header->vertexSize;
+		vertexSize = header->vertexSize / sizeof(float);
+		CreateBuffers(mesh.vertices, indices, header->indexSize, usage);
+	}
+
+	unmap_mesh_file(&mesh);
+	isLoaded = true;
+	return true;
 }
 
 void DXModel::LoadAsQuad(const vec3& dimensions, const vec4& texCoord, ModelUsage usage)
@@ -80,7 +180,7 @@ void DXModel::LoadAsQuad(const vec3& dimensions, const vec4& texCoord, ModelUsag
 		vec2(texCoord.x + texCoord.z, texCoord.y + texCoord.w),
 		vec2(texCoord.x, texCoord.y + texCoord.w)
 	};
-	const unsigned short elements[6] = { 0, 3, 1, 1, 3, 2 };
+	const uint32_t elements[6] = { 0, 3, 1, 1, 3, 2 };
 
 	BufferData(vertices, texcoords, elements, usage);
 
@@ -92,10 +192,8 @@ void DXModel::LoadAsQuad(const vec3& dimensions, const vec4& texCoord, ModelUsag
 	isLoaded = true;
 }
 
-void DXModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsigned short* elements, ModelUsage usage)
+void DXModel::BufferData(const vec4* vertices, const vec2* texcoords, const uint32_t* elements, ModelUsage usage)
 {
-	HRESULT hr = S_OK;
-
 	vertexSize = 4 + 2;
 	vertexWidth = sizeof(float) * vertexSize;
 	float* vertexDataBuffer = new float[numVertices * vertexSize];
@@ -109,6 +207,29 @@ void DXModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsi
 		vertexDataBuffer[i*vertexSize+5] = texcoords[i].y;
 	}
 
+	unsigned short* shortElements = nullptr;
+	size_t indexSize = sizeof(uint32_t);
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	if(numVertices <= 65536)
+	{
+		shortElements = new unsigned short[numIndices];
+		for(int i = 0; i < numIndices; i++)
+			shortElements[i] = elements[i];
+		indexSize = sizeof(unsigned short);
+		indexFormat = DXGI_FORMAT_R16_UINT;
+	}
+
+	CreateBuffers(vertexDataBuffer, (shortElements)? (const void*) shortElements : (const void*) elements, indexSize, usage);
+	delete[] vertexDataBuffer;
+	delete[] shortElements;
+}
+
+// vertices start with a position of four floats and then a texture
+// coordinate of two, however much else comes after them
+void DXModel::CreateBuffers(const void* vertices, const void* indices, size_t indexSize, ModelUsage usage)
+{
+	HRESULT hr = S_OK;
+
 	D3D11_USAGE bufferUsage;
 	switch(usage)
 	{
@@ -129,13 +250,12 @@ void DXModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsi
 	vertexBufferDesc.StructureByteStride = 0;
  
 	D3D11_SUBRESOURCE_DATA vertexBufferData;
-	vertexBufferData.pSysMem = vertexDataBuffer;
+	vertexBufferData.pSysMem = vertices;
 	vertexBufferData.SysMemPitch = 0;
 	vertexBufferData.SysMemSlicePitch = 0;
  
 	ID3D11Buffer* vertexBuffer;
 	hr = _Device->CreateBuffer(&vertexBufferDesc, &vertexBufferData, &vertexBuffer);
-	delete[] vertexDataBuffer;
 	if(FAILED(hr))
 	{
 		LOG_ISSUE("DIRECTX ERROR: %s - could not buffer vertex data", hresult_text(hr).Data());
@@ -143,7 +263,7 @@ void DXModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsi
 	}
 
 	D3D11_BUFFER_DESC indexBufferDesc;
-	indexBufferDesc.ByteWidth = sizeof(unsigned short) * numIndices;
+	indexBufferDesc.ByteWidth = indexSize * numIndices;
 	indexBufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
 	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	indexBufferDesc.CPUAccessFlags = 0;
@@ -151,7 +271,7 @@ void DXModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsi
 	indexBufferDesc.StructureByteStride = 0;
 
 	D3D11_SUBRESOURCE_DATA indexBufferData;
-	indexBufferData.pSysMem = elements;
+	indexBufferData.pSysMem = indices;
 	indexBufferData.SysMemPitch = 0;
 	indexBufferData.SysMemSlicePitch = 0;
  
@@ -190,7 +310,7 @@ void DXModel::Draw(RenderPhase phase, DXShader& shader) const
     UINT stride = vertexWidth;
     UINT offset = 0;
 	_DeviceContext->IASetVertexBuffers(0, 1, &verticesB, &stride, &offset);
-	_DeviceContext->IASetIndexBuffer(indicesB, DXGI_FORMAT_R16_UINT, 0);
+	_DeviceContext->IASetIndexBuffer(indicesB, indexFormat, 0);
 
     _DeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
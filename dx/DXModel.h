@@ -5,6 +5,7 @@
 
 #include "../utilities/GLMath.h"
 #include "../utilities/String.h"
+#include "../utilities/DataTypes.h"
 
 #include "../RenderPhase.h"
 
@@ -44,10 +45,13 @@ private:
 	ID3D11Buffer *verticesB, *indicesB;
 	size_t vertexWidth, vertexSize;
 
-	unsigned short numVertices, numIndices;
+	int numVertices, numIndices;
+	DXGI_FORMAT indexFormat; // 16-bit indices unless there are too many vertices
 
 	void SetDefaults();
-	void BufferData(const vec4* vertices, const vec2* texcoords, const unsigned short* elements, ModelUsage usage);
+	bool LoadBaked(const char* path, ModelUsage usage);
+	void BufferData(const vec4* vertices, const vec2* texcoords, const uint32_t* elements, ModelUsage usage);
+	void CreateBuffers(const void* vertices, const void* indices, size_t indexSize, ModelUsage usage);
 };
 
 #endif
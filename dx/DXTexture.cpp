@@ -37,13 +37,15 @@ void DXTexture::SetDefaults()
 
 bool DXTexture::Load(const String& fileName)
 {
+	StringId fileId(fileName);
+
 	DXTexture* existingTexture = nullptr;
 	for(int i = 0; i < MAX_NUM_TEXTURES; i++)
 	{
 		DXTexture* tex = loadedTextures[i].record;
 		if(tex == nullptr) continue;
 
-		if(loadedTextures[i].fileName == fileName)
+		if(loadedTextures[i].fileId == fileId)
 		{
 			existingTexture = tex;
 
@@ -68,7 +70,7 @@ bool DXTexture::Load(const String& fileName)
 				DXTexture* tex = loadedTextures[i].record;
 				if(tex != nullptr) continue;
 
-				loadedTextures[i].fileName = fileName;
+				loadedTextures[i].fileId = fileId;
 				loadedTextures[i].record = this;
 				loadedTextures[i].numOwners = 1;
 				break;
@@ -232,7 +234,7 @@ void DXTexture::Unload()
 
 			loadedTextures[i].numOwners = 0;
 			loadedTextures[i].record = nullptr;
-			loadedTextures[i].fileName.Clear();
+			loadedTextures[i].fileId = StringId();
 		}
 		else
 			loadedTextures[i].numOwners--;
@@ -4,6 +4,7 @@
 #include "DXInfo.h"
 
 #include "../utilities/String.h"
+#include "../utilities/StringId.h"
 
 class DXTexture
 {
@@ -24,7 +25,7 @@ public:
 private:
 	struct TextureRecord
 	{
-		String fileName;
+		StringId fileId;
 		DXTexture* record;
 		int numOwners;
 	};
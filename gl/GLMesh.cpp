@@ -4,14 +4,25 @@ GLMesh::GLMesh():
 	sortingKey(0),
 	vertexArray(0),
 	startIndex(0),
-	numIndices(0)
+	numIndices(0),
+	indexType(GL_UNSIGNED_SHORT),
+	rangeCounts(nullptr),
+	rangeOffsets(nullptr),
+	numRanges(0)
 {
 	materialBlock.color = VEC4_ONE;
 	objectBlock.modelViewProjection = MAT_I;
+	objectBlock.texcoordTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f);
 }
 
 void GLMesh::Draw() const
 {
 	glBindVertexArray(vertexArray);
-	glDrawElementsBaseVertex(GL_TRIANGLES, numIndices, GL_UNSIGNED_SHORT, (GLvoid*)(startIndex * sizeof(GLushort)), 0);
+	if(rangeCounts)
+	{
+		glMultiDrawElements(GL_TRIANGLES, rangeCounts, indexType, rangeOffsets, numRanges);
+		return;
+	}
+	size_t indexSize = (indexType == GL_UNSIGNED_INT)? sizeof(GLuint) : sizeof(GLushort);
+	glDrawElementsBaseVertex(GL_TRIANGLES, numIndices, indexType, (GLvoid*)(startIndex * indexSize), 0);
 }
@@ -9,6 +9,7 @@
 struct ObjectBlock
 {
 	mat4x4 modelViewProjection;
+	vec4 texcoordTransform; // scale in xy, offset in zw
 };
 
 struct MaterialBlock
@@ -38,6 +39,13 @@ public:
 	GLuint vertexArray;
 	GLuint startIndex;
 	GLuint numIndices;
+	GLenum indexType;
+
+	// if set, the runs of indices left after culling meshlets, drawn in place
+	// of the one range above
+	const GLsizei* rangeCounts;
+	const GLvoid* const* rangeOffsets;
+	GLsizei numRanges;
 
 	GLuint textureID;
 	mat4x4 model;
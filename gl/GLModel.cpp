@@ -2,6 +2,15 @@
 
 #include "../utilities/String.h"
 #include "../utilities/MeshLoading.h"
+#include "../utilities/MeshFile.h"
+#include "../utilities/MeshProcessing.h"
+#include "../utilities/Logging.h"
+#include "../utilities/Timer.h"
+#include "../utilities/NumberMacros.h"
+
+#include <cstring>
+#include <cstddef>
+#include <float.h>
 
 GLModel::GLModel()
 {
@@ -23,20 +32,39 @@ void GLModel::SetDefaults()
 
 	numIndices = 0;
 	numVertices = 0;
+	indexType = GL_UNSIGNED_SHORT;
+	positionDecode = MAT_I;
+	texcoordDecode = vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+	numLods = 0;
+	meshlets.Clear();
 }
 
 void GLModel::LoadAsMesh(const String& filename)
 {
+	double startTime = Timer::GetTime();
+
 	String path("data/meshes/");
 	path.Append(filename);
 
+	// a copy baked by MeshBaker next to the model is used instead, if there is one
+	String bakedPath("data/meshes/");
+	const char* dot = strrchr(filename.Data(), '.');
+	bakedPath.Append(filename.Data(), (dot)? dot : filename.Data() + filename.Size());
+	bakedPath.Append(".mesh");
+	if(LoadBaked(bakedPath.Data()))
+	{
+		LOG_INFO("%s mapped in %.2f ms", bakedPath.Data(), Timer::GetTime() - startTime);
+		return;
+	}
+
 	AutoArray<vec4> vertices;
 	AutoArray<vec3> normals;
 	AutoArray<vec2> texcoords;
-	AutoArray<unsigned short> elements;
+	AutoArray<uint32_t> elements;
 
 	MaterialInfo matInfo[MAX_MATERIALS];
-	numMaterials = load_obj(path.Data(), vertices, normals, texcoords, elements, matInfo);
+	numMaterials = load_obj(path.Data(), vertices, normals, texcoords, elements, matInfo, MAX_MATERIALS);
 
 	for(int i = 0; i < numMaterials; i++)
 	{
@@ -46,12 +74,125 @@ void GLModel::LoadAsMesh(const String& filename)
 		materials[i].texture.Load(matInfo[i].texName);
 	}
 
-	numVertices = vertices.Count();
+	int startIndices[MAX_MATERIALS];
+	for(int i = 0; i < numMaterials; i++)
+		startIndices[i] = matInfo[i].startIndex;
+
+	numVertices = optimize_mesh(vertices.First(), normals.First(), texcoords.First(), vertices.Count(),
+		elements.First(), elements.Count(), startIndices, numMaterials);
+
+	// the coarser levels go after the full detail triangles in the same buffer,
+	// and how far each strays decides when it's drawn, so any amount will do
+	LodLevel levels[MAX_LODS];
+	int rangeStarts[MAX_LODS * MAX_MATERIALS];
+	numLods = build_lod_chain(elements, startIndices, numMaterials, vertices.First(), normals.First(), texcoords.First(),
+		numVertices, FLT_MAX, MAX_LODS, levels, rangeStarts);
 	numIndices = elements.Count();
 
-	BufferData(vertices.First(), texcoords.First(), elements.First());
+	int numRanges = MAX(numMaterials, 1);
+	for(int i = 0; i < numLods; i++)
+	{
+		for(int j = 0; j < numRanges; j++)
+			lodStarts[i][j] = rangeStarts[i * numRanges + j];
+		lodStarts[i][numRanges] = levels[i].startIndex + levels[i].numIndices;
+		lodErrors[i] = levels[i].error;
+	}
+
+	// split last, since it reorders each range's triangles, and then number
+	// the vertices in the order the new triangles use them
+	for(int i = 0; i < numLods; i++)
+	{
+		for(int j = 0; j < numRanges; j++)
+		{
+			int first = lodStarts[i][j];
+			meshletStarts[i][j] = meshlets.Count();
+			build_meshlets(elements.First() + first, lodStarts[i][j + 1] - first, vertices.First(), numVertices,
+				MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, first, meshlets);
+		}
+		meshletStarts[i][numRanges] = meshlets.Count();
+	}
+	numVertices = optimize_vertex_fetch(vertices.First(), normals.First(), texcoords.First(), numVertices,
+		elements.First(), elements.Count());
+
+	// packed into 16 bytes a vertex rather than 24 of floats, as MeshBaker does
+	VertexQuantization quantization = compute_vertex_quantization(vertices.First(), texcoords.First(), numVertices);
+	PackedVertex* packed = new PackedVertex[numVertices];
+	pack_vertices(packed, vertices.First(), normals.First(), texcoords.First(), numVertices, quantization);
+	SetQuantization(quantization);
+	BufferData(packed, MESH_VERTEX_PACKED, sizeof(PackedVertex), elements.First());
+	delete[] packed;
 
 	isLoaded = true;
+
+	LOG_INFO("%s parsed in %.2f ms", path.Data(), Timer::GetTime() - startTime);
+}
+
+bool GLModel::LoadBaked(const char* path)
+{
+	MappedMesh mesh;
+	if(!map_mesh_file(path, &mesh)) return false;
+
+	// each submesh has a material of its own, so a file with more than there
+	// is room for can't be drawn as it was baked
+	const MeshFileHeader* header = mesh.header;
+	if(header->numSubmeshes > uint32_t(MAX_MATERIALS))
+	{
+		LOG_ISSUE("%s has %u materials, more than the %d a model can have", path, header->numSubmeshes, MAX_MATERIALS);
+		unmap_mesh_file(&mesh);
+		return false;
+	}
+
+	// every level goes in the one index buffer, where the file has them
+	numVertices = header->numVertices;
+	numIndices = header->numIndices;
+	numMaterials = header->numSubmeshes;
+	numLods = MIN(int(header->numLods), MAX_LODS);
+	for(int i = 0; i < numMaterials; i++)
+	{
+		const MeshFileSubmesh& submesh = mesh.submeshes[i];
+		materials[i].startIndex = submesh.startIndex;
+		materials[i].phase = (submesh.alpha < 1.0f)? PHASE_TRANSPARENT : PHASE_SOLID;
+		materials[i].color = VEC4_ONE;
+		materials[i].texture.Load(submesh.textureName);
+	}
+
+	for(int i = 0; i < numLods; i++)
+	{
+		const MeshFileLod& lod = mesh.lods[i];
+		for(int j = 0; j < numMaterials; j++)
+			lodStarts[i][j] = mesh.submeshes[lod.firstSubmesh + j].startIndex;
+		lodStarts[i][numMaterials] = lod.startIndex + lod.numIndices;
+		lodErrors[i] = lod.error;
+
+		const MeshFileSubmesh& last = mesh.submeshes[lod.firstSubmesh + numMaterials - 1];
+		for(int j = 0; j < numMaterials; j++)
+			meshletStarts[i][j] = mesh.submeshes[lod.firstSubmesh + j].firstMeshlet;
+		meshletStarts[i][numMaterials] = last.firstMeshlet + last.numMeshlets;
+	}
+
+	for(uint32_t i = 0; i < header->numMeshlets; i++)
+	{
+		const MeshFileMeshlet& m = mesh.meshlets[i];
+		Meshlet meshlet;
+		meshlet.startIndex = m.startIndex;
+		meshlet.numIndices = m.numIndices;
+		meshlet.center = vec3(m.center[0], m.center[1], m.center[2]);
+		meshlet.radius = m.radius;
+		meshlet.coneAxis = vec3(m.coneAxis[0], m.coneAxis[1], m.coneAxis[2]);
+		meshlet.coneCutoff = m.coneCutoff;
+		meshlets.Push(meshlet);
+	}
+
+	MeshVertexFormat format = (MeshVertexFormat) header->vertexFormat;
+	if(format == MESH_VERTEX_PACKED)
+		SetQuantization(get_vertex_quantization(header));
+
+	indexType = (header->indexSize == 2)? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	UploadBuffers(mesh.vertices, format, header->vertexSize, mesh.indices, numIndices * header->indexSize, GL_STATIC_DRAW);
+
+	unmap_mesh_file(&mesh);
+	isLoaded = true;
+	return true;
 }
 
 void GLModel::LoadAsQuad(const vec3& dimensions, const vec4& texCoord, bool isStatic)
@@ -59,31 +200,65 @@ void GLModel::LoadAsQuad(const vec3& dimensions, const vec4& texCoord, bool isSt
 	numVertices = 4;
 	numIndices = 6;
 
-	const vec4 vertices[4] = { 
-		vec4(-dimensions.x / 2.0f, 0.0f, 0.0f, 1.0f),
-		vec4(dimensions.x / 2.0f, 0.0f, 0.0f, 1.0f),
-		vec4(dimensions.x / 2.0f, dimensions.y, 0.0f, 1.0f),
-		vec4(-dimensions.x / 2.0f, dimensions.y, 0.0f, 1.0f)
-	};
-	const vec2 texcoords[4] = { 
-		vec2(texCoord.x, texCoord.y), 
-		vec2(texCoord.x + texCoord.z, texCoord.y), 
-		vec2(texCoord.x + texCoord.z, texCoord.y + texCoord.w),
-		vec2(texCoord.x, texCoord.y + texCoord.w)
+	// quads are small and may change, so they stay as floats
+	const float vertices[4 * 6] = {
+		-dimensions.x / 2.0f, 0.0f, 0.0f, 1.0f,           texCoord.x, texCoord.y,
+		dimensions.x / 2.0f, 0.0f, 0.0f, 1.0f,            texCoord.x + texCoord.z, texCoord.y,
+		dimensions.x / 2.0f, dimensions.y, 0.0f, 1.0f,    texCoord.x + texCoord.z, texCoord.y + texCoord.w,
+		-dimensions.x / 2.0f, dimensions.y, 0.0f, 1.0f,   texCoord.x, texCoord.y + texCoord.w
 	};
-	const unsigned short elements[6] = { 0, 3, 1, 1, 3, 2 };
+	const uint32_t elements[6] = { 0, 3, 1, 1, 3, 2 };
 
-	BufferData(vertices, texcoords, elements, isStatic);
+	BufferData(vertices, MESH_VERTEX_FLOAT, 6 * sizeof(float), elements, isStatic);
 
 	numMaterials = 1;
 	materials[0].startIndex = 0;
 	materials[0].phase = PHASE_MASKED;
 	materials[0].color = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 
+	numLods = 1;
+	lodStarts[0][0] = 0;
+	lodStarts[0][1] = numIndices;
+	lodErrors[0] = 0.0f;
+	meshletStarts[0][0] = 0;
+	meshletStarts[0][1] = 0;
+
 	isLoaded = true;
 }
 
-void GLModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsigned short* elements, bool isStatic)
+void GLModel::SetQuantization(const VertexQuantization& quantization)
+{
+	const VertexQuantization& q = quantization;
+	positionDecode = translation_matrix(q.positionOffset.x, q.positionOffset.y, q.positionOffset.z) *
+		scale_matrix(q.positionScale.x, q.positionScale.y, q.positionScale.z);
+	texcoordDecode = vec4(q.texcoordScale.x, q.texcoordScale.y, q.texcoordOffset.x, q.texcoordOffset.y);
+}
+
+void GLModel::BufferData(const void* vertices, MeshVertexFormat format, GLsizei vertexWidth, const uint32_t* elements, bool isStatic)
+{
+	GLenum mode = (isStatic) ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW;
+
+	if(numVertices <= 65536)
+	{
+		GLushort* shortElements = new GLushort[numIndices];
+		for(int i = 0; i < numIndices; i++)
+			shortElements[i] = elements[i];
+
+		indexType = GL_UNSIGNED_SHORT;
+		UploadBuffers(vertices, format, vertexWidth, shortElements, sizeof(GLushort) * numIndices, mode);
+		delete[] shortElements;
+	}
+	else
+	{
+		indexType = GL_UNSIGNED_INT;
+		UploadBuffers(vertices, format, vertexWidth, elements, sizeof(GLuint) * numIndices, mode);
+	}
+}
+
+// float vertices start with a position of four floats and then a texture
+// coordinate of two, however much else comes after them
+void GLModel::UploadBuffers(const void* vertices, MeshVertexFormat format, GLsizei vertexWidth,
+	const void* indices, GLsizeiptr indicesSize, GLenum mode)
 {
 	// Create the VAO
     glGenVertexArrays(1, &vertexArray); 
@@ -93,37 +268,62 @@ void GLModel::BufferData(const vec4* vertices, const vec2* texcoords, const unsi
 	glGenBuffers(1, &verticesV);
 	glGenBuffers(1, &elementsV);
 
-	static const int vertexSize = 4 + 2;
-	static const int vertexWidth = vertexSize * sizeof(float);
+	glBindBuffer(GL_ARRAY_BUFFER, verticesV);
+	glBufferData(GL_ARRAY_BUFFER, numVertices * vertexWidth, vertices, mode);
 
-	float* verts = new float[numVertices * vertexSize];
-	for(int i = 0; i < numVertices; i++)
+	// a position given three values gets a w of one
+	if(format == MESH_VERTEX_PACKED)
 	{
-		verts[i*vertexSize+0] = vertices[i].x;
-		verts[i*vertexSize+1] = vertices[i].y;
-		verts[i*vertexSize+2] = vertices[i].z;
-		verts[i*vertexSize+3] = vertices[i].w;
-		verts[i*vertexSize+4] = texcoords[i].x;
-		verts[i*vertexSize+5] = texcoords[i].y;
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, vertexWidth, 0);
+		glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, vertexWidth, (GLvoid*) offsetof(PackedVertex, texcoord));
+	}
+	else
+	{
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, vertexWidth, 0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, vertexWidth, (GLvoid*) offsetof(MeshFileVertex, texcoord));
 	}
-
-	GLenum mode = (isStatic) ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW;
-
-	glBindBuffer(GL_ARRAY_BUFFER, verticesV);
-	glBufferData(GL_ARRAY_BUFFER, numVertices * vertexWidth, verts, mode);
-
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, vertexWidth, 0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, vertexWidth, (GLvoid*)(NULL + sizeof(float) * 4));
 
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementsV);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * numIndices, elements, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, indices, GL_STATIC_DRAW);
 
 	glBindVertexArray(0);
+}
+
+int GLModel::SelectLod(float distance, float fov, int viewportHeight) const
+{
+	// past a pixel the difference is hard to see
+	const float maxPixelError = 1.0f;
+	return select_lod(lodErrors, numLods, distance, fov, viewportHeight, maxPixelError);
+}
+
+void GLModel::GetLodRange(int lod, int material, GLuint* startIndex, GLuint* count) const
+{
+	// the last range runs to the end of the level
+	*startIndex = lodStarts[lod][material];
+	*count = lodStarts[lod][material + 1] - *startIndex;
+}
+
+// Backfaces are only culled for solid materials, which the renderer always
+// draws with GL_CULL_FACE on, so dropping meshlets facing away hides nothing
+// that would have been drawn.
+int GLModel::CullMeshlets(int lod, int material, const mat4x4& transform, const Frustum& frustum,
+	const vec3& viewPosition, IndexRange* ranges) const
+{
+	int first = meshletStarts[lod][material];
+	int count = meshletStarts[lod][material + 1] - first;
+	if(count == 0)
+	{
+		// nothing to cull by, so the whole range is drawn
+		ranges[0].startIndex = lodStarts[lod][material];
+		ranges[0].numIndices = lodStarts[lod][material + 1] - lodStarts[lod][material];
+		return 1;
+	}
 
-	delete[] verts;
+	bool cullBackfaces = materials[material].phase == PHASE_SOLID;
+	return cull_meshlets(meshlets.First() + first, count, transform, frustum, viewPosition, cullBackfaces, ranges);
 }
 
 void GLModel::Unload()
@@ -6,6 +6,7 @@
 #include "GLShader.h"
 
 #include "../RenderPhase.h"
+#include "../utilities/MeshFile.h"
 
 struct GLMaterial
 {
@@ -19,13 +20,31 @@ class GLModel
 {
 private:
 	static const int MAX_MATERIALS = 8;
+	static const int MAX_LODS = 5;
 
 public:
 	GLuint vertexArray;
-	unsigned short numVertices, numIndices;
+	int numVertices, numIndices; // indices of every level of detail together
+	GLenum indexType; // 16-bit indices unless there are too many vertices
+
+	// packed vertices come out between 0 and 1, and are brought back by
+	// these; the position decode goes before the model's own transform
+	mat4x4 positionDecode;
+	vec4 texcoordDecode; // scale in xy, offset in zw
 
 	GLMaterial materials[MAX_MATERIALS];
 	int numMaterials;
+
+	// each level's material ranges, followed by where the level ends
+	GLuint lodStarts[MAX_LODS][MAX_MATERIALS + 1];
+	float lodErrors[MAX_LODS]; // in model units, from none at full detail
+	int numLods;
+
+	// each level's material ranges split into meshlets, with starts laid
+	// out as in lodStarts
+	AutoArray<Meshlet> meshlets;
+	int meshletStarts[MAX_LODS][MAX_MATERIALS + 1];
+
 	mat4x4 modelMatrix;
 	bool isLoaded, isBillboarded, inBackground;
 
@@ -34,11 +53,20 @@ public:
 	void LoadAsQuad(const vec3& dimensions, const vec4& texCoord, bool isStatic = true);
 	void Unload();
 
+	int SelectLod(float distance, float fov, int viewportHeight) const;
+	void GetLodRange(int lod, int material, GLuint* startIndex, GLuint* count) const;
+	int CullMeshlets(int lod, int material, const mat4x4& transform, const Frustum& frustum,
+		const vec3& viewPosition, IndexRange* ranges) const;
+
 private:
 	GLuint verticesV, elementsV;
 
 	void SetDefaults();
-	void BufferData(const vec4* vertices, const vec2* texcoords, const unsigned short* elements, bool isStatic = true);
+	bool LoadBaked(const char* path);
+	void SetQuantization(const VertexQuantization& quantization);
+	void BufferData(const void* vertices, MeshVertexFormat format, GLsizei vertexWidth, const uint32_t* elements, bool isStatic = true);
+	void UploadBuffers(const void* vertices, MeshVertexFormat format, GLsizei vertexWidth,
+		const void* indices, GLsizeiptr indicesSize, GLenum mode);
 };
 
 #endif
@@ -14,8 +14,12 @@
 #include "../utilities/GLMath.h"
 #include "../utilities/GLUtils.h"
 #include "../utilities/Collision.h"
+#include "../utilities/AABBTree.h"
+#include "../utilities/OcclusionBuffer.h"
 #include "../utilities/collections/DenseArray.h"
 
+#include <cstring>
+
 int gl_version, gl_max_texture_size;
 float gl_max_texture_max_anisotropy_ext;
 bool wgl_context_forward_compatible;
@@ -35,6 +39,7 @@ namespace GLRenderer
 	{
 		BINDING_MATERIAL,
 		BINDING_OBJECT,
+		BINDING_TERRAIN,
 	};
 
 	GLuint fbo;
@@ -50,16 +55,27 @@ namespace GLRenderer
 	static const int NUM_MODELS = 10;
 	static const int NUM_SUBMESHES = 2;
 	Handle mershHandles[NUM_MODELS * NUM_SUBMESHES];
+	mat4x4 modelTransforms[NUM_MODELS];
+
+	// what's left of each submesh after culling its meshlets, a run of
+	// indices at a time, with room for every meshlet of every model
+	IndexRange* visibleRanges = nullptr;
+	GLsizei* rangeCounts = nullptr;
+	const GLvoid** rangeOffsets = nullptr;
 
 	OBB boundingBoxes[NUM_MODELS * NUM_SUBMESHES];
 	bool boundsVisible[NUM_MODELS * NUM_SUBMESHES];
+	int boundsProxies[NUM_MODELS * NUM_SUBMESHES];
+	AABBTree cullingTree;
+	OcclusionBuffer occlusionBuffer(256, 128);
 
 	GLuint materialUniformBuffer = 0;
 	GLuint objectUniformBuffer = 0;
+	GLuint terrainUniformBuffer = 0;
 
 	GLTexture blankTexture;
 	GLTexture scaleTexture;
-	GLShader defaultShader, alphaTestShader;
+	GLShader defaultShader, alphaTestShader, terrainShader;
 
 	DenseArray<GLMesh> renderQueue(128);
 
@@ -106,13 +122,20 @@ bool GLRenderer::Initialize()
 	blankTexture.Load("blank.png");
 	scaleTexture.Load("tile4.png");
 
+	// the terrain repeats it once per cell
+	glBindTexture(GL_TEXTURE_2D, scaleTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
 	// uniform buffers
 	objectUniformBuffer = GLUniformBuffer::Create(sizeof(ObjectBlock));
 	materialUniformBuffer = GLUniformBuffer::Create(sizeof(MaterialBlock));
+	terrainUniformBuffer = GLUniformBuffer::Create(sizeof(TerrainBlock));
 
 	// shader setup
 	defaultShader.Load("default_vertex.vert", "default_frag.frag");
 	alphaTestShader.Load("default_vertex.vert", "alpha_test.frag");
+	terrainShader.Load("terrain.vert", "default_frag.frag");
 
 	defaultShader.Bind();
 	defaultShader.AddAttribute("position");
@@ -130,11 +153,26 @@ bool GLRenderer::Initialize()
 	alphaTestShader.BindUniformBuffer("ObjectBlock", objectUniformBuffer, BINDING_OBJECT);
 	alphaTestShader.SetUniformInt("texture", 0);
 
+	terrainShader.Bind();
+	terrainShader.AddAttribute("position");
+	terrainShader.AddAttribute("textureCoordinate");
+	terrainShader.AddAttribute("morph");
+
+	terrainShader.BindUniformBuffer("MaterialBlock", materialUniformBuffer, BINDING_MATERIAL);
+	terrainShader.BindUniformBuffer("TerrainBlock", terrainUniformBuffer, BINDING_TERRAIN);
+	terrainShader.SetUniformInt("texture", 0);
+
 	// models Init
 	wonk.LoadAsMesh("Fiona.obj");
 
+	int maxRanges = NUM_MODELS * (wonk.meshlets.Count() + NUM_SUBMESHES);
+	visibleRanges = new IndexRange[maxRanges];
+	rangeCounts = new GLsizei[maxRanges];
+	rangeOffsets = new const GLvoid*[maxRanges];
+
 	for(int j = 0; j < NUM_MODELS; j++)
 	{
+		modelTransforms[j] = translation_matrix(j * 8, 0, 0) * rotation_matrix(j * 15, UNIT_Y);
 		for(int i = 0; i < NUM_SUBMESHES; i++)
 		{
 			Handle meshHandle = renderQueue.Claim();
@@ -143,15 +181,15 @@ bool GLRenderer::Initialize()
 			GLMesh* mesh = renderQueue.Get(meshHandle);
 			mesh->phase = wonk.materials[i].phase;
 			mesh->vertexArray = wonk.vertexArray;
+			mesh->indexType = wonk.indexType;
 			mesh->viewportLayer = LAYER_WORLD;
 			mesh->material = i + 1;
 
 			mesh->textureID = wonk.materials[i].texture;
-			mesh->model = translation_matrix(j * 8, 0, 0) * rotation_matrix(j * 15, UNIT_Y);
+			mesh->model = modelTransforms[j] * wonk.positionDecode;
+			mesh->objectBlock.texcoordTransform = wonk.texcoordDecode;
 
-			mesh->startIndex = wonk.materials[i].startIndex;
-			GLuint endIndex = (i == NUM_SUBMESHES - 1) ? wonk.numIndices : wonk.materials[i + 1].startIndex;
-			mesh->numIndices = endIndex - wonk.materials[i].startIndex;
+			wonk.GetLodRange(0, i, &mesh->startIndex, &mesh->numIndices);
 		}
 	}
 
@@ -162,10 +200,12 @@ bool GLRenderer::Initialize()
 		boundingBoxes[i].axes[0] = UNIT_X;
 		boundingBoxes[i].axes[1] = UNIT_Y;
 		boundingBoxes[i].axes[2] = UNIT_Z;
+
+		boundsProxies[i] = cullingTree.CreateProxy(compute_bounds(boundingBoxes[i]), (void*)(intptr_t) i);
 	}
 
 	// terrain initialization
-	Terrain::Initialize();
+	Terrain::Initialize(&terrainShader);
 
 	// camera init
 	cameraData.projection = MAT_I;
@@ -188,16 +228,22 @@ void GLRenderer::Terminate()
 
 	GLUniformBuffer::Destroy(objectUniformBuffer);
 	GLUniformBuffer::Destroy(materialUniformBuffer);
+	GLUniformBuffer::Destroy(terrainUniformBuffer);
 
 	wonk.Unload();
+	delete[] visibleRanges;
+	delete[] rangeCounts;
+	delete[] rangeOffsets;
 
 	for(int i = 0; i < NUM_MODELS * NUM_SUBMESHES; i++)
 	{
 		renderQueue.Relinquish(mershHandles[i]);
+		cullingTree.DestroyProxy(boundsProxies[i]);
 	}
 
 	defaultShader.Unload();
 	alphaTestShader.Unload();
+	terrainShader.Unload();
 
 	blankTexture.Unload();
 	scaleTexture.Unload();
@@ -304,14 +350,73 @@ void GLRenderer::RenderScene()
 	const float clearColor[] = { 0.0f, 1.0f, 1.0f, 1.0f };
 	glClearBufferfv(GL_COLOR, 0, clearColor);
 
-	cull_frustum_obb_list(frustum, boundingBoxes, NUM_MODELS * NUM_SUBMESHES, boundsVisible);
+	Terrain::Update(cameraData.position, frustum, cameraData.fov, height);
+
+	// only boxes whose tree leaves touch the frustum get the exact OBB test
+	struct CullBounds
+	{
+		bool operator()(int proxy)
+		{
+			intptr_t i = (intptr_t) cullingTree.GetUserData(proxy);
+			cull_frustum_obb_list(frustum, &boundingBoxes[i], 1, &boundsVisible[i]);
+			return true;
+		}
+	} cullBounds;
+
+	FILL(boundsVisible, NUM_MODELS * NUM_SUBMESHES, false);
+	cullingTree.QueryFrustum(frustum, cullBounds);
+
+	mat4x4 view = view_matrix(cameraData.viewX, cameraData.viewY, cameraData.viewZ, cameraData.position);
+	mat4x4 viewProjection = cameraData.projection * view;
+
+	// then drop the boxes hidden behind the terrain
+	if(!cameraData.isOrtho)
+	{
+		occlusionBuffer.Begin(viewProjection);
+		Terrain::AddOccluders(&occlusionBuffer);
+		occlusionBuffer.Rasterize();
+
+		for(int i = 0; i < NUM_MODELS * NUM_SUBMESHES; i++)
+		{
+			if(boundsVisible[i])
+				boundsVisible[i] = occlusionBuffer.TestAABB(compute_bounds(boundingBoxes[i]));
+		}
+	}
 	
+	// draw fewer triangles of the models further away, and of those only the
+	// meshlets in view and facing the camera
+	size_t indexSize = (wonk.indexType == GL_UNSIGNED_INT)? sizeof(GLuint) : sizeof(GLushort);
+	int numRanges = 0;
+	for(int j = 0; j < NUM_MODELS; j++)
+	{
+		float distance = length(boundingBoxes[j*NUM_SUBMESHES].center - cameraData.position);
+		int lod = wonk.SelectLod(distance, cameraData.fov, height);
+		for(int i = 0; i < NUM_SUBMESHES; i++)
+		{
+			GLMesh* mesh = renderQueue.Get(mershHandles[j*NUM_SUBMESHES+i]);
+			wonk.GetLodRange(lod, i, &mesh->startIndex, &mesh->numIndices);
+
+			mesh->rangeCounts = nullptr;
+			if(cameraData.isOrtho || !boundsVisible[j*NUM_SUBMESHES+i]) continue;
+
+			IndexRange* ranges = &visibleRanges[numRanges];
+			int count = wonk.CullMeshlets(lod, i, modelTransforms[j], frustum, cameraData.position, ranges);
+			for(int k = 0; k < count; k++)
+			{
+				rangeCounts[numRanges + k] = ranges[k].numIndices;
+				rangeOffsets[numRanges + k] = (const GLvoid*)(ranges[k].startIndex * indexSize);
+			}
+			mesh->rangeCounts = &rangeCounts[numRanges];
+			mesh->rangeOffsets = &rangeOffsets[numRanges];
+			mesh->numRanges = count;
+			numRanges += count;
+		}
+	}
+
 	// sort meshes
 	//renderQueue.Sort(CompareMeshes());
 	
 	// loop through and draw meshes
-	mat4x4 view = view_matrix(cameraData.viewX, cameraData.viewY, cameraData.viewZ, cameraData.position);
-	mat4x4 viewProjection = cameraData.projection * view;
 
 	RenderPhase phase = PHASE_TRANSPARENT;
 	int material = 0;
@@ -388,12 +493,15 @@ void GLRenderer::RenderScene()
 		mesh->Draw();
 	}
 
+	terrainShader.Bind();
+	glBindTexture(GL_TEXTURE_2D, scaleTexture);
+	Terrain::Render(viewProjection, terrainUniformBuffer);
+
 	ObjectBlock objectBlock;
 	objectBlock.modelViewProjection = viewProjection * MAT_I;
+	objectBlock.texcoordTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f);
 	GLUniformBuffer::BufferData(objectUniformBuffer, &objectBlock, sizeof objectBlock);
-
-	glBindTexture(GL_TEXTURE_2D, scaleTexture);
-	Terrain::Render();
+	defaultShader.Bind();
 
 	
 	for(int i = 0; i < NUM_MODELS * NUM_SUBMESHES; i++)
@@ -471,6 +579,7 @@ void GLRenderer::RenderFinal()
 
 	ObjectBlock objectBlock;
 	objectBlock.modelViewProjection = MAT_I;
+	objectBlock.texcoordTransform = vec4(1.0f, 1.0f, 0.0f, 0.0f);
 	GLUniformBuffer::BufferData(objectUniformBuffer, &objectBlock, sizeof objectBlock);
 
 	MaterialBlock materialBlock;
@@ -38,13 +38,15 @@ GLTexture::operator GLuint() const
 
 bool GLTexture::Load(const String& fileName)
 {
+	StringId fileId(fileName);
+
 	unsigned id = 0;
 	for(int i = 0; i < MAX_NUM_TEXTURES; ++i)
 	{
 		GLTexture* tex = loadedTextures[i].record;
 		if(tex == nullptr) continue;
 
-		if(tex->textureID != 0 && loadedTextures[i].fileName == fileName)
+		if(tex->textureID != 0 && loadedTextures[i].fileId == fileId)
 		{
 			id = tex->textureID;
 			width = tex->width;
@@ -64,7 +66,7 @@ bool GLTexture::Load(const String& fileName)
 				GLTexture* tex = loadedTextures[i].record;
 				if(tex != nullptr) continue;
 
-				loadedTextures[i].fileName = fileName;
+				loadedTextures[i].fileId = fileId;
 				loadedTextures[i].record = this;
 				loadedTextures[i].numOwners = 1;
 				break;
@@ -174,7 +176,7 @@ void GLTexture::Unload()
 
 			loadedTextures[i].numOwners = 0;
 			loadedTextures[i].record = nullptr;
-			loadedTextures[i].fileName.Clear();
+			loadedTextures[i].fileId = StringId();
 		}
 		else loadedTextures[i].numOwners--;
 		break;
@@ -4,6 +4,7 @@
 #include "GLInfo.h"
 
 #include "../utilities/String.h"
+#include "../utilities/StringId.h"
 
 class GLTexture
 {
@@ -23,7 +24,7 @@ public:
 private:
 	struct TextureRecord
 	{
-		String fileName;
+		StringId fileId;
 		GLTexture* record;
 		int numOwners;
 	};
@@ -1,145 +1,278 @@
 #include "Terrain.h"
+#include "GLShader.h"
+#include "GLUniformBuffer.h"
 
 #include "../utilities/GLMath.h"
-#include "../utilities/Noise.h"
+#include "../utilities/Macros.h"
+#include "../utilities/NumberMacros.h"
+#include "../utilities/TerrainStreaming.h"
+#include "../utilities/OcclusionBuffer.h"
+
+#include <cstring>
+#include <cstddef>
 
 namespace Terrain
 {
-	Chunk chunk;
+	TerrainSettings settings;
+	TerrainStreamer* streamer;
+	const GLShader* shader;
+
+	// one index list per level, shared by every chunk
+	GLuint indexBuffer;
+	uint16_t* lodIndices;
+	int numLodIndices;
+
+	// the coarsest level's list again, over only the vertices it uses
+	uint16_t* occluderIndices;
+	int numOccluderIndices;
+	int occluderSide;
+
+	vec3 viewPosition;
+	float ranges[MAX_TERRAIN_LEVELS];
+	float morphStarts[MAX_TERRAIN_LEVELS];
+	AutoArray<TerrainNodeDraw> draws;
+	TerrainLodStats stats;
 }
 
-void Terrain::Initialize()
+void Terrain::Initialize(const GLShader* terrainShader)
 {
-	chunk.Create();
+	shader = terrainShader;
+
+	settings.cellsPerSide = 128;
+	settings.cellSize = 2.0f;
+	settings.baseHeight = 10.0f;
+	settings.amplitude = 4.0f;
+	settings.noise.type = FRACTAL_FBM;
+	settings.noise.numOctaves = 1;
+	settings.noise.frequency = 0.05f;
+	settings.noise.lacunarity = 2.0f;
+	settings.noise.persistence = 0.5f;
+	settings.numLevels = 4;
+
+	const int viewRadius = 3;
+	const int uploadBudget = 2;
+	const size_t memoryCap = 96 * 1024 * 1024;
+	streamer = new TerrainStreamer(settings, viewRadius, uploadBudget, memoryCap);
+
+	numLodIndices = count_terrain_lod_indices(settings);
+	lodIndices = new uint16_t[numLodIndices];
+	fill_terrain_lod_indices(settings, lodIndices);
+
+	glGenBuffers(1, &indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * numLodIndices, lodIndices, GL_STATIC_DRAW);
+
+	int gridSide = settings.cellsPerSide + 1;
+	int topStride = 1 << (settings.numLevels - 1);
+	occluderSide = settings.cellsPerSide / topStride + 1;
+	numOccluderIndices = numLodIndices / settings.numLevels;
+	occluderIndices = new uint16_t[numOccluderIndices];
+	const uint16_t* topIndices = lodIndices + (settings.numLevels - 1) * numOccluderIndices;
+	for(int i = 0; i < numOccluderIndices; i++)
+	{
+		int x = topIndices[i] % gridSide / topStride;
+		int z = topIndices[i] / gridSide / topStride;
+		occluderIndices[i] = z * occluderSide + x;
+	}
 }
 
 void Terrain::Terminate()
 {
-	chunk.Destroy();
+	for(int i = 0; i < streamer->GetResidentCount(); i++)
+	{
+		Chunk* chunk = (Chunk*) streamer->GetResident(i)->userData;
+		chunk->Destroy();
+		delete chunk;
+	}
+	delete streamer;
+	streamer = nullptr;
+	draws.Clear();
+
+	glDeleteBuffers(1, &indexBuffer);
+	delete[] lodIndices;
+	delete[] occluderIndices;
+	lodIndices = nullptr;
+	occluderIndices = nullptr;
 }
 
-void Terrain::Render()
+void Terrain::Update(const vec3& position, const Frustum& frustum, float fov, int viewportHeight)
 {
-	chunk.Render();
+	streamer->Update(position);
+
+	while(TerrainChunk* evicted = streamer->NextEviction())
+	{
+		Chunk* chunk = (Chunk*) evicted->userData;
+		chunk->Destroy();
+		delete chunk;
+		evicted->userData = nullptr;
+	}
+
+	while(TerrainChunk* generated = streamer->NextUpload())
+	{
+		Chunk* chunk = new Chunk;
+		chunk->Create(generated);
+		generated->userData = chunk;
+	}
+
+	// the ranges only grow as rougher chunks come in, so they settle soon
+	// after the first few loads
+	const float maxPixelError = 4.0f;
+	compute_terrain_lod_ranges(settings, streamer->GetLevelErrors(), fov, viewportHeight, maxPixelError, ranges, morphStarts);
+
+	viewPosition = position;
+	draws.Clear();
+	ZERO_STRUCT(&stats);
+	for(int i = 0; i < streamer->GetResidentCount(); i++)
+		select_terrain_lods(settings, streamer->GetResident(i), position, ranges, &frustum, &draws, &stats);
 }
 
-Terrain::Chunk::Chunk():
-	vertexArray(0),
-	numIndices(0)
+void Terrain::Render(const mat4x4& viewProjection, GLuint uniformBuffer)
 {
-	buffers[0] = buffers[1] = 0;
+	TerrainBlock block;
+	block.modelViewProjection = viewProjection;
+	block.viewPosition = vec4(viewPosition.x, viewPosition.y, viewPosition.z, 1.0f);
+
+	// a level at a time, so the morph only has to be set once for each
+	for(int level = 0; level < settings.numLevels; level++)
+	{
+		if(stats.trianglesPerLevel[level] == 0) continue;
+
+		float morphLength = ranges[level] - morphStarts[level];
+		block.morph = vec4(float(1 << level), morphStarts[level], 1.0f / MAX(morphLength, 1e-6f), 0.0f);
+		GLUniformBuffer::BufferData(uniformBuffer, &block, sizeof block);
+
+		for(size_t i = 0; i < draws.Count(); i++)
+		{
+			const TerrainNodeDraw& draw = draws[i];
+			if(draw.level != level) continue;
+
+			const Chunk* chunk = (const Chunk*) draw.chunk->userData;
+			glBindVertexArray(chunk->vertexArray);
+			glDrawElementsBaseVertex(GL_TRIANGLES, draw.numIndices, GL_UNSIGNED_SHORT,
+				(GLvoid*)(draw.firstIndex * sizeof(GLushort)), draw.firstVertex);
+		}
+	}
 }
 
-void Terrain::Chunk::Create()
+void Terrain::AddOccluders(OcclusionBuffer* buffer)
 {
-	// Create the VAO
-    glGenVertexArrays(1, &vertexArray); 
-    glBindVertexArray(vertexArray);
+	for(int i = 0; i < streamer->GetResidentCount(); i++)
+	{
+		const Chunk* chunk = (const Chunk*) streamer->GetResident(i)->userData;
+		chunk->AddOccluder(buffer);
+	}
+}
 
-	// Create the buffers for the vertex attributes
-	glGenBuffers(2, buffers);
+const TerrainLodStats& Terrain::GetStats()
+{
+	return stats;
+}
 
-	static const int vertexSize = 4 + 2;
-	static const int vertexWidth = vertexSize * sizeof(float);
+Terrain::Chunk::Chunk():
+	vertexArray(0),
+	vertexBuffer(0),
+	data(nullptr),
+	occluderPositions(nullptr)
+{}
 
-	static const int GRID_X = 64;
-	static const int GRID_Z = 64;
+void Terrain::Chunk::Create(const TerrainChunk* chunk)
+{
+	data = chunk;
 
-	int numVertices = 4 * GRID_X * GRID_Z;
-	float* vertexData = new float[vertexSize * numVertices];
+	// Create the VAO
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
 
-	numIndices = 6 * GRID_X * GRID_Z;
-	unsigned short* indices = new unsigned short[numIndices];
+	// Create the buffer for the vertex attributes
+	glGenBuffers(1, &vertexBuffer);
 
+	// 20 bytes rather than 32. The height to morph to rides in the w of the
+	// position, which is always one, and the texture coordinates and morph
+	// spacing are whole numbers of cells, so they fit 16 bits as they are.
+	struct Vertex
 	{
-		vec3 corner = vec3(0.0f, 10.0f, 0.0f);
-		float cellSize = 2.0f;
-		float frequency = 0.1f;
-		float amplitude = 4.0f;
+		float position[3];
+		float morphHeight;
+		uint16_t texcoord[2];
+		uint16_t morphSpacing;
+		uint16_t padding;
+	};
+	static const int vertexWidth = sizeof(Vertex);
 
-		float* heightMap = new float[(GRID_X + 1) * (GRID_Z + 1)];
-		for(int z = 0; z < GRID_Z + 1; z++)
-		{
-			for(int x = 0; x < GRID_X + 1; x++)
-			{
-				heightMap[z * (GRID_X + 1) + x] = amplitude * simplex_noise_2d(frequency * x, frequency * z);
-			}
-		}
+	// positions come from where each height sits in the grid, worked out
+	// in whole cells the same way on both sides of a shared edge
+	const Heightfield& field = chunk->heightfield;
+	int firstX = chunk->x * settings.cellsPerSide;
+	int firstZ = chunk->z * settings.cellsPerSide;
 
-		for(int z = 0; z < GRID_Z; z++)
-		{
-			for(int x = 0; x < GRID_X; x++)
-			{
-				int i = (z * GRID_X + x) * vertexSize * 4;
-				vertexData[i+0] = corner.x + x * cellSize;
-				vertexData[i+1] = corner.y + heightMap[z * (GRID_X + 1) + x];
-				vertexData[i+2] = corner.z + z * cellSize;
-				vertexData[i+3] = 1.0f;
-				vertexData[i+4] = 0.0f;
-				vertexData[i+5] = 0.0f;
-
-				vertexData[i+6] = corner.x + x * cellSize + cellSize;
-				vertexData[i+7] = corner.y + heightMap[z * (GRID_X + 1) + x + 1];
-				vertexData[i+8] = corner.z + z * cellSize;
-				vertexData[i+9] = 1.0f;
-				vertexData[i+10] = 1.0f;
-				vertexData[i+11] = 0.0f;
-
-				vertexData[i+12] = corner.x + x * cellSize + cellSize;
-				vertexData[i+13] = corner.y + heightMap[(z + 1) * (GRID_X + 1) + x + 1];
-				vertexData[i+14] = corner.z + z * cellSize + cellSize;
-				vertexData[i+15] = 1.0f;
-				vertexData[i+16] = 1.0f;
-				vertexData[i+17] = 1.0f;
-
-				vertexData[i+18] = corner.x + x * cellSize;
-				vertexData[i+19] = corner.y + heightMap[(z + 1) * (GRID_X + 1) + x];
-				vertexData[i+20] = corner.z + z * cellSize + cellSize;
-				vertexData[i+21] = 1.0f;
-				vertexData[i+22] = 0.0f;
-				vertexData[i+23] = 1.0f;
-			}
-		}
-
-		delete[] heightMap;
-
-		for(int i = 0; i < GRID_X * GRID_Z; i++)
-		{
-			 indices[(i*6)+0] = (i * 4) + 0;
-			 indices[(i*6)+1] = (i * 4) + 3;
-			 indices[(i*6)+2] = (i * 4) + 1;
-			 indices[(i*6)+3] = (i * 4) + 1;
-			 indices[(i*6)+4] = (i * 4) + 3;
-			 indices[(i*6)+5] = (i * 4) + 2;
-		}
+	int numVertices = chunk->numVertices;
+	Vertex* vertexData = new Vertex[numVertices];
+	for(int i = 0; i < numVertices; i++)
+	{
+		Vertex& vertex = vertexData[i];
+		vertex.position[0] = (firstX + i % field.columns) * settings.cellSize;
+		vertex.position[1] = field.heights[i];
+		vertex.position[2] = (firstZ + i / field.columns) * settings.cellSize;
+		vertex.morphHeight = chunk->morphs[i].x;
+		vertex.texcoord[0] = chunk->texcoords[i].x;
+		vertex.texcoord[1] = chunk->texcoords[i].y;
+		vertex.morphSpacing = chunk->morphs[i].y;
+		vertex.padding = 0;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glBufferData(GL_ARRAY_BUFFER, vertexWidth * numVertices, vertexData, GL_STATIC_DRAW);
 
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, vertexWidth, 0);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, vertexWidth, (GLvoid*)(0 + 4 * sizeof(float)));
+	const GLint* locations = shader->attributeLocations;
+	glVertexAttribPointer(locations[0], 4, GL_FLOAT, GL_FALSE, vertexWidth, 0);
+	glVertexAttribPointer(locations[1], 2, GL_UNSIGNED_SHORT, GL_FALSE, vertexWidth, (GLvoid*)(0 + offsetof(Vertex, texcoord)));
+	glVertexAttribPointer(locations[2], 1, GL_UNSIGNED_SHORT, GL_FALSE, vertexWidth, (GLvoid*)(0 + offsetof(Vertex, morphSpacing)));
 
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(locations[0]);
+	glEnableVertexAttribArray(locations[1]);
+	glEnableVertexAttribArray(locations[2]);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * numIndices, indices, GL_STATIC_DRAW);
+	// every chunk draws from the same index lists
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
 
 	glBindVertexArray(0);
 
 	delete[] vertexData;
-	delete[] indices;
+
+	int topStride = 1 << (settings.numLevels - 1);
+	occluderPositions = new vec3[occluderSide * occluderSide];
+	for(int z = 0; z < occluderSide; z++)
+	{
+		for(int x = 0; x < occluderSide; x++)
+		{
+			int gridX = x * topStride;
+			int gridZ = z * topStride;
+			float height = field.heights[gridZ * field.columns + gridX];
+			occluderPositions[z * occluderSide + x] = vec3((firstX + gridX) * settings.cellSize, height, (firstZ + gridZ) * settings.cellSize);
+		}
+	}
 }
 
 void Terrain::Chunk::Destroy()
 {
-	glDeleteBuffers(2, buffers);
+	glDeleteBuffers(1, &vertexBuffer);
 	glDeleteVertexArrays(1, &vertexArray);
+	delete[] occluderPositions;
+	occluderPositions = nullptr;
+	data = nullptr;
 }
 
-void Terrain::Chunk::Render() const
+void Terrain::Chunk::AddOccluder(OcclusionBuffer* buffer) const
 {
-	glBindVertexArray(vertexArray);
-	glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_SHORT, nullptr);
+	// The coarsest level is cheap to rasterize, but it can stand above the
+	// surface that's actually drawn, by its own error plus that of whichever
+	// level is drawn there. Pushed down by that much it never hides anything
+	// that could be seen over the real thing.
+	int topLevel = settings.numLevels - 1;
+	float drop = 0.0f;
+	for(int level = 0; level < settings.numLevels; level++)
+		drop = MAX(drop, data->levelErrors[level]);
+	drop += data->levelErrors[topLevel];
+
+	buffer->AddOccluder(occluderPositions, occluderIndices, numOccluderIndices, translation_matrix(0.0f, -drop, 0.0f));
 }
@@ -3,23 +3,53 @@
 
 #include "GLInfo.h"
 
+#include "../utilities/GLMath.h"
+
+class Frustum;
+class GLShader;
+class OcclusionBuffer;
+struct TerrainChunk;
+struct TerrainLodStats;
+
+struct TerrainBlock
+{
+	mat4x4 modelViewProjection;
+	vec4 viewPosition;
+	vec4 morph; // spacing of the level drawn, where its morph starts, and one over the morph's length
+};
+
 namespace Terrain
 {
-	void Initialize();
+	// the shader takes position, textureCoordinate and morph attributes, in
+	// that order
+	void Initialize(const GLShader* shader);
 	void Terminate();
-	void Render();
+
+	// streams chunks in around the viewer, uploading only a few each frame,
+	// then picks a level of detail for every part of them in the frustum
+	void Update(const vec3& viewPosition, const Frustum& frustum, float fov, int viewportHeight);
+	void Render(const mat4x4& viewProjection, GLuint uniformBuffer);
+	void AddOccluders(OcclusionBuffer* buffer);
+
+	// what the last Update picked to draw
+	const TerrainLodStats& GetStats();
 
 	class Chunk
 	{
 	public:
 		GLuint vertexArray;
-		GLuint buffers[2];
-		unsigned short numIndices;
+		GLuint vertexBuffer;
+
+		// owned by the streamer
+		const TerrainChunk* data;
+
+		// the coarsest level's vertices, for occlusion culling
+		vec3* occluderPositions;
 
 		Chunk();
-		void Create();
+		void Create(const TerrainChunk* chunk);
 		void Destroy();
-		void Render() const;
+		void AddOccluder(OcclusionBuffer* buffer) const;
 	};
 }
 
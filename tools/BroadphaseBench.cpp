@@ -0,0 +1,156 @@
+// Times the two broadphases against each other on crowds of equally sized
+// spheres wandering around a box, without opening a window. The box grows
+// with the crowd so every size has the same density.
+//
+//     BroadphaseBench
+//     BroadphaseBench 10000 50000 200000
+//
+// Each frame, every sphere takes a small random step. The tree moves its
+// proxies and reports overlapping fat boxes; the grid is rebuilt from
+// scratch and reports spheres closer than a diameter. After the frames, both
+// answer a radius query around every sphere, and the grid also finds each
+// one's nearest neighbours.
+
+#include "../utilities/AABBTree.h"
+#include "../utilities/SpatialHashGrid.h"
+#include "../utilities/RandomUniform.h"
+#include "../utilities/Timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+static const int NUM_FRAMES = 10;
+static const float RADIUS = 0.5f;
+static const float SPACING = 1.5f; // room per sphere, along each axis
+static const float STEP = 0.1f;
+
+struct CountProxies
+{
+	int found;
+
+	bool operator()(int /*proxy*/)
+	{
+		found++;
+		return true;
+	}
+};
+
+static void run(int count)
+{
+	rng::Stream stream;
+	rng::seed_stream(&stream, count);
+
+	float side = SPACING * cbrtf(float(count));
+	vec3* positions = new vec3[count];
+	for(int i = 0; i < count; ++i)
+	{
+		positions[i].x = float(rng::real_range(0.0, side, &stream));
+		positions[i].y = float(rng::real_range(0.0, side, &stream));
+		positions[i].z = float(rng::real_range(0.0, side, &stream));
+	}
+
+	AABBTree tree(count);
+	SpatialHashGrid grid(2.0f * RADIUS);
+	AutoArray<ProxyPair> pairs;
+
+	int* proxies = new int[count];
+	for(int i = 0; i < count; ++i)
+	{
+		AABB bounds;
+		bounds.center = positions[i];
+		bounds.extents = vec3(RADIUS, RADIUS, RADIUS);
+		proxies[i] = tree.CreateProxy(bounds, nullptr);
+	}
+	tree.UpdatePairs(pairs);
+
+	double treeTime = 0.0, gridTime = 0.0;
+	int treePairs = 0, gridPairs = 0;
+	for(int frame = 0; frame < NUM_FRAMES; ++frame)
+	{
+		vec3* steps = new vec3[count];
+		for(int i = 0; i < count; ++i)
+		{
+			steps[i].x = float(rng::real_range(-STEP, STEP, &stream));
+			steps[i].y = float(rng::real_range(-STEP, STEP, &stream));
+			steps[i].z = float(rng::real_range(-STEP, STEP, &stream));
+			positions[i] += steps[i];
+		}
+
+		double start = Timer::GetTime();
+		for(int i = 0; i < count; ++i)
+		{
+			AABB bounds;
+			bounds.center = positions[i];
+			bounds.extents = vec3(RADIUS, RADIUS, RADIUS);
+			tree.MoveProxy(proxies[i], bounds, steps[i]);
+		}
+		pairs.Clear();
+		tree.UpdatePairs(pairs);
+		treeTime += Timer::GetTime() - start;
+		treePairs += pairs.Count();
+
+		start = Timer::GetTime();
+		grid.Build(positions, count);
+		pairs.Clear();
+		grid.FindPairs(2.0f * RADIUS, pairs);
+		gridTime += Timer::GetTime() - start;
+		gridPairs += pairs.Count();
+
+		delete[] steps;
+	}
+
+	printf("%d spheres:\n", count);
+	printf("  update+pairs  tree %8.2f ms  grid %8.2f ms  (%d fat pairs, %d exact pairs a frame)\n",
+		treeTime / NUM_FRAMES, gridTime / NUM_FRAMES, treePairs / NUM_FRAMES, gridPairs / NUM_FRAMES);
+
+	// radius queries around every sphere
+	int results[256];
+	CountProxies counter;
+	counter.found = 0;
+	double start = Timer::GetTime();
+	for(int i = 0; i < count; ++i)
+	{
+		AABB bounds;
+		bounds.center = positions[i];
+		bounds.extents = vec3(2.0f * RADIUS, 2.0f * RADIUS, 2.0f * RADIUS);
+		tree.QueryAABB(bounds, counter);
+	}
+	treeTime = Timer::GetTime() - start;
+
+	int gridFound = 0;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i)
+		gridFound += grid.QueryRadius(positions[i], 2.0f * RADIUS, results, 256);
+	gridTime = Timer::GetTime() - start;
+
+	printf("  radius        tree %8.2f ms  grid %8.2f ms  (%d boxes, %d spheres found)\n",
+		treeTime, gridTime, counter.found, gridFound);
+
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i)
+		grid.QueryNearest(positions[i], 8, results);
+	printf("  8 nearest                      grid %8.2f ms\n", Timer::GetTime() - start);
+
+	delete[] positions;
+	delete[] proxies;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc > 1)
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			int count = atoi(argv[i]);
+			if(count > 0) run(count);
+		}
+	}
+	else
+	{
+		run(10000);
+		run(50000);
+		run(100000);
+	}
+	return 0;
+}
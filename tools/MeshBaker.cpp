@@ -0,0 +1,74 @@
+// Bakes Wavefront OBJ meshes into the binary format the renderers map at
+// startup. Each argument is a model to bake, written next to it with the
+// extension swapped for .mesh, or to the path after -o if one follows it.
+// Vertices are packed into 16 bytes unless -float comes first, which keeps
+// them as 36 bytes of full floats.
+//
+//     MeshBaker data/meshes/Fiona.obj
+//     MeshBaker data/meshes/Fiona.obj -o build/Fiona.mesh
+//     MeshBaker -float data/meshes/Fiona.obj
+
+#include "../utilities/MeshFile.h"
+#include "../utilities/Logging.h"
+#include "../utilities/Timer.h"
+
+#include "../utilities/concurrent/JobPool.h"
+
+#include <cstdio>
+#include <cstring>
+
+static void replace_extension(const char* path, const char* extension, char* result, size_t size)
+{
+	const char* dot = strrchr(path, '.');
+	const char* slash = strrchr(path, '/');
+	size_t stem = (dot && (!slash || dot > slash))? dot - path : strlen(path);
+	snprintf(result, size, "%.*s%s", int(stem), path, extension);
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("usage: %s [-float] model.obj [-o model.mesh] ...\n", argv[0]);
+		return 1;
+	}
+
+	int first = 1;
+	MeshVertexFormat vertexFormat = MESH_VERTEX_PACKED;
+	if(strcmp(argv[1], "-float") == 0)
+	{
+		vertexFormat = MESH_VERTEX_FLOAT;
+		first++;
+	}
+
+	JobPool pool;
+	int failures = 0;
+	for(int i = first; i < argc; ++i)
+	{
+		const char* input = argv[i];
+		char output[512];
+		if(i + 2 < argc && strcmp(argv[i + 1], "-o") == 0)
+		{
+			snprintf(output, sizeof output, "%s", argv[i + 2]);
+			i += 2;
+		}
+		else
+		{
+			replace_extension(input, ".mesh", output, sizeof output);
+		}
+
+		double start = Timer::GetTime();
+		if(bake_obj_file(input, output, &pool, vertexFormat))
+		{
+			printf("%s -> %s in %.1f ms\n", input, output, Timer::GetTime() - start);
+		}
+		else
+		{
+			printf("%s could not be baked\n", input);
+			failures++;
+		}
+	}
+
+	Log::Output(true);
+	return (failures > 0)? 1 : 0;
+}
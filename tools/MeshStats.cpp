@@ -0,0 +1,88 @@
+// Prints how well the GPU's vertex cache would do on Wavefront OBJ meshes,
+// as loaded and after each of the reordering passes the renderers and
+// MeshBaker run, without opening a window.
+//
+//     MeshStats data/meshes/Fiona.obj
+//
+// ACMR is vertices transformed per triangle and ATVR vertices transformed
+// per vertex, both for first in, first out caches of 16 and 32 entries.
+
+#include "../utilities/MeshLoading.h"
+#include "../utilities/MeshProcessing.h"
+#include "../utilities/Logging.h"
+#include "../utilities/Timer.h"
+#include "../utilities/NumberMacros.h"
+
+#include <cstdio>
+
+static const int MAX_MATERIALS = 64;
+
+static void print_stats(const char* stage, const uint32_t* indices, int numIndices, int numVertices, double time)
+{
+	VertexCacheStats small = analyze_vertex_cache(indices, numIndices, numVertices, 16);
+	VertexCacheStats large = analyze_vertex_cache(indices, numIndices, numVertices, 32);
+	printf("  %-12s ACMR %.3f / %.3f  ATVR %.3f / %.3f", stage, small.acmr, large.acmr, small.atvr, large.atvr);
+	if(time > 0.0) printf("  %.2f ms", time);
+	printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("usage: %s model.obj ...\n", argv[0]);
+		return 1;
+	}
+
+	int failures = 0;
+	for(int i = 1; i < argc; ++i)
+	{
+		AutoArray<vec4> vertices;
+		AutoArray<vec3> normals;
+		AutoArray<vec2> texcoords;
+		AutoArray<uint32_t> elements;
+		MaterialInfo materials[MAX_MATERIALS];
+		int numMaterials = load_obj(argv[i], vertices, normals, texcoords, elements, materials, MAX_MATERIALS);
+		if(elements.Count() == 0)
+		{
+			printf("%s has no triangles\n", argv[i]);
+			failures++;
+			continue;
+		}
+
+		int numVertices = vertices.Count();
+		int numIndices = elements.Count();
+		uint32_t* indices = elements.First();
+		printf("%s: %d vertices, %d triangles, %d materials\n", argv[i], numVertices, numIndices / 3, numMaterials);
+		print_stats("as loaded", indices, numIndices, numVertices, 0.0);
+
+		int startIndices[MAX_MATERIALS];
+		for(int j = 0; j < numMaterials; ++j)
+			startIndices[j] = materials[j].startIndex;
+
+		double start = Timer::GetTime();
+		for(int j = 0; j < MAX(numMaterials, 1); ++j)
+		{
+			int first = (numMaterials > 0)? startIndices[j] : 0;
+			int last = (j + 1 < numMaterials)? startIndices[j + 1] : numIndices;
+			optimize_vertex_cache(indices + first, last - first, numVertices);
+		}
+		print_stats("cache", indices, numIndices, numVertices, Timer::GetTime() - start);
+
+		start = Timer::GetTime();
+		for(int j = 0; j < MAX(numMaterials, 1); ++j)
+		{
+			int first = (numMaterials > 0)? startIndices[j] : 0;
+			int last = (j + 1 < numMaterials)? startIndices[j + 1] : numIndices;
+			optimize_overdraw(indices + first, last - first, vertices.First(), numVertices, 1.05f);
+		}
+		print_stats("overdraw", indices, numIndices, numVertices, Timer::GetTime() - start);
+
+		start = Timer::GetTime();
+		numVertices = optimize_vertex_fetch(vertices.First(), normals.First(), texcoords.First(), numVertices, indices, numIndices);
+		print_stats("fetch", indices, numIndices, numVertices, Timer::GetTime() - start);
+	}
+
+	Log::Output(true);
+	return (failures > 0)? 1 : 0;
+}
@@ -0,0 +1,168 @@
+// Times passes over an array of entities before and after putting them in
+// Z-order with morton_order, without opening a window.
+//
+//     MortonBench
+//     MortonBench 100000 1000000 4000000
+//
+// Entities are 64 bytes, one to a cache line, scattered through a box at a
+// few to a cell of the grid. Three passes read them the way gameplay does:
+// one walks the array in order and reads each entity's nearest neighbour by
+// index, one asks a grid for everything within a radius of each entity and
+// reads what it finds, and one reads both ends of every close pair, as a
+// collision pass would. Each runs on the array as it was created, in random
+// order, and again after sorting it along the curve, with the grid and pairs
+// rebuilt so they point at the new places.
+
+#include "../utilities/MortonOrder.h"
+#include "../utilities/SpatialHashGrid.h"
+#include "../utilities/RandomUniform.h"
+#include "../utilities/Timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+static const float SPACING = 1.0f; // room per entity, along each axis
+static const float RADIUS = 1.0f;
+static const int MAX_FOUND = 64;
+
+struct Entity
+{
+	vec3 position;
+	vec3 velocity;
+	float health;
+	int nearest;
+	float padding[8];
+};
+
+struct Times
+{
+	double nearest;
+	double radius;
+	double pairs;
+	double checksum; // so no pass can be left out
+};
+
+static Times run_passes(const Entity* entities, int count)
+{
+	vec3* positions = new vec3[count];
+	for(int i = 0; i < count; ++i)
+		positions[i] = entities[i].position;
+
+	SpatialHashGrid grid(2.0f * RADIUS);
+	grid.Build(positions, count);
+	AutoArray<ProxyPair> pairs;
+	grid.FindPairs(RADIUS, pairs);
+
+	Times times;
+	double sum = 0.0;
+
+	double start = Timer::GetTime();
+	for(int i = 0; i < count; ++i)
+		sum += entities[entities[i].nearest].health;
+	times.nearest = Timer::GetTime() - start;
+
+	int found[MAX_FOUND];
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i)
+	{
+		int n = grid.QueryRadius(entities[i].position, RADIUS, found, MAX_FOUND);
+		for(int j = 0; j < n; ++j)
+			sum += entities[found[j]].velocity.x;
+	}
+	times.radius = Timer::GetTime() - start;
+
+	start = Timer::GetTime();
+	for(size_t i = 0; i < pairs.Count(); ++i)
+	{
+		const Entity& a = entities[pairs[i].proxyA];
+		const Entity& b = entities[pairs[i].proxyB];
+		sum += dot(a.velocity - b.velocity, a.position - b.position);
+	}
+	times.pairs = Timer::GetTime() - start;
+
+	times.checksum = sum;
+	delete[] positions;
+	return times;
+}
+
+static void run(int count)
+{
+	rng::Stream stream;
+	rng::seed_stream(&stream, count);
+
+	float side = SPACING * cbrtf(float(count));
+	Entity* entities = new Entity[count];
+	vec3* positions = new vec3[count];
+	for(int i = 0; i < count; ++i)
+	{
+		Entity& entity = entities[i];
+		entity.position.x = float(rng::real_range(0.0, side, &stream));
+		entity.position.y = float(rng::real_range(0.0, side, &stream));
+		entity.position.z = float(rng::real_range(0.0, side, &stream));
+		entity.velocity = vec3(float(rng::real_range(-1.0, 1.0, &stream)), 0.0f, 0.0f);
+		entity.health = 1.0f;
+		positions[i] = entity.position;
+	}
+
+	// the nearest neighbours are found once, and kept as indices the way an
+	// entity would keep a target
+	SpatialHashGrid grid(2.0f * RADIUS);
+	grid.Build(positions, count);
+	for(int i = 0; i < count; ++i)
+	{
+		int nearest[2];
+		int n = grid.QueryNearest(positions[i], 2, nearest);
+		entities[i].nearest = (n > 1)? nearest[1] : i;
+		if(n > 1 && nearest[1] == i) entities[i].nearest = nearest[0];
+	}
+
+	Times before = run_passes(entities, count);
+
+	// sorting moves the entities, so their indices into each other have to
+	// follow them
+	int* order = new int[count];
+	int* newIndex = new int[count];
+	Entity* scratch = new Entity[count];
+	double start = Timer::GetTime();
+	morton_order(positions, count, order);
+	apply_order(entities, order, count, scratch);
+	double sortTime = Timer::GetTime() - start;
+	for(int i = 0; i < count; ++i)
+		newIndex[order[i]] = i;
+	for(int i = 0; i < count; ++i)
+		entities[i].nearest = newIndex[entities[i].nearest];
+
+	Times after = run_passes(entities, count);
+
+	printf("%d entities, %.1f MB:\n", count, count * sizeof(Entity) / (1024.0 * 1024.0));
+	printf("  nearest  random %8.2f ms  z-order %8.2f ms  %.1fx\n", before.nearest, after.nearest, before.nearest / after.nearest);
+	printf("  radius   random %8.2f ms  z-order %8.2f ms  %.1fx\n", before.radius, after.radius, before.radius / after.radius);
+	printf("  pairs    random %8.2f ms  z-order %8.2f ms  %.1fx\n", before.pairs, after.pairs, before.pairs / after.pairs);
+	printf("  ordering took %.2f ms%s\n", sortTime,
+		(fabs(before.checksum - after.checksum) > 1.0e-6 * (1.0 + fabs(before.checksum)))? "  CHECKSUMS DIFFER" : "");
+
+	delete[] entities;
+	delete[] positions;
+	delete[] order;
+	delete[] newIndex;
+	delete[] scratch;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc > 1)
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			int count = atoi(argv[i]);
+			if(count > 0) run(count);
+		}
+	}
+	else
+	{
+		run(100000);
+		run(1000000);
+	}
+	return 0;
+}
@@ -0,0 +1,124 @@
+// Checks the batched contact generation against contacts worked out by hand,
+// without opening a window.
+//
+//     NarrowphaseCheck
+//
+// Each case is a pair of shapes whose normal, depth and contact point are
+// known, and the point has to land halfway between the two surfaces, since
+// the solver takes it as the arm that contact forces turn bodies by. The
+// cases go through together, so they fill more than one batch. Exits with 1
+// if any check fails.
+
+#include "../utilities/Narrowphase.h"
+
+#include <cstdio>
+#include <cmath>
+
+static const float TOLERANCE = 1.0e-5f;
+
+static int failures = 0;
+
+static bool near(const vec3& a, const vec3& b)
+{
+	return fabsf(a.x - b.x) <= TOLERANCE && fabsf(a.y - b.y) <= TOLERANCE && fabsf(a.z - b.z) <= TOLERANCE;
+}
+
+static void check(const char* name, const ContactRecord& contact, const vec3& normal, float depth, const vec3& point)
+{
+	bool passed = near(contact.normal, normal) && fabsf(contact.depth - depth) <= TOLERANCE && near(contact.point, point);
+	printf("  %-28s %-9s point (%.3f, %.3f, %.3f), expected (%.3f, %.3f, %.3f)\n", name, passed? "ok" : "FAILED",
+		contact.point.x, contact.point.y, contact.point.z, point.x, point.y, point.z);
+	if(!passed) failures++;
+}
+
+static OBB make_box(const vec3& center, const vec3& extents)
+{
+	OBB obb;
+	obb.center = center;
+	obb.extents = extents;
+	obb.axes[0] = vec3(1.0f, 0.0f, 0.0f);
+	obb.axes[1] = vec3(0.0f, 1.0f, 0.0f);
+	obb.axes[2] = vec3(0.0f, 0.0f, 1.0f);
+	return obb;
+}
+
+static Sphere make_sphere(const vec3& position, float radius)
+{
+	Sphere sphere;
+	sphere.position = position;
+	sphere.radius = radius;
+	return sphere;
+}
+
+struct Expected
+{
+	const char* name;
+	vec3 normal;
+	float depth;
+	vec3 point;
+};
+
+static void check_obb_sphere()
+{
+	OBB boxes[2];
+	boxes[0] = make_box(vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 1.0f, 1.0f));
+	boxes[1] = make_box(vec3(10.0f, 0.0f, 0.0f), vec3(2.0f, 1.0f, 1.0f));
+
+	// a box turned a quarter turn about y, so its long side runs along z
+	boxes[1].axes[0] = vec3(0.0f, 0.0f, -1.0f);
+	boxes[1].axes[2] = vec3(1.0f, 0.0f, 0.0f);
+
+	Sphere spheres[5];
+	spheres[0] = make_sphere(vec3(1.5f, 0.0f, 0.0f), 1.0f);  // centre outside
+	spheres[1] = make_sphere(vec3(0.8f, 0.0f, 0.0f), 0.5f);  // centre inside
+	spheres[2] = make_sphere(vec3(0.0f, -1.25f, 0.0f), 0.5f); // below
+	spheres[3] = make_sphere(vec3(10.0f, 0.0f, 2.5f), 1.0f); // off the turned box's end
+	spheres[4] = make_sphere(vec3(0.0f, 0.0f, 5.0f), 1.0f);  // apart
+
+	ProxyPair pairs[5] = { {0, 0}, {0, 1}, {0, 2}, {1, 3}, {0, 4} };
+	Expected expected[4] =
+	{
+		{ "obb-sphere outside", vec3(1.0f, 0.0f, 0.0f), 0.5f, vec3(0.75f, 0.0f, 0.0f) },
+		{ "obb-sphere inside", vec3(1.0f, 0.0f, 0.0f), 0.7f, vec3(0.65f, 0.0f, 0.0f) },
+		{ "obb-sphere below", vec3(0.0f, -1.0f, 0.0f), 0.25f, vec3(0.0f, -0.875f, 0.0f) },
+		{ "obb-sphere turned box", vec3(0.0f, 0.0f, 1.0f), 0.5f, vec3(10.0f, 0.0f, 1.75f) },
+	};
+
+	ContactRecord contacts[5];
+	int count = collide_obb_sphere_pairs(boxes, spheres, pairs, 5, contacts);
+	if(count != 4)
+	{
+		printf("  %-28s FAILED    %d contacts, expected 4\n", "obb-sphere", count);
+		failures++;
+		return;
+	}
+	for(int i = 0; i < count; ++i)
+		check(expected[i].name, contacts[i], expected[i].normal, expected[i].depth, expected[i].point);
+}
+
+static void check_spheres()
+{
+	Sphere spheres[2];
+	spheres[0] = make_sphere(vec3(0.0f, 0.0f, 0.0f), 1.0f);
+	spheres[1] = make_sphere(vec3(0.0f, 1.5f, 0.0f), 1.0f);
+
+	ProxyPair pair = {0, 1};
+	ContactRecord contact;
+	if(collide_sphere_pairs(spheres, &pair, 1, &contact) != 1)
+	{
+		printf("  %-28s FAILED    no contact\n", "sphere-sphere");
+		failures++;
+		return;
+	}
+	check("sphere-sphere", contact, vec3(0.0f, 1.0f, 0.0f), 0.5f, vec3(0.0f, 0.75f, 0.0f));
+}
+
+int main()
+{
+	printf("contacts:\n");
+	check_obb_sphere();
+	check_spheres();
+
+	if(failures > 0) printf("%d checks failed\n", failures);
+	return (failures > 0)? 1 : 0;
+}
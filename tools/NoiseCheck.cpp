@@ -0,0 +1,286 @@
+// Checks the batched float noise against the scalar double versions it was
+// written from, and times the two, without opening a window.
+//
+//     NoiseCheck
+//     NoiseCheck 1000000
+//
+// At random points, single octaves have to match the scalar simplex noise in
+// value and in gradient, taken by central differences, and fractal sums have
+// to match the same octaves summed one sample at a time. Grid fills are held
+// to the same points sampled one by one. Exits with 1 if any check fails.
+
+#include "../utilities/Noise.h"
+#include "../utilities/RandomUniform.h"
+#include "../utilities/Timer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+static const float EXTENT = 64.0f;
+
+// float has about seven digits, and a difference taken over a small step
+// loses a few more
+static const double VALUE_TOLERANCE = 1.0e-4;
+static const double GRADIENT_TOLERANCE = 1.0e-2;
+static const float GRADIENT_STEP = 1.0e-2f;
+
+static int failures = 0;
+
+static void check(const char* name, const char* what, double error, double tolerance)
+{
+	bool passed = error <= tolerance;
+	printf("  %-14s %-9s largest %s error %.2e, allowed %.2e\n", name, passed? "ok" : "FAILED", what, error, tolerance);
+	if(!passed) failures++;
+}
+
+static double scalar_fractal_2d(const FractalNoise& fractal, double x, double y)
+{
+	double sum = 0.0;
+	double frequency = fractal.frequency;
+	double amplitude = 1.0;
+	double combinedAmplitude = 0.0;
+	for(int octave = 0; octave < fractal.numOctaves; ++octave)
+	{
+		double n = simplex_noise_2d(x * frequency, y * frequency);
+		if(fractal.type == FRACTAL_RIDGED)
+		{
+			n = 1.0 - fabs(n);
+			n = n * n;
+		}
+		sum += n * amplitude;
+		combinedAmplitude += amplitude;
+		frequency *= fractal.lacunarity;
+		amplitude *= fractal.persistence;
+	}
+	return sum / combinedAmplitude;
+}
+
+static double scalar_fractal_3d(const FractalNoise& fractal, double x, double y, double z)
+{
+	double sum = 0.0;
+	double frequency = fractal.frequency;
+	double amplitude = 1.0;
+	double combinedAmplitude = 0.0;
+	for(int octave = 0; octave < fractal.numOctaves; ++octave)
+	{
+		double n = simplex_noise_3d(x * frequency, y * frequency, z * frequency);
+		if(fractal.type == FRACTAL_RIDGED)
+		{
+			n = 1.0 - fabs(n);
+			n = n * n;
+		}
+		sum += n * amplitude;
+		combinedAmplitude += amplitude;
+		frequency *= fractal.lacunarity;
+		amplitude *= fractal.persistence;
+	}
+	return sum / combinedAmplitude;
+}
+
+static void check_values_2d(const char* name, const FractalNoise& fractal, const float* x, const float* y, int count, float* out)
+{
+	fractal_noise_2d(fractal, x, y, count, out);
+	double worst = 0.0;
+	for(int i = 0; i < count; ++i)
+		worst = fmax(worst, fabs(out[i] - scalar_fractal_2d(fractal, x[i], y[i])));
+	check(name, "value", worst, VALUE_TOLERANCE);
+}
+
+static void check_values_3d(const char* name, const FractalNoise& fractal,
+	const float* x, const float* y, const float* z, int count, float* out)
+{
+	fractal_noise_3d(fractal, x, y, z, count, out);
+	double worst = 0.0;
+	for(int i = 0; i < count; ++i)
+		worst = fmax(worst, fabs(out[i] - scalar_fractal_3d(fractal, x[i], y[i], z[i])));
+	check(name, "value", worst, VALUE_TOLERANCE);
+}
+
+// each gradient component is the difference between samples a step either
+// side, taken at the same float points for both versions
+static void check_gradients_2d(const FractalNoise& fractal, const float* x, const float* y, int count)
+{
+	float* plus = new float[count];
+	float* minus = new float[count];
+	float* ahead = new float[count];
+	float* behind = new float[count];
+	double worst = 0.0;
+	for(int axis = 0; axis < 2; ++axis)
+	{
+		const float* moved = (axis == 0) ? x : y;
+		for(int i = 0; i < count; ++i)
+		{
+			plus[i] = moved[i] + GRADIENT_STEP;
+			minus[i] = moved[i] - GRADIENT_STEP;
+		}
+		fractal_noise_2d(fractal, (axis == 0) ? plus : x, (axis == 1) ? plus : y, count, ahead);
+		fractal_noise_2d(fractal, (axis == 0) ? minus : x, (axis == 1) ? minus : y, count, behind);
+
+		for(int i = 0; i < count; ++i)
+		{
+			double scalar = (axis == 0)
+				? simplex_noise_2d(plus[i], y[i]) - simplex_noise_2d(minus[i], y[i])
+				: simplex_noise_2d(x[i], plus[i]) - simplex_noise_2d(x[i], minus[i]);
+			double batched = double(ahead[i]) - behind[i];
+			worst = fmax(worst, fabs(batched - scalar) / (double(plus[i]) - minus[i]));
+		}
+	}
+	check("simplex 2D", "gradient", worst, GRADIENT_TOLERANCE);
+	delete[] plus;
+	delete[] minus;
+	delete[] ahead;
+	delete[] behind;
+}
+
+static void check_gradients_3d(const FractalNoise& fractal, const float* x, const float* y, const float* z, int count)
+{
+	float* plus = new float[count];
+	float* minus = new float[count];
+	float* ahead = new float[count];
+	float* behind = new float[count];
+	double worst = 0.0;
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		const float* in[3] = { x, y, z };
+		const float* moved = in[axis];
+		for(int i = 0; i < count; ++i)
+		{
+			plus[i] = moved[i] + GRADIENT_STEP;
+			minus[i] = moved[i] - GRADIENT_STEP;
+		}
+		in[axis] = plus;
+		fractal_noise_3d(fractal, in[0], in[1], in[2], count, ahead);
+		in[axis] = minus;
+		fractal_noise_3d(fractal, in[0], in[1], in[2], count, behind);
+
+		for(int i = 0; i < count; ++i)
+		{
+			double high[3] = { x[i], y[i], z[i] };
+			double low[3] = { x[i], y[i], z[i] };
+			high[axis] = plus[i];
+			low[axis] = minus[i];
+			double scalar = simplex_noise_3d(high[0], high[1], high[2]) - simplex_noise_3d(low[0], low[1], low[2]);
+			double batched = double(ahead[i]) - behind[i];
+			worst = fmax(worst, fabs(batched - scalar) / (double(plus[i]) - minus[i]));
+		}
+	}
+	check("simplex 3D", "gradient", worst, GRADIENT_TOLERANCE);
+	delete[] plus;
+	delete[] minus;
+	delete[] ahead;
+	delete[] behind;
+}
+
+static void check_grids(const FractalNoise& fractal)
+{
+	// odd sizes, so rows end partway through the lanes
+	const int width = 37, height = 29, depth = 11;
+	const float step = 0.173f;
+	const float x = -3.5f, y = 12.25f, z = 7.0f;
+	float* out = new float[width * height * depth];
+
+	fill_noise_grid_2d(fractal, x, y, step, width, height, out);
+	double worst = 0.0;
+	for(int row = 0; row < height; ++row)
+	{
+		for(int column = 0; column < width; ++column)
+		{
+			float px = x + column * step, py = y + row * step;
+			worst = fmax(worst, fabs(out[row * width + column] - scalar_fractal_2d(fractal, px, py)));
+		}
+	}
+	check("grid 2D", "value", worst, VALUE_TOLERANCE);
+
+	fill_noise_grid_3d(fractal, x, y, z, step, width, height, depth, out);
+	worst = 0.0;
+	for(int layer = 0; layer < depth; ++layer)
+	{
+		for(int row = 0; row < height; ++row)
+		{
+			for(int column = 0; column < width; ++column)
+			{
+				float px = x + column * step, py = y + row * step, pz = z + layer * step;
+				float value = out[(layer * height + row) * width + column];
+				worst = fmax(worst, fabs(value - scalar_fractal_3d(fractal, px, py, pz)));
+			}
+		}
+	}
+	check("grid 3D", "value", worst, VALUE_TOLERANCE);
+
+	delete[] out;
+}
+
+int main(int argc, char** argv)
+{
+	int count = (argc > 1)? atoi(argv[1]) : 100000;
+	if(count < 1)
+	{
+		printf("usage: %s [samples]\n", argv[0]);
+		return 1;
+	}
+
+	rng::Stream stream;
+	rng::seed_stream(&stream, 36);
+	float* x = new float[count];
+	float* y = new float[count];
+	float* z = new float[count];
+	float* out = new float[count];
+	for(int i = 0; i < count; ++i)
+	{
+		x[i] = float(rng::real_range(-EXTENT, EXTENT, &stream));
+		y[i] = float(rng::real_range(-EXTENT, EXTENT, &stream));
+		z[i] = float(rng::real_range(-EXTENT, EXTENT, &stream));
+	}
+
+	FractalNoise single;
+	single.type = FRACTAL_FBM;
+	single.numOctaves = 1;
+	single.frequency = 1.0f;
+	single.lacunarity = 2.0f;
+	single.persistence = 0.5f;
+
+	FractalNoise fbm = single;
+	fbm.numOctaves = 5;
+	fbm.frequency = 0.25f;
+
+	FractalNoise ridged = fbm;
+	ridged.type = FRACTAL_RIDGED;
+
+	printf("against the scalar noise, %d samples each:\n", count);
+	check_values_2d("simplex 2D", single, x, y, count, out);
+	check_values_3d("simplex 3D", single, x, y, z, count, out);
+	check_gradients_2d(single, x, y, count);
+	check_gradients_3d(single, x, y, z, count);
+	check_values_2d("fbm 2D", fbm, x, y, count, out);
+	check_values_3d("fbm 3D", fbm, x, y, z, count, out);
+	check_values_2d("ridged 2D", ridged, x, y, count, out);
+	check_values_3d("ridged 3D", ridged, x, y, z, count, out);
+	check_grids(fbm);
+
+	printf("timing, %d samples of %d octaves:\n", count, fbm.numOctaves);
+
+	double start = Timer::GetTime();
+	fractal_noise_2d(fbm, x, y, count, out);
+	double batched = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) out[i] = float(scalar_fractal_2d(fbm, x[i], y[i]));
+	double scalar = Timer::GetTime() - start;
+	printf("  2D  batched %.2f ms, scalar %.2f ms, %.1fx\n", batched, scalar, scalar / batched);
+
+	start = Timer::GetTime();
+	fractal_noise_3d(fbm, x, y, z, count, out);
+	batched = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) out[i] = float(scalar_fractal_3d(fbm, x[i], y[i], z[i]));
+	scalar = Timer::GetTime() - start;
+	printf("  3D  batched %.2f ms, scalar %.2f ms, %.1fx\n", batched, scalar, scalar / batched);
+
+	delete[] x;
+	delete[] y;
+	delete[] z;
+	delete[] out;
+
+	if(failures > 0) printf("%d checks failed\n", failures);
+	return (failures > 0)? 1 : 0;
+}
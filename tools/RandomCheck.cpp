@@ -0,0 +1,228 @@
+// Checks that the array fills in RandomDistribution draw from the
+// distributions they claim to, and times them against a loop over the
+// one-at-a-time functions, without opening a window.
+//
+//     RandomCheck
+//     RandomCheck 10000000
+//
+// Each fill's mean and variance have to land within five standard errors of
+// the true ones, and the largest gap between its cumulative distribution and
+// the true one, the Kolmogorov-Smirnov statistic, has to stay under the
+// critical value at a significance of 0.001. Exits with 1 if any check fails.
+
+#include "../utilities/RandomDistribution.h"
+#include "../utilities/Timer.h"
+#include "../utilities/Sorting.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+static const double PI = 3.14159265358979323846;
+
+struct IsLess
+{
+	bool operator()(float a, float b) const { return a < b; }
+};
+
+struct Moments
+{
+	double mean;
+	double variance;
+};
+
+static Moments measure(const float* values, int count)
+{
+	double sum = 0.0;
+	for(int i = 0; i < count; ++i) sum += values[i];
+	double mean = sum / count;
+
+	double squares = 0.0;
+	for(int i = 0; i < count; ++i)
+	{
+		double d = values[i] - mean;
+		squares += d * d;
+	}
+
+	Moments moments;
+	moments.mean = mean;
+	moments.variance = squares / (count - 1);
+	return moments;
+}
+
+// the cumulative distributions being checked against
+static double uniform_cdf(double x) { return (x < 0.0)? 0.0 : (x > 1.0)? 1.0 : x; }
+static double normal_cdf(double x) { return 0.5 * erfc(-x / sqrt(2.0)); }
+static double exponential_cdf(double x) { return (x < 0.0)? 0.0 : 1.0 - exp(-2.0 * x); }
+static double cauchy_cdf(double x) { return 0.5 + atan(x) / PI; }
+
+// sorts values in place
+static double kolmogorov_smirnov(float* values, int count, double (*cdf)(double))
+{
+	quick_sort(values, count, IsLess());
+	double worst = 0.0;
+	for(int i = 0; i < count; ++i)
+	{
+		double f = cdf(values[i]);
+		double below = f - double(i) / count;
+		double above = double(i + 1) / count - f;
+		if(below > worst) worst = below;
+		if(above > worst) worst = above;
+	}
+	return worst;
+}
+
+static int failures = 0;
+
+static void check(const char* name, bool passed, const char* format, double value, double expected)
+{
+	printf("  %-12s %-9s ", name, passed? "ok" : "FAILED");
+	printf(format, value, expected);
+	printf("\n");
+	if(!passed) failures++;
+}
+
+// fourthMoment is the central one, which the variance's standard error
+// depends on
+static void check_moments(const char* name, const float* values, int count,
+	double mean, double variance, double fourthMoment)
+{
+	Moments moments = measure(values, count);
+	double meanError = 5.0 * sqrt(variance / count);
+	double varianceError = 5.0 * sqrt((fourthMoment - variance * variance) / count);
+	check(name, fabs(moments.mean - mean) <= meanError, "mean %.5f, expected %.5f", moments.mean, mean);
+	check(name, fabs(moments.variance - variance) <= varianceError, "variance %.5f, expected %.5f", moments.variance, variance);
+}
+
+static void check_distribution(const char* name, float* values, int count, double (*cdf)(double))
+{
+	double critical = 1.949 / sqrt(double(count));
+	double statistic = kolmogorov_smirnov(values, count, cdf);
+	check(name, statistic <= critical, "KS %.5f, critical %.5f", statistic, critical);
+}
+
+// the same test for whole numbers, taken at every value up to the largest
+static void check_poisson(const char* name, const long* values, int count, double m)
+{
+	long largest = 0;
+	for(int i = 0; i < count; ++i)
+		if(values[i] > largest) largest = values[i];
+
+	int* tally = new int[largest + 1]();
+	double sum = 0.0, squares = 0.0;
+	for(int i = 0; i < count; ++i)
+	{
+		tally[values[i]]++;
+		sum += values[i];
+		squares += double(values[i]) * values[i];
+	}
+
+	double mean = sum / count;
+	double variance = (squares - sum * mean) / (count - 1);
+	double meanError = 5.0 * sqrt(m / count);
+	double varianceError = 5.0 * sqrt((m + 2.0 * m * m) / count);
+	check(name, fabs(mean - m) <= meanError, "mean %.5f, expected %.5f", mean, m);
+	check(name, fabs(variance - m) <= varianceError, "variance %.5f, expected %.5f", variance, m);
+
+	double p = exp(-m);
+	double cdf = p;
+	double seen = 0.0;
+	double worst = 0.0;
+	for(long k = 0; k <= largest; ++k)
+	{
+		seen += double(tally[k]) / count;
+		if(fabs(seen - cdf) > worst) worst = fabs(seen - cdf);
+		p *= m / (k + 1);
+		cdf += p;
+	}
+	delete[] tally;
+
+	double critical = 1.949 / sqrt(double(count));
+	check(name, worst <= critical, "KS %.5f, critical %.5f", worst, critical);
+}
+
+static void print_time(const char* name, double fill, double loop)
+{
+	printf("  %-12s fill %.2f ms, loop %.2f ms, %.1fx\n", name, fill, loop, loop / fill);
+}
+
+int main(int argc, char** argv)
+{
+	int count = (argc > 1)? atoi(argv[1]) : 1000000;
+	if(count < 1000)
+	{
+		printf("usage: %s [samples, at least 1000]\n", argv[0]);
+		return 1;
+	}
+
+	float* values = new float[count];
+	long* integers = new long[count];
+	rng::Stream stream;
+	rng::seed_stream(&stream, 1234);
+
+	printf("distributions, %d samples each:\n", count);
+
+	rng::uniform_fill(values, count, 0.0f, 1.0f, &stream);
+	check_moments("uniform", values, count, 0.5, 1.0 / 12.0, 1.0 / 80.0);
+	check_distribution("uniform", values, count, uniform_cdf);
+
+	rng::gaussian_fill(values, count, 0.0f, 1.0f, &stream);
+	check_moments("gaussian", values, count, 0.0, 1.0, 3.0);
+	check_distribution("gaussian", values, count, normal_cdf);
+
+	rng::exponential_fill(values, count, 2.0f, &stream);
+	check_moments("exponential", values, count, 0.5, 0.25, 9.0 / 16.0);
+	check_distribution("exponential", values, count, exponential_cdf);
+
+	// a Cauchy distribution has no mean or variance to check
+	rng::cauchy_fill(values, count, 0.0f, 1.0f, &stream);
+	check_distribution("cauchy", values, count, cauchy_cdf);
+
+	rng::poisson_fill(integers, count, 4.0, &stream);
+	check_poisson("poisson 4", integers, count, 4.0);
+	rng::poisson_fill(integers, count, 50.0, &stream);
+	check_poisson("poisson 50", integers, count, 50.0);
+
+	printf("timing, %d samples each:\n", count);
+
+	double start = Timer::GetTime();
+	rng::uniform_fill(values, count, 0.0f, 1.0f, &stream);
+	double fill = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) values[i] = float(rng::uniform_real(&stream));
+	print_time("uniform", fill, Timer::GetTime() - start);
+
+	start = Timer::GetTime();
+	rng::gaussian_fill(values, count, 0.0f, 1.0f, &stream);
+	fill = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) values[i] = float(rng::gaussian(0.0, 1.0, &stream));
+	print_time("gaussian", fill, Timer::GetTime() - start);
+
+	start = Timer::GetTime();
+	rng::exponential_fill(values, count, 2.0f, &stream);
+	fill = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) values[i] = float(rng::exponential(2.0, &stream));
+	print_time("exponential", fill, Timer::GetTime() - start);
+
+	start = Timer::GetTime();
+	rng::cauchy_fill(values, count, 0.0f, 1.0f, &stream);
+	fill = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) values[i] = float(rng::cauchy(0.0, 1.0, &stream));
+	print_time("cauchy", fill, Timer::GetTime() - start);
+
+	start = Timer::GetTime();
+	rng::poisson_fill(integers, count, 4.0, &stream);
+	fill = Timer::GetTime() - start;
+	start = Timer::GetTime();
+	for(int i = 0; i < count; ++i) integers[i] = rng::poisson(4.0, &stream);
+	print_time("poisson 4", fill, Timer::GetTime() - start);
+
+	delete[] values;
+	delete[] integers;
+
+	if(failures > 0) printf("%d checks failed\n", failures);
+	return (failures > 0)? 1 : 0;
+}
@@ -0,0 +1,140 @@
+// Times the rigid body solver on a stacking scene and a pile scene at a range
+// of thread counts, without opening a window.
+//
+//     RigidBodyBench
+//     RigidBodyBench 1 2 4 8
+//
+// The stacking scene is a grid of eight-box towers, about as tall as stays
+// still enough to fall asleep with the default ten iterations. The pile scene
+// is a grid of pyramids with a thousand spheres and boxes dropped on them,
+// which knocks them about and keeps islands merging and waking. Speed is given
+// as bodies stepped per millisecond, and every thread count should end up
+// with exactly the same bodies in exactly the same places, since islands are
+// solved in the same order however they were spread across threads.
+
+#include "../utilities/RigidBodies.h"
+#include "../utilities/Timer.h"
+
+#include "../utilities/concurrent/JobPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const int NUM_STEPS = 300;
+static const float TIME_STEP = 1.0f / 60.0f;
+
+static void build_stacks(RigidBodyWorld& world)
+{
+	world.AddBox(vec3(0.0f, -1.0f, 0.0f), QUAT_I, vec3(100.0f, 1.0f, 100.0f), 0.0f);
+	for(int x = 0; x < 16; ++x)
+	{
+		for(int z = 0; z < 16; ++z)
+		{
+			for(int i = 0; i < 8; ++i)
+			{
+				vec3 position(x * 3.0f - 24.0f, 0.5f + i, z * 3.0f - 24.0f);
+				world.AddBox(position, QUAT_I, vec3(0.5f, 0.5f, 0.5f), 1.0f);
+			}
+		}
+	}
+}
+
+static void build_pile(RigidBodyWorld& world)
+{
+	world.AddBox(vec3(0.0f, -1.0f, 0.0f), QUAT_I, vec3(100.0f, 1.0f, 100.0f), 0.0f);
+
+	// pyramids of 15 boxes, five on a side at the bottom
+	for(int x = 0; x < 8; ++x)
+	{
+		for(int z = 0; z < 8; ++z)
+		{
+			for(int row = 0; row < 5; ++row)
+			{
+				for(int i = 0; i < 5 - row; ++i)
+				{
+					vec3 position(x * 8.0f - 28.0f + i * 1.05f + row * 0.525f, 0.5f + row, z * 8.0f - 28.0f);
+					world.AddBox(position, QUAT_I, vec3(0.5f, 0.5f, 0.5f), 1.0f);
+				}
+			}
+		}
+	}
+
+	// and things falling on them, every other one a sphere
+	for(int i = 0; i < 1000; ++i)
+	{
+		vec3 position((i % 20) * 3.0f - 30.0f, 8.0f + (i / 400) * 3.0f, ((i / 20) % 20) * 3.0f - 30.0f);
+		if(i & 1) world.AddSphere(position, 0.5f, 1.0f);
+		else world.AddBox(position, QUAT_I, vec3(0.4f, 0.4f, 0.4f), 1.0f);
+	}
+}
+
+struct Result
+{
+	double time;
+	int bodies;
+	int awake;
+	vec3* positions;
+};
+
+static Result run(void (*build)(RigidBodyWorld&), JobPool* pool)
+{
+	RigidBodyWorld world;
+	build(world);
+
+	double start = Timer::GetTime();
+	for(int i = 0; i < NUM_STEPS; ++i)
+		world.Step(TIME_STEP, pool);
+
+	Result result;
+	result.time = Timer::GetTime() - start;
+	result.bodies = world.GetBodyCount();
+	result.awake = 0;
+	result.positions = new vec3[result.bodies];
+	for(int i = 0; i < result.bodies; ++i)
+	{
+		result.positions[i] = world.GetPosition(i);
+		if(world.IsAwake(i)) result.awake++;
+	}
+	return result;
+}
+
+static void bench(const char* name, void (*build)(RigidBodyWorld&), const int* threadCounts, int numThreadCounts)
+{
+	printf("%s:\n", name);
+	vec3* first = nullptr;
+	for(int i = 0; i < numThreadCounts; ++i)
+	{
+		JobPool pool(threadCounts[i]);
+		Result result = run(build, &pool);
+
+		bool same = true;
+		if(first) same = memcmp(first, result.positions, sizeof(vec3) * result.bodies) == 0;
+		printf("  %d threads  %7.1f bodies/ms  %.1f ms a step  %d of %d bodies awake%s\n",
+			pool.GetThreadCount(), result.bodies * NUM_STEPS / result.time, result.time / NUM_STEPS,
+			result.awake, result.bodies, same? "" : "  DIFFERENT RESULT");
+
+		if(first) delete[] result.positions;
+		else first = result.positions;
+	}
+	delete[] first;
+}
+
+int main(int argc, char** argv)
+{
+	int threadCounts[16] = { 1, 2, 4, 8 };
+	int numThreadCounts = 4;
+	if(argc > 1)
+	{
+		numThreadCounts = 0;
+		for(int i = 1; i < argc && numThreadCounts < 16; ++i)
+		{
+			int count = atoi(argv[i]);
+			if(count > 0) threadCounts[numThreadCounts++] = count;
+		}
+	}
+
+	bench("stacks", build_stacks, threadCounts, numThreadCounts);
+	bench("pile", build_pile, threadCounts, numThreadCounts);
+	return 0;
+}
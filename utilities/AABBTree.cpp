@@ -0,0 +1,422 @@
+#include "AABBTree.h"
+
+#include "NumberMacros.h"
+
+#include <assert.h>
+
+// velocity is scaled by this to predict where a moving proxy is headed
+static const float DISPLACEMENT_MULTIPLIER = 4.0f;
+
+static inline vec3 min3(const vec3& a, const vec3& b)
+{
+	return vec3(MIN(a.x, b.x), MIN(a.y, b.y), MIN(a.z, b.z));
+}
+
+static inline vec3 max3(const vec3& a, const vec3& b)
+{
+	return vec3(MAX(a.x, b.x), MAX(a.y, b.y), MAX(a.z, b.z));
+}
+
+static inline float surface_area(const vec3& min, const vec3& max)
+{
+	vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+AABBTree::AABBTree(int initialCapacity, float margin):
+	nodeCapacity(initialCapacity),
+	nodeCount(0),
+	freeList(0),
+	root(NULL_NODE),
+	proxyCount(0),
+	margin(margin)
+{
+	nodes = new Node[nodeCapacity];
+
+	// link all nodes into the free list
+	for(int i = 0; i < nodeCapacity - 1; ++i)
+	{
+		nodes[i].next = i + 1;
+		nodes[i].height = -1;
+	}
+	nodes[nodeCapacity - 1].next = NULL_NODE;
+	nodes[nodeCapacity - 1].height = -1;
+}
+
+AABBTree::~AABBTree()
+{
+	delete[] nodes;
+}
+
+int AABBTree::AllocateNode()
+{
+	// grow the node pool when the free list runs dry
+	if(freeList == NULL_NODE)
+	{
+		Node* oldNodes = nodes;
+		int oldCapacity = nodeCapacity;
+
+		nodeCapacity *= 2;
+		nodes = new Node[nodeCapacity];
+		for(int i = 0; i < oldCapacity; ++i)
+			nodes[i] = oldNodes[i];
+		delete[] oldNodes;
+
+		for(int i = oldCapacity; i < nodeCapacity - 1; ++i)
+		{
+			nodes[i].next = i + 1;
+			nodes[i].height = -1;
+		}
+		nodes[nodeCapacity - 1].next = NULL_NODE;
+		nodes[nodeCapacity - 1].height = -1;
+		freeList = oldCapacity;
+	}
+
+	int index = freeList;
+	Node& node = nodes[index];
+	freeList = node.next;
+
+	node.parent = NULL_NODE;
+	node.children[0] = NULL_NODE;
+	node.children[1] = NULL_NODE;
+	node.height = 0;
+	node.userData = nullptr;
+	node.moved = false;
+	++nodeCount;
+
+	return index;
+}
+
+void AABBTree::FreeNode(int index)
+{
+	assert(0 <= index && index < nodeCapacity);
+
+	nodes[index].next = freeList;
+	nodes[index].height = -1;
+	freeList = index;
+	--nodeCount;
+}
+
+int AABBTree::CreateProxy(const AABB& aabb, void* userData)
+{
+	int proxy = AllocateNode();
+
+	Node& node = nodes[proxy];
+	node.min = aabb.center - aabb.extents - margin;
+	node.max = aabb.center + aabb.extents + margin;
+	node.userData = userData;
+	node.moved = true;
+
+	InsertLeaf(proxy);
+	moveBuffer.Push(proxy);
+	++proxyCount;
+
+	return proxy;
+}
+
+void AABBTree::DestroyProxy(int proxy)
+{
+	assert(nodes[proxy].IsLeaf());
+
+	// a destroyed proxy can't take part in any new pairs
+	for(size_t i = 0, n = moveBuffer.Count(); i < n; ++i)
+	{
+		if(moveBuffer[i] == proxy)
+			moveBuffer[i] = NULL_NODE;
+	}
+
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	--proxyCount;
+}
+
+bool AABBTree::MoveProxy(int proxy, const AABB& aabb, const vec3& displacement)
+{
+	Node& node = nodes[proxy];
+
+	vec3 min = aabb.center - aabb.extents;
+	vec3 max = aabb.center + aabb.extents;
+
+	// nothing to do while the proxy stays inside its fat bounds
+	if(node.min.x <= min.x && node.min.y <= min.y && node.min.z <= min.z
+	&& max.x <= node.max.x && max.y <= node.max.y && max.z <= node.max.z)
+		return false;
+
+	RemoveLeaf(proxy);
+
+	// extend the fat bounds in the direction of travel
+	vec3 d = DISPLACEMENT_MULTIPLIER * displacement;
+	min -= margin;
+	max += margin;
+	if(d.x < 0.0f) min.x += d.x; else max.x += d.x;
+	if(d.y < 0.0f) min.y += d.y; else max.y += d.y;
+	if(d.z < 0.0f) min.z += d.z; else max.z += d.z;
+
+	nodes[proxy].min = min;
+	nodes[proxy].max = max;
+
+	InsertLeaf(proxy);
+
+	if(!nodes[proxy].moved)
+	{
+		nodes[proxy].moved = true;
+		moveBuffer.Push(proxy);
+	}
+
+	return true;
+}
+
+AABB AABBTree::GetFatAABB(int proxy) const
+{
+	const Node& node = nodes[proxy];
+
+	AABB aabb;
+	aabb.center = (node.min + node.max) * 0.5f;
+	aabb.extents = (node.max - node.min) * 0.5f;
+	return aabb;
+}
+
+int AABBTree::GetHeight() const
+{
+	return (root == NULL_NODE) ? 0 : nodes[root].height;
+}
+
+void AABBTree::UpdatePairs(AutoArray<ProxyPair>& pairs)
+{
+	struct PairCallback
+	{
+		const Node* nodes;
+		AutoArray<ProxyPair>* pairs;
+		int queryProxy;
+
+		bool operator()(int proxy)
+		{
+			if(proxy == queryProxy) return true;
+
+			// when both proxies moved, only the higher-numbered query reports it
+			if(proxy > queryProxy && nodes[proxy].moved) return true;
+
+			ProxyPair pair;
+			pair.proxyA = MIN(proxy, queryProxy);
+			pair.proxyB = MAX(proxy, queryProxy);
+			pairs->Push(pair);
+			return true;
+		}
+	};
+
+	PairCallback callback;
+	callback.nodes = nodes;
+	callback.pairs = &pairs;
+
+	for(size_t i = 0, n = moveBuffer.Count(); i < n; ++i)
+	{
+		int proxy = moveBuffer[i];
+		if(proxy == NULL_NODE) continue;
+
+		callback.queryProxy = proxy;
+		QueryAABB(GetFatAABB(proxy), callback);
+	}
+
+	for(size_t i = 0, n = moveBuffer.Count(); i < n; ++i)
+	{
+		int proxy = moveBuffer[i];
+		if(proxy != NULL_NODE)
+			nodes[proxy].moved = false;
+	}
+	moveBuffer.Clear();
+}
+
+void AABBTree::InsertLeaf(int leaf)
+{
+	if(root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[root].parent = NULL_NODE;
+		return;
+	}
+
+	// descend to the sibling which gives the cheapest tree by the surface
+	// area heuristic, where every ancestor pays for the enlarged bounds
+	vec3 leafMin = nodes[leaf].min;
+	vec3 leafMax = nodes[leaf].max;
+
+	int index = root;
+	while(!nodes[index].IsLeaf())
+	{
+		const Node& node = nodes[index];
+		int child0 = node.children[0];
+		int child1 = node.children[1];
+
+		float area = surface_area(node.min, node.max);
+		float combinedArea = surface_area(min3(node.min, leafMin), max3(node.max, leafMax));
+
+		// cost of making a new parent for this node and the leaf
+		float cost = 2.0f * combinedArea;
+
+		// minimum cost of pushing the leaf further down the tree
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		for(int i = 0; i < 2; ++i)
+		{
+			const Node& child = nodes[node.children[i]];
+			float enlarged = surface_area(min3(child.min, leafMin), max3(child.max, leafMax));
+			if(child.IsLeaf())
+				childCosts[i] = enlarged + inheritanceCost;
+			else
+				childCosts[i] = (enlarged - surface_area(child.min, child.max)) + inheritanceCost;
+		}
+
+		if(cost < childCosts[0] && cost < childCosts[1])
+			break;
+
+		index = (childCosts[0] < childCosts[1]) ? child0 : child1;
+	}
+	int sibling = index;
+
+	// create a new parent for the leaf and its sibling
+	int oldParent = nodes[sibling].parent;
+	int newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].min = min3(leafMin, nodes[sibling].min);
+	nodes[newParent].max = max3(leafMax, nodes[sibling].max);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].children[0] = sibling;
+	nodes[newParent].children[1] = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if(oldParent != NULL_NODE)
+	{
+		if(nodes[oldParent].children[0] == sibling)
+			nodes[oldParent].children[0] = newParent;
+		else
+			nodes[oldParent].children[1] = newParent;
+	}
+	else
+	{
+		root = newParent;
+	}
+
+	// walk back up the tree fixing bounds and heights
+	Refit(nodes[leaf].parent);
+}
+
+void AABBTree::RemoveLeaf(int leaf)
+{
+	if(leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	int parent = nodes[leaf].parent;
+	int grandParent = nodes[parent].parent;
+	int sibling = (nodes[parent].children[0] == leaf) ? nodes[parent].children[1] : nodes[parent].children[0];
+
+	if(grandParent != NULL_NODE)
+	{
+		// destroy the parent and connect the sibling to the grandparent
+		if(nodes[grandParent].children[0] == parent)
+			nodes[grandParent].children[0] = sibling;
+		else
+			nodes[grandParent].children[1] = sibling;
+		nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+
+		Refit(grandParent);
+	}
+	else
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+		FreeNode(parent);
+	}
+}
+
+void AABBTree::Refit(int index)
+{
+	while(index != NULL_NODE)
+	{
+		Rotate(index);
+
+		Node& node = nodes[index];
+		const Node& child0 = nodes[node.children[0]];
+		const Node& child1 = nodes[node.children[1]];
+
+		node.min = min3(child0.min, child1.min);
+		node.max = max3(child0.max, child1.max);
+		node.height = 1 + MAX(child0.height, child1.height);
+
+		index = node.parent;
+	}
+}
+
+void AABBTree::Rotate(int index)
+{
+	// For a node A with children B and C, where B has children D and E and C
+	// has children F and G, tries swapping one child of A with one of its
+	// grandchildren on the other side. A swap is taken when it shrinks the surface area of the internal
+	// node it changes, since A's own bounds are the same regardless.
+
+	Node& a = nodes[index];
+	int b = a.children[0];
+	int c = a.children[1];
+
+	enum Rotation { NONE, B_F, B_G, C_D, C_E };
+	Rotation best = NONE;
+	float bestReduction = 0.0f;
+
+	if(!nodes[c].IsLeaf())
+	{
+		int f = nodes[c].children[0];
+		int g = nodes[c].children[1];
+		float areaC = surface_area(nodes[c].min, nodes[c].max);
+
+		float reduction = areaC - surface_area(min3(nodes[b].min, nodes[g].min), max3(nodes[b].max, nodes[g].max));
+		if(reduction > bestReduction) { best = B_F; bestReduction = reduction; }
+
+		reduction = areaC - surface_area(min3(nodes[b].min, nodes[f].min), max3(nodes[b].max, nodes[f].max));
+		if(reduction > bestReduction) { best = B_G; bestReduction = reduction; }
+	}
+
+	if(!nodes[b].IsLeaf())
+	{
+		int d = nodes[b].children[0];
+		int e = nodes[b].children[1];
+		float areaB = surface_area(nodes[b].min, nodes[b].max);
+
+		float reduction = areaB - surface_area(min3(nodes[c].min, nodes[e].min), max3(nodes[c].max, nodes[e].max));
+		if(reduction > bestReduction) { best = C_D; bestReduction = reduction; }
+
+		reduction = areaB - surface_area(min3(nodes[c].min, nodes[d].min), max3(nodes[c].max, nodes[d].max));
+		if(reduction > bestReduction) { best = C_E; bestReduction = reduction; }
+	}
+
+	// swap child 'outer' of A with grandchild slot 'slot' of 'inner'
+	int outer, inner, slot;
+	switch(best)
+	{
+		default:
+		case NONE: return;
+		case B_F: outer = 0; inner = c; slot = 0; break;
+		case B_G: outer = 0; inner = c; slot = 1; break;
+		case C_D: outer = 1; inner = b; slot = 0; break;
+		case C_E: outer = 1; inner = b; slot = 1; break;
+	}
+
+	int swappedOut = a.children[outer];
+	int swappedIn = nodes[inner].children[slot];
+
+	a.children[outer] = swappedIn;
+	nodes[swappedIn].parent = index;
+	nodes[inner].children[slot] = swappedOut;
+	nodes[swappedOut].parent = inner;
+
+	Node& changed = nodes[inner];
+	const Node& child0 = nodes[changed.children[0]];
+	const Node& child1 = nodes[changed.children[1]];
+	changed.min = min3(child0.min, child1.min);
+	changed.max = max3(child0.max, child1.max);
+	changed.height = 1 + MAX(child0.height, child1.height);
+}
@@ -0,0 +1,240 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+
+#include "Collision.h"
+
+#include "collections/AutoArray.h"
+
+#include <math.h>
+
+// Dynamic bounding volume hierarchy used as a broadphase. Leaves hold "fat"
+// boxes enlarged by a margin, so a proxy is only reinserted once its real
+// bounds leave the fat box. Insertion uses the surface area heuristic and
+// tree rotations keep the hierarchy tight as proxies move around.
+
+class AABBTree
+{
+public:
+	static const int NULL_NODE = -1;
+
+	explicit AABBTree(int initialCapacity = 64, float margin = 0.1f);
+	~AABBTree();
+
+	int CreateProxy(const AABB& aabb, void* userData);
+	void DestroyProxy(int proxy);
+	bool MoveProxy(int proxy, const AABB& aabb, const vec3& displacement);
+
+	void* GetUserData(int proxy) const { return nodes[proxy].userData; }
+	AABB GetFatAABB(int proxy) const;
+	int GetHeight() const;
+	int GetProxyCount() const { return proxyCount; }
+
+	// reports each overlapping pair involving a proxy that was created or
+	// moved since the last call, then clears the moved flags
+	void UpdatePairs(AutoArray<ProxyPair>& pairs);
+
+	// functor is called as callback(int proxy) and returns false to stop
+	template<typename QueryCallback>
+	void QueryAABB(const AABB& aabb, QueryCallback& callback) const;
+
+	template<typename QueryCallback>
+	void QueryFrustum(const Frustum& frustum, QueryCallback& callback) const;
+
+	// functor is called as callback(int proxy, float maxDistance) and returns
+	// the new max distance to clip the ray, or zero to stop the query
+	template<typename RayCallback>
+	void QueryRay(const vec3& origin, const vec3& direction, float maxDistance, RayCallback& callback) const;
+
+private:
+	struct Node
+	{
+		vec3 min, max;
+		void* userData;
+		union
+		{
+			int parent;
+			int next;
+		};
+		int children[2];
+		int height; // leaf = 0, free node = -1
+		bool moved;
+
+		bool IsLeaf() const { return children[0] == NULL_NODE; }
+	};
+
+	// traversal stack which spills to the heap for unusually deep trees
+	class NodeStack
+	{
+	public:
+		NodeStack(): data(buffer), count(0), capacity(STACK_CAPACITY) {}
+		~NodeStack() { if(data != buffer) delete[] data; }
+
+		bool IsEmpty() const { return count == 0; }
+		int Pop() { return data[--count]; }
+		void Push(int index)
+		{
+			if(count == capacity)
+			{
+				int* grown = new int[capacity * 2];
+				for(int i = 0; i < count; ++i) grown[i] = data[i];
+				if(data != buffer) delete[] data;
+				data = grown;
+				capacity *= 2;
+			}
+			data[count++] = index;
+		}
+
+	private:
+		static const int STACK_CAPACITY = 128;
+		int buffer[STACK_CAPACITY];
+		int* data;
+		int count, capacity;
+	};
+
+	Node* nodes;
+	int nodeCapacity;
+	int nodeCount;
+	int freeList;
+	int root;
+	int proxyCount;
+	float margin;
+
+	AutoArray<int> moveBuffer;
+
+	AABBTree(const AABBTree&);
+	AABBTree& operator = (const AABBTree&);
+
+	int AllocateNode();
+	void FreeNode(int index);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	void Refit(int index);
+	void Rotate(int index);
+
+	static bool Overlaps(const Node& node, const vec3& min, const vec3& max)
+	{
+		return node.min.x <= max.x && node.max.x >= min.x
+		    && node.min.y <= max.y && node.max.y >= min.y
+		    && node.min.z <= max.z && node.max.z >= min.z;
+	}
+};
+
+template<typename QueryCallback>
+void AABBTree::QueryAABB(const AABB& aabb, QueryCallback& callback) const
+{
+	if(root == NULL_NODE) return;
+
+	vec3 min = aabb.center - aabb.extents;
+	vec3 max = aabb.center + aabb.extents;
+
+	NodeStack stack;
+	stack.Push(root);
+	while(!stack.IsEmpty())
+	{
+		const Node& node = nodes[stack.Pop()];
+		if(!Overlaps(node, min, max)) continue;
+
+		if(node.IsLeaf())
+		{
+			if(!callback(int(&node - nodes))) return;
+		}
+		else
+		{
+			stack.Push(node.children[0]);
+			stack.Push(node.children[1]);
+		}
+	}
+}
+
+template<typename QueryCallback>
+void AABBTree::QueryFrustum(const Frustum& frustum, QueryCallback& callback) const
+{
+	if(root == NULL_NODE) return;
+
+	vec3 absPlaneNormals[6];
+	for(int i = 0; i < 6; ++i)
+	{
+		absPlaneNormals[i].x = fabs(frustum.planeNormals[i].x);
+		absPlaneNormals[i].y = fabs(frustum.planeNormals[i].y);
+		absPlaneNormals[i].z = fabs(frustum.planeNormals[i].z);
+	}
+
+	// the low bits of each stack entry flag a subtree already known to be
+	// fully inside the frustum, which skips the plane tests below it
+	NodeStack stack;
+	stack.Push(root << 1);
+	while(!stack.IsEmpty())
+	{
+		int entry = stack.Pop();
+		const Node& node = nodes[entry >> 1];
+		bool inside = entry & 1;
+
+		if(!inside)
+		{
+			vec3 center = (node.min + node.max) * 0.5f;
+			vec3 extents = (node.max - node.min) * 0.5f;
+
+			bool culled = false;
+			inside = true;
+			for(int i = 0; i < 6; ++i)
+			{
+				float d = dot(center, frustum.planeNormals[i]);
+				float r = dot(extents, absPlaneNormals[i]);
+				if(d + r < frustum.planeDots[i])
+				{
+					culled = true;
+					break;
+				}
+				if(d - r < frustum.planeDots[i])
+					inside = false;
+			}
+			if(culled) continue;
+		}
+
+		if(node.IsLeaf())
+		{
+			if(!callback(entry >> 1)) return;
+		}
+		else
+		{
+			stack.Push(node.children[0] << 1 | inside);
+			stack.Push(node.children[1] << 1 | inside);
+		}
+	}
+}
+
+template<typename RayCallback>
+void AABBTree::QueryRay(const vec3& origin, const vec3& direction, float maxDistance, RayCallback& callback) const
+{
+	if(root == NULL_NODE) return;
+
+	vec3 inverse = 1.0f / direction;
+
+	NodeStack stack;
+	stack.Push(root);
+	while(!stack.IsEmpty())
+	{
+		int index = stack.Pop();
+		const Node& node = nodes[index];
+
+		// slab test against the node bounds
+		vec3 t0 = (node.min - origin) * inverse;
+		vec3 t1 = (node.max - origin) * inverse;
+		float tNear = fmax(fmax(fmin(t0.x, t1.x), fmin(t0.y, t1.y)), fmin(t0.z, t1.z));
+		float tFar = fmin(fmin(fmax(t0.x, t1.x), fmax(t0.y, t1.y)), fmax(t0.z, t1.z));
+		if(tNear > tFar || tFar < 0.0f || tNear > maxDistance) continue;
+
+		if(node.IsLeaf())
+		{
+			maxDistance = callback(index, maxDistance);
+			if(maxDistance <= 0.0f) return;
+		}
+		else
+		{
+			stack.Push(node.children[0]);
+			stack.Push(node.children[1]);
+		}
+	}
+}
+
+#endif
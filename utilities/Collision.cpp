@@ -1,8 +1,11 @@
 #include "Collision.h"
 
 #include "Maths.h"
+#include "NumberMacros.h"
+#include "Sorting.h"
 
 #include <math.h>
+#include <float.h>
 
 enum FrustumPlanes
 {
@@ -86,6 +89,32 @@ static vec3 get_forward_axis(const quaternion& q)
 	        1 - 2 * (q.x * q.x + q.y * q.y));
 }
 
+AABB compute_bounds(const OBB& obb)
+{
+	AABB aabb;
+	aabb.center = obb.center;
+	aabb.extents = VEC3_ZERO;
+	for(int i = 0; i < 3; ++i)
+	{
+		float e = (i == 0) ? obb.extents.x : (i == 1) ? obb.extents.y : obb.extents.z;
+		aabb.extents.x += fabs(obb.axes[i].x) * e;
+		aabb.extents.y += fabs(obb.axes[i].y) * e;
+		aabb.extents.z += fabs(obb.axes[i].z) * e;
+	}
+	return aabb;
+}
+
+OBB make_obb(vec3 position, quaternion orientation, vec3 dimensions)
+{
+	OBB obb;
+	obb.center = position;
+	obb.extents = dimensions / 2.0f;
+	obb.axes[0] = get_right_axis(orientation);
+	obb.axes[1] = get_up_axis(orientation);
+	obb.axes[2] = get_forward_axis(orientation);
+	return obb;
+}
+
 bool intersect_point_rect(vec2 point, int x, int y, int width, int height)
 {
 	return point.x > x
@@ -326,25 +355,25 @@ bool intersect_obb_obb(const OBB& obbA, const OBB& obbB)
 	return true;
 }
 
-/*
 bool intersect_obb_sphere(const OBB& obb, const Sphere& sphere)
 {
 	const vec3 diff = sphere.position - obb.center;
+	const float extents[3] = { obb.extents.x, obb.extents.y, obb.extents.z };
 
 	vec3 pointOnOBB = VEC3_ZERO;
 	for(int i = 0; i < 3; i++)
 	{
 		float dist = dot(diff, obb.axes[i]);
 
-		if(dist > obb.extents[i]) dist = obb.extents[i];
-		if(dist < -obb.extents[i]) dist = -obb.extents[i];
+		if(dist > extents[i]) dist = extents[i];
+		if(dist < -extents[i]) dist = -extents[i];
 
 		pointOnOBB += dist * obb.axes[i];
 	}
 
-	return length(pointOnOBB + obb.center - sphere.position) < sphere.radius;
+	vec3 d = pointOnOBB + obb.center - sphere.position;
+	return dot(d, d) < sphere.radius * sphere.radius;
 }
-*/
 
 bool intersect_point_frustum(const vec3& point, const Frustum& frustum)
 {
@@ -514,273 +543,1234 @@ bool intersect_ray_triangle(vec3 orig, vec3 dir, vec3 vert0, vec3 vert1, vec3 ve
 	return true;
 }
 
-struct Simplex
+vec3 closest_point_on_triangle(const vec3& point, const vec3& a, const vec3& b, const vec3& c)
 {
-	vec3 points[4];
-	int numPoints;
-};
+	// checks the voronoi regions of the triangle's vertices, then its edges,
+	// and falls through to projecting onto the face
 
-#define SAME_DIRECTION(point) dot((point), aO) > 0
+	vec3 ab = b - a;
+	vec3 ac = c - a;
+	vec3 ap = point - a;
+	float d1 = dot(ab, ap);
+	float d2 = dot(ac, ap);
+	if(d1 <= 0.0f && d2 <= 0.0f) return a;
+
+	vec3 bp = point - b;
+	float d3 = dot(ab, bp);
+	float d4 = dot(ac, bp);
+	if(d3 >= 0.0f && d4 <= d3) return b;
+
+	float vc = d1 * d4 - d3 * d2;
+	if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+		return a + (d1 / (d1 - d3)) * ab;
+
+	vec3 cp = point - c;
+	float d5 = dot(ab, cp);
+	float d6 = dot(ac, cp);
+	if(d6 >= 0.0f && d5 <= d6) return c;
+
+	float vb = d5 * d2 - d1 * d6;
+	if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+		return a + (d2 / (d2 - d6)) * ac;
+
+	float va = d3 * d6 - d5 * d4;
+	if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+		return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
 
-bool enclose_line(Simplex* simplex, vec3* searchDirection)
+float closest_points_segment_segment(const vec3& p1, const vec3& q1, const vec3& p2, const vec3& q2, vec3* c1, vec3* c2)
 {
-	vec3 a = simplex->points[1];
-	vec3 b = simplex->points[0];
-	vec3 aO = -a;
-	vec3 ab = b - a;
-	if(SAME_DIRECTION(ab))
+	// returns the squared distance between the segments p1q1 and p2q2
+
+	const float epsilon = 1.0e-6f;
+
+	vec3 d1 = q1 - p1;
+	vec3 d2 = q2 - p2;
+	vec3 r = p1 - p2;
+	float a = dot(d1, d1);
+	float e = dot(d2, d2);
+	float f = dot(d2, r);
+
+	float s, t;
+	if(a <= epsilon && e <= epsilon)
+	{
+		s = t = 0.0f;
+	}
+	else if(a <= epsilon)
 	{
-		*searchDirection = triple_product(ab, aO, ab);
+		s = 0.0f;
+		t = clamp(f / e, 0.0f, 1.0f);
 	}
 	else
 	{
-		simplex->points[0] = a;
-		simplex->numPoints = 1;
+		float c = dot(d1, r);
+		if(e <= epsilon)
+		{
+			t = 0.0f;
+			s = clamp(-c / a, 0.0f, 1.0f);
+		}
+		else
+		{
+			float b = dot(d1, d2);
+			float denom = a * e - b * b;
+
+			// parallel segments pick an arbitrary s
+			s = (denom != 0.0f) ? clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
 
-		*searchDirection = aO;
+			t = (b * s + f) / e;
+			if(t < 0.0f)
+			{
+				t = 0.0f;
+				s = clamp(-c / a, 0.0f, 1.0f);
+			}
+			else if(t > 1.0f)
+			{
+				t = 1.0f;
+				s = clamp((b - c) / a, 0.0f, 1.0f);
+			}
+		}
 	}
-	return false;
+
+	*c1 = p1 + d1 * s;
+	*c2 = p2 + d2 * t;
+	vec3 d = *c1 - *c2;
+	return dot(d, d);
 }
 
-bool enclose_triangle(Simplex* simplex, vec3* searchDirection)
+float closest_points_segment_triangle(const vec3& p, const vec3& q, const vec3& a, const vec3& b, const vec3& c, vec3* onSegment, vec3* onTriangle)
 {
-	vec3 a = simplex->points[2];
-	vec3 b = simplex->points[1];
-	vec3 c = simplex->points[0];
+	// returns the squared distance between the segment pq and the triangle
 
-	vec3 ab = b - a;
-	vec3 ac = c - a;
-	vec3 abc = cross(ab, ac);
+	// a segment piercing the triangle touches it
+	vec3 hit;
+	vec3 pq = q - p;
+	if(intersect_ray_triangle(p, pq, a, b, c, &hit) && dot(hit - p, pq) >= 0.0f && dot(hit - q, pq) <= 0.0f)
+	{
+		*onSegment = hit;
+		*onTriangle = hit;
+		return 0.0f;
+	}
+
+	// otherwise the closest feature pair involves an endpoint or an edge
+	*onSegment = p;
+	*onTriangle = closest_point_on_triangle(p, a, b, c);
+	vec3 d = *onTriangle - p;
+	float best = dot(d, d);
 
-	vec3 aO = -a;
-	vec3 acEdgeNormal = cross(abc, ac);
-	// if origin is outside edge ac
-	if(SAME_DIRECTION(acEdgeNormal))
+	vec3 candidate = closest_point_on_triangle(q, a, b, c);
+	d = candidate - q;
+	if(dot(d, d) < best)
 	{
-		// if origin is towards c, it cannot be outside ab
-		if(SAME_DIRECTION(ac))
+		best = dot(d, d);
+		*onSegment = q;
+		*onTriangle = candidate;
+	}
+
+	const vec3* edges[3][2] = { { &a, &b }, { &b, &c }, { &c, &a } };
+	for(int i = 0; i < 3; ++i)
+	{
+		vec3 c1, c2;
+		float distance = closest_points_segment_segment(p, q, *edges[i][0], *edges[i][1], &c1, &c2);
+		if(distance < best)
 		{
-			simplex->points[1] = a;
-			simplex->numPoints = 2;
-			
-			*searchDirection = triple_product(ac, aO, ac);
+			best = distance;
+			*onSegment = c1;
+			*onTriangle = c2;
 		}
-		else
-		{
-			// if outside ab, check whether ab or a is closest
-			simplex->points[0] = b;
-			simplex->points[1] = a;
-			simplex->numPoints = 2;
+	}
+	return best;
+}
+
+static bool get_lowest_root(float a, float b, float c, float maxRoot, float* root)
+{
+	float determinant = b * b - 4.0f * a * c;
+	if(determinant < 0.0f || a == 0.0f) return false;
+
+	float sqrtD = sqrt(determinant);
+	float r1 = (-b - sqrtD) / (2.0f * a);
+	float r2 = (-b + sqrtD) / (2.0f * a);
+	if(r1 > r2)
+	{
+		float temp = r2;
+		r2 = r1;
+		r1 = temp;
+	}
 
-			return enclose_line(simplex, searchDirection);
+	if(r1 > 0.0f && r1 < maxRoot)
+	{
+		*root = r1;
+		return true;
+	}
+	if(r2 > 0.0f && r2 < maxRoot)
+	{
+		*root = r2;
+		return true;
+	}
+	return false;
+}
+
+bool sweep_sphere_triangle(const Sphere& sphere, const vec3& motion, const vec3& a, const vec3& b, const vec3& c,
+	float* t, vec3* point, vec3* normal)
+{
+	// finds the earliest time in [0, 1] the sphere moving by motion touches
+	// the triangle, first against the face and then against its vertices
+	// and edges, after Fauerby's "Improved Collision detection and Response"
+
+	vec3 center = sphere.position;
+	float r = sphere.radius;
+
+	vec3 n = cross(b - a, c - a);
+	float area = length(n);
+	if(area < 1.0e-12f) return false;
+	n /= area;
+
+	// treat the triangle as two-sided, facing the sphere
+	float distance = dot(center - a, n);
+	if(distance < 0.0f)
+	{
+		n = -n;
+		distance = -distance;
+	}
+
+	// already touching
+	if(distance <= r)
+	{
+		vec3 closest = closest_point_on_triangle(center, a, b, c);
+		vec3 d = center - closest;
+		float distanceSquared = dot(d, d);
+		if(distanceSquared <= r * r)
+		{
+			*t = 0.0f;
+			*point = closest;
+			*normal = (distanceSquared > 1.0e-12f) ? d / sqrt(distanceSquared) : n;
+			return true;
 		}
 	}
-	// else, origin must be either in triangle or outside edge ab
-	else
+
+	float approach = dot(n, motion);
+	if(distance > r && approach >= 0.0f) return false;
+
+	float tFirst = 1.0f;
+	bool found = false;
+
+	// hit on the face
+	if(distance > r)
 	{
-		vec3 abEdgeNormal = cross(ab, abc);
-		if(SAME_DIRECTION(abEdgeNormal))
+		float tPlane = (r - distance) / approach;
+		if(tPlane > 1.0f) return false;
+
+		vec3 contact = center + tPlane * motion - r * n;
+		vec3 closest = closest_point_on_triangle(contact, a, b, c);
+		vec3 d = contact - closest;
+		if(dot(d, d) < 1.0e-8f)
 		{
-			// if outside ab, check whether ab or a is closest
-			simplex->points[0] = b;
-			simplex->points[1] = a;
-			simplex->numPoints = 2;
+			*t = tPlane;
+			*point = contact;
+			*normal = n;
+			return true;
+		}
+	}
 
-			return enclose_line(simplex, searchDirection);
+	// hit on a vertex
+	float motionSquared = dot(motion, motion);
+	const vec3* vertices[3] = { &a, &b, &c };
+	for(int i = 0; i < 3; ++i)
+	{
+		vec3 toCenter = center - *vertices[i];
+		float root;
+		if(get_lowest_root(motionSquared, 2.0f * dot(motion, toCenter), dot(toCenter, toCenter) - r * r, tFirst, &root))
+		{
+			tFirst = root;
+			*point = *vertices[i];
+			found = true;
 		}
-		else
+	}
+
+	// hit on an edge
+	for(int i = 0; i < 3; ++i)
+	{
+		const vec3& p1 = *vertices[i];
+		const vec3& p2 = *vertices[(i + 1) % 3];
+
+		vec3 edge = p2 - p1;
+		vec3 baseToVertex = p1 - center;
+		float edgeSquared = dot(edge, edge);
+		float edgeDotMotion = dot(edge, motion);
+		float edgeDotBase = dot(edge, baseToVertex);
+
+		float qa = edgeSquared * -motionSquared + edgeDotMotion * edgeDotMotion;
+		float qb = edgeSquared * (2.0f * dot(motion, baseToVertex)) - 2.0f * edgeDotMotion * edgeDotBase;
+		float qc = edgeSquared * (r * r - dot(baseToVertex, baseToVertex)) + edgeDotBase * edgeDotBase;
+
+		float root;
+		if(get_lowest_root(qa, qb, qc, tFirst, &root))
 		{
-			// if inside triangle, origin must be either above or below
-			if(SAME_DIRECTION(abc))
+			// make sure the contact lies within the edge's extent
+			float f = (edgeDotMotion * root - edgeDotBase) / edgeSquared;
+			if(f >= 0.0f && f <= 1.0f)
 			{
-				*searchDirection = abc;
-			}
-			else
-			{
-				simplex->points[1] = c;
-				simplex->points[0] = b;
-
-				*searchDirection -abc;
+				tFirst = root;
+				*point = p1 + f * edge;
+				found = true;
 			}
 		}
 	}
-	return false;
+
+	if(found)
+	{
+		*t = tFirst;
+		*normal = normalize(center + tFirst * motion - *point);
+	}
+	return found;
 }
 
-bool enclose_tetrahedron(Simplex* simplex, vec3* searchDirection)
+// Swept Boxes.................................................................
+
+static bool sweep_point_capsule(const vec3& origin, const vec3& motion, const vec3& p, const vec3& q, float radius,
+	float tMax, float* t)
 {
-	vec3 a = simplex->points[3];
-	vec3 b = simplex->points[2];
-	vec3 c = simplex->points[1];
-	vec3 d = simplex->points[0];
+	// the earliest time before tMax the point moving by motion enters the
+	// capsule, as long as it starts outside it
+
+	vec3 d = q - p;
+	vec3 m = origin - p;
+	float dd = dot(d, d);
+	float md = dot(m, d);
+	float nd = dot(motion, d);
+	float nn = dot(motion, motion);
+
+	bool found = false;
+
+	// the side of the cylinder, where it falls between the end caps
+	float a = dd * nn - nd * nd;
+	float b = dd * dot(m, motion) - nd * md;
+	float c = dd * (dot(m, m) - radius * radius) - md * md;
+	float root;
+	if(get_lowest_root(a, 2.0f * b, c, tMax, &root))
+	{
+		float along = md + root * nd;
+		if(along >= 0.0f && along <= dd)
+		{
+			tMax = root;
+			found = true;
+		}
+	}
 
-	vec3 ab = b - a;
-	vec3 ac = c - a;
-	vec3 ad = d - a;
-	
-	vec3 abc = cross(ab, ac);
-	vec3 acd = cross(ac, ad);
-	vec3 adb = cross(ad, ab);
+	// the end caps
+	const vec3* ends[2] = { &p, &q };
+	for(int i = 0; i < 2; ++i)
+	{
+		vec3 toOrigin = origin - *ends[i];
+		if(get_lowest_root(nn, 2.0f * dot(motion, toOrigin), dot(toOrigin, toOrigin) - radius * radius, tMax, &root))
+		{
+			tMax = root;
+			found = true;
+		}
+	}
 
-	vec3 aO = -a;
+	if(found) *t = tMax;
+	return found;
+}
 
-	if(SAME_DIRECTION(abc))
+static bool sweep_sphere_box(const vec3& center, const vec3& motion, float radius, const vec3& extents,
+	float* t, vec3* point, vec3* normal)
+{
+	// works in the box's frame, where the box is centred on the origin. The
+	// sphere's centre is traced as a ray against the box grown by the radius,
+	// whose edges and corners are rounded, after Ericson's "Real-Time
+	// Collision Detection" section 5.5.7
+
+	const float c[3] = { center.x, center.y, center.z };
+	const float m[3] = { motion.x, motion.y, motion.z };
+	const float e[3] = { extents.x, extents.y, extents.z };
+
+	// already touching
+	vec3 closest(clamp(c[0], -e[0], e[0]), clamp(c[1], -e[1], e[1]), clamp(c[2], -e[2], e[2]));
+	vec3 d = center - closest;
+	float distanceSquared = dot(d, d);
+	if(distanceSquared <= radius * radius)
 	{
-		if(SAME_DIRECTION(acd))
+		*t = 0.0f;
+		*point = closest;
+		if(distanceSquared > 1.0e-12f)
 		{
-			if(SAME_DIRECTION(adb))
+			*normal = d / sqrt(distanceSquared);
+		}
+		else
+		{
+			// the centre is inside, so push out through the nearest face
+			int axis = 0;
+			float least = FLT_MAX;
+			for(int i = 0; i < 3; ++i)
 			{
-				// eliminate b, c, d
-				simplex->points[0] = a;
-				simplex->numPoints = 1;
-
-				*searchDirection = aO;
+				float gap = e[i] - fabs(c[i]);
+				if(gap < least)
+				{
+					least = gap;
+					axis = i;
+				}
 			}
-			else
-			{
-				// eliminate b, d
-				simplex->points[0] = c;
-				simplex->points[1] = a;
-				simplex->numPoints = 2;
+			float n[3] = { 0.0f, 0.0f, 0.0f };
+			n[axis] = (c[axis] < 0.0f) ? -1.0f : 1.0f;
+			*normal = vec3(n[0], n[1], n[2]);
+		}
+		return true;
+	}
 
-				return enclose_line(simplex, searchDirection);
-			}
+	// slab test against the grown box
+	float tEnter = 0.0f;
+	float tExit = 1.0f;
+	for(int i = 0; i < 3; ++i)
+	{
+		float lo = -e[i] - radius;
+		float hi = e[i] + radius;
+		if(fabs(m[i]) < 1.0e-12f)
+		{
+			if(c[i] < lo || c[i] > hi) return false;
+			continue;
+		}
+		float t1 = (lo - c[i]) / m[i];
+		float t2 = (hi - c[i]) / m[i];
+		if(t1 > t2)
+		{
+			float temp = t1;
+			t1 = t2;
+			t2 = temp;
+		}
+		tEnter = MAX(tEnter, t1);
+		tExit = MIN(tExit, t2);
+		if(tEnter > tExit) return false;
+	}
+
+	// find which sides of the unrounded box the entry point is beyond
+	vec3 entry = center + tEnter * motion;
+	const float p[3] = { entry.x, entry.y, entry.z };
+	float corner[3];
+	int numOutside = 0;
+	int inside = 0;
+	for(int i = 0; i < 3; ++i)
+	{
+		if(p[i] < -e[i])
+		{
+			corner[i] = -e[i];
+			++numOutside;
+		}
+		else if(p[i] > e[i])
+		{
+			corner[i] = e[i];
+			++numOutside;
 		}
 		else
 		{
-			if(SAME_DIRECTION(adb))
-			{
-				// eliminate c, d
-				simplex->points[0] = b;
-				simplex->points[1] = a;
-				simplex->numPoints = 2;
-				
-				return enclose_line(simplex, searchDirection);
-			}
-			else
-			{
-				// eliminate d
-				simplex->points[0] = c;
-				simplex->points[1] = b;
-				simplex->points[2] = a;
-				simplex->numPoints = 3;
+			corner[i] = -e[i];
+			inside = i;
+		}
+	}
+
+	float tHit = tEnter;
+	if(numOutside >= 2)
+	{
+		// the entry point is in an edge or corner region, where the grown box
+		// is rounded, so trace against the capsules around the box edges
+		// that meet there
+		vec3 start(corner[0], corner[1], corner[2]);
+		bool found = false;
+		float tBest = tExit;
+		for(int i = 0; i < 3; ++i)
+		{
+			if(numOutside == 2 && i != inside) continue;
 
-				return enclose_triangle(simplex, searchDirection);
+			float other[3] = { corner[0], corner[1], corner[2] };
+			other[i] = -corner[i];
+			float tEdge;
+			if(sweep_point_capsule(center, motion, start, vec3(other[0], other[1], other[2]), radius, tBest, &tEdge))
+			{
+				tBest = tEdge;
+				found = true;
 			}
 		}
+		if(!found) return false;
+		tHit = tBest;
 	}
-	else
+
+	vec3 at = center + tHit * motion;
+	*t = tHit;
+	*point = vec3(clamp(at.x, -e[0], e[0]), clamp(at.y, -e[1], e[1]), clamp(at.z, -e[2], e[2]));
+	*normal = normalize(at - *point);
+	return true;
+}
+
+bool sweep_sphere_aabb(const Sphere& sphere, const vec3& motion, const AABB& aabb, float* t, vec3* point, vec3* normal)
+{
+	if(!sweep_sphere_box(sphere.position - aabb.center, motion, sphere.radius, aabb.extents, t, point, normal))
+		return false;
+	*point += aabb.center;
+	return true;
+}
+
+bool sweep_sphere_obb(const Sphere& sphere, const vec3& motion, const OBB& obb, float* t, vec3* point, vec3* normal)
+{
+	vec3 diff = sphere.position - obb.center;
+	vec3 center(dot(diff, obb.axes[0]), dot(diff, obb.axes[1]), dot(diff, obb.axes[2]));
+	vec3 localMotion(dot(motion, obb.axes[0]), dot(motion, obb.axes[1]), dot(motion, obb.axes[2]));
+
+	vec3 localPoint, localNormal;
+	if(!sweep_sphere_box(center, localMotion, sphere.radius, obb.extents, t, &localPoint, &localNormal))
+		return false;
+
+	*point = obb.center + localPoint.x * obb.axes[0] + localPoint.y * obb.axes[1] + localPoint.z * obb.axes[2];
+	*normal = localNormal.x * obb.axes[0] + localNormal.y * obb.axes[1] + localNormal.z * obb.axes[2];
+	return true;
+}
+
+struct AdjacencyEdge
+{
+	int from, to;
+};
+
+struct AdjacencyEdgeIsLess
+{
+	bool operator()(const AdjacencyEdge& a, const AdjacencyEdge& b) const
+	{
+		return a.from < b.from || (a.from == b.from && a.to < b.to);
+	}
+};
+
+void build_convex_adjacency(ConvexRegion* region, const int* triangleIndices, int numIndices)
+{
+	// every triangle edge gives a neighbour in both directions, and shared
+	// edges come up twice, so sort and skip the repeats
+	int numEdges = 2 * numIndices;
+	AdjacencyEdge* edges = new AdjacencyEdge[numEdges];
+	for(int i = 0; i < numIndices; i += 3)
 	{
-		if(SAME_DIRECTION(acd))
+		for(int j = 0; j < 3; ++j)
 		{
-			if(SAME_DIRECTION(adb))
-			{
-				// eliminate b, c
-				simplex->points[1] = a;
-				simplex->numPoints = 2;
+			int a = triangleIndices[i + j];
+			int b = triangleIndices[i + (j + 1) % 3];
+			edges[2 * (i + j)].from = a;
+			edges[2 * (i + j)].to = b;
+			edges[2 * (i + j) + 1].from = b;
+			edges[2 * (i + j) + 1].to = a;
+		}
+	}
+	if(numEdges > 0) quick_sort(edges, numEdges, AdjacencyEdgeIsLess());
 
-				return enclose_line(simplex, searchDirection);
-			}
-			else
-			{
-				// eliminate b
-				simplex->points[2] = a;
-				simplex->numPoints = 3;
+	int numUnique = 0;
+	for(int i = 0; i < numEdges; ++i)
+	{
+		if(numUnique == 0 || edges[numUnique - 1].from != edges[i].from || edges[numUnique - 1].to != edges[i].to)
+			edges[numUnique++] = edges[i];
+	}
+
+	destroy_convex_adjacency(region);
+	region->adjacencyStarts = new int[region->numVertices + 1];
+	region->adjacency = new int[MAX(numUnique, 1)];
 
-				return enclose_triangle(simplex, searchDirection);
+	int edge = 0;
+	for(int i = 0; i < region->numVertices; ++i)
+	{
+		region->adjacencyStarts[i] = edge;
+		for(; edge < numUnique && edges[edge].from == i; ++edge)
+			region->adjacency[edge] = edges[edge].to;
+	}
+	region->adjacencyStarts[region->numVertices] = edge;
+
+	delete[] edges;
+}
+
+void destroy_convex_adjacency(ConvexRegion* region)
+{
+	delete[] region->adjacencyStarts;
+	delete[] region->adjacency;
+	region->adjacencyStarts = nullptr;
+	region->adjacency = nullptr;
+}
+
+static int find_support_index(const ConvexRegion& region, const vec3& direction, int start)
+{
+	const vec3* vertices = region.vertices;
+
+	if(region.adjacency == nullptr)
+	{
+		int best = 0;
+		float bestDot = dot(direction, vertices[0]);
+		for(int i = 1; i < region.numVertices; ++i)
+		{
+			float d = dot(direction, vertices[i]);
+			if(d > bestDot)
+			{
+				bestDot = d;
+				best = i;
 			}
 		}
-		else
+		return best;
+	}
+
+	// hill climb: on a convex hull, a vertex with no neighbour further along
+	// the direction is the furthest vertex of all
+	int best = start;
+	float bestDot = dot(direction, vertices[best]);
+	for(bool improved = true; improved;)
+	{
+		improved = false;
+		for(int i = region.adjacencyStarts[best], end = region.adjacencyStarts[best + 1]; i < end; ++i)
 		{
-			if(SAME_DIRECTION(adb))
+			int neighbour = region.adjacency[i];
+			float d = dot(direction, vertices[neighbour]);
+			if(d > bestDot)
 			{
-				// eliminate c
-				simplex->points[1] = b;
-				simplex->points[2] = a;
-				simplex->numPoints = 3;
-
-				return enclose_triangle(simplex, searchDirection);
+				bestDot = d;
+				best = neighbour;
+				improved = true;
 			}
-			else return true;
 		}
 	}
-	return false;
+	return best;
+}
+
+struct SimplexVertex
+{
+	vec3 a, b; // support points on each region
+	vec3 w;    // a - b, a point on the minkowski difference
+	int indexA, indexB;
+	float weight;
+};
+
+struct Simplex
+{
+	SimplexVertex vertices[4];
+	int numPoints;
+};
+
+// offsetA translates region A without touching its vertices, for queries that
+// move it along a path
+static SimplexVertex make_simplex_vertex(const ConvexRegion& regionA, const ConvexRegion& regionB, int indexA, int indexB,
+	const vec3& offsetA = VEC3_ZERO)
+{
+	SimplexVertex vertex;
+	vertex.indexA = indexA;
+	vertex.indexB = indexB;
+	vertex.a = regionA.vertices[indexA] + offsetA;
+	vertex.b = regionB.vertices[indexB];
+	vertex.w = vertex.a - vertex.b;
+	vertex.weight = 1.0f;
+	return vertex;
+}
+
+static void keep_simplex_vertices(Simplex* simplex, int i, float weightI, int j, float weightJ)
+{
+	SimplexVertex vi = simplex->vertices[i];
+	SimplexVertex vj = simplex->vertices[j];
+	simplex->vertices[0] = vi;
+	simplex->vertices[0].weight = weightI;
+	simplex->vertices[1] = vj;
+	simplex->vertices[1].weight = weightJ;
+	simplex->numPoints = 2;
+}
+
+static void keep_simplex_vertex(Simplex* simplex, int i)
+{
+	simplex->vertices[0] = simplex->vertices[i];
+	simplex->vertices[0].weight = 1.0f;
+	simplex->numPoints = 1;
+}
+
+// each solver finds the point of its simplex closest to the origin, stores
+// it as weights on the vertices, and drops the vertices it doesn't need
+
+static void solve_line(Simplex* simplex)
+{
+	vec3 a = simplex->vertices[0].w;
+	vec3 ab = simplex->vertices[1].w - a;
+
+	float lengthSquared = dot(ab, ab);
+	float t = (lengthSquared > 0.0f) ? -dot(a, ab) / lengthSquared : 0.0f;
+	if(t <= 0.0f)
+		keep_simplex_vertex(simplex, 0);
+	else if(t >= 1.0f)
+		keep_simplex_vertex(simplex, 1);
+	else
+		keep_simplex_vertices(simplex, 0, 1.0f - t, 1, t);
+}
+
+static void solve_triangle(Simplex* simplex)
+{
+	// same voronoi region tests as closest_point_on_triangle, with the
+	// origin as the query point
+
+	vec3 a = simplex->vertices[0].w;
+	vec3 b = simplex->vertices[1].w;
+	vec3 c = simplex->vertices[2].w;
+	vec3 ab = b - a;
+	vec3 ac = c - a;
+
+	float d1 = -dot(ab, a);
+	float d2 = -dot(ac, a);
+	if(d1 <= 0.0f && d2 <= 0.0f)
+	{
+		keep_simplex_vertex(simplex, 0);
+		return;
+	}
+
+	float d3 = -dot(ab, b);
+	float d4 = -dot(ac, b);
+	if(d3 >= 0.0f && d4 <= d3)
+	{
+		keep_simplex_vertex(simplex, 1);
+		return;
+	}
+
+	float vc = d1 * d4 - d3 * d2;
+	if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		float t = d1 / (d1 - d3);
+		keep_simplex_vertices(simplex, 0, 1.0f - t, 1, t);
+		return;
+	}
+
+	float d5 = -dot(ab, c);
+	float d6 = -dot(ac, c);
+	if(d6 >= 0.0f && d5 <= d6)
+	{
+		keep_simplex_vertex(simplex, 2);
+		return;
+	}
+
+	float vb = d5 * d2 - d1 * d6;
+	if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		float t = d2 / (d2 - d6);
+		keep_simplex_vertices(simplex, 0, 1.0f - t, 2, t);
+		return;
+	}
+
+	float va = d3 * d6 - d5 * d4;
+	if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+	{
+		float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		keep_simplex_vertices(simplex, 1, 1.0f - t, 2, t);
+		return;
+	}
+
+	float sum = va + vb + vc;
+	if(sum <= 0.0f)
+	{
+		// the points are collinear, so fall back to the newest edge
+		keep_simplex_vertices(simplex, 1, 0.0f, 2, 0.0f);
+		solve_line(simplex);
+		return;
+	}
+
+	simplex->vertices[0].weight = va / sum;
+	simplex->vertices[1].weight = vb / sum;
+	simplex->vertices[2].weight = vc / sum;
+}
+
+static vec3 get_simplex_point(const Simplex& simplex)
+{
+	vec3 point = VEC3_ZERO;
+	for(int i = 0; i < simplex.numPoints; ++i)
+		point += simplex.vertices[i].w * simplex.vertices[i].weight;
+	return point;
+}
+
+// returns true when the origin lies inside the tetrahedron
+static bool solve_tetrahedron(Simplex* simplex)
+{
+	static const int faces[4][4] =
+	{
+		{ 0, 1, 2, 3 },
+		{ 0, 3, 1, 2 },
+		{ 0, 2, 3, 1 },
+		{ 1, 3, 2, 0 },
+	};
+
+	// a nearly flat tetrahedron can't be trusted to enclose anything, so
+	// then every face is tried instead
+	const SimplexVertex* v = simplex->vertices;
+	vec3 n = cross(v[1].w - v[0].w, v[2].w - v[0].w);
+	vec3 d = v[3].w - v[0].w;
+	float height = fabs(dot(n, d));
+	float size = MAX(MAX(dot(v[1].w - v[0].w, v[1].w - v[0].w), dot(v[2].w - v[0].w, v[2].w - v[0].w)), dot(d, d));
+	bool flat = height * height <= 1.0e-8f * dot(n, n) * size;
+
+	// try each face which has the origin on its far side from the opposite
+	// vertex and keep whichever comes closest
+	Simplex best = {};
+	float bestDistance = FLT_MAX;
+	bool outside = false;
+	for(int i = 0; i < 4; ++i)
+	{
+		const int* face = faces[i];
+		vec3 a = v[face[0]].w;
+		vec3 faceNormal = cross(v[face[1]].w - a, v[face[2]].w - a);
+		float originSide = -dot(faceNormal, a);
+		float vertexSide = dot(faceNormal, v[face[3]].w - a);
+		if(!flat && originSide * vertexSide >= 0.0f) continue;
+		outside = true;
+
+		Simplex candidate = {};
+		candidate.vertices[0] = v[face[0]];
+		candidate.vertices[1] = v[face[1]];
+		candidate.vertices[2] = v[face[2]];
+		candidate.numPoints = 3;
+		solve_triangle(&candidate);
+
+		vec3 closest = get_simplex_point(candidate);
+		float distance = dot(closest, closest);
+		if(distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = candidate;
+		}
+	}
+
+	if(outside)
+	{
+		*simplex = best;
+		return false;
+	}
+	return true;
 }
 
-bool simplex_contains_origin(Simplex* simplex, vec3* searchDirection)
+static bool solve_simplex(Simplex* simplex)
 {
 	switch(simplex->numPoints)
 	{
+		case 1:
+			simplex->vertices[0].weight = 1.0f;
+			return false;
 		case 2:
-			return enclose_line(simplex, searchDirection);
+			solve_line(simplex);
+			return false;
 		case 3:
-			return enclose_triangle(simplex, searchDirection);
+			solve_triangle(simplex);
+			return false;
 		case 4: default:
-			return enclose_tetrahedron(simplex, searchDirection);
+			return solve_tetrahedron(simplex);
 	}
 }
 
-vec3 get_furthest_in_direction(const ConvexRegion& region, vec3 direction)
+// Gilbert-Johnson-Keerthi distance query over the minkowski difference of
+// the two regions. Returns true if they overlap, otherwise leaves the point
+// of the difference closest to the origin in the simplex.
+static bool run_gjk(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache, Simplex* simplex,
+	const vec3& offsetA = VEC3_ZERO)
 {
-	vec3 furthest = region.vertices[0];
-	float maxDot = dot(direction, furthest);
-	for(int i = 1; i < region.numVertices; i++)
+	const int MAX_ITERATIONS = 64;
+	const float relativeTolerance = 1.0e-6f;
+
+	// warm start from last frame's simplex, if its vertices still exist
+	simplex->numPoints = 0;
+	if(cache != nullptr)
 	{
-		float dist = dot(direction, region.vertices[i]);
-		if(dist > maxDot)
+		for(int i = 0; i < cache->numPoints; ++i)
 		{
-			maxDot = dist;
-			furthest = region.vertices[i];
+			if(cache->indicesA[i] >= regionA.numVertices || cache->indicesB[i] >= regionB.numVertices)
+			{
+				simplex->numPoints = 0;
+				break;
+			}
+			simplex->vertices[simplex->numPoints++] = make_simplex_vertex(regionA, regionB, cache->indicesA[i], cache->indicesB[i], offsetA);
 		}
 	}
-	return furthest;
+	if(simplex->numPoints == 0)
+	{
+		simplex->vertices[0] = make_simplex_vertex(regionA, regionB, 0, 0, offsetA);
+		simplex->numPoints = 1;
+	}
+
+	bool overlapping = false;
+	for(int iteration = 0;; ++iteration)
+	{
+		if(solve_simplex(simplex))
+		{
+			overlapping = true;
+			break;
+		}
+
+		vec3 v = get_simplex_point(*simplex);
+		float distanceSquared = dot(v, v);
+		if(distanceSquared < 1.0e-12f)
+		{
+			overlapping = true;
+			break;
+		}
+		if(iteration == MAX_ITERATIONS) break;
+
+		// search from the newest vertex, which is usually close to the answer
+		const SimplexVertex& last = simplex->vertices[simplex->numPoints - 1];
+		int indexA = find_support_index(regionA, -v, last.indexA);
+		int indexB = find_support_index(regionB, v, last.indexB);
+
+		// a repeated vertex means no further progress can be made
+		bool repeated = false;
+		for(int i = 0; i < simplex->numPoints; ++i)
+		{
+			if(simplex->vertices[i].indexA == indexA && simplex->vertices[i].indexB == indexB)
+				repeated = true;
+		}
+		if(repeated) break;
+
+		SimplexVertex vertex = make_simplex_vertex(regionA, regionB, indexA, indexB, offsetA);
+		if(distanceSquared - dot(v, vertex.w) <= relativeTolerance * distanceSquared) break;
+
+		simplex->vertices[simplex->numPoints++] = vertex;
+	}
+
+	if(cache != nullptr)
+	{
+		cache->numPoints = simplex->numPoints;
+		for(int i = 0; i < simplex->numPoints; ++i)
+		{
+			cache->indicesA[i] = simplex->vertices[i].indexA;
+			cache->indicesB[i] = simplex->vertices[i].indexB;
+		}
+	}
+
+	return overlapping;
 }
 
-vec3 find_support(const ConvexRegion& regionA, const ConvexRegion& regionB, vec3 searchDirection)
+static void get_closest_points(const Simplex& simplex, vec3* closestA, vec3* closestB)
 {
-	return get_furthest_in_direction(regionA, searchDirection)
-	     - get_furthest_in_direction(regionB, -searchDirection);
+	vec3 a = VEC3_ZERO;
+	vec3 b = VEC3_ZERO;
+	for(int i = 0; i < simplex.numPoints; ++i)
+	{
+		a += simplex.vertices[i].a * simplex.vertices[i].weight;
+		b += simplex.vertices[i].b * simplex.vertices[i].weight;
+	}
+	*closestA = a;
+	*closestB = b;
 }
 
-bool intersect_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB)
+bool intersect_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache)
 {
-	vec3 support = find_support(regionA, regionB, VEC3_ONE);
+	Simplex simplex;
+	return run_gjk(regionA, regionB, cache, &simplex);
+}
+
+float closest_points_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache,
+	vec3* closestA, vec3* closestB)
+{
+	// returns the distance between the regions, which is zero when they overlap
 
 	Simplex simplex;
-	simplex.points[0] = support;
-	simplex.numPoints = 1;
+	bool overlapping = run_gjk(regionA, regionB, cache, &simplex);
+	get_closest_points(simplex, closestA, closestB);
 
-	vec3 searchDirection = -support;
-	do
-	{
-		vec3 a = find_support(regionA, regionB, searchDirection);
-		if(dot(a, searchDirection) < 0)
-			return false;
-		simplex.points[simplex.numPoints++] = a;
-	}
-	while(!simplex_contains_origin(&simplex, &searchDirection));
+	if(overlapping) return 0.0f;
+	return length(*closestA - *closestB);
+}
+
+struct PolytopeFace
+{
+	int vertices[3];
+	vec3 normal;
+	float distance;
+};
 
+static bool make_polytope_face(const SimplexVertex* vertices, int a, int b, int c, PolytopeFace* face)
+{
+	vec3 n = cross(vertices[b].w - vertices[a].w, vertices[c].w - vertices[a].w);
+	float area = length(n);
+	if(area < 1.0e-12f) return false;
+
+	face->vertices[0] = a;
+	face->vertices[1] = b;
+	face->vertices[2] = c;
+	face->normal = n / area;
+	face->distance = dot(face->normal, vertices[a].w);
 	return true;
 }
 
-/*
-void expanding_polytope(const ConvexRegion& regionA, const ConvexRegion& regionB, const Simplex& simplex)
+bool penetrate_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache,
+	vec3* normal, float* depth, vec3* pointA, vec3* pointB)
 {
-	while(true)
+	// returns false if the regions are apart; otherwise the normal points
+	// from A toward B, and moving B along it by depth separates them
+
+	Simplex simplex;
+	if(!run_gjk(regionA, regionB, cache, &simplex)) return false;
+
+	const int MAX_VERTICES = 128;
+	const int MAX_FACES = 2 * MAX_VERTICES;
+	const int MAX_ITERATIONS = MAX_VERTICES - 4;
+
+	SimplexVertex vertices[MAX_VERTICES];
+	int numVertices = simplex.numPoints;
+	for(int i = 0; i < numVertices; ++i)
+		vertices[i] = simplex.vertices[i];
+
+	// the shapes only touch or the origin lies on the simplex, so grow it out
+	// to a tetrahedron using supports in directions it doesn't span yet
+	int startA = vertices[0].indexA;
+	int startB = vertices[0].indexB;
+	if(numVertices == 1)
+	{
+		static const vec3 axes[6] =
+		{
+			vec3(1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f),
+			vec3(0.0f, 1.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f),
+			vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 0.0f, -1.0f),
+		};
+		for(int i = 0; i < 6 && numVertices == 1; ++i)
+		{
+			SimplexVertex vertex = make_simplex_vertex(regionA, regionB,
+				find_support_index(regionA, axes[i], startA), find_support_index(regionB, -axes[i], startB));
+			vec3 d = vertex.w - vertices[0].w;
+			if(dot(d, d) > 1.0e-12f) vertices[numVertices++] = vertex;
+		}
+	}
+	if(numVertices == 2)
 	{
-		Edge e = find_closest_edge(simplex);
-		vec3 support = find_support(regionA, regionB, e.normal);
+		vec3 line = vertices[1].w - vertices[0].w;
+		vec3 axis = (fabs(line.x) < fabs(line.y) && fabs(line.x) < fabs(line.z)) ? vec3(1.0f, 0.0f, 0.0f)
+			: (fabs(line.y) < fabs(line.z)) ? vec3(0.0f, 1.0f, 0.0f) : vec3(0.0f, 0.0f, 1.0f);
+		vec3 directions[4];
+		directions[0] = normalize(cross(line, axis));
+		directions[1] = normalize(cross(line, directions[0]));
+		directions[2] = -directions[0];
+		directions[3] = -directions[1];
+		for(int i = 0; i < 4 && numVertices == 2; ++i)
+		{
+			SimplexVertex vertex = make_simplex_vertex(regionA, regionB,
+				find_support_index(regionA, directions[i], startA), find_support_index(regionB, -directions[i], startB));
+			vec3 offLine = cross(vertex.w - vertices[0].w, line);
+			if(dot(offLine, offLine) > 1.0e-12f * dot(line, line)) vertices[numVertices++] = vertex;
+		}
+	}
+	if(numVertices == 3)
+	{
+		vec3 n = cross(vertices[1].w - vertices[0].w, vertices[2].w - vertices[0].w);
+		for(int i = 0; i < 2 && numVertices == 3; ++i)
+		{
+			vec3 direction = (i == 0) ? n : -n;
+			SimplexVertex vertex = make_simplex_vertex(regionA, regionB,
+				find_support_index(regionA, direction, startA), find_support_index(regionB, -direction, startB));
+			if(fabs(dot(vertex.w - vertices[0].w, n)) > 1.0e-6f * length(n)) vertices[numVertices++] = vertex;
+		}
+	}
 
-		float d = dot(support, e.normal);
-		if(d - e.distance < 0.0001f)
+	if(numVertices < 4)
+	{
+		// the difference is flat, so the shapes can only be touching
+		*normal = vec3(0.0f, 0.0f, 1.0f);
+		if(numVertices == 3)
+			*normal = normalize(cross(vertices[1].w - vertices[0].w, vertices[2].w - vertices[0].w));
+		*depth = 0.0f;
+		*pointA = vertices[0].a;
+		*pointB = vertices[0].b;
+		return true;
+	}
+
+	// wind the tetrahedron's faces outward, judged from its centre since the
+	// origin may lie on its surface
+	PolytopeFace faces[MAX_FACES];
+	int numFaces = 0;
+	{
+		static const int tetrahedron[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 3, 2 } };
+		vec3 centre = (vertices[0].w + vertices[1].w + vertices[2].w + vertices[3].w) * 0.25f;
+		for(int i = 0; i < 4; ++i)
 		{
-			normal = e.normal;
-			depth = d;
+			int a = tetrahedron[i][0];
+			int b = tetrahedron[i][1];
+			int c = tetrahedron[i][2];
+			vec3 n = cross(vertices[b].w - vertices[a].w, vertices[c].w - vertices[a].w);
+			if(dot(n, centre - vertices[a].w) > 0.0f)
+			{
+				int temp = b;
+				b = c;
+				c = temp;
+			}
+			if(make_polytope_face(vertices, a, b, c, &faces[numFaces])) ++numFaces;
 		}
-		else
+	}
+
+	// expanding polytope: push out the face nearest the origin until it can
+	// grow no further, at which point it lies on the minkowski difference
+	PolytopeFace face;
+	face.distance = -FLT_MAX;
+	for(int iteration = 0; numFaces > 0; ++iteration)
+	{
+		int closest = 0;
+		for(int i = 1; i < numFaces; ++i)
+		{
+			if(faces[i].distance < faces[closest].distance)
+				closest = i;
+		}
+
+		// the nearest face should only ever move outward, so if rounding
+		// has folded the polytope, settle for the last good face
+		if(faces[closest].distance < face.distance - 1.0e-5f) break;
+		face = faces[closest];
+
+		SimplexVertex vertex = make_simplex_vertex(regionA, regionB,
+			find_support_index(regionA, face.normal, vertices[face.vertices[0]].indexA),
+			find_support_index(regionB, -face.normal, vertices[face.vertices[0]].indexB));
+		float supportDistance = dot(vertex.w, face.normal);
+		if(supportDistance - face.distance <= MAX(1.0e-4f * supportDistance, 1.0e-6f)) break;
+		if(iteration == MAX_ITERATIONS || numVertices == MAX_VERTICES) break;
+
+		// find every face the new point can see, and the edges along the
+		// boundary of that patch which the new faces will be built on. faces
+		// the point is almost level with are left alone, since rounding could
+		// otherwise carve out a patch that isn't a single connected piece
+		const float visibleTolerance = 1.0e-5f * MAX(supportDistance, 1.0f);
+		bool visible[MAX_FACES];
+		int horizon[MAX_FACES * 3][2];
+		int numHorizon = 0;
+		for(int i = 0; i < numFaces; ++i)
+		{
+			visible[i] = dot(faces[i].normal, vertex.w - vertices[faces[i].vertices[0]].w) > visibleTolerance;
+			if(!visible[i]) continue;
+
+			for(int j = 0; j < 3; ++j)
+			{
+				int a = faces[i].vertices[j];
+				int b = faces[i].vertices[(j + 1) % 3];
+
+				// an edge shared by two visible faces shows up reversed
+				bool shared = false;
+				for(int k = 0; k < numHorizon; ++k)
+				{
+					if(horizon[k][0] == b && horizon[k][1] == a)
+					{
+						horizon[k][0] = horizon[numHorizon - 1][0];
+						horizon[k][1] = horizon[numHorizon - 1][1];
+						--numHorizon;
+						shared = true;
+						break;
+					}
+				}
+				if(!shared)
+				{
+					horizon[numHorizon][0] = a;
+					horizon[numHorizon][1] = b;
+					++numHorizon;
+				}
+			}
+		}
+
+		int numKept = 0;
+		for(int i = 0; i < numFaces; ++i)
 		{
-			simplex.points[simplex.numPoints++] = 
+			if(!visible[i]) ++numKept;
+		}
+		if(numKept + numHorizon > MAX_FACES) break;
+
+		for(int i = 0, j = 0; i < numFaces; ++i)
+		{
+			if(!visible[i]) faces[j++] = faces[i];
+		}
+		numFaces = numKept;
+
+		int newIndex = numVertices;
+		vertices[numVertices++] = vertex;
+		for(int i = 0; i < numHorizon; ++i)
+		{
+			if(make_polytope_face(vertices, horizon[i][0], horizon[i][1], newIndex, &faces[numFaces]))
+				++numFaces;
 		}
 	}
+
+	if(face.distance == -FLT_MAX)
+	{
+		*normal = vec3(0.0f, 0.0f, 1.0f);
+		*depth = 0.0f;
+		*pointA = vertices[0].a;
+		*pointB = vertices[0].b;
+		return true;
+	}
+
+	// the contact points come from where the origin projects onto the face
+	const SimplexVertex& v0 = vertices[face.vertices[0]];
+	const SimplexVertex& v1 = vertices[face.vertices[1]];
+	const SimplexVertex& v2 = vertices[face.vertices[2]];
+
+	vec3 projection = face.normal * face.distance;
+	vec3 e1 = v1.w - v0.w;
+	vec3 e2 = v2.w - v0.w;
+	vec3 p = projection - v0.w;
+	float d11 = dot(e1, e1);
+	float d12 = dot(e1, e2);
+	float d22 = dot(e2, e2);
+	float denominator = d11 * d22 - d12 * d12;
+	float u = 0.0f, v = 0.0f;
+	if(denominator > 0.0f)
+	{
+		float dp1 = dot(p, e1);
+		float dp2 = dot(p, e2);
+		u = (d22 * dp1 - d12 * dp2) / denominator;
+		v = (d11 * dp2 - d12 * dp1) / denominator;
+	}
+	float w = 1.0f - u - v;
+
+	*normal = face.normal;
+	*depth = face.distance;
+	*pointA = v0.a * w + v1.a * u + v2.a * v;
+	*pointB = v0.b * w + v1.b * u + v2.b * v;
+	return true;
+}
+
+bool time_of_impact_convex_regions(const ConvexRegion& regionA, const vec3& motionA, const ConvexRegion& regionB, const vec3& motionB,
+	SimplexCache* cache, float* t, vec3* normal, vec3* point)
+{
+	// conservative advancement: the distance between two convex shapes that
+	// only translate can't shrink faster than their closing speed along the
+	// line between their closest points, so stepping by distance over that
+	// speed never passes the time they first touch
+
+	const int MAX_ITERATIONS = 32;
+	const float targetDistance = 1.0e-3f;
+	const float tolerance = 0.5f * targetDistance;
+
+	// B stays put and A moves relative to it
+	vec3 motion = motionA - motionB;
+
+	float time = 0.0f;
+	for(int iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+	{
+		Simplex simplex;
+		vec3 offset = time * motion;
+		bool overlapping = run_gjk(regionA, regionB, cache, &simplex, offset);
+
+		vec3 closestA, closestB;
+		get_closest_points(simplex, &closestA, &closestB);
+		vec3 between = closestB - closestA;
+		float distance = length(between);
+
+		if(overlapping || distance <= targetDistance + tolerance)
+		{
+			*t = time;
+			if(overlapping && time == 0.0f)
+			{
+				float depth;
+				vec3 pointA;
+				if(!penetrate_convex_regions(regionA, regionB, cache, normal, &depth, &pointA, point))
+					*normal = normalize(-motion);
+				return true;
+			}
+			*normal = (distance > 1.0e-12f) ? between / distance : normalize(motion);
+			*point = closestB + time * motionB;
+			return true;
+		}
+
+		// moving apart along the closest direction means they never meet,
+		// since the distance along a straight path only grows from here
+		vec3 direction = between / distance;
+		float speed = dot(motion, direction);
+		if(speed <= 1.0e-12f) return false;
+
+		time += (distance - targetDistance) / speed;
+		if(time > 1.0f) return false;
+	}
+
+	*t = time;
+	*normal = normalize(motion);
+	return false;
 }
-*/
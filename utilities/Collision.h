@@ -22,6 +22,19 @@ struct Sphere
 	float radius;
 };
 
+struct Capsule
+{
+	vec3 start, end;
+	float radius;
+};
+
+struct Ray
+{
+	vec3 origin;
+	vec3 direction;
+	float maxDistance;
+};
+
 class Frustum
 {
 public:
@@ -33,12 +46,43 @@ public:
 		float fov, float ratio, float nearClip, float farClip);
 };
 
+struct ProxyPair
+{
+	int proxyA, proxyB;
+};
+
 struct ConvexRegion
 {
 	vec3* vertices;
 	int numVertices;
+
+	// optional vertex adjacency from build_convex_adjacency, which lets
+	// support lookups on large hulls walk toward the furthest vertex instead
+	// of scanning them all
+	int* adjacencyStarts;
+	int* adjacency;
+
+	ConvexRegion(): vertices(nullptr), numVertices(0), adjacencyStarts(nullptr), adjacency(nullptr) {}
 };
 
+// vertex indices of the last simplex found between two regions, kept by the
+// owner of a pair from one frame to the next so the query can start from
+// where it left off
+struct SimplexCache
+{
+	int indicesA[4];
+	int indicesB[4];
+	int numPoints;
+
+	SimplexCache(): numPoints(0) {}
+};
+
+AABB compute_bounds(const OBB& obb);
+
+// works out the axes once, for queries that would otherwise redo it from the
+// orientation every call; dimensions are full widths, as in intersect_ray_obb
+OBB make_obb(vec3 position, quaternion orientation, vec3 dimensions);
+
 bool intersect_point_rect(vec2 point, int x, int y, int width, int height);
 
 bool intersect_point_obb(vec3 pointPosition, vec3 obbPosition, quaternion obbOrientation, vec3 obbDimensions);
@@ -58,4 +102,28 @@ void cull_frustum_obb_list(const Frustum& frustum, OBB* obbList, int numOBBs, bo
 
 bool intersect_ray_triangle(vec3 orig, vec3 dir, vec3 vert0, vec3 vert1, vec3 vert2, vec3* intersect);
 
+vec3 closest_point_on_triangle(const vec3& point, const vec3& a, const vec3& b, const vec3& c);
+float closest_points_segment_segment(const vec3& p1, const vec3& q1, const vec3& p2, const vec3& q2, vec3* c1, vec3* c2);
+float closest_points_segment_triangle(const vec3& p, const vec3& q, const vec3& a, const vec3& b, const vec3& c, vec3* onSegment, vec3* onTriangle);
+
+bool sweep_sphere_triangle(const Sphere& sphere, const vec3& motion, const vec3& a, const vec3& b, const vec3& c,
+	float* t, vec3* point, vec3* normal);
+bool sweep_sphere_aabb(const Sphere& sphere, const vec3& motion, const AABB& aabb, float* t, vec3* point, vec3* normal);
+bool sweep_sphere_obb(const Sphere& sphere, const vec3& motion, const OBB& obb, float* t, vec3* point, vec3* normal);
+
+void build_convex_adjacency(ConvexRegion* region, const int* triangleIndices, int numIndices);
+void destroy_convex_adjacency(ConvexRegion* region);
+
+bool intersect_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache = nullptr);
+float closest_points_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache,
+	vec3* closestA, vec3* closestB);
+bool penetrate_convex_regions(const ConvexRegion& regionA, const ConvexRegion& regionB, SimplexCache* cache,
+	vec3* normal, float* depth, vec3* pointA, vec3* pointB);
+
+// the fraction of their motions two translating regions travel before they
+// touch; the normal points from A toward B and the point is on B at the time
+// of impact
+bool time_of_impact_convex_regions(const ConvexRegion& regionA, const vec3& motionA, const ConvexRegion& regionB, const vec3& motionB,
+	SimplexCache* cache, float* t, vec3* normal, vec3* point);
+
 #endif
@@ -13,6 +13,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <sys/mman.h>
+
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -175,6 +177,44 @@ void save_text_file(const char* data, size_t size, const char* filePath, FileWri
 	CloseHandle(file);
 }
 
+const char* map_file(const char* filePath, size_t* size)
+{
+	HANDLE file = open_file(filePath, FILE_MODE_READ);
+	if(file == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER fileSize;
+	if(GetFileSizeEx(file, &fileSize) == FALSE || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	// the view keeps the file open, so neither handle is needed past here
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if(mapping == NULL)
+	{
+		LOG_ISSUE("could not map file: %s", filePath);
+		return nullptr;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if(view == NULL)
+	{
+		LOG_ISSUE("could not map a view of file: %s", filePath);
+		return nullptr;
+	}
+
+	*size = size_t(fileSize.QuadPart);
+	return (const char*) view;
+}
+
+void unmap_file(const char* data, size_t /*size*/)
+{
+	UnmapViewOfFile(data);
+}
+
 void* open_file_stream(const char* filePath)
 {
 	return open_file(filePath, FILE_MODE_READ);
@@ -321,6 +361,36 @@ void save_text_file(const char* data, size_t size, const char* filePath, FileWri
 	close(file);
 }
 
+const char* map_file(const char* filePath, size_t* size)
+{
+	int file = open_file(filePath, FILE_MODE_READ);
+	if(file < 0) return nullptr;
+
+	struct stat info;
+	if(fstat(file, &info) < 0 || info.st_size == 0)
+	{
+		close(file);
+		return nullptr;
+	}
+
+	void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if(data == MAP_FAILED)
+	{
+		LOG_ISSUE("could not map file: %s - %s", filePath, strerror(errno));
+		return nullptr;
+	}
+	madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+	*size = info.st_size;
+	return (const char*) data;
+}
+
+void unmap_file(const char* data, size_t size)
+{
+	munmap((void*) data, size);
+}
+
 file_handle_t open_file_stream(const char* filePath)
 {
 	return open_file(filePath, FILE_MODE_READ);
@@ -24,6 +24,12 @@ void clear_file(const char* filePath);
 
 void save_text_file(const char* data, size_t size, const char* filePath, FileWriteMode writeMode = FILE_MODE_OVERWRITE);
 
+// maps a whole file into memory read-only, so it can be parsed in place
+// without copying it first; returns null for a file that can't be opened
+// or is empty
+const char* map_file(const char* filePath, size_t* size);
+void unmap_file(const char* data, size_t size);
+
 file_handle_t open_file_stream(const char* filePath);
 void close_file_stream(file_handle_t file);
 size_t read_file_stream(file_handle_t file, unsigned long long readOffset, void* buffer, size_t size);
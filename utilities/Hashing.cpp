@@ -1,6 +1,12 @@
 #include "Hashing.h"
 
 #include "BitManipulation.h"
+#include "SIMD.h"
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#define MORTON_BMI2
+#endif
 
 // MULTI-BYTE HASHES
 //-------------------------------------------------------------------------------------------------
@@ -100,6 +106,78 @@ uint32_t murmur_hash(const void* key, size_t len, uint32_t seed)
 	return h;
 }
 
+// 64-BIT STRING HASH
+//-------------------------------------------------------------------------------------------------
+
+static inline void multiply_128(uint64_t a, uint64_t b, uint64_t* low, uint64_t* high)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = __uint128_t(a) * b;
+	*low = uint64_t(r);
+	*high = uint64_t(r >> 64);
+#else
+	*low = a * b;
+	*high = detail::hash_multiply_high(a, b);
+#endif
+}
+
+static inline uint64_t mix(uint64_t a, uint64_t b)
+{
+	uint64_t low, high;
+	multiply_128(a, b, &low, &high);
+	return low ^ high;
+}
+
+static inline uint64_t read_4(const uint8_t* p)
+{
+	return uint64_t(p[0]) | uint64_t(p[1]) << 8 | uint64_t(p[2]) << 16 | uint64_t(p[3]) << 24;
+}
+
+static inline uint64_t read_8(const uint8_t* p)
+{
+	return read_4(p) | read_4(p + 4) << 32;
+}
+
+uint64_t hash_64(const void* key, size_t len, uint64_t seed)
+{
+	const uint64_t s0 = detail::HASH_SECRET_0;
+	const uint64_t s1 = detail::HASH_SECRET_1;
+
+	const uint8_t* p = (const uint8_t*)key;
+	seed ^= mix(seed ^ s0, s1);
+
+	uint64_t a, b;
+	if(len <= 16)
+	{
+		if(len >= 4)
+		{
+			size_t middle = (len >> 3) << 2;
+			a = read_4(p) << 32 | read_4(p + middle);
+			b = read_4(p + len - 4) << 32 | read_4(p + len - 4 - middle);
+		}
+		else if(len > 0)
+		{
+			a = uint64_t(p[0]) << 16 | uint64_t(p[len >> 1]) << 8 | p[len - 1];
+			b = 0;
+		}
+		else
+		{
+			a = b = 0;
+		}
+	}
+	else
+	{
+		size_t left = len;
+		for(; left > 16; left -= 16, p += 16)
+			seed = mix(read_8(p) ^ s1, read_8(p + 8) ^ seed);
+		a = read_8(p + left - 16);
+		b = read_8(p + left - 8);
+	}
+
+	multiply_128(a ^ s1, b ^ seed, &a, &b);
+	return mix(a ^ s0 ^ len, b ^ s1);
+}
+
 // INTEGER HASHES
 //-------------------------------------------------------------------------------------------------
 
@@ -179,3 +257,197 @@ uint64_t morton_hash_3d(uint32_t x, uint32_t y, uint32_t z)
 {
 	return spread_3(x) | spread_3(y) << 1 | spread_3(z) << 2;
 }
+
+// Bulk Morton Codes...........................................................
+
+static const uint64_t MORTON_2D_X = 0x5555555555555555;
+static const uint64_t MORTON_3D_X = 0x1249249249249249;
+
+#if defined(MORTON_BMI2)
+
+void morton_encode_2d(const uint32_t* x, const uint32_t* y, int count, uint64_t* codes)
+{
+	for(int i = 0; i < count; ++i)
+		codes[i] = _pdep_u64(x[i], MORTON_2D_X) | _pdep_u64(y[i], MORTON_2D_X << 1);
+}
+
+void morton_decode_2d(const uint64_t* codes, int count, uint32_t* x, uint32_t* y)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		x[i] = uint32_t(_pext_u64(codes[i], MORTON_2D_X));
+		y[i] = uint32_t(_pext_u64(codes[i], MORTON_2D_X << 1));
+	}
+}
+
+void morton_encode_3d(const uint32_t* x, const uint32_t* y, const uint32_t* z, int count, uint64_t* codes)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		codes[i] = _pdep_u64(x[i], MORTON_3D_X) | _pdep_u64(y[i], MORTON_3D_X << 1)
+			| _pdep_u64(z[i], MORTON_3D_X << 2);
+	}
+}
+
+void morton_decode_3d(const uint64_t* codes, int count, uint32_t* x, uint32_t* y, uint32_t* z)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		x[i] = uint32_t(_pext_u64(codes[i], MORTON_3D_X));
+		y[i] = uint32_t(_pext_u64(codes[i], MORTON_3D_X << 1));
+		z[i] = uint32_t(_pext_u64(codes[i], MORTON_3D_X << 2));
+	}
+}
+
+#else
+
+// The same shift and mask steps as spread_2 and spread_3, widened to 64 bits.
+// They're written once over a lane type, so the SSE2 version and the leftover
+// elements share them.
+
+static inline uint64_t shift_left(uint64_t a, int n) { return a << n; }
+static inline uint64_t shift_right(uint64_t a, int n) { return a >> n; }
+static inline uint64_t bits_and(uint64_t a, uint64_t mask) { return a & mask; }
+static inline uint64_t bits_or(uint64_t a, uint64_t b) { return a | b; }
+
+#if defined(SIMD_SSE)
+static inline __m128i bits_and(__m128i a, uint64_t mask) { return _mm_and_si128(a, _mm_set1_epi64x(mask)); }
+static inline __m128i bits_or(__m128i a, __m128i b) { return _mm_or_si128(a, b); }
+static inline __m128i shift_left(__m128i a, int n) { return _mm_sll_epi64(a, _mm_cvtsi32_si128(n)); }
+static inline __m128i shift_right(__m128i a, int n) { return _mm_srl_epi64(a, _mm_cvtsi32_si128(n)); }
+#endif
+
+template<typename T>
+static inline T spread_2_wide(T x)
+{
+	x = bits_and(x, 0x00000000FFFFFFFF);
+	x = bits_and(bits_or(x, shift_left(x, 16)), 0x0000FFFF0000FFFF);
+	x = bits_and(bits_or(x, shift_left(x, 8)), 0x00FF00FF00FF00FF);
+	x = bits_and(bits_or(x, shift_left(x, 4)), 0x0F0F0F0F0F0F0F0F);
+	x = bits_and(bits_or(x, shift_left(x, 2)), 0x3333333333333333);
+	x = bits_and(bits_or(x, shift_left(x, 1)), 0x5555555555555555);
+	return x;
+}
+
+template<typename T>
+static inline T compact_2_wide(T x)
+{
+	x = bits_and(x, 0x5555555555555555);
+	x = bits_and(bits_or(x, shift_right(x, 1)), 0x3333333333333333);
+	x = bits_and(bits_or(x, shift_right(x, 2)), 0x0F0F0F0F0F0F0F0F);
+	x = bits_and(bits_or(x, shift_right(x, 4)), 0x00FF00FF00FF00FF);
+	x = bits_and(bits_or(x, shift_right(x, 8)), 0x0000FFFF0000FFFF);
+	x = bits_and(bits_or(x, shift_right(x, 16)), 0x00000000FFFFFFFF);
+	return x;
+}
+
+template<typename T>
+static inline T spread_3_wide(T x)
+{
+	x = bits_and(x, 0x00000000001FFFFF);
+	x = bits_and(bits_or(x, shift_left(x, 32)), 0x001F00000000FFFF);
+	x = bits_and(bits_or(x, shift_left(x, 16)), 0x001F0000FF0000FF);
+	x = bits_and(bits_or(x, shift_left(x, 8)), 0x100F00F00F00F00F);
+	x = bits_and(bits_or(x, shift_left(x, 4)), 0x10C30C30C30C30C3);
+	x = bits_and(bits_or(x, shift_left(x, 2)), 0x1249249249249249);
+	return x;
+}
+
+template<typename T>
+static inline T compact_3_wide(T x)
+{
+	x = bits_and(x, 0x1249249249249249);
+	x = bits_and(bits_or(x, shift_right(x, 2)), 0x10C30C30C30C30C3);
+	x = bits_and(bits_or(x, shift_right(x, 4)), 0x100F00F00F00F00F);
+	x = bits_and(bits_or(x, shift_right(x, 8)), 0x001F0000FF0000FF);
+	x = bits_and(bits_or(x, shift_right(x, 16)), 0x001F00000000FFFF);
+	x = bits_and(bits_or(x, shift_right(x, 32)), 0x00000000001FFFFF);
+	return x;
+}
+
+#if defined(SIMD_SSE)
+
+// two 32-bit values into the low halves of two 64-bit lanes, and back
+static inline __m128i load_pair(const uint32_t* p)
+{
+	return _mm_unpacklo_epi32(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128());
+}
+
+static inline void store_pair(uint32_t* p, __m128i a)
+{
+	_mm_storel_epi64((__m128i*)p, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+#endif
+
+void morton_encode_2d(const uint32_t* x, const uint32_t* y, int count, uint64_t* codes)
+{
+	int i = 0;
+#if defined(SIMD_SSE)
+	for(; i + 2 <= count; i += 2)
+	{
+		__m128i code = bits_or(spread_2_wide(load_pair(x + i)), shift_left(spread_2_wide(load_pair(y + i)), 1));
+		_mm_storeu_si128((__m128i*)(codes + i), code);
+	}
+#endif
+	for(; i < count; ++i)
+		codes[i] = spread_2_wide(uint64_t(x[i])) | spread_2_wide(uint64_t(y[i])) << 1;
+}
+
+void morton_decode_2d(const uint64_t* codes, int count, uint32_t* x, uint32_t* y)
+{
+	int i = 0;
+#if defined(SIMD_SSE)
+	for(; i + 2 <= count; i += 2)
+	{
+		__m128i code = _mm_loadu_si128((const __m128i*)(codes + i));
+		store_pair(x + i, compact_2_wide(code));
+		store_pair(y + i, compact_2_wide(shift_right(code, 1)));
+	}
+#endif
+	for(; i < count; ++i)
+	{
+		x[i] = uint32_t(compact_2_wide(codes[i]));
+		y[i] = uint32_t(compact_2_wide(codes[i] >> 1));
+	}
+}
+
+void morton_encode_3d(const uint32_t* x, const uint32_t* y, const uint32_t* z, int count, uint64_t* codes)
+{
+	int i = 0;
+#if defined(SIMD_SSE)
+	for(; i + 2 <= count; i += 2)
+	{
+		__m128i code = bits_or(spread_3_wide(load_pair(x + i)),
+			bits_or(shift_left(spread_3_wide(load_pair(y + i)), 1), shift_left(spread_3_wide(load_pair(z + i)), 2)));
+		_mm_storeu_si128((__m128i*)(codes + i), code);
+	}
+#endif
+	for(; i < count; ++i)
+	{
+		codes[i] = spread_3_wide(uint64_t(x[i])) | spread_3_wide(uint64_t(y[i])) << 1
+			| spread_3_wide(uint64_t(z[i])) << 2;
+	}
+}
+
+void morton_decode_3d(const uint64_t* codes, int count, uint32_t* x, uint32_t* y, uint32_t* z)
+{
+	int i = 0;
+#if defined(SIMD_SSE)
+	for(; i + 2 <= count; i += 2)
+	{
+		__m128i code = _mm_loadu_si128((const __m128i*)(codes + i));
+		store_pair(x + i, compact_3_wide(code));
+		store_pair(y + i, compact_3_wide(shift_right(code, 1)));
+		store_pair(z + i, compact_3_wide(shift_right(code, 2)));
+	}
+#endif
+	for(; i < count; ++i)
+	{
+		x[i] = uint32_t(compact_3_wide(codes[i]));
+		y[i] = uint32_t(compact_3_wide(codes[i] >> 1));
+		z[i] = uint32_t(compact_3_wide(codes[i] >> 2));
+	}
+}
+
+#endif // defined(MORTON_BMI2)
@@ -12,6 +12,90 @@ uint32_t djb_hash(const void* key, size_t len, uint32_t seed);
 uint32_t oat_hash(const void* key, size_t len);
 uint32_t murmur_hash(const void* key, size_t len, uint32_t seed);
 
+//--- 64-BIT STRING HASH --------------------------------------------------------------------------
+
+// After wyhash, but with one lane where it has three, which only costs
+// anything on keys much longer than a name. The constant version gives the
+// same values and runs at compile time on string literals, so names hashed
+// either way can be compared.
+
+uint64_t hash_64(const void* key, size_t len, uint64_t seed = 0);
+constexpr uint64_t hash_64_constant(const char* key, size_t len, uint64_t seed = 0);
+
+namespace detail
+{
+	const uint64_t HASH_SECRET_0 = 0xA0761D6478BD642F;
+	const uint64_t HASH_SECRET_1 = 0xE7037ED1A0B428DB;
+	const uint64_t HASH_LOW_HALF = 0xFFFFFFFF;
+
+	// bytes are read little-endian whatever the machine, to match hash_64
+
+	constexpr uint64_t hash_read_4(const char* p)
+	{
+		return uint64_t(uint8_t(p[0])) | uint64_t(uint8_t(p[1])) << 8
+			| uint64_t(uint8_t(p[2])) << 16 | uint64_t(uint8_t(p[3])) << 24;
+	}
+
+	constexpr uint64_t hash_read_8(const char* p)
+	{
+		return hash_read_4(p) | hash_read_4(p + 4) << 32;
+	}
+
+	constexpr uint64_t hash_read_3(const char* p, size_t k)
+	{
+		return uint64_t(uint8_t(p[0])) << 16 | uint64_t(uint8_t(p[k >> 1])) << 8 | uint64_t(uint8_t(p[k - 1]));
+	}
+
+	// the high half of a 64 by 64-bit multiply, put together from 32-bit halves
+	constexpr uint64_t hash_multiply_middle(uint64_t a, uint64_t b)
+	{
+		return ((a & HASH_LOW_HALF) * (b & HASH_LOW_HALF) >> 32)
+			+ ((a & HASH_LOW_HALF) * (b >> 32) & HASH_LOW_HALF)
+			+ ((a >> 32) * (b & HASH_LOW_HALF) & HASH_LOW_HALF);
+	}
+
+	constexpr uint64_t hash_multiply_high(uint64_t a, uint64_t b)
+	{
+		return (a >> 32) * (b >> 32) + ((a & HASH_LOW_HALF) * (b >> 32) >> 32)
+			+ ((a >> 32) * (b & HASH_LOW_HALF) >> 32) + (hash_multiply_middle(a, b) >> 32);
+	}
+
+	constexpr uint64_t hash_mix(uint64_t a, uint64_t b)
+	{
+		return (a * b) ^ hash_multiply_high(a, b);
+	}
+
+	constexpr uint64_t hash_finish(uint64_t a, uint64_t b, size_t len)
+	{
+		return hash_mix(a * b ^ HASH_SECRET_0 ^ len, hash_multiply_high(a, b) ^ HASH_SECRET_1);
+	}
+
+	constexpr uint64_t hash_short(const char* p, size_t len, uint64_t seed)
+	{
+		return (len >= 4)
+			? hash_finish((hash_read_4(p) << 32 | hash_read_4(p + ((len >> 3) << 2))) ^ HASH_SECRET_1,
+				(hash_read_4(p + len - 4) << 32 | hash_read_4(p + len - 4 - ((len >> 3) << 2))) ^ seed, len)
+			: hash_finish(((len > 0)? hash_read_3(p, len) : 0) ^ HASH_SECRET_1, seed, len);
+	}
+
+	constexpr uint64_t hash_blocks(const char* p, size_t left, uint64_t seed, size_t len)
+	{
+		return (left > 16)
+			? hash_blocks(p + 16, left - 16, hash_mix(hash_read_8(p) ^ HASH_SECRET_1, hash_read_8(p + 8) ^ seed), len)
+			: hash_finish(hash_read_8(p + left - 16) ^ HASH_SECRET_1, hash_read_8(p + left - 8) ^ seed, len);
+	}
+
+	constexpr uint64_t hash_start(const char* p, size_t len, uint64_t seed)
+	{
+		return (len <= 16)? hash_short(p, len, seed) : hash_blocks(p, len, seed, len);
+	}
+}
+
+constexpr uint64_t hash_64_constant(const char* key, size_t len, uint64_t seed)
+{
+	return detail::hash_start(key, len, seed ^ detail::hash_mix(seed ^ detail::HASH_SECRET_0, detail::HASH_SECRET_1));
+}
+
 //--- INTEGER HASHES ------------------------------------------------------------------------------
 
 uint32_t jenkin_hash(uint32_t a);
@@ -22,6 +106,14 @@ uint32_t mystery_hash(uint32_t a);
 //--- SPATIAL HASHES ------------------------------------------------------------------------------
 
 uint64_t morton_hash_2d(uint32_t x, uint32_t y);
-uint64_t morton_hash_3d(uint32_t x, uint32_t y, int32_t z);
+uint64_t morton_hash_3d(uint32_t x, uint32_t y, uint32_t z);
+
+// Whole arrays at a time, with 32 bits per axis in 2D and 21 in 3D. These
+// use BMI2's bit deposit and extract where the compiler targets it, and
+// otherwise spread bits two lanes at a time with SSE2.
+void morton_encode_2d(const uint32_t* x, const uint32_t* y, int count, uint64_t* codes);
+void morton_decode_2d(const uint64_t* codes, int count, uint32_t* x, uint32_t* y);
+void morton_encode_3d(const uint32_t* x, const uint32_t* y, const uint32_t* z, int count, uint64_t* codes);
+void morton_decode_3d(const uint64_t* codes, int count, uint32_t* x, uint32_t* y, uint32_t* z);
 
 #endif
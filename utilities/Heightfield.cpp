@@ -0,0 +1,253 @@
+#include "Heightfield.h"
+
+#include "NumberMacros.h"
+
+#include <math.h>
+#include <float.h>
+
+// Cells.......................................................................
+
+static bool find_cell(const Heightfield& field, float x, float z, int* cellX, int* cellZ, float* u, float* v)
+{
+	float scale = 1.0f / field.cellSize;
+	float gridX = (x - field.x) * scale;
+	float gridZ = (z - field.z) * scale;
+	if(!(gridX >= 0.0f && gridZ >= 0.0f && gridX <= field.columns - 1 && gridZ <= field.rows - 1))
+		return false;
+
+	// points on the far edges belong to the last cell
+	*cellX = MIN(int(gridX), field.columns - 2);
+	*cellZ = MIN(int(gridZ), field.rows - 2);
+	*u = gridX - *cellX;
+	*v = gridZ - *cellZ;
+	return true;
+}
+
+static float cell_height(const Heightfield& field, int cellX, int cellZ, float u, float v)
+{
+	const float* h = field.heights + cellZ * field.columns + cellX;
+	const float* nextRow = h + field.columns;
+	if(u + v <= 1.0f)
+		return h[0] + u * (h[1] - h[0]) + v * (nextRow[0] - h[0]);
+	else
+		return nextRow[1] + (1.0f - u) * (nextRow[0] - nextRow[1]) + (1.0f - v) * (h[1] - nextRow[1]);
+}
+
+static vec3 cell_normal(const Heightfield& field, int cellX, int cellZ, float u, float v)
+{
+	const float* h = field.heights + cellZ * field.columns + cellX;
+	const float* nextRow = h + field.columns;
+	if(u + v <= 1.0f)
+		return normalize(vec3(h[0] - h[1], field.cellSize, h[0] - nextRow[0]));
+	else
+		return normalize(vec3(nextRow[0] - nextRow[1], field.cellSize, h[1] - nextRow[1]));
+}
+
+// Point Queries...............................................................
+
+bool get_heightfield_height(const Heightfield& field, float x, float z, float* height)
+{
+	int cellX, cellZ;
+	float u, v;
+	if(!find_cell(field, x, z, &cellX, &cellZ, &u, &v)) return false;
+
+	*height = cell_height(field, cellX, cellZ, u, v);
+	return true;
+}
+
+bool get_heightfield_normal(const Heightfield& field, float x, float z, vec3* normal)
+{
+	int cellX, cellZ;
+	float u, v;
+	if(!find_cell(field, x, z, &cellX, &cellZ, &u, &v)) return false;
+
+	*normal = cell_normal(field, cellX, cellZ, u, v);
+	return true;
+}
+
+void sample_heightfield(const Heightfield& field, const vec3* points, int count, float* heights)
+{
+	int cellX, cellZ;
+	float u, v;
+	for(int i = 0; i < count; ++i)
+	{
+		if(find_cell(field, points[i].x, points[i].z, &cellX, &cellZ, &u, &v))
+			heights[i] = cell_height(field, cellX, cellZ, u, v);
+	}
+}
+
+// Ray Marching................................................................
+
+struct RayMarch
+{
+	const Heightfield* field;
+	vec3 origin;
+	vec3 direction;
+	float invCellSize;
+
+	// how far the ray is above the ground at t, measured in the given cell
+	float Clearance(int cellX, int cellZ, float t) const
+	{
+		vec3 p = origin + t * direction;
+		float u = (p.x - field->x) * invCellSize - cellX;
+		float v = (p.z - field->z) * invCellSize - cellZ;
+		u = MIN(MAX(u, 0.0f), 1.0f);
+		v = MIN(MAX(v, 0.0f), 1.0f);
+		return p.y - cell_height(*field, cellX, cellZ, u, v);
+	}
+
+	// The ray's span over a cell is at most two straight pieces, one over
+	// each triangle, with the break where it crosses the diagonal. The
+	// clearance is linear along each piece, so the first place it turns
+	// negative can be solved for exactly.
+	bool TestCell(int cellX, int cellZ, float enter, float exit, float* t) const
+	{
+		float stops[3];
+		int numStops = 0;
+		stops[numStops++] = enter;
+
+		float along = direction.x + direction.z;
+		if(along != 0.0f)
+		{
+			float cornerX = field->x + (cellX + 1) * field->cellSize;
+			float cornerZ = field->z + cellZ * field->cellSize;
+			float diagonal = ((cornerX - origin.x) + (cornerZ - origin.z)) / along;
+			if(diagonal > enter && diagonal < exit)
+				stops[numStops++] = diagonal;
+		}
+		stops[numStops++] = exit;
+
+		float before = Clearance(cellX, cellZ, stops[0]);
+		if(before < 0.0f)
+		{
+			*t = stops[0];
+			return true;
+		}
+		for(int i = 1; i < numStops; ++i)
+		{
+			float after = Clearance(cellX, cellZ, stops[i]);
+			if(after < 0.0f)
+			{
+				*t = stops[i - 1] + (stops[i] - stops[i - 1]) * before / (before - after);
+				return true;
+			}
+			before = after;
+		}
+		return false;
+	}
+};
+
+bool intersect_ray_heightfield(const Heightfield& field, const Ray& ray, float* distance, vec3* normal)
+{
+	if(field.columns < 2 || field.rows < 2) return false;
+
+	// clip the ray to the box around the field
+	float lower[3] = { field.x, field.minHeight, field.z };
+	float upper[3] = { field.x + (field.columns - 1) * field.cellSize, field.maxHeight, field.z + (field.rows - 1) * field.cellSize };
+	float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+
+	float start = 0.0f;
+	float end = ray.maxDistance;
+	for(int i = 0; i < 3; ++i)
+	{
+		if(direction[i] == 0.0f)
+		{
+			// a ray level with the bottom of the box can still be under the
+			// ground, which is solid all the way down
+			if(origin[i] > upper[i] || (i != 1 && origin[i] < lower[i])) return false;
+			continue;
+		}
+		float closest = (lower[i] - origin[i]) / direction[i];
+		float furthest = (upper[i] - origin[i]) / direction[i];
+		if(closest > furthest)
+		{
+			float temp = closest;
+			closest = furthest;
+			furthest = temp;
+		}
+		if(i == 1)
+		{
+			// below the box counts as inside the ground
+			if(direction[i] > 0.0f) closest = -FLT_MAX;
+			else furthest = FLT_MAX;
+		}
+		start = MAX(start, closest);
+		end = MIN(end, furthest);
+	}
+	if(start > end) return false;
+
+	RayMarch march;
+	march.field = &field;
+	march.origin = ray.origin;
+	march.direction = ray.direction;
+	march.invCellSize = 1.0f / field.cellSize;
+
+	// find the cell where the ray starts, then step from cell to cell
+	// across whichever edge comes first
+	vec3 first = ray.origin + start * ray.direction;
+	int cellX = int(floor((first.x - field.x) * march.invCellSize));
+	int cellZ = int(floor((first.z - field.z) * march.invCellSize));
+	cellX = MIN(MAX(cellX, 0), field.columns - 2);
+	cellZ = MIN(MAX(cellZ, 0), field.rows - 2);
+
+	int stepX = (ray.direction.x > 0.0f) ? 1 : -1;
+	int stepZ = (ray.direction.z > 0.0f) ? 1 : -1;
+	float nextX = FLT_MAX;
+	float nextZ = FLT_MAX;
+	float deltaX = FLT_MAX;
+	float deltaZ = FLT_MAX;
+	if(ray.direction.x != 0.0f)
+	{
+		float edge = field.x + (cellX + (stepX > 0)) * field.cellSize;
+		nextX = (edge - ray.origin.x) / ray.direction.x;
+		deltaX = field.cellSize / fabs(ray.direction.x);
+	}
+	if(ray.direction.z != 0.0f)
+	{
+		float edge = field.z + (cellZ + (stepZ > 0)) * field.cellSize;
+		nextZ = (edge - ray.origin.z) / ray.direction.z;
+		deltaZ = field.cellSize / fabs(ray.direction.z);
+	}
+
+	float enter = start;
+	while(true)
+	{
+		float exit = MIN(MIN(nextX, nextZ), end);
+
+		// skip cells the ray stays above the highest corner of
+		const float* h = field.heights + cellZ * field.columns + cellX;
+		float highest = MAX(MAX(h[0], h[1]), MAX(h[field.columns], h[field.columns + 1]));
+		float lowestY = ray.origin.y + ray.direction.y * ((ray.direction.y < 0.0f) ? exit : enter);
+
+		float t;
+		if(lowestY <= highest && march.TestCell(cellX, cellZ, enter, exit, &t))
+		{
+			*distance = t;
+			if(normal)
+			{
+				vec3 p = ray.origin + t * ray.direction;
+				float u = (p.x - field.x) * march.invCellSize - cellX;
+				float v = (p.z - field.z) * march.invCellSize - cellZ;
+				*normal = cell_normal(field, cellX, cellZ, u, v);
+			}
+			return true;
+		}
+
+		if(exit >= end) return false;
+
+		enter = exit;
+		if(nextX < nextZ)
+		{
+			cellX += stepX;
+			nextX += deltaX;
+			if(cellX < 0 || cellX > field.columns - 2) return false;
+		}
+		else
+		{
+			cellZ += stepZ;
+			nextZ += deltaZ;
+			if(cellZ < 0 || cellZ > field.rows - 2) return false;
+		}
+	}
+}
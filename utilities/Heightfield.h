@@ -0,0 +1,39 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include "Collision.h"
+
+// Ground queries against a regular grid of heights over x and z, for
+// gameplay that needs to stand things on terrain or trace lines across it
+// without handling it as a mesh. Each cell is split into two triangles along
+// the diagonal from its corner at (x, z + 1) to the one at (x + 1, z), the
+// same way terrain quads are, so answers agree with the full detail surface.
+// The ground counts as solid below the surface.
+
+struct Heightfield
+{
+	float* heights; // columns * rows samples, in rows along z
+	int columns, rows;
+	float x, z;     // position of the first sample
+	float cellSize;
+	float minHeight, maxHeight;
+
+	Heightfield(): heights(nullptr), columns(0), rows(0), x(0.0f), z(0.0f), cellSize(1.0f), minHeight(0.0f), maxHeight(0.0f) {}
+};
+
+// Both return false outside the grid. The normal is the triangle's under
+// the point, so it's constant across each half of a cell.
+bool get_heightfield_height(const Heightfield& field, float x, float z, float* height);
+bool get_heightfield_normal(const Heightfield& field, float x, float z, vec3* normal);
+
+// heights under many points at once, such as particles or agents; points
+// outside the grid are left alone
+void sample_heightfield(const Heightfield& field, const vec3* points, int count, float* heights);
+
+// Walks the cells under the ray in order and stops at the first one it goes
+// below the surface in. A ray that starts out below the surface, or comes
+// in under it through the side of the grid, hits where it starts or enters.
+// Distances are in multiples of the ray's direction, as in RayHit.
+bool intersect_ray_heightfield(const Heightfield& field, const Ray& ray, float* distance, vec3* normal);
+
+#endif
@@ -78,7 +78,7 @@ static const char* log_level_name(Log::LogLevel level)
 		case Log::INFO:  return "INFO";
 		case Log::DEBUG: return "DEBUG";
 	}
-	return '\0';
+	return "";
 }
 
 #define LOG_CASE(CASE_TYPE, ParamType, convert_function)\
@@ -49,19 +49,46 @@ static union { unsigned long long x; double y; } neg_huge_val = { 0xff8000000000
 
 //--- MATHEMATICAL CONSTANTS ------------------------------------------------------------
 
+// the C library defines most of these already, not always with the same digits
+#ifndef M_E
 #define M_E        2.71828182845904523536
+#endif
+#ifndef M_LOG2E
 #define M_LOG2E    1.44269504088896340736
+#endif
+#ifndef M_LOG10E
 #define M_LOG10E   0.43429448190325182765
+#endif
+#ifndef M_LN2
 #define M_LN2      0.69314718055994530942
+#endif
+#ifndef M_LN10
 #define M_LN10     2.30258509299404568402
+#endif
+#ifndef M_PI
 #define M_PI       3.14159265358979323846
+#endif
+#ifndef M_PI_2
 #define M_PI_2     1.57079632679489661923
+#endif
+#ifndef M_PI_4
 #define M_PI_4     0.78539816339744830962
+#endif
+#ifndef M_1_PI
 #define M_1_PI     0.31830988618379067154
+#endif
+#ifndef M_2_PI
 #define M_2_PI     0.63661977236758134308
+#endif
+#ifndef M_2_SQRTPI
 #define M_2_SQRTPI 1.12837916709551257390
+#endif
+#ifndef M_SQRT2
 #define M_SQRT2    1.41421356237309504880
+#endif
+#ifndef M_SQRT1_2
 #define M_SQRT1_2  0.70710678118654752440
+#endif
 
 #define M_TAU      6.28318530717958647692
 #define M_PHI      1.61803398874989484820
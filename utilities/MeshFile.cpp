@@ -0,0 +1,432 @@
+#include "MeshFile.h"
+
+#include "FileHandling.h"
+#include "Logging.h"
+#include "MeshLoading.h"
+#include "MeshProcessing.h"
+#include "NumberMacros.h"
+
+#include "collections/AutoArray.h"
+
+#include <cstring>
+#include <float.h>
+
+static inline uint32_t align_offset(uint32_t offset)
+{
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~uint32_t(MESH_FILE_ALIGNMENT - 1);
+}
+
+static inline uint32_t swap_bytes(uint32_t x)
+{
+	return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+static uint32_t vertex_size(uint32_t format)
+{
+	switch(format)
+	{
+		case MESH_VERTEX_FLOAT:  return sizeof(MeshFileVertex);
+		case MESH_VERTEX_PACKED: return sizeof(PackedVertex);
+	}
+	return 0;
+}
+
+// true if the section of count items of the given size fits in the file
+static bool section_fits(uint32_t offset, uint64_t count, uint32_t itemSize, size_t fileSize)
+{
+	if(offset % MESH_FILE_ALIGNMENT != 0) return false;
+	uint64_t end = uint64_t(offset) + count * itemSize;
+	return end <= fileSize;
+}
+
+// true if a run of count starting at start lies inside one of size
+static bool range_fits(uint32_t start, uint32_t count, uint64_t size)
+{
+	return uint64_t(start) + count <= size;
+}
+
+// Goes through every table entry and index once the sections are known to
+// fit, so the loaders can use them without checking anything themselves.
+// Returns what's wrong, or null if nothing is.
+static const char* check_tables(const MeshFileHeader* header, const char* data)
+{
+	const MeshFileSubmesh* submeshes = (const MeshFileSubmesh*) (data + header->submeshOffset);
+	const MeshFileLod* lods = (const MeshFileLod*) (data + header->lodOffset);
+	const MeshFileMeshlet* meshlets = (const MeshFileMeshlet*) (data + header->meshletOffset);
+	uint64_t numSubmeshes = uint64_t(header->numSubmeshes) * header->numLods;
+
+	for(uint32_t i = 0; i < header->numLods; ++i)
+	{
+		const MeshFileLod& lod = lods[i];
+		if(!range_fits(lod.startIndex, lod.numIndices, header->numIndices) ||
+			!range_fits(lod.firstSubmesh, header->numSubmeshes, numSubmeshes))
+			return "pointing past the end of its tables";
+
+		// a level's submeshes stay inside its own run of indices
+		for(uint32_t j = 0; j < header->numSubmeshes; ++j)
+		{
+			const MeshFileSubmesh& submesh = submeshes[lod.firstSubmesh + j];
+			if(submesh.startIndex < lod.startIndex ||
+				!range_fits(submesh.startIndex, submesh.numIndices, uint64_t(lod.startIndex) + lod.numIndices))
+				return "pointing past the end of its tables";
+		}
+	}
+
+	for(uint64_t i = 0; i < numSubmeshes; ++i)
+	{
+		const MeshFileSubmesh& submesh = submeshes[i];
+		if(!range_fits(submesh.startIndex, submesh.numIndices, header->numIndices) ||
+			!range_fits(submesh.firstMeshlet, submesh.numMeshlets, header->numMeshlets))
+			return "pointing past the end of its tables";
+		if(memchr(submesh.textureName, '\0', MESH_FILE_NAME_SIZE) == nullptr)
+			return "holding a texture name with no end";
+	}
+
+	for(uint32_t i = 0; i < header->numMeshlets; ++i)
+	{
+		if(!range_fits(meshlets[i].startIndex, meshlets[i].numIndices, header->numIndices))
+			return "pointing past the end of its tables";
+	}
+
+	const void* indices = data + header->indexOffset;
+	for(uint32_t i = 0; i < header->numIndices; ++i)
+	{
+		uint32_t index = (header->indexSize == 2)? ((const uint16_t*) indices)[i] : ((const uint32_t*) indices)[i];
+		if(index >= header->numVertices)
+			return "indexing past its last vertex";
+	}
+
+	return nullptr;
+}
+
+bool map_mesh_file(const char* path, MappedMesh* mesh)
+{
+	memset(mesh, 0, sizeof *mesh);
+
+	size_t size;
+	const char* data = map_file(path, &size);
+	if(data == nullptr) return false;
+
+	const MeshFileHeader* header = (const MeshFileHeader*) data;
+	const char* problem = nullptr;
+	if(size < sizeof(MeshFileHeader) || memcmp(header->magic, "MESH", 4) != 0)
+		problem = "not a baked mesh";
+	else if(header->version == swap_bytes(MESH_FILE_VERSION))
+		problem = "baked for a machine of the other byte order";
+	else if(header->version != MESH_FILE_VERSION)
+		problem = "baked by a different version";
+	else if(header->fileSize != size)
+		problem = "cut short";
+	else if(vertex_size(header->vertexFormat) == 0 || header->vertexSize != vertex_size(header->vertexFormat) ||
+		(header->indexSize != 2 && header->indexSize != 4) || header->numLods == 0 || header->numSubmeshes == 0)
+	{
+		problem = "laid out in a way this version can't use";
+	}
+	else if(!section_fits(header->vertexOffset, header->numVertices, header->vertexSize, size) ||
+		!section_fits(header->indexOffset, header->numIndices, header->indexSize, size) ||
+		!section_fits(header->submeshOffset, uint64_t(header->numSubmeshes) * header->numLods, sizeof(MeshFileSubmesh), size) ||
+		!section_fits(header->lodOffset, header->numLods, sizeof(MeshFileLod), size) ||
+		!section_fits(header->meshletOffset, header->numMeshlets, sizeof(MeshFileMeshlet), size))
+	{
+		problem = "pointing outside itself";
+	}
+	else
+	{
+		problem = check_tables(header, data);
+	}
+
+	if(problem)
+	{
+		LOG_ISSUE("%s is %s", path, problem);
+		unmap_file(data, size);
+		return false;
+	}
+
+	mesh->header = header;
+	mesh->vertices = data + header->vertexOffset;
+	mesh->indices = data + header->indexOffset;
+	mesh->submeshes = (const MeshFileSubmesh*) (data + header->submeshOffset);
+	mesh->lods = (const MeshFileLod*) (data + header->lodOffset);
+	mesh->meshlets = (const MeshFileMeshlet*) (data + header->meshletOffset);
+	mesh->data = data;
+	mesh->size = size;
+	return true;
+}
+
+void unmap_mesh_file(MappedMesh* mesh)
+{
+	if(mesh->data) unmap_file(mesh->data, mesh->size);
+	memset(mesh, 0, sizeof *mesh);
+}
+
+VertexQuantization get_vertex_quantization(const MeshFileHeader* header)
+{
+	VertexQuantization quantization;
+	quantization.positionOffset = vec3(header->positionOffset[0], header->positionOffset[1], header->positionOffset[2]);
+	quantization.positionScale = vec3(header->positionScale[0], header->positionScale[1], header->positionScale[2]);
+	quantization.texcoordOffset = vec2(header->texcoordOffset[0], header->texcoordOffset[1]);
+	quantization.texcoordScale = vec2(header->texcoordScale[0], header->texcoordScale[1]);
+	return quantization;
+}
+
+// BAKING
+//-------------------------------------------------------------------------------------------------
+
+bool bake_mesh_file(const MeshSource& source, const char* path)
+{
+	if(source.numVertices <= 0 || source.numLods <= 0)
+	{
+		LOG_ISSUE("nothing to bake into %s", path);
+		return false;
+	}
+
+	int numIndices = 0;
+	for(int i = 0; i < source.numLods; ++i)
+		numIndices += source.lods[i].numIndices;
+	int numSubmeshes = MAX(source.numMaterials, 1);
+
+	// gather every level's indices, so each submesh can be split into
+	// meshlets before anything is laid out
+	uint32_t* indices = new uint32_t[MAX(numIndices, 1)];
+	int* meshletStarts = new int[source.numLods * numSubmeshes + 1];
+	AutoArray<Meshlet> meshlets;
+	bool badIndex = false;
+	for(int i = 0, start = 0; i < source.numLods; ++i)
+	{
+		const MeshLodSource& lod = source.lods[i];
+		for(int j = 0; j < lod.numIndices; ++j)
+		{
+			uint32_t index = lod.elements[j];
+			if(index >= uint32_t(source.numVertices))
+			{
+				badIndex = true;
+				index = 0;
+			}
+			indices[start + j] = index;
+		}
+
+		for(int j = 0; j < numSubmeshes; ++j)
+		{
+			int first = (source.numMaterials > 0)? lod.startIndices[j] : 0;
+			int last = (j + 1 < source.numMaterials)? lod.startIndices[j + 1] : lod.numIndices;
+			meshletStarts[i * numSubmeshes + j] = meshlets.Count();
+			build_meshlets(indices + start + first, last - first, source.positions, source.numVertices,
+				MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, start + first, meshlets);
+		}
+
+		start += lod.numIndices;
+	}
+	meshletStarts[source.numLods * numSubmeshes] = meshlets.Count();
+
+	// splitting reorders triangles, so the vertices are numbered again in the
+	// order they're now first used; the source is left as it was
+	vec4* positions = new vec4[source.numVertices];
+	vec3* normals = new vec3[source.numVertices];
+	vec2* texcoords = new vec2[source.numVertices];
+	for(int i = 0; i < source.numVertices; ++i)
+	{
+		positions[i] = source.positions[i];
+		normals[i] = source.normals[i];
+		texcoords[i] = source.texcoords[i];
+	}
+	int numVertices = optimize_vertex_fetch(positions, normals, texcoords, source.numVertices, indices, numIndices);
+
+	MeshFileHeader header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, "MESH", 4);
+	header.version = MESH_FILE_VERSION;
+	header.vertexFormat = source.vertexFormat;
+	header.vertexSize = vertex_size(source.vertexFormat);
+	header.numVertices = numVertices;
+	header.indexSize = (numVertices <= 65536)? 2 : 4;
+	header.numIndices = numIndices;
+	header.numSubmeshes = numSubmeshes;
+	header.numLods = source.numLods;
+	header.numMeshlets = meshlets.Count();
+
+	header.vertexOffset = align_offset(sizeof header);
+	header.indexOffset = align_offset(header.vertexOffset + header.numVertices * header.vertexSize);
+	header.submeshOffset = align_offset(header.indexOffset + header.numIndices * header.indexSize);
+	header.lodOffset = align_offset(header.submeshOffset + numSubmeshes * source.numLods * sizeof(MeshFileSubmesh));
+	header.meshletOffset = align_offset(header.lodOffset + source.numLods * sizeof(MeshFileLod));
+	header.fileSize = header.meshletOffset + header.numMeshlets * sizeof(MeshFileMeshlet);
+
+	char* data = new char[header.fileSize];
+	memset(data, 0, header.fileSize);
+
+	VertexQuantization quantization = compute_vertex_quantization(positions, texcoords, numVertices);
+	const vec3& lower = quantization.positionOffset;
+	vec3 upper = lower + quantization.positionScale;
+	float boundsMin[3] = {lower.x, lower.y, lower.z};
+	float boundsMax[3] = {upper.x, upper.y, upper.z};
+	memcpy(header.boundsMin, boundsMin, sizeof boundsMin);
+	memcpy(header.boundsMax, boundsMax, sizeof boundsMax);
+
+	if(source.vertexFormat == MESH_VERTEX_PACKED)
+	{
+		PackedVertex* vertices = (PackedVertex*) (data + header.vertexOffset);
+		pack_vertices(vertices, positions, normals, texcoords, numVertices, quantization);
+
+		const VertexQuantization& q = quantization;
+		float positionOffset[3] = {q.positionOffset.x, q.positionOffset.y, q.positionOffset.z};
+		float positionScale[3] = {q.positionScale.x, q.positionScale.y, q.positionScale.z};
+		float texcoordOffset[2] = {q.texcoordOffset.x, q.texcoordOffset.y};
+		float texcoordScale[2] = {q.texcoordScale.x, q.texcoordScale.y};
+		memcpy(header.positionOffset, positionOffset, sizeof positionOffset);
+		memcpy(header.positionScale, positionScale, sizeof positionScale);
+		memcpy(header.texcoordOffset, texcoordOffset, sizeof texcoordOffset);
+		memcpy(header.texcoordScale, texcoordScale, sizeof texcoordScale);
+	}
+	else
+	{
+		MeshFileVertex* vertices = (MeshFileVertex*) (data + header.vertexOffset);
+		for(int i = 0; i < numVertices; ++i)
+		{
+			const vec4& p = positions[i];
+			MeshFileVertex& v = vertices[i];
+			v.position[0] = p.x;
+			v.position[1] = p.y;
+			v.position[2] = p.z;
+			v.position[3] = p.w;
+			v.texcoord[0] = texcoords[i].x;
+			v.texcoord[1] = texcoords[i].y;
+			v.normal[0] = normals[i].x;
+			v.normal[1] = normals[i].y;
+			v.normal[2] = normals[i].z;
+		}
+
+		float one[3] = {1.0f, 1.0f, 1.0f};
+		memcpy(header.positionScale, one, sizeof header.positionScale);
+		memcpy(header.texcoordScale, one, sizeof header.texcoordScale);
+	}
+
+	MeshFileSubmesh* submeshes = (MeshFileSubmesh*) (data + header.submeshOffset);
+	MeshFileLod* lods = (MeshFileLod*) (data + header.lodOffset);
+	uint16_t* shortIndices = (uint16_t*) (data + header.indexOffset);
+	uint32_t* longIndices = (uint32_t*) (data + header.indexOffset);
+	for(int i = 0; i < numIndices; ++i)
+	{
+		if(header.indexSize == 2) shortIndices[i] = indices[i];
+		else longIndices[i] = indices[i];
+	}
+
+	MeshFileMeshlet* fileMeshlets = (MeshFileMeshlet*) (data + header.meshletOffset);
+	for(size_t i = 0; i < meshlets.Count(); ++i)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		MeshFileMeshlet& m = fileMeshlets[i];
+		m.startIndex = meshlet.startIndex;
+		m.numIndices = meshlet.numIndices;
+		m.center[0] = meshlet.center.x;
+		m.center[1] = meshlet.center.y;
+		m.center[2] = meshlet.center.z;
+		m.radius = meshlet.radius;
+		m.coneAxis[0] = meshlet.coneAxis.x;
+		m.coneAxis[1] = meshlet.coneAxis.y;
+		m.coneAxis[2] = meshlet.coneAxis.z;
+		m.coneCutoff = meshlet.coneCutoff;
+	}
+
+	for(int i = 0, start = 0; i < source.numLods; ++i)
+	{
+		const MeshLodSource& lod = source.lods[i];
+		lods[i].startIndex = start;
+		lods[i].numIndices = lod.numIndices;
+		lods[i].firstSubmesh = i * numSubmeshes;
+		lods[i].error = lod.error;
+
+		// with no materials the whole level is one submesh
+		for(int j = 0; j < numSubmeshes; ++j)
+		{
+			MeshFileSubmesh& submesh = submeshes[i * numSubmeshes + j];
+			int first = (source.numMaterials > 0)? lod.startIndices[j] : 0;
+			int last = (j + 1 < source.numMaterials)? lod.startIndices[j + 1] : lod.numIndices;
+			submesh.startIndex = start + first;
+			submesh.numIndices = last - first;
+			submesh.firstMeshlet = meshletStarts[i * numSubmeshes + j];
+			submesh.numMeshlets = meshletStarts[i * numSubmeshes + j + 1] - submesh.firstMeshlet;
+			submesh.alpha = 1.0f;
+			if(source.numMaterials > 0)
+			{
+				const MaterialInfo& material = source.materials[j];
+				submesh.alpha = material.alpha;
+				if(material.texName.Size() >= size_t(MESH_FILE_NAME_SIZE))
+					LOG_ISSUE("texture name %s is too long to bake into %s", material.texName.Data(), path);
+				else
+					memcpy(submesh.textureName, material.texName.Data(), material.texName.Size());
+			}
+		}
+
+		start += lod.numIndices;
+	}
+
+	if(badIndex)
+	{
+		LOG_ISSUE("indices past the last vertex were baked into %s as zero", path);
+	}
+
+	memcpy(data, &header, sizeof header);
+	save_binary_file(data, header.fileSize, path);
+	delete[] data;
+	delete[] meshletStarts;
+	delete[] indices;
+	delete[] positions;
+	delete[] normals;
+	delete[] texcoords;
+
+	return true;
+}
+
+bool bake_obj_file(const char* objPath, const char* meshPath, JobPool* pool, MeshVertexFormat vertexFormat)
+{
+	static const int MAX_MATERIALS = 64;
+
+	AutoArray<vec4> vertices;
+	AutoArray<vec3> normals;
+	AutoArray<vec2> texcoords;
+	AutoArray<uint32_t> elements;
+	MaterialInfo materials[MAX_MATERIALS];
+	int numMaterials = load_obj(objPath, vertices, normals, texcoords, elements, materials, MAX_MATERIALS, pool);
+	if(vertices.Count() == 0) return false;
+
+	int startIndices[MAX_MATERIALS];
+	for(int i = 0; i < numMaterials; ++i)
+		startIndices[i] = materials[i].startIndex;
+
+	int numVertices = optimize_mesh(vertices.First(), normals.First(), texcoords.First(), vertices.Count(),
+		elements.First(), elements.Count(), startIndices, numMaterials);
+
+	// the renderers pick levels by how far each strays, so any amount will do
+	LodLevel levels[MAX_MESH_LODS];
+	int rangeStarts[MAX_MESH_LODS * MAX_MATERIALS];
+	int numLods = build_lod_chain(elements, startIndices, numMaterials, vertices.First(), normals.First(), texcoords.First(),
+		numVertices, FLT_MAX, MAX_MESH_LODS, levels, rangeStarts);
+
+	// starts are kept relative to each level
+	int numRanges = MAX(numMaterials, 1);
+	MeshLodSource lods[MAX_MESH_LODS];
+	for(int i = 0; i < numLods; ++i)
+	{
+		int* starts = rangeStarts + i * numRanges;
+		for(int j = 0; j < numRanges; ++j)
+			starts[j] -= levels[i].startIndex;
+
+		lods[i].elements = elements.First() + levels[i].startIndex;
+		lods[i].numIndices = levels[i].numIndices;
+		lods[i].startIndices = starts;
+		lods[i].error = levels[i].error;
+	}
+
+	MeshSource source;
+	source.positions = vertices.First();
+	source.normals = normals.First();
+	source.texcoords = texcoords.First();
+	source.numVertices = numVertices;
+	source.vertexFormat = vertexFormat;
+	source.materials = materials;
+	source.numMaterials = numMaterials;
+	source.lods = lods;
+	source.numLods = numLods;
+
+	return bake_mesh_file(source, meshPath);
+}
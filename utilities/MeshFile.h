@@ -0,0 +1,164 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include "GLMath.h"
+#include "DataTypes.h"
+#include "MeshProcessing.h"
+
+#include <stddef.h>
+
+struct MaterialInfo;
+class JobPool;
+
+// Baked meshes are laid out exactly as they're uploaded, so loading one is
+// mapping the file and pointing the graphics API at it, with nothing parsed
+// or copied on the way. A header is followed by the vertices, the indices,
+// the submesh table, the level of detail table and the meshlet table, each
+// section starting on a MESH_FILE_ALIGNMENT boundary. Everything is
+// little-endian; a file baked on a machine of the other order is turned away
+// rather than swapped.
+//
+// Every level of detail has its own run of indices into the shared vertices,
+// and its own numSubmeshes entries in the submesh table, so a level draws the
+// same way the full detail mesh does. Each submesh's triangles are ordered
+// meshlet by meshlet, so any run of its meshlets is a run of its indices.
+
+static const uint32_t MESH_FILE_VERSION = 3;
+static const int MESH_FILE_ALIGNMENT = 64;
+static const int MESH_FILE_NAME_SIZE = 52;
+
+enum MeshVertexFormat
+{
+	MESH_VERTEX_FLOAT, // MeshFileVertex
+	MESH_VERTEX_PACKED, // PackedVertex
+};
+
+// texcoord comes straight after position, so the same attribute offsets
+// work as for vertices built at load time
+struct MeshFileVertex
+{
+	float position[4];
+	float texcoord[2];
+	float normal[3];
+};
+
+struct MeshFileSubmesh
+{
+	uint32_t startIndex; // from the start of the whole index section
+	uint32_t numIndices;
+	uint32_t firstMeshlet;
+	uint32_t numMeshlets;
+	float alpha;
+	char textureName[MESH_FILE_NAME_SIZE]; // null-terminated
+};
+
+struct MeshFileLod
+{
+	uint32_t startIndex;
+	uint32_t numIndices;
+	uint32_t firstSubmesh;
+	float error; // how far from the full detail surface it strays, in model units
+};
+
+// as Meshlet in MeshProcessing.h
+struct MeshFileMeshlet
+{
+	uint32_t startIndex; // from the start of the whole index section
+	uint32_t numIndices;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+struct MeshFileHeader
+{
+	char magic[4]; // "MESH"
+	uint32_t version;
+	uint32_t fileSize;
+
+	uint32_t vertexFormat;
+	uint32_t vertexSize;
+	uint32_t numVertices;
+	uint32_t indexSize; // 2 or 4 bytes
+	uint32_t numIndices;
+	uint32_t numSubmeshes; // per level of detail
+	uint32_t numLods;
+	uint32_t numMeshlets;
+
+	float boundsMin[3];
+	float boundsMax[3];
+
+	// packed positions and texture coordinates are offset + scale * t, with t
+	// between 0 and 1; float vertices leave these at no offset and no scale
+	float positionOffset[3];
+	float positionScale[3];
+	float texcoordOffset[2];
+	float texcoordScale[2];
+
+	uint32_t vertexOffset;
+	uint32_t indexOffset;
+	uint32_t submeshOffset;
+	uint32_t lodOffset;
+	uint32_t meshletOffset;
+};
+
+// A baked file mapped into memory. Pointers are into the mapping and stay
+// valid until unmap_mesh_file.
+struct MappedMesh
+{
+	const MeshFileHeader* header;
+	const void* vertices;
+	const void* indices;
+	const MeshFileSubmesh* submeshes;
+	const MeshFileLod* lods;
+	const MeshFileMeshlet* meshlets;
+
+	const char* data;
+	size_t size;
+};
+
+// Maps a baked mesh and checks that everything the header points to lies
+// inside the file, that every table entry points inside the sections it
+// indexes and that every index names a vertex; on failure the mesh is left
+// empty.
+bool map_mesh_file(const char* path, MappedMesh* mesh);
+void unmap_mesh_file(MappedMesh* mesh);
+
+// how the header says to take packed vertices back to model space
+VertexQuantization get_vertex_quantization(const MeshFileHeader* header);
+
+// BAKING
+//-------------------------------------------------------------------------------------------------
+
+struct MeshLodSource
+{
+	const uint32_t* elements;
+	int numIndices;
+	const int* startIndices; // where each material starts, within elements
+	float error;
+};
+
+struct MeshSource
+{
+	const vec4* positions;
+	const vec3* normals;
+	const vec2* texcoords;
+	int numVertices;
+	MeshVertexFormat vertexFormat;
+
+	const MaterialInfo* materials;
+	int numMaterials;
+
+	const MeshLodSource* lods; // the first is full detail
+	int numLods;
+};
+
+bool bake_mesh_file(const MeshSource& source, const char* path);
+
+// loads a Wavefront OBJ, and its material library, and bakes it with a chain
+// of levels of detail after the full detail one
+bool bake_obj_file(const char* objPath, const char* meshPath, JobPool* pool = nullptr,
+	MeshVertexFormat vertexFormat = MESH_VERTEX_PACKED);
+
+#endif
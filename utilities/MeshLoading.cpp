@@ -1,277 +1,609 @@
 #include "MeshLoading.h"
 
+#include "FileHandling.h"
 #include "Logging.h"
+#include "MeshProcessing.h"
+#include "NumberMacros.h"
 
-#include <vector>
-#include <map>
-#include <string>
-#include <fstream>
-#include <sstream>
+#include "concurrent/JobPool.h"
 
 #include <math.h>
 #include <cstring>
-#include <cstdlib>
 
-using std::vector;
-using std::map;
-using std::string;
+// The file is mapped rather than read, and parsed in place with scanners that
+// never look past the end of it, since a mapped file isn't null-terminated.
+// Big files are cut into chunks at line breaks which are parsed in parallel,
+// then stitched back together, with relative indices resolved once every
+// chunk's counts are known.
 
-using std::ifstream;
-using std::istringstream;
+// NUMBER SCANNING
+//-------------------------------------------------------------------------------------------------
 
-struct PackedVertex
+static const double powersOfTen[] =
 {
-	vec4 position;
-	vec2 uv;
-	vec3 normal;
-	vec4 boneIndices;
-	vec4 boneWeights;
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_spaces(const char* s, const char* end)
+{
+	while(s < end && is_space(*s)) ++s;
+	return s;
+}
 
-	bool operator < (const PackedVertex& that) const
+static inline const char* skip_line(const char* s, const char* end)
+{
+	const char* newline = (const char*) memchr(s, '\n', end - s);
+	return (newline)? newline + 1 : end;
+}
+
+static const char* scan_int(const char* s, const char* end, int* value)
+{
+	bool negative = false;
+	if(s < end && (*s == '-' || *s == '+'))
 	{
-		return memcmp((void*)this, (void*)&that, sizeof(PackedVertex)) > 0;
+		negative = *s == '-';
+		++s;
 	}
-};
 
-static bool get_similar_vertex_index(
-	PackedVertex& packed,
-	map<PackedVertex,unsigned short>& VertexToOutIndex,
-	unsigned short& result)
+	int x = 0;
+	for(; s < end && is_digit(*s); ++s)
+		x = 10 * x + (*s - '0');
+
+	*value = (negative)? -x : x;
+	return s;
+}
+
+// Up to nineteen significant digits are kept as an integer and scaled once
+// by a power of ten, which rounds no worse than half a float ulp or so.
+static const char* scan_float(const char* s, const char* end, float* value)
 {
-	map<PackedVertex,unsigned short>::iterator it = VertexToOutIndex.find(packed);
-	if(it == VertexToOutIndex.end()) 
+	bool negative = false;
+	if(s < end && (*s == '-' || *s == '+'))
+	{
+		negative = *s == '-';
+		++s;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	for(; s < end && is_digit(*s); ++s)
+	{
+		if(digits < 19)
+		{
+			mantissa = 10 * mantissa + (*s - '0');
+			if(mantissa != 0) ++digits;
+		}
+		else ++exponent;
+	}
+	if(s < end && *s == '.')
+	{
+		for(++s; s < end && is_digit(*s); ++s)
+		{
+			if(digits < 19)
+			{
+				mantissa = 10 * mantissa + (*s - '0');
+				if(mantissa != 0) ++digits;
+				--exponent;
+			}
+		}
+	}
+	if(s < end && (*s == 'e' || *s == 'E'))
 	{
-		return false;
+		int power;
+		s = scan_int(s + 1, end, &power);
+		exponent += power;
 	}
-	else 
+
+	double x = double(mantissa);
+	if(exponent < 0)
 	{
-		result = it->second;
-		return true;
+		x = (exponent >= -22)? x / powersOfTen[-exponent] : x / pow(10.0, -exponent);
 	}
+	else if(exponent > 0)
+	{
+		x = (exponent <= 22)? x * powersOfTen[exponent] : x * pow(10.0, exponent);
+	}
+
+	*value = float((negative)? -x : x);
+	return s;
+}
+
+// PARSING CHUNKS
+//-------------------------------------------------------------------------------------------------
+
+static const int NO_INDEX = -1;
+
+// Indices are zero-based. One counted back from the end, like -1, is stored
+// relative to the start of its own chunk, with its flag set, and can point
+// into an earlier chunk until it's resolved.
+struct ObjCorner
+{
+	enum
+	{
+		RELATIVE_POSITION = 1,
+		RELATIVE_TEXCOORD = 2,
+		RELATIVE_NORMAL = 4,
+	};
+
+	int position;
+	int texcoord;
+	int normal;
+	int flags;
+};
+
+struct ObjMaterialUse
+{
+	const char* name;
+	int nameLength;
+	int firstCorner; // within the chunk
+};
+
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+
+	AutoArray<vec4> positions;
+	AutoArray<vec2> texcoords;
+	AutoArray<vec3> normals;
+	AutoArray<ObjCorner> corners; // three per triangle
+	AutoArray<ObjMaterialUse> uses;
+	AutoArray<ObjCorner> polygon;
+
+	const char* library;
+	int libraryLength;
+};
+
+static const char* scan_word(const char* s, const char* end, const char** word, int* length)
+{
+	s = skip_spaces(s, end);
+	const char* start = s;
+	while(s < end && !is_space(*s) && *s != '\n') ++s;
+	*word = start;
+	*length = s - start;
+	return s;
+}
+
+static bool starts_with(const char* s, const char* end, const char* prefix, int length)
+{
+	return end - s > length && memcmp(s, prefix, length) == 0 && is_space(s[length]);
 }
 
-static void index_VBO(
-	const vector<vec4> & in_vertices,
-	const vector<vec2> & in_uvs,
-	const vector<vec3> & in_normals,
-	AutoArray<unsigned short> & out_indices,
-	AutoArray<vec4> & out_vertices,
-	AutoArray<vec2> & out_uvs,
-	AutoArray<vec3> & out_normals
-)
+static const char* scan_corner(const char* s, const char* end, const ObjChunk& chunk, ObjCorner* corner)
 {
-	map<PackedVertex,unsigned short> VertexToOutIndex;
+	int counts[3] = { int(chunk.positions.Count()), int(chunk.texcoords.Count()), int(chunk.normals.Count()) };
+	int* indices[3] = { &corner->position, &corner->texcoord, &corner->normal };
+	corner->flags = 0;
 
-	// For each input vertex
-	unsigned int numVertices = in_vertices.size();
-	for (unsigned int i = 0; i < numVertices; i++)
+	// v, v/vt, v//vn or v/vt/vn
+	for(int i = 0; i < 3; ++i)
 	{
-		PackedVertex packed;
-		packed.position = in_vertices[i];
-		packed.uv = in_uvs[i];
-		packed.normal = in_normals[i];
-		
-		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = get_similar_vertex_index(packed, VertexToOutIndex, index);
-
-		if(found)
+		int raw = 0;
+		if(s < end && *s != '/')
+			s = scan_int(s, end, &raw);
+
+		if(raw > 0)
 		{
-			// A similar vertex is already in the VBO, use it instead !
-			out_indices.Push(index);
+			*indices[i] = raw - 1;
 		}
+		else if(raw < 0)
+		{
+			*indices[i] = counts[i] + raw;
+			corner->flags |= 1 << i;
+		}
+		else *indices[i] = NO_INDEX;
+
+		if(s < end && *s == '/') ++s;
 		else
 		{
-			out_vertices.Push(in_vertices[i]);
-			out_uvs.Push(in_uvs[i]);
-			out_normals.Push(in_normals[i]);
-			unsigned short newindex = (unsigned short) out_vertices.Count() - 1;
-			out_indices.Push(newindex);
-			VertexToOutIndex[packed] = newindex;
+			for(++i; i < 3; ++i) *indices[i] = NO_INDEX;
+			break;
 		}
 	}
+	return s;
 }
 
-int load_obj(
-	const char* filename,
-	AutoArray<vec4> &vertices,
-	AutoArray<vec3> &normals,
-	AutoArray<vec2> &texcoords,
-	AutoArray<unsigned short> &elements,
-	MaterialInfo* materials)
+static void parse_obj_chunk(ObjChunk* chunk)
 {
-	ifstream in(filename, std::ios::in);
-	if(!in)
+	const char* end = chunk->end;
+	for(const char* s = chunk->begin; s < end; s = skip_line(s, end))
 	{
-		Log::Add(Log::ISSUE, "Cannot open %s", filename);
-		return 0;
-	}
-
-	vector<vec4> tempVerts;
-	vector<vec2> tempCoords;
-	vector<vec3> tempNormals;
-	vector<int> vertIndices, uvIndices, normIndices;
-	string matlib;
-	vector<string> mats;
-	vector<int> matIndices;
+		s = skip_spaces(s, end);
+		if(end - s < 2) continue;
 
-	string line;
-	while(getline(in, line)) 
-	{
-		if (line.substr(0,2) == "v ") 
+		if(s[0] == 'v' && is_space(s[1]))
 		{
-			istringstream s(line.substr(2));
-			vec4 v; 
-			s >> v.x;
-			s >> v.y; 
-			s >> v.z; 
+			vec4 v;
+			s = scan_float(skip_spaces(s + 2, end), end, &v.x);
+			s = scan_float(skip_spaces(s, end), end, &v.y);
+			s = scan_float(skip_spaces(s, end), end, &v.z);
 			v.w = 1.0f;
-			tempVerts.push_back(v);
-		}  
-		else if (line.substr(0,2) == "vt") 
+			chunk->positions.Push(v);
+		}
+		else if(s[0] == 'v' && s[1] == 't')
 		{
-			istringstream s(line.substr(2));
 			vec2 v;
-			s >> v.x;
-			s >> v.y;
-
-			// ensure texcoords are between 0 and 1
-			double intPart;
-			v.x = modf(v.x, &intPart);
-			v.y = modf(v.y, &intPart);
-			if(v.x < 0.0f)
-				v.x += 1.0f;
-			if(v.y < 0.0f)
-				v.y += 1.0f;
-
-			tempCoords.push_back(v);
-		}  
-		else if (line.substr(0,2) == "vn") 
+			s = scan_float(skip_spaces(s + 2, end), end, &v.x);
+			s = scan_float(skip_spaces(s, end), end, &v.y);
+			chunk->texcoords.Push(v);
+		}
+		else if(s[0] == 'v' && s[1] == 'n')
 		{
-			istringstream s(line.substr(2));
-			vec3 v; 
-			s >> v.x; 
-			s >> v.y; 
-			s >> v.z; 
-			tempNormals.push_back(v);
-		}  
-		else if (line.substr(0,2) == "f ") 
+			vec3 v;
+			s = scan_float(skip_spaces(s + 2, end), end, &v.x);
+			s = scan_float(skip_spaces(s, end), end, &v.y);
+			s = scan_float(skip_spaces(s, end), end, &v.z);
+			chunk->normals.Push(v);
+		}
+		else if(s[0] == 'f' && is_space(s[1]))
 		{
-			istringstream s(line.substr(2));
-			unsigned short a,b,c,i,j,k,x,y,z;
-
-			s >> a; 
-			s.ignore(1, L'/');
-			s >> i;
-			s.ignore(1, L'/');
-			s >> x;
-			s.ignore(16, L' ');
-
-			s >> b; 
-			s.ignore(1, L'/');
-			s >> j; 
-			s.ignore(1, L'/');
-			s >> y;
-			s.ignore(16, L' ');
-
-			s >> c;
-			s.ignore(1, L'/');
-			s >> k;
-			s.ignore(1, L'/');
-			s >> z;
-			s.ignore(16, L' ');
-
-			vertIndices.push_back(a); 
-			vertIndices.push_back(b);
-			vertIndices.push_back(c);
-			uvIndices.push_back(i);
-			uvIndices.push_back(j);
-			uvIndices.push_back(k);
-			normIndices.push_back(x);
-			normIndices.push_back(y);
-			normIndices.push_back(z);
+			// polygons of any size become fans of triangles around the first corner
+			AutoArray<ObjCorner>& polygon = chunk->polygon;
+			polygon.Clear();
+			for(s = skip_spaces(s + 2, end); s < end && *s != '\n'; s = skip_spaces(s, end))
+			{
+				ObjCorner corner;
+				const char* next = scan_corner(s, end, *chunk, &corner);
+				if(next == s) break;
+				polygon.Push(corner);
+				s = next;
+			}
+
+			for(size_t i = 2; i < polygon.Count(); ++i)
+			{
+				chunk->corners.Push(polygon[0]);
+				chunk->corners.Push(polygon[i - 1]);
+				chunk->corners.Push(polygon[i]);
+			}
 		}
-		else if (line.substr(0,6) == "mtllib")
+		else if(starts_with(s, end, "usemtl", 6))
 		{
-			istringstream s(line.substr(6));
-			s >> matlib;
+			ObjMaterialUse use;
+			scan_word(s + 6, end, &use.name, &use.nameLength);
+			use.firstCorner = chunk->corners.Count();
+			chunk->uses.Push(use);
 		}
-		else if (line.substr(0,6) == "usemtl")
+		else if(starts_with(s, end, "mtllib", 6))
 		{
-			istringstream s(line.substr(6));
-			string material;
-			s >> material;
-			mats.push_back(material);
-			matIndices.push_back(vertIndices.size());
+			scan_word(s + 6, end, &chunk->library, &chunk->libraryLength);
 		}
 	}
+}
+
+// JOINING CHUNKS
+//-------------------------------------------------------------------------------------------------
+
+static int resolve_index(int index, bool relative, int base, int count)
+{
+	if(relative) index += base;
+	else if(index == NO_INDEX) return NO_INDEX;
+	return (index >= 0 && index < count)? index : NO_INDEX;
+}
+
+static inline uint32_t hash_corner(int position, int texcoord, int normal)
+{
+	uint32_t h = uint32_t(position) * 0x9E3779B1;
+	h ^= uint32_t(texcoord) * 0x85EBCA77 + (h << 6) + (h >> 2);
+	h ^= uint32_t(normal) * 0xC2B2AE3D + (h << 6) + (h >> 2);
+	return h;
+}
 
-	vector<vec4> out_vertices;
-	vector<vec2> out_uvs;
-	vector<vec3> out_normals;
+// Corners naming the same position, texture coordinate and normal share a
+// vertex, found through an open addressing table keyed by the index triple.
+struct CornerTable
+{
+	int* keys; // three per slot, the first NO_INDEX - 1 when the slot is empty
+	uint32_t* vertices;
+	uint32_t mask;
 
-	unsigned int lengthIndices = vertIndices.size();
-	for(unsigned int i = 0; i < lengthIndices; i++)
+	explicit CornerTable(size_t numCorners)
 	{
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normIndices[i];
-		
-		// Get the attributes thanks to the index
-		vec4 vertex = tempVerts[vertexIndex-1];
-		vec2 uv = tempCoords[uvIndex-1];
-		vec3 normal = tempNormals[normalIndex-1];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs.push_back(uv);
-		out_normals.push_back(normal);
+		uint32_t size = 16;
+		while(size < 2 * numCorners) size <<= 1;
+		keys = new int[3 * size];
+		vertices = new uint32_t[size];
+		mask = size - 1;
+		for(uint32_t i = 0; i < size; ++i)
+			keys[3 * i] = NO_INDEX - 1;
 	}
 
-	index_VBO(out_vertices, out_uvs, out_normals, elements, vertices, texcoords, normals);
+	~CornerTable()
+	{
+		delete[] keys;
+		delete[] vertices;
+	}
 
-	int numMaterials = mats.size();
-	for(int i = 0; i < numMaterials; i++)
+	// true if the slot was empty, which the caller fills in
+	bool Find(const ObjCorner& c, uint32_t** vertex)
 	{
-		materials[i].startIndex = matIndices[i];
+		for(uint32_t i = hash_corner(c.position, c.texcoord, c.normal) & mask;; i = (i + 1) & mask)
+		{
+			int* key = keys + 3 * i;
+			if(key[0] == NO_INDEX - 1)
+			{
+				key[0] = c.position;
+				key[1] = c.texcoord;
+				key[2] = c.normal;
+				*vertex = vertices + i;
+				return true;
+			}
+			if(key[0] == c.position && key[1] == c.texcoord && key[2] == c.normal)
+			{
+				*vertex = vertices + i;
+				return false;
+			}
+		}
 	}
+};
+
+// below this there's little to gain from more than one chunk
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+struct ChunkParser
+{
+	ObjChunk* chunks;
 
-	string filePath = string(filename);
-	string directory = filePath.substr(0, filePath.find_last_of(L'/') + 1);
-	string mtlPath = directory + matlib;
+	void operator () (int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+			parse_obj_chunk(&chunks[i]);
+	}
+};
 
-	ifstream matIn(mtlPath, std::ios::in);
-	if(!matIn)
+static void load_materials(const char* path, const ObjMaterialUse* uses, int numUses, MaterialInfo* materials)
+{
+	void* data;
+	size_t size = load_binary_file(&data, path);
+	if(size == 0)
 	{
-		Log::Add(Log::ISSUE, "material file: %s for model %s failed to load!",
-			mtlPath.c_str(), filename);
+		LOG_ISSUE("material file: %s failed to load!", path);
+		return;
 	}
 
-	int matInd = 0;
-	while (getline(matIn, line))
+	const char* text = (const char*) data;
+	const char* end = text + size;
+
+	// a material may be used more than once, so settings go to every use of
+	// the current name
+	const char* name = nullptr;
+	int nameLength = 0;
+	for(const char* s = text; s < end; s = skip_line(s, end))
 	{
-		if (line.substr(0,6) == "newmtl")
+		s = skip_spaces(s, end);
+		if(starts_with(s, end, "newmtl", 6))
 		{
-			line = line.substr(7);
-			for(size_t i = 0; i < mats.size(); i++)
+			scan_word(s + 6, end, &name, &nameLength);
+			continue;
+		}
+		if(name == nullptr) continue;
+
+		if(starts_with(s, end, "map_Kd", 6))
+		{
+			// keep only the file name, wherever the exporter thought it was;
+			// the path runs to the end of the line, since it may have spaces
+			const char* word = skip_spaces(s + 6, end);
+			const char* lineEnd = (word < end)? (const char*) memchr(word, '\n', end - word) : nullptr;
+			if(lineEnd == nullptr) lineEnd = end;
+			while(lineEnd > word && is_space(lineEnd[-1])) --lineEnd;
+			int length = lineEnd - word;
+			for(int i = length - 1; i >= 0; --i)
+			{
+				if(word[i] == '/' || word[i] == '\\')
+				{
+					word += i + 1;
+					length -= i + 1;
+					break;
+				}
+			}
+
+			char* fileName = new char[length + 1];
+			memcpy(fileName, word, length);
+			fileName[length] = '\0';
+			for(int i = 0; i < numUses; ++i)
+			{
+				if(uses[i].nameLength == nameLength && memcmp(uses[i].name, name, nameLength) == 0)
+					materials[i].texName = fileName;
+			}
+			delete[] fileName;
+		}
+		else if(starts_with(s, end, "d", 1))
+		{
+			float alpha;
+			scan_float(skip_spaces(s + 1, end), end, &alpha);
+			for(int i = 0; i < numUses; ++i)
 			{
-				if(mats[i] == line)
-					matInd = i;
+				if(uses[i].nameLength == nameLength && memcmp(uses[i].name, name, nameLength) == 0)
+					materials[i].alpha = alpha;
 			}
 		}
-		else if(line.substr(0,6) == "map_Kd")
+	}
+
+	delete[] (char*) data;
+}
+
+int load_obj(
+	const char* filename,
+	AutoArray<vec4>& vertices,
+	AutoArray<vec3>& normals,
+	AutoArray<vec2>& texcoords,
+	AutoArray<uint32_t>& elements,
+	MaterialInfo* materials,
+	int maxMaterials,
+	JobPool* pool)
+{
+	size_t size;
+	const char* file = map_file(filename, &size);
+	if(file == nullptr)
+	{
+		LOG_ISSUE("Cannot open %s", filename);
+		return 0;
+	}
+	const char* fileEnd = file + size;
+
+	// cut the file into chunks that each start on a new line
+	int numChunks = 1;
+	if(pool) numChunks = MAX(1, MIN(int(size / MIN_CHUNK_SIZE), 4 * pool->GetThreadCount()));
+
+	ObjChunk* chunks = new ObjChunk[numChunks];
+	const char* start = file;
+	for(int i = 0; i < numChunks; ++i)
+	{
+		const char* split = (i == numChunks - 1)? fileEnd : file + size * (i + 1) / numChunks;
+		if(split < start) split = start;
+		else if(split < fileEnd) split = skip_line(split, fileEnd);
+
+		chunks[i].begin = start;
+		chunks[i].end = split;
+		chunks[i].library = nullptr;
+		chunks[i].libraryLength = 0;
+		start = split;
+	}
+
+	ChunkParser parser;
+	parser.chunks = chunks;
+	if(pool) pool->ParallelFor(numChunks, 1, parser);
+	else parser(0, numChunks);
+
+	// put the chunks' attributes end to end
+	int numPositions = 0, numTexcoords = 0, numNormals = 0;
+	size_t numCorners = 0;
+	for(int i = 0; i < numChunks; ++i)
+	{
+		numPositions += chunks[i].positions.Count();
+		numTexcoords += chunks[i].texcoords.Count();
+		numNormals += chunks[i].normals.Count();
+		numCorners += chunks[i].corners.Count();
+	}
+
+	vec4* positions = new vec4[numPositions];
+	vec2* coords = new vec2[numTexcoords];
+	vec3* norms = new vec3[numNormals];
+
+	CornerTable table(numCorners);
+	elements.Resize(MAX(numCorners, size_t(1)));
+	int numBadIndices = 0;
+	int numUses = 0;
+	const char* library = nullptr;
+	int libraryLength = 0;
+
+	for(int i = 0, positionBase = 0, texcoordBase = 0, normalBase = 0, cornerBase = 0; i < numChunks; ++i)
+	{
+		ObjChunk& chunk = chunks[i];
+		for(size_t j = 0; j < chunk.positions.Count(); ++j)
+			positions[positionBase + j] = chunk.positions[j];
+		for(size_t j = 0; j < chunk.texcoords.Count(); ++j)
+			coords[texcoordBase + j] = chunk.texcoords[j];
+		for(size_t j = 0; j < chunk.normals.Count(); ++j)
+			norms[normalBase + j] = chunk.normals[j];
+
+		// material uses past what the caller has room for are dropped, and
+		// their faces join the material before
+		for(size_t j = 0; j < chunk.uses.Count() && numUses < maxMaterials; ++j)
+		{
+			materials[numUses].startIndex = cornerBase + chunk.uses[j].firstCorner;
+			materials[numUses].alpha = 1.0f;
+			numUses++;
+		}
+		if(chunk.library)
 		{
-			size_t slashInd = line.rfind("\\\\");
-			line = line.substr(slashInd+2);
-			materials[matInd].texName = line.c_str();
+			library = chunk.library;
+			libraryLength = chunk.libraryLength;
+		}
+
+		for(size_t j = 0; j < chunk.corners.Count(); ++j)
+		{
+			ObjCorner c = chunk.corners[j];
+			c.position = resolve_index(c.position, c.flags & ObjCorner::RELATIVE_POSITION, positionBase, numPositions);
+			c.texcoord = resolve_index(c.texcoord, c.flags & ObjCorner::RELATIVE_TEXCOORD, texcoordBase, numTexcoords);
+			c.normal = resolve_index(c.normal, c.flags & ObjCorner::RELATIVE_NORMAL, normalBase, numNormals);
+			if(c.position == NO_INDEX)
+			{
+				numBadIndices++;
+				c.position = 0;
+			}
+
+			uint32_t* vertex;
+			if(table.Find(c, &vertex))
+			{
+				*vertex = vertices.Count();
+
+				vertices.Push((numPositions > 0)? positions[c.position] : vec4(0.0f, 0.0f, 0.0f, 1.0f));
+				normals.Push((c.normal != NO_INDEX)? norms[c.normal] : vec3(0.0f, 0.0f, 0.0f));
+
+				// texture coordinates are wrapped to between 0 and 1
+				vec2 uv(0.0f, 0.0f);
+				if(c.texcoord != NO_INDEX)
+				{
+					uv = coords[c.texcoord];
+					uv.x -= floorf(uv.x);
+					uv.y -= floorf(uv.y);
+				}
+				texcoords.Push(uv);
+			}
+			elements.Push(*vertex);
 		}
-		else if(line.substr(0,1) == "d")
+
+		positionBase += chunk.positions.Count();
+		texcoordBase += chunk.texcoords.Count();
+		normalBase += chunk.normals.Count();
+		cornerBase += chunk.corners.Count();
+	}
+
+	// exporters often repeat the same value under different indices, so
+	// corners still have to be welded by what they hold
+	int numWelded = weld_vertices(vertices.First(), normals.First(), texcoords.First(), vertices.Count(),
+		elements.First(), elements.Count(), 0.0f, 0.0f, pool);
+	if(numWelded > 0 && size_t(numWelded) < vertices.Count())
+	{
+		vertices.Resize(numWelded);
+		normals.Resize(numWelded);
+		texcoords.Resize(numWelded);
+	}
+
+	if(numBadIndices > 0)
+	{
+		LOG_ISSUE("%s has %d face corners with no position", filename, numBadIndices);
+	}
+
+	// the material library sits next to the model
+	if(numUses > 0 && library != nullptr)
+	{
+		const char* slash = strrchr(filename, '/');
+		int directoryLength = (slash)? slash - filename + 1 : 0;
+		char* path = new char[directoryLength + libraryLength + 1];
+		memcpy(path, filename, directoryLength);
+		memcpy(path + directoryLength, library, libraryLength);
+		path[directoryLength + libraryLength] = '\0';
+
+		ObjMaterialUse* uses = new ObjMaterialUse[numUses];
+		for(int i = 0, used = 0; i < numChunks && used < numUses; ++i)
 		{
-			line = line.substr(2);
-			float alpha = (float) atof(line.c_str());
-			materials[matInd].alpha = alpha;
+			for(size_t j = 0; j < chunks[i].uses.Count() && used < numUses; ++j)
+				uses[used++] = chunks[i].uses[j];
 		}
+		load_materials(path, uses, numUses, materials);
+
+		delete[] uses;
+		delete[] path;
 	}
-	return numMaterials;
+
+	delete[] positions;
+	delete[] coords;
+	delete[] norms;
+	delete[] chunks;
+	unmap_file(file, size);
+
+	return numUses;
 }
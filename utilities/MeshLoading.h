@@ -5,6 +5,9 @@
 
 #include "String.h"
 #include "GLMath.h"
+#include "DataTypes.h"
+
+class JobPool;
 
 struct MaterialInfo
 {
@@ -13,11 +16,19 @@ struct MaterialInfo
 	float alpha;
 };
 
+// Loads a Wavefront OBJ file into indexed triangles, one vertex for each
+// distinct position, texture coordinate and normal a face corner names.
+// Faces with more than three sides are split into fans, and corners may
+// leave out the texture coordinate or normal. Each usemtl starts a material,
+// up to maxMaterials, and the return is how many there were. With a pool,
+// big files are parsed a chunk per thread.
 int load_obj(const char* filename,
 	AutoArray<vec4>& vertices,
 	AutoArray<vec3>& normals,
 	AutoArray<vec2>& texcoords,
-	AutoArray<unsigned short>& elements, 
-	MaterialInfo* materials);
+	AutoArray<uint32_t>& elements,
+	MaterialInfo* materials,
+	int maxMaterials,
+	JobPool* pool = nullptr);
 
 #endif
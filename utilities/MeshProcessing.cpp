@@ -0,0 +1,1628 @@
+#include "MeshProcessing.h"
+
+#include "NumberMacros.h"
+#include "Sorting.h"
+#include "Maths.h"
+#include "Collision.h"
+
+#include "concurrent/JobPool.h"
+
+#include <math.h>
+#include <cstring>
+#include <float.h>
+
+// WELDING
+//-------------------------------------------------------------------------------------------------
+
+// Each vertex gets a key of its attributes rounded to whole grid cells, and
+// vertices with equal keys are merged through open addressing tables. Every
+// chunk of vertices is welded against itself first, then the survivors of
+// each chunk are merged in order through one more table, so the first vertex
+// of every group is kept no matter how the chunks fell.
+
+static const int WELD_KEY_SIZE = 9;
+
+struct WeldKey
+{
+	int32_t values[WELD_KEY_SIZE];
+};
+
+// with no grid, the float's own bits, minus the sign of zero
+static inline int32_t quantize(float x, float scale)
+{
+	if(scale == 0.0f)
+	{
+		if(x == 0.0f) return 0;
+		int32_t bits;
+		memcpy(&bits, &x, sizeof bits);
+		return bits;
+	}
+
+	// clamped so huge values don't overflow the conversion
+	float cell = floorf(x * scale + 0.5f);
+	cell = MIN(MAX(cell, -1073741824.0f), 1073741824.0f);
+	return int32_t(cell);
+}
+
+static inline uint32_t hash_weld_key(const WeldKey& key)
+{
+	uint64_t h = 0;
+	for(int i = 0; i < WELD_KEY_SIZE; ++i)
+		h = (h ^ uint32_t(key.values[i])) * 0x9E3779B97F4A7C15ull;
+	return uint32_t(h ^ (h >> 32));
+}
+
+static inline uint32_t table_size(int count)
+{
+	uint32_t size = 16;
+	while(size < 2u * uint32_t(count)) size <<= 1;
+	return size;
+}
+
+// below this a chunk isn't worth handing to another thread
+static const int MIN_WELD_CHUNK = 1 << 15;
+
+struct Welder
+{
+	const vec4* positions;
+	const vec3* normals;
+	const vec2* texcoords;
+	float positionScale;
+	float attributeScale;
+
+	WeldKey* keys;
+	uint32_t* hashes;
+	int* representatives; // the first vertex in its chunk with the same key
+	int* outputs;         // for each representative, where it ends up
+	uint32_t* elements;
+
+	int numVertices;
+	int numChunks;
+	int* chunkStarts;    // numChunks + 1 of them
+	int* survivorCounts; // representatives in each chunk, which come first
+	int* survivors;      // each chunk's representatives, from its start
+
+	// looks for a vertex with the same key as vertex, adding it if there's
+	// none, and returns the one found
+	int Find(int* table, uint32_t mask, int vertex)
+	{
+		for(uint32_t i = hashes[vertex] & mask;; i = (i + 1) & mask)
+		{
+			int other = table[i];
+			if(other < 0)
+			{
+				table[i] = vertex;
+				return vertex;
+			}
+			if(hashes[other] == hashes[vertex] &&
+				memcmp(&keys[other], &keys[vertex], sizeof(WeldKey)) == 0)
+			{
+				return other;
+			}
+		}
+	}
+
+	void MakeKeys(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+		{
+			int32_t* k = keys[i].values;
+			k[0] = quantize(positions[i].x, positionScale);
+			k[1] = quantize(positions[i].y, positionScale);
+			k[2] = quantize(positions[i].z, positionScale);
+			k[3] = quantize(positions[i].w, positionScale);
+			k[4] = quantize(normals[i].x, attributeScale);
+			k[5] = quantize(normals[i].y, attributeScale);
+			k[6] = quantize(normals[i].z, attributeScale);
+			k[7] = quantize(texcoords[i].x, attributeScale);
+			k[8] = quantize(texcoords[i].y, attributeScale);
+			hashes[i] = hash_weld_key(keys[i]);
+		}
+	}
+
+	void WeldChunk(int chunk)
+	{
+		int begin = chunkStarts[chunk];
+		int end = chunkStarts[chunk + 1];
+		uint32_t size = table_size(end - begin);
+		int* table = new int[size];
+		memset(table, -1, sizeof(int) * size);
+
+		int count = 0;
+		for(int i = begin; i < end; ++i)
+		{
+			int found = Find(table, size - 1, i);
+			representatives[i] = found;
+			if(found == i) survivors[begin + count++] = i;
+		}
+		survivorCounts[chunk] = count;
+
+		delete[] table;
+	}
+
+	void RenumberElements(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+			elements[i] = outputs[representatives[elements[i]]];
+	}
+};
+
+// ParallelFor takes one loop body, so each pass over the welder gets its own
+struct WeldKeyPass
+{
+	Welder* welder;
+	void operator () (int begin, int end) { welder->MakeKeys(begin, end); }
+};
+
+struct WeldChunkPass
+{
+	Welder* welder;
+	void operator () (int begin, int end) { for(int i = begin; i < end; ++i) welder->WeldChunk(i); }
+};
+
+struct WeldElementPass
+{
+	Welder* welder;
+	void operator () (int begin, int end) { welder->RenumberElements(begin, end); }
+};
+
+int weld_vertices(
+	vec4* positions,
+	vec3* normals,
+	vec2* texcoords,
+	int numVertices,
+	uint32_t* elements,
+	int numElements,
+	float positionEpsilon,
+	float attributeEpsilon,
+	JobPool* pool)
+{
+	if(numVertices <= 0) return 0;
+
+	Welder welder;
+	welder.positions = positions;
+	welder.normals = normals;
+	welder.texcoords = texcoords;
+	welder.positionScale = (positionEpsilon > 0.0f)? 1.0f / positionEpsilon : 0.0f;
+	welder.attributeScale = (attributeEpsilon > 0.0f)? 1.0f / attributeEpsilon : 0.0f;
+	welder.keys = new WeldKey[numVertices];
+	welder.hashes = new uint32_t[numVertices];
+	welder.representatives = new int[numVertices];
+	welder.outputs = new int[numVertices];
+	welder.survivors = new int[numVertices];
+	welder.elements = elements;
+	welder.numVertices = numVertices;
+
+	int numChunks = 1;
+	if(pool) numChunks = MAX(1, MIN(numVertices / MIN_WELD_CHUNK, 4 * pool->GetThreadCount()));
+	welder.numChunks = numChunks;
+	welder.chunkStarts = new int[numChunks + 1];
+	welder.survivorCounts = new int[numChunks];
+	for(int i = 0; i <= numChunks; ++i)
+		welder.chunkStarts[i] = int(int64_t(numVertices) * i / numChunks);
+
+	WeldKeyPass keyPass = { &welder };
+	WeldChunkPass chunkPass = { &welder };
+	if(pool)
+	{
+		pool->ParallelFor(numVertices, MIN_WELD_CHUNK, keyPass);
+		pool->ParallelFor(numChunks, 1, chunkPass);
+	}
+	else
+	{
+		keyPass(0, numVertices);
+		chunkPass(0, numChunks);
+	}
+
+	// merge the chunks in order, so each group keeps its earliest vertex
+	int numWelded = 0;
+	if(numChunks == 1)
+	{
+		for(int i = 0; i < welder.survivorCounts[0]; ++i)
+			welder.outputs[welder.survivors[i]] = numWelded++;
+	}
+	else
+	{
+		int numSurvivors = 0;
+		for(int i = 0; i < numChunks; ++i)
+			numSurvivors += welder.survivorCounts[i];
+
+		uint32_t size = table_size(numSurvivors);
+		int* table = new int[size];
+		memset(table, -1, sizeof(int) * size);
+		for(int i = 0; i < numChunks; ++i)
+		{
+			const int* survivors = welder.survivors + welder.chunkStarts[i];
+			for(int j = 0; j < welder.survivorCounts[i]; ++j)
+			{
+				int vertex = survivors[j];
+				int found = welder.Find(table, size - 1, vertex);
+				if(found == vertex)
+				{
+					welder.outputs[vertex] = numWelded;
+					welder.survivors[numWelded++] = vertex;
+				}
+				else
+				{
+					welder.outputs[vertex] = welder.outputs[found];
+				}
+			}
+		}
+		delete[] table;
+	}
+
+	// kept vertices only ever move toward the front, so this can't clobber
+	// one that's still to be moved
+	for(int i = 0; i < numWelded; ++i)
+	{
+		int from = welder.survivors[i];
+		positions[i] = positions[from];
+		normals[i] = normals[from];
+		texcoords[i] = texcoords[from];
+	}
+
+	WeldElementPass elementPass = { &welder };
+	if(pool) pool->ParallelFor(numElements, MIN_WELD_CHUNK, elementPass);
+	else elementPass(0, numElements);
+
+	delete[] welder.keys;
+	delete[] welder.hashes;
+	delete[] welder.representatives;
+	delete[] welder.outputs;
+	delete[] welder.survivors;
+	delete[] welder.chunkStarts;
+	delete[] welder.survivorCounts;
+
+	return numWelded;
+}
+
+// TRIANGLE ORDER
+//-------------------------------------------------------------------------------------------------
+
+// vertices further back than this aren't scored as being in the cache
+static const int SCORED_CACHE_SIZE = 32;
+static const int MAX_SCORED_VALENCE = 32;
+
+struct VertexScores
+{
+	float cache[SCORED_CACHE_SIZE];
+	float valence[MAX_SCORED_VALENCE];
+
+	VertexScores()
+	{
+		// the three vertices of the last triangle score the same, so there's
+		// no bias toward one winding; after that the score falls off
+		for(int i = 0; i < SCORED_CACHE_SIZE; ++i)
+		{
+			if(i < 3) cache[i] = 0.75f;
+			else cache[i] = powf(1.0f - float(i - 3) / (SCORED_CACHE_SIZE - 3), 1.5f);
+		}
+
+		// vertices with few triangles left get finished off first, so they
+		// don't linger and need reloading later
+		valence[0] = 0.0f;
+		for(int i = 1; i < MAX_SCORED_VALENCE; ++i)
+			valence[i] = 2.0f / sqrtf(float(i));
+	}
+
+	float Score(int cachePosition, int activeTriangles) const
+	{
+		if(activeTriangles == 0) return -1.0f;
+		float score = valence[MIN(activeTriangles, MAX_SCORED_VALENCE - 1)];
+		if(cachePosition >= 0) score += cache[cachePosition];
+		return score;
+	}
+};
+
+void optimize_vertex_cache(uint32_t* indices, int numIndices, int numVertices)
+{
+	static const VertexScores scores;
+
+	int numTriangles = numIndices / 3;
+	if(numTriangles == 0 || numVertices <= 0) return;
+
+	// triangles around each vertex, with the ones not yet drawn at the front
+	int* activeCounts = new int[numVertices];
+	int* offsets = new int[numVertices + 1];
+	int* adjacency = new int[numTriangles * 3];
+	memset(activeCounts, 0, sizeof(int) * numVertices);
+	for(int i = 0; i < numTriangles * 3; ++i)
+		activeCounts[indices[i]]++;
+	offsets[0] = 0;
+	for(int i = 0; i < numVertices; ++i)
+		offsets[i + 1] = offsets[i] + activeCounts[i];
+	int* filled = new int[numVertices];
+	memcpy(filled, offsets, sizeof(int) * numVertices);
+	for(int i = 0; i < numTriangles * 3; ++i)
+		adjacency[filled[indices[i]]++] = i / 3;
+	delete[] filled;
+
+	float* vertexScores = new float[numVertices];
+	for(int i = 0; i < numVertices; ++i)
+		vertexScores[i] = scores.Score(-1, activeCounts[i]);
+
+	float* triangleScores = new float[numTriangles];
+	bool* drawn = new bool[numTriangles];
+	for(int i = 0; i < numTriangles; ++i)
+	{
+		const uint32_t* t = indices + 3 * i;
+		triangleScores[i] = vertexScores[t[0]] + vertexScores[t[1]] + vertexScores[t[2]];
+		drawn[i] = false;
+	}
+
+	// the output is built to the side, since the input is still being read
+	uint32_t* output = new uint32_t[numTriangles * 3];
+	uint32_t cache[SCORED_CACHE_SIZE + 3];
+	uint32_t nextCache[SCORED_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int best = -1;
+	int cursor = 0;
+
+	for(int emitted = 0; emitted < numTriangles; ++emitted)
+	{
+		// when nothing in the cache leads anywhere, carry on from the first
+		// triangle left in input order
+		if(best < 0)
+		{
+			while(drawn[cursor]) cursor++;
+			best = cursor;
+		}
+
+		const uint32_t* t = indices + 3 * best;
+		output[3 * emitted + 0] = t[0];
+		output[3 * emitted + 1] = t[1];
+		output[3 * emitted + 2] = t[2];
+		drawn[best] = true;
+
+		// take the triangle out of its vertices' active lists
+		for(int i = 0; i < 3; ++i)
+		{
+			uint32_t v = t[i];
+			int* triangles = adjacency + offsets[v];
+			int count = activeCounts[v];
+			for(int j = 0; j < count; ++j)
+			{
+				if(triangles[j] == best)
+				{
+					triangles[j] = triangles[count - 1];
+					triangles[count - 1] = best;
+					break;
+				}
+			}
+			activeCounts[v] = count - 1;
+		}
+
+		// the triangle's vertices go to the front of the cache, and whatever
+		// falls off the back is no longer in it
+		int nextCount = 0;
+		nextCache[nextCount++] = t[0];
+		nextCache[nextCount++] = t[1];
+		nextCache[nextCount++] = t[2];
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			uint32_t v = cache[i];
+			if(v == t[0] || v == t[1] || v == t[2]) continue;
+			if(nextCount < SCORED_CACHE_SIZE)
+			{
+				nextCache[nextCount++] = v;
+				continue;
+			}
+
+			float score = scores.Score(-1, activeCounts[v]);
+			float change = score - vertexScores[v];
+			vertexScores[v] = score;
+			const int* triangles = adjacency + offsets[v];
+			for(int j = 0; j < activeCounts[v]; ++j)
+				triangleScores[triangles[j]] += change;
+		}
+		cacheCount = nextCount;
+		memcpy(cache, nextCache, sizeof(uint32_t) * cacheCount);
+
+		// rescore what's in the cache and the triangles around it, and pick
+		// the best of those to draw next
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			uint32_t v = cache[i];
+			float score = scores.Score(i, activeCounts[v]);
+			float change = score - vertexScores[v];
+			vertexScores[v] = score;
+
+			const int* triangles = adjacency + offsets[v];
+			for(int j = 0; j < activeCounts[v]; ++j)
+				triangleScores[triangles[j]] += change;
+		}
+
+		best = -1;
+		float bestScore = -1.0f;
+		for(int i = 0; i < cacheCount; ++i)
+		{
+			uint32_t v = cache[i];
+			const int* triangles = adjacency + offsets[v];
+			for(int j = 0; j < activeCounts[v]; ++j)
+			{
+				if(triangleScores[triangles[j]] > bestScore)
+				{
+					bestScore = triangleScores[triangles[j]];
+					best = triangles[j];
+				}
+			}
+		}
+	}
+
+	memcpy(indices, output, sizeof(uint32_t) * numTriangles * 3);
+
+	delete[] output;
+	delete[] drawn;
+	delete[] triangleScores;
+	delete[] vertexScores;
+	delete[] adjacency;
+	delete[] offsets;
+	delete[] activeCounts;
+}
+
+// the cache simulated to find where clusters start and end
+static const int CLUSTER_CACHE_SIZE = 16;
+
+// A first in, first out cache of vertices, kept as the time each vertex last
+// went in, so checking for one is a lookup instead of a search.
+struct FifoCache
+{
+	unsigned int* stamps;
+	unsigned int time;
+	int size;
+
+	FifoCache(int numVertices, int size):
+		time(size + 1),
+		size(size)
+	{
+		stamps = new unsigned int[numVertices];
+		memset(stamps, 0, sizeof(unsigned int) * numVertices);
+	}
+
+	~FifoCache()
+	{
+		delete[] stamps;
+	}
+
+	// true on a miss, which puts the vertex in the cache
+	bool Touch(uint32_t vertex)
+	{
+		if(time - stamps[vertex] <= unsigned(size)) return false;
+		stamps[vertex] = time++;
+		return true;
+	}
+
+	void Clear()
+	{
+		time += size + 1;
+	}
+
+private:
+	FifoCache(const FifoCache&);
+	FifoCache& operator = (const FifoCache&);
+};
+
+struct OverdrawCluster
+{
+	int firstTriangle;
+	int numTriangles;
+	float sortKey;
+};
+
+struct ClusterIsBefore
+{
+	bool operator () (const OverdrawCluster& a, const OverdrawCluster& b) const
+	{
+		return a.sortKey > b.sortKey;
+	}
+};
+
+void optimize_overdraw(uint32_t* indices, int numIndices, const vec4* positions, int numVertices, float threshold)
+{
+	int numTriangles = numIndices / 3;
+	if(numTriangles == 0 || numVertices <= 0) return;
+
+	// Clusters start wherever the cache order started over: at triangles
+	// where all three vertices miss. Within those, a cluster is ended early
+	// wherever the misses so far are no worse than threshold times those of
+	// the whole, with the cache starting empty for each.
+	int* misses = new int[numTriangles];
+	bool* starts = new bool[numTriangles + 1];
+	FifoCache cache(numVertices, CLUSTER_CACHE_SIZE);
+	for(int i = 0; i < numTriangles; ++i)
+	{
+		const uint32_t* t = indices + 3 * i;
+		misses[i] = int(cache.Touch(t[0])) + int(cache.Touch(t[1])) + int(cache.Touch(t[2]));
+		starts[i] = (i == 0 || misses[i] == 3);
+	}
+	starts[numTriangles] = true;
+
+	int numClusters = 0;
+	OverdrawCluster* clusters = new OverdrawCluster[numTriangles];
+	for(int begin = 0, end; begin < numTriangles; begin = end)
+	{
+		int total = 0;
+		for(end = begin; end == begin || !starts[end]; ++end)
+			total += misses[end];
+		float limit = threshold * float(total) / float(end - begin);
+
+		cache.Clear();
+		int first = begin;
+		int count = 0;
+		for(int i = begin; i < end; ++i)
+		{
+			const uint32_t* t = indices + 3 * i;
+			count += int(cache.Touch(t[0])) + int(cache.Touch(t[1])) + int(cache.Touch(t[2]));
+			if(i + 1 == end || float(count) <= limit * float(i - first + 1))
+			{
+				clusters[numClusters].firstTriangle = first;
+				clusters[numClusters].numTriangles = i - first + 1;
+				numClusters++;
+				first = i + 1;
+				count = 0;
+				cache.Clear();
+			}
+		}
+	}
+
+	// the middle of the mesh, weighted by area
+	vec3 meshCentre(0.0f, 0.0f, 0.0f);
+	float meshArea = 0.0f;
+	for(int i = 0; i < numTriangles; ++i)
+	{
+		const uint32_t* t = indices + 3 * i;
+		vec3 a(positions[t[0]].x, positions[t[0]].y, positions[t[0]].z);
+		vec3 b(positions[t[1]].x, positions[t[1]].y, positions[t[1]].z);
+		vec3 c(positions[t[2]].x, positions[t[2]].y, positions[t[2]].z);
+		float area = length(cross(b - a, c - a));
+		meshCentre += (a + b + c) * (area / 3.0f);
+		meshArea += area;
+	}
+	if(meshArea > 0.0f) meshCentre /= meshArea;
+
+	// clusters facing away from the middle are drawn first, since those
+	// are the ones most likely to be in front
+	for(int i = 0; i < numClusters; ++i)
+	{
+		OverdrawCluster& cluster = clusters[i];
+		vec3 centre(0.0f, 0.0f, 0.0f);
+		vec3 normal(0.0f, 0.0f, 0.0f);
+		float area = 0.0f;
+		for(int j = 0; j < cluster.numTriangles; ++j)
+		{
+			const uint32_t* t = indices + 3 * (cluster.firstTriangle + j);
+			vec3 a(positions[t[0]].x, positions[t[0]].y, positions[t[0]].z);
+			vec3 b(positions[t[1]].x, positions[t[1]].y, positions[t[1]].z);
+			vec3 c(positions[t[2]].x, positions[t[2]].y, positions[t[2]].z);
+			vec3 n = cross(b - a, c - a);
+			float triangleArea = length(n);
+			centre += (a + b + c) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+		if(area > 0.0f) centre /= area;
+		float normalLength = length(normal);
+		if(normalLength > 0.0f) normal /= normalLength;
+		cluster.sortKey = dot(centre - meshCentre, normal);
+	}
+
+	// a stable sort, so clusters facing the same way stay in cache order
+	OverdrawCluster* buffer = new OverdrawCluster[numClusters];
+	merge_sort(clusters, buffer, numClusters, ClusterIsBefore());
+	delete[] buffer;
+
+	uint32_t* output = new uint32_t[numTriangles * 3];
+	uint32_t* out = output;
+	for(int i = 0; i < numClusters; ++i)
+	{
+		int count = 3 * clusters[i].numTriangles;
+		memcpy(out, indices + 3 * clusters[i].firstTriangle, sizeof(uint32_t) * count);
+		out += count;
+	}
+	memcpy(indices, output, sizeof(uint32_t) * numTriangles * 3);
+
+	delete[] output;
+	delete[] clusters;
+	delete[] starts;
+	delete[] misses;
+}
+
+// VERTEX ORDER
+//-------------------------------------------------------------------------------------------------
+
+template<typename T>
+static void gather(T* items, const int* sources, int count)
+{
+	T* scratch = new T[count];
+	for(int i = 0; i < count; ++i)
+		scratch[i] = items[sources[i]];
+	for(int i = 0; i < count; ++i)
+		items[i] = scratch[i];
+	delete[] scratch;
+}
+
+int optimize_vertex_fetch(vec4* positions, vec3* normals, vec2* texcoords, int numVertices,
+	uint32_t* indices, int numIndices)
+{
+	if(numVertices <= 0) return 0;
+
+	int* remap = new int[numVertices];
+	int* sources = new int[numVertices];
+	for(int i = 0; i < numVertices; ++i)
+		remap[i] = -1;
+
+	int numUsed = 0;
+	for(int i = 0; i < numIndices; ++i)
+	{
+		uint32_t v = indices[i];
+		if(remap[v] < 0)
+		{
+			remap[v] = numUsed;
+			sources[numUsed++] = v;
+		}
+		indices[i] = remap[v];
+	}
+
+	gather(positions, sources, numUsed);
+	gather(normals, sources, numUsed);
+	gather(texcoords, sources, numUsed);
+
+	delete[] sources;
+	delete[] remap;
+
+	return numUsed;
+}
+
+int optimize_mesh(vec4* positions, vec3* normals, vec2* texcoords, int numVertices,
+	uint32_t* indices, int numIndices, const int* startIndices, int numRanges)
+{
+	for(int i = 0; i < MAX(numRanges, 1); ++i)
+	{
+		int start = (numRanges > 0)? startIndices[i] : 0;
+		int end = (i + 1 < numRanges)? startIndices[i + 1] : numIndices;
+		optimize_vertex_cache(indices + start, end - start, numVertices);
+		optimize_overdraw(indices + start, end - start, positions, numVertices, 1.05f);
+	}
+	return optimize_vertex_fetch(positions, normals, texcoords, numVertices, indices, numIndices);
+}
+
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, int numIndices, int numVertices, int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.acmr = 0.0f;
+	stats.atvr = 0.0f;
+	if(numIndices < 3 || numVertices <= 0) return stats;
+
+	FifoCache cache(numVertices, cacheSize);
+	bool* used = new bool[numVertices];
+	memset(used, 0, sizeof(bool) * numVertices);
+
+	int misses = 0;
+	int numUsed = 0;
+	for(int i = 0; i < numIndices; ++i)
+	{
+		uint32_t v = indices[i];
+		misses += int(cache.Touch(v));
+		if(!used[v])
+		{
+			used[v] = true;
+			numUsed++;
+		}
+	}
+	delete[] used;
+
+	stats.acmr = float(misses) / float(numIndices / 3);
+	stats.atvr = float(misses) / float(numUsed);
+	return stats;
+}
+
+// LEVELS OF DETAIL
+//-------------------------------------------------------------------------------------------------
+
+// Positions are scaled into a unit box first and the attributes weighted
+// against that, so the same settings suit meshes of any size. Each vertex is
+// then a point in eight dimensions, and each triangle a plane through three
+// of them, whose quadric measures squared distance from it. Collapses are
+// ordered by that, but the error reported and held under maxError is only
+// the distance in space, from a second quadric over the first three.
+static const int ATTRIBUTE_SIZE = 8;
+static const float TEXCOORD_WEIGHT = 0.5f;
+static const float NORMAL_WEIGHT = 0.25f;
+
+template<int N>
+struct Quadric
+{
+	float a[N * (N + 1) / 2]; // upper triangle of a symmetric matrix, row by row
+	float b[N];
+	float c;
+	float weight; // the area of the triangles summed in
+
+	void Add(const Quadric& q)
+	{
+		for(int i = 0; i < N * (N + 1) / 2; ++i) a[i] += q.a[i];
+		for(int i = 0; i < N; ++i) b[i] += q.b[i];
+		c += q.c;
+		weight += q.weight;
+	}
+
+	float Evaluate(const float* v) const
+	{
+		float sum = c;
+		for(int i = 0, k = 0; i < N; ++i)
+		{
+			float row = a[k++] * v[i];
+			for(int j = i + 1; j < N; ++j)
+				row += 2.0f * a[k++] * v[j];
+			sum += v[i] * (row + 2.0f * b[i]);
+		}
+		return sum;
+	}
+};
+
+template<int N>
+static float dot_n(const float* a, const float* b)
+{
+	float sum = 0.0f;
+	for(int i = 0; i < N; ++i) sum += a[i] * b[i];
+	return sum;
+}
+
+// Garland and Heckbert's generalized quadric, with the triangle's plane
+// spanned by two orthonormal edges e1 and e2
+template<int N>
+static bool triangle_quadric(const float* p0, const float* p1, const float* p2, float area, Quadric<N>* q)
+{
+	float e1[N], e2[N];
+	for(int i = 0; i < N; ++i)
+	{
+		e1[i] = p1[i] - p0[i];
+		e2[i] = p2[i] - p0[i];
+	}
+	float length1 = sqrtf(dot_n<N>(e1, e1));
+	if(length1 == 0.0f) return false;
+	for(int i = 0; i < N; ++i) e1[i] /= length1;
+	float along = dot_n<N>(e2, e1);
+	for(int i = 0; i < N; ++i) e2[i] -= along * e1[i];
+	float length2 = sqrtf(dot_n<N>(e2, e2));
+	if(length2 == 0.0f) return false;
+	for(int i = 0; i < N; ++i) e2[i] /= length2;
+
+	float p0e1 = dot_n<N>(p0, e1);
+	float p0e2 = dot_n<N>(p0, e2);
+	for(int i = 0, k = 0; i < N; ++i)
+	{
+		for(int j = i; j < N; ++j)
+			q->a[k++] = area * (float(i == j) - e1[i] * e1[j] - e2[i] * e2[j]);
+		q->b[i] = area * (p0e1 * e1[i] + p0e2 * e2[i] - p0[i]);
+	}
+	q->c = area * (dot_n<N>(p0, p0) - p0e1 * p0e1 - p0e2 * p0e2);
+	q->weight = area;
+	return true;
+}
+
+static inline uint32_t hash_position(const vec4& p)
+{
+	WeldKey key;
+	memset(&key, 0, sizeof key);
+	key.values[0] = quantize(p.x, 0.0f);
+	key.values[1] = quantize(p.y, 0.0f);
+	key.values[2] = quantize(p.z, 0.0f);
+	return hash_weld_key(key);
+}
+
+// Vertices that may not move: those at a position shared with another
+// vertex, which is a seam, and those on an edge that isn't between exactly
+// two triangles, which is a border or somewhere the surface isn't a surface.
+static void lock_borders_and_seams(const uint32_t* indices, int numIndices, const vec4* positions, int numVertices, bool* locked)
+{
+	// the first vertex at each exact position stands in for all of them
+	int* ids = new int[numVertices];
+	int* sharing = new int[numVertices];
+	uint32_t size = table_size(numVertices);
+	int* table = new int[size];
+	memset(table, -1, sizeof(int) * size);
+	for(int v = 0; v < numVertices; ++v)
+	{
+		const vec4& p = positions[v];
+		sharing[v] = 0;
+		for(uint32_t i = hash_position(p) & (size - 1);; i = (i + 1) & (size - 1))
+		{
+			int other = table[i];
+			if(other < 0)
+			{
+				table[i] = v;
+				ids[v] = v;
+				break;
+			}
+			const vec4& o = positions[other];
+			if(o.x == p.x && o.y == p.y && o.z == p.z)
+			{
+				ids[v] = other;
+				break;
+			}
+		}
+	}
+	delete[] table;
+
+	// only vertices that are used count toward a seam
+	bool* lockedIds = new bool[numVertices];
+	memset(lockedIds, 0, sizeof(bool) * numVertices);
+	bool* used = new bool[numVertices];
+	memset(used, 0, sizeof(bool) * numVertices);
+	for(int i = 0; i < numIndices; ++i)
+	{
+		uint32_t v = indices[i];
+		if(!used[v])
+		{
+			used[v] = true;
+			if(++sharing[ids[v]] > 1) lockedIds[ids[v]] = true;
+		}
+	}
+	delete[] used;
+
+	// count the triangles on each edge between positions
+	uint32_t edgeTableSize = table_size(numIndices);
+	uint64_t* edges = new uint64_t[edgeTableSize];
+	int* edgeCounts = new int[edgeTableSize];
+	memset(edges, 0xFF, sizeof(uint64_t) * edgeTableSize);
+	for(int i = 0; i < numIndices; ++i)
+	{
+		uint32_t a = ids[indices[i]];
+		uint32_t b = ids[indices[(i % 3 == 2)? i - 2 : i + 1]];
+		uint64_t key = (a < b)? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+		uint32_t hash = uint32_t((key * 0x9E3779B97F4A7C15ull) >> 32);
+		for(uint32_t j = hash & (edgeTableSize - 1);; j = (j + 1) & (edgeTableSize - 1))
+		{
+			if(edges[j] == ~uint64_t(0))
+			{
+				edges[j] = key;
+				edgeCounts[j] = 1;
+				break;
+			}
+			if(edges[j] == key)
+			{
+				edgeCounts[j]++;
+				break;
+			}
+		}
+	}
+	for(uint32_t j = 0; j < edgeTableSize; ++j)
+	{
+		if(edges[j] != ~uint64_t(0) && edgeCounts[j] != 2)
+		{
+			lockedIds[edges[j] >> 32] = true;
+			lockedIds[edges[j] & 0xFFFFFFFF] = true;
+		}
+	}
+	delete[] edges;
+	delete[] edgeCounts;
+
+	for(int v = 0; v < numVertices; ++v)
+		locked[v] = lockedIds[ids[v]];
+
+	delete[] lockedIds;
+	delete[] sharing;
+	delete[] ids;
+}
+
+struct Collapse
+{
+	float cost;
+	int vertex;
+};
+
+struct CollapseIsCheaper
+{
+	bool operator () (const Collapse& a, const Collapse& b) const
+	{
+		return a.cost < b.cost;
+	}
+};
+
+static inline vec3 position_of(const vec4* positions, uint32_t v)
+{
+	return vec3(positions[v].x, positions[v].y, positions[v].z);
+}
+
+// true if moving from onto to would turn any of from's other triangles over,
+// or near enough on edge that it might as well
+static bool collapse_flips(int from, int to, const uint32_t* indices, const int* adjacency, int numAdjacent,
+	const int* remap, const vec4* positions)
+{
+	vec3 target = position_of(positions, to);
+	for(int i = 0; i < numAdjacent; ++i)
+	{
+		const uint32_t* t = indices + 3 * adjacency[i];
+		int corner[3] = { remap[t[0]], remap[t[1]], remap[t[2]] };
+		if(corner[0] == to || corner[1] == to || corner[2] == to) continue;
+		if(corner[0] == corner[1] || corner[1] == corner[2] || corner[0] == corner[2]) continue;
+
+		vec3 p[3];
+		for(int j = 0; j < 3; ++j)
+			p[j] = position_of(positions, corner[j]);
+		vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+		for(int j = 0; j < 3; ++j)
+			if(corner[j] == from) p[j] = target;
+		vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+		if(dot(before, after) <= 0.25f * length(before) * length(after)) return true;
+	}
+	return false;
+}
+
+int simplify_mesh(uint32_t* result, const uint32_t* indices, int numIndices,
+	const vec4* positions, const vec3* normals, const vec2* texcoords, int numVertices,
+	int targetIndices, float maxError, float* error)
+{
+	int count = numIndices - numIndices % 3;
+	memcpy(result, indices, sizeof(uint32_t) * count);
+	*error = 0.0f;
+	if(count <= targetIndices || numVertices <= 0) return count;
+
+	// bounds of the vertices actually used
+	vec3 lower = position_of(positions, indices[0]);
+	vec3 upper = lower;
+	for(int i = 1; i < count; ++i)
+	{
+		vec3 p = position_of(positions, indices[i]);
+		lower = vec3(MIN(lower.x, p.x), MIN(lower.y, p.y), MIN(lower.z, p.z));
+		upper = vec3(MAX(upper.x, p.x), MAX(upper.y, p.y), MAX(upper.z, p.z));
+	}
+	float extent = MAX(upper.x - lower.x, MAX(upper.y - lower.y, upper.z - lower.z));
+	if(extent <= 0.0f) extent = 1.0f;
+	float scale = 1.0f / extent;
+
+	float* points = new float[numVertices * ATTRIBUTE_SIZE];
+	Quadric<ATTRIBUTE_SIZE>* quadrics = new Quadric<ATTRIBUTE_SIZE>[numVertices];
+	Quadric<3>* planes = new Quadric<3>[numVertices];
+	memset(quadrics, 0, sizeof(Quadric<ATTRIBUTE_SIZE>) * numVertices);
+	memset(planes, 0, sizeof(Quadric<3>) * numVertices);
+	for(int v = 0; v < numVertices; ++v)
+	{
+		float* point = points + v * ATTRIBUTE_SIZE;
+		point[0] = (positions[v].x - lower.x) * scale;
+		point[1] = (positions[v].y - lower.y) * scale;
+		point[2] = (positions[v].z - lower.z) * scale;
+		point[3] = texcoords[v].x * TEXCOORD_WEIGHT;
+		point[4] = texcoords[v].y * TEXCOORD_WEIGHT;
+		point[5] = normals[v].x * NORMAL_WEIGHT;
+		point[6] = normals[v].y * NORMAL_WEIGHT;
+		point[7] = normals[v].z * NORMAL_WEIGHT;
+	}
+	for(int i = 0; i < count; i += 3)
+	{
+		const float* p0 = points + indices[i] * ATTRIBUTE_SIZE;
+		const float* p1 = points + indices[i + 1] * ATTRIBUTE_SIZE;
+		const float* p2 = points + indices[i + 2] * ATTRIBUTE_SIZE;
+		vec3 e1(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]);
+		vec3 e2(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]);
+		float area = 0.5f * length(cross(e1, e2));
+
+		Quadric<ATTRIBUTE_SIZE> q;
+		if(triangle_quadric(p0, p1, p2, area, &q))
+		{
+			quadrics[indices[i]].Add(q);
+			quadrics[indices[i + 1]].Add(q);
+			quadrics[indices[i + 2]].Add(q);
+		}
+		Quadric<3> plane;
+		if(triangle_quadric(p0, p1, p2, area, &plane))
+		{
+			planes[indices[i]].Add(plane);
+			planes[indices[i + 1]].Add(plane);
+			planes[indices[i + 2]].Add(plane);
+		}
+	}
+
+	bool* locked = new bool[numVertices];
+	lock_borders_and_seams(indices, count, positions, numVertices, locked);
+
+	int* remap = new int[numVertices];
+	int* targets = new int[numVertices];
+	float* costs = new float[numVertices];
+	float* distances = new float[numVertices];
+	bool* touched = new bool[numVertices];
+	int* offsets = new int[numVertices + 1];
+	int* adjacency = new int[count];
+	Collapse* collapses = new Collapse[numVertices];
+	Collapse* buffer = new Collapse[numVertices];
+	for(int v = 0; v < numVertices; ++v)
+		remap[v] = v;
+
+	// distances are mean squared, in the unit box
+	float maxCost = (maxError * scale) * (maxError * scale);
+	float worst = 0.0f;
+
+	// Each pass finds the cheapest collapse for every vertex, then makes as
+	// many as it can, cheapest first, without two touching the same triangle.
+	while(count > targetIndices)
+	{
+		memset(offsets, 0, sizeof(int) * (numVertices + 1));
+		for(int i = 0; i < count; ++i)
+			offsets[result[i] + 1]++;
+		for(int v = 0; v < numVertices; ++v)
+			offsets[v + 1] += offsets[v];
+		for(int i = 0; i < count; ++i)
+			adjacency[offsets[result[i]]++] = i / 3;
+		for(int v = numVertices; v > 0; --v)
+			offsets[v] = offsets[v - 1];
+		offsets[0] = 0;
+
+		for(int v = 0; v < numVertices; ++v)
+		{
+			targets[v] = -1;
+			costs[v] = FLT_MAX;
+		}
+		for(int i = 0; i < count; ++i)
+		{
+			int from = result[i];
+			int to = result[(i % 3 == 2)? i - 2 : i + 1];
+			for(int direction = 0; direction < 2; ++direction)
+			{
+				if(!locked[from])
+				{
+					const Quadric<ATTRIBUTE_SIZE>& q = quadrics[from];
+					const Quadric<ATTRIBUTE_SIZE>& r = quadrics[to];
+					const float* point = points + to * ATTRIBUTE_SIZE;
+					float cost = (q.Evaluate(point) + r.Evaluate(point)) / MAX(q.weight + r.weight, 1e-12f);
+					if(cost < costs[from])
+					{
+						const Quadric<3>& m = planes[from];
+						const Quadric<3>& n = planes[to];
+						float distance = (m.Evaluate(point) + n.Evaluate(point)) / MAX(m.weight + n.weight, 1e-12f);
+						costs[from] = cost;
+						distances[from] = MAX(distance, 0.0f);
+						targets[from] = to;
+					}
+				}
+				int swap = from;
+				from = to;
+				to = swap;
+			}
+		}
+
+		int numCollapses = 0;
+		for(int v = 0; v < numVertices; ++v)
+		{
+			if(targets[v] >= 0 && distances[v] <= maxCost)
+			{
+				collapses[numCollapses].cost = costs[v];
+				collapses[numCollapses].vertex = v;
+				numCollapses++;
+			}
+		}
+		if(numCollapses == 0) break;
+		merge_sort(collapses, buffer, numCollapses, CollapseIsCheaper());
+
+		// each collapse takes away about two triangles
+		int limit = (count - targetIndices) / 6 + 1;
+		int made = 0;
+		memset(touched, 0, sizeof(bool) * numVertices);
+		for(int i = 0; i < numCollapses && made < limit; ++i)
+		{
+			int from = collapses[i].vertex;
+			int to = targets[from];
+			if(touched[from] || touched[to]) continue;
+			if(collapse_flips(from, to, result, adjacency + offsets[from], offsets[from + 1] - offsets[from], remap, positions))
+				continue;
+
+			remap[from] = to;
+			quadrics[to].Add(quadrics[from]);
+			planes[to].Add(planes[from]);
+
+			// nothing around it can move again until its triangles are redone
+			for(int j = offsets[from]; j < offsets[from + 1]; ++j)
+			{
+				const uint32_t* t = result + 3 * adjacency[j];
+				touched[t[0]] = true;
+				touched[t[1]] = true;
+				touched[t[2]] = true;
+			}
+			touched[to] = true;
+			worst = MAX(worst, distances[from]);
+			made++;
+		}
+		if(made == 0) break;
+
+		// drop the triangles that collapsed to nothing
+		int kept = 0;
+		for(int i = 0; i < count; i += 3)
+		{
+			uint32_t a = remap[result[i]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+			if(a == b || b == c || a == c) continue;
+			result[kept++] = a;
+			result[kept++] = b;
+			result[kept++] = c;
+		}
+		count = kept;
+	}
+
+	delete[] buffer;
+	delete[] collapses;
+	delete[] adjacency;
+	delete[] offsets;
+	delete[] touched;
+	delete[] distances;
+	delete[] costs;
+	delete[] targets;
+	delete[] remap;
+	delete[] locked;
+	delete[] planes;
+	delete[] quadrics;
+	delete[] points;
+
+	*error = sqrtf(worst) * extent;
+	return count;
+}
+
+int build_lod_chain(AutoArray<uint32_t>& indices, const int* startIndices, int numRanges,
+	const vec4* positions, const vec3* normals, const vec2* texcoords, int numVertices,
+	float maxError, int maxLevels, LodLevel* levels, int* rangeStarts)
+{
+	int ranges = MAX(numRanges, 1);
+	maxLevels = MIN(maxLevels, MAX_MESH_LODS);
+
+	levels[0].startIndex = 0;
+	levels[0].numIndices = indices.Count();
+	levels[0].error = 0.0f;
+	for(int i = 0; i < ranges; ++i)
+		rangeStarts[i] = (numRanges > 0)? startIndices[i] : 0;
+
+	uint32_t* scratch = new uint32_t[MAX(indices.Count(), size_t(1))];
+	int numLevels = 1;
+	while(numLevels < maxLevels)
+	{
+		const LodLevel& previous = levels[numLevels - 1];
+		const int* previousStarts = rangeStarts + (numLevels - 1) * ranges;
+		int* starts = rangeStarts + numLevels * ranges;
+		int start = indices.Count();
+
+		// errors are measured against the level before, so they add up
+		float budget = maxError - previous.error;
+		if(budget <= 0.0f) break;
+		float error = 0.0f;
+		for(int i = 0; i < ranges; ++i)
+		{
+			int first = previousStarts[i];
+			int last = (i + 1 < ranges)? previousStarts[i + 1] : previous.startIndex + previous.numIndices;
+			int target = (last - first) / 6 * 3;
+
+			float rangeError;
+			int kept = simplify_mesh(scratch, indices.First() + first, last - first, positions, normals, texcoords,
+				numVertices, target, budget, &rangeError);
+			optimize_vertex_cache(scratch, kept, numVertices);
+			optimize_overdraw(scratch, kept, positions, numVertices, 1.05f);
+
+			starts[i] = indices.Count();
+			for(int j = 0; j < kept; ++j)
+				indices.Push(scratch[j]);
+			error = MAX(error, rangeError);
+		}
+
+		// a level with barely fewer triangles isn't worth having
+		int numIndices = indices.Count() - start;
+		if(numIndices > previous.numIndices - previous.numIndices / 10)
+		{
+			indices.Resize(start);
+			break;
+		}
+
+		levels[numLevels].startIndex = start;
+		levels[numLevels].numIndices = numIndices;
+		levels[numLevels].error = previous.error + error;
+		numLevels++;
+	}
+	delete[] scratch;
+
+	return numLevels;
+}
+
+int select_lod(const float* errors, int numLevels, float distance, float fov, int viewportHeight, float maxPixelError)
+{
+	// an error of one unit covers this many pixels at a distance of one unit
+	float pixelsPerUnit = viewportHeight / (2.0f * tan((M_PI / 180.0f) * fov * 0.5f));
+	float allowed = maxPixelError * MAX(distance, 0.0f) / pixelsPerUnit;
+
+	int level = 0;
+	while(level + 1 < numLevels && errors[level + 1] <= allowed)
+		level++;
+	return level;
+}
+
+// PACKING
+//-------------------------------------------------------------------------------------------------
+
+VertexQuantization compute_vertex_quantization(const vec4* positions, const vec2* texcoords, int numVertices)
+{
+	vec3 lower, upper;
+	vec2 lowerTexcoord, upperTexcoord;
+	if(numVertices > 0)
+	{
+		lower = upper = vec3(positions[0].x, positions[0].y, positions[0].z);
+		lowerTexcoord = upperTexcoord = texcoords[0];
+	}
+	for(int i = 1; i < numVertices; ++i)
+	{
+		const vec4& p = positions[i];
+		lower = vec3(MIN(lower.x, p.x), MIN(lower.y, p.y), MIN(lower.z, p.z));
+		upper = vec3(MAX(upper.x, p.x), MAX(upper.y, p.y), MAX(upper.z, p.z));
+		const vec2& t = texcoords[i];
+		lowerTexcoord = vec2(MIN(lowerTexcoord.x, t.x), MIN(lowerTexcoord.y, t.y));
+		upperTexcoord = vec2(MAX(upperTexcoord.x, t.x), MAX(upperTexcoord.y, t.y));
+	}
+
+	VertexQuantization quantization;
+	quantization.positionOffset = lower;
+	quantization.positionScale = upper - lower;
+	quantization.texcoordOffset = lowerTexcoord;
+	quantization.texcoordScale = upperTexcoord - lowerTexcoord;
+	return quantization;
+}
+
+static inline uint16_t quantize_unorm16(float x, float offset, float scale)
+{
+	// a flat axis has everything at the offset
+	if(scale <= 0.0f) return 0;
+	float t = (x - offset) / scale;
+	t = MIN(MAX(t, 0.0f), 1.0f);
+	return uint16_t(t * 65535.0f + 0.5f);
+}
+
+static inline int16_t quantize_snorm16(float x)
+{
+	x = MIN(MAX(x, -1.0f), 1.0f);
+	return int16_t(floorf(x * 32767.0f + 0.5f));
+}
+
+vec2 encode_octahedral(const vec3& normal)
+{
+	float sum = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+	if(sum == 0.0f) return vec2(0.0f, 0.0f);
+	vec2 e(normal.x / sum, normal.y / sum);
+
+	// the lower half folds out over the corners
+	if(normal.z < 0.0f)
+	{
+		float x = (1.0f - fabs(e.y)) * ((e.x >= 0.0f)? 1.0f : -1.0f);
+		float y = (1.0f - fabs(e.x)) * ((e.y >= 0.0f)? 1.0f : -1.0f);
+		e = vec2(x, y);
+	}
+	return e;
+}
+
+vec3 decode_octahedral(const vec2& encoded)
+{
+	vec3 n(encoded.x, encoded.y, 1.0f - fabs(encoded.x) - fabs(encoded.y));
+	if(n.z < 0.0f)
+	{
+		float x = (1.0f - fabs(n.y)) * ((n.x >= 0.0f)? 1.0f : -1.0f);
+		float y = (1.0f - fabs(n.x)) * ((n.y >= 0.0f)? 1.0f : -1.0f);
+		n.x = x;
+		n.y = y;
+	}
+	return normalize(n);
+}
+
+void pack_vertices(PackedVertex* result, const vec4* positions, const vec3* normals, const vec2* texcoords,
+	int numVertices, const VertexQuantization& quantization)
+{
+	const VertexQuantization& q = quantization;
+	for(int i = 0; i < numVertices; ++i)
+	{
+		PackedVertex& v = result[i];
+		v.position[0] = quantize_unorm16(positions[i].x, q.positionOffset.x, q.positionScale.x);
+		v.position[1] = quantize_unorm16(positions[i].y, q.positionOffset.y, q.positionScale.y);
+		v.position[2] = quantize_unorm16(positions[i].z, q.positionOffset.z, q.positionScale.z);
+		v.position[3] = 0;
+		v.texcoord[0] = quantize_unorm16(texcoords[i].x, q.texcoordOffset.x, q.texcoordScale.x);
+		v.texcoord[1] = quantize_unorm16(texcoords[i].y, q.texcoordOffset.y, q.texcoordScale.y);
+
+		vec2 normal = encode_octahedral(normals[i]);
+		v.normal[0] = quantize_snorm16(normal.x);
+		v.normal[1] = quantize_snorm16(normal.y);
+	}
+}
+
+void unpack_vertices(vec4* positions, vec3* normals, vec2* texcoords, const PackedVertex* packed,
+	int numVertices, const VertexQuantization& quantization)
+{
+	const VertexQuantization& q = quantization;
+	const float step = 1.0f / 65535.0f;
+	for(int i = 0; i < numVertices; ++i)
+	{
+		const PackedVertex& v = packed[i];
+		positions[i].x = q.positionOffset.x + q.positionScale.x * (v.position[0] * step);
+		positions[i].y = q.positionOffset.y + q.positionScale.y * (v.position[1] * step);
+		positions[i].z = q.positionOffset.z + q.positionScale.z * (v.position[2] * step);
+		positions[i].w = 1.0f;
+		texcoords[i].x = q.texcoordOffset.x + q.texcoordScale.x * (v.texcoord[0] * step);
+		texcoords[i].y = q.texcoordOffset.y + q.texcoordScale.y * (v.texcoord[1] * step);
+		normals[i] = decode_octahedral(vec2(v.normal[0] / 32767.0f, v.normal[1] / 32767.0f));
+	}
+}
+
+// MESHLETS
+//-------------------------------------------------------------------------------------------------
+
+static void compute_meshlet_bounds(const uint32_t* indices, const vec4* positions, Meshlet* meshlet)
+{
+	// a sphere about the middle of the box around the triangles
+	const uint32_t* first = indices + meshlet->startIndex;
+	vec3 lower = position_of(positions, first[0]);
+	vec3 upper = lower;
+	for(int i = 1; i < meshlet->numIndices; ++i)
+	{
+		vec3 p = position_of(positions, first[i]);
+		lower = vec3(MIN(lower.x, p.x), MIN(lower.y, p.y), MIN(lower.z, p.z));
+		upper = vec3(MAX(upper.x, p.x), MAX(upper.y, p.y), MAX(upper.z, p.z));
+	}
+	vec3 center = 0.5f * (lower + upper);
+	float radius = 0.0f;
+	for(int i = 0; i < meshlet->numIndices; ++i)
+		radius = MAX(radius, length(position_of(positions, first[i]) - center));
+	meshlet->center = center;
+	meshlet->radius = radius;
+
+	// the cone is about the area-weighted normal, as wide as the triangle
+	// that strays furthest from it
+	vec3 sum = VEC3_ZERO;
+	for(int i = 0; i < meshlet->numIndices; i += 3)
+	{
+		vec3 a = position_of(positions, first[i]);
+		sum += cross(position_of(positions, first[i + 1]) - a, position_of(positions, first[i + 2]) - a);
+	}
+	meshlet->coneAxis = VEC3_ZERO;
+	meshlet->coneCutoff = 1.0f;
+	float sumLength = length(sum);
+	if(sumLength == 0.0f) return;
+	vec3 axis = sum / sumLength;
+
+	float lowestDot = 1.0f;
+	for(int i = 0; i < meshlet->numIndices; i += 3)
+	{
+		vec3 a = position_of(positions, first[i]);
+		vec3 normal = cross(position_of(positions, first[i + 1]) - a, position_of(positions, first[i + 2]) - a);
+		float area = length(normal);
+		if(area == 0.0f) continue;
+		lowestDot = MIN(lowestDot, dot(axis, normal) / area);
+	}
+	meshlet->coneAxis = axis;
+
+	// facing more than a right angle apart, some triangle always faces the viewer
+	if(lowestDot > 0.0f)
+		meshlet->coneCutoff = sqrtf(1.0f - lowestDot * lowestDot);
+}
+
+// how many of the triangles not yet taken are looked through for the nearest,
+// once a cluster has no neighbours left
+static const int MESHLET_SEARCH_WINDOW = 64;
+
+int build_meshlets(uint32_t* indices, int numIndices, const vec4* positions, int numVertices,
+	int maxVertices, int maxTriangles, int firstIndex, AutoArray<Meshlet>& meshlets)
+{
+	int numTriangles = numIndices / 3;
+	if(numTriangles == 0) return 0;
+	maxVertices = MAX(maxVertices, 3);
+	maxTriangles = MAX(maxTriangles, 1);
+
+	// the triangles around each vertex
+	int* offsets = new int[numVertices + 1];
+	int* adjacency = new int[numTriangles * 3];
+	memset(offsets, 0, sizeof(int) * (numVertices + 1));
+	for(int i = 0; i < numTriangles * 3; ++i)
+		offsets[indices[i] + 1]++;
+	for(int v = 0; v < numVertices; ++v)
+		offsets[v + 1] += offsets[v];
+	for(int i = 0; i < numTriangles * 3; ++i)
+		adjacency[offsets[indices[i]]++] = i / 3;
+	for(int v = numVertices; v > 0; --v)
+		offsets[v] = offsets[v - 1];
+	offsets[0] = 0;
+
+	vec3* centroids = new vec3[numTriangles];
+	for(int t = 0; t < numTriangles; ++t)
+	{
+		const uint32_t* tri = indices + 3 * t;
+		centroids[t] = (position_of(positions, tri[0]) + position_of(positions, tri[1]) + position_of(positions, tri[2])) / 3.0f;
+	}
+
+	bool* used = new bool[numTriangles];
+	memset(used, 0, sizeof(bool) * numTriangles);
+	int* order = new int[numTriangles];
+	int* owner = new int[numVertices]; // the last cluster each vertex went in
+	memset(owner, -1, sizeof(int) * numVertices);
+	int* members = new int[maxVertices];
+	int* clusterStarts = new int[numTriangles + 1];
+
+	int numOrdered = 0;
+	int numMeshlets = 0;
+	for(int scan = 0; numOrdered < numTriangles; ++numMeshlets)
+	{
+		while(used[scan]) scan++;
+
+		int numMembers = 0;
+		int clusterStart = numOrdered;
+		clusterStarts[numMeshlets] = clusterStart;
+		vec3 centroidSum = VEC3_ZERO;
+		vec3 lower = centroids[scan];
+		vec3 upper = lower;
+		for(int next = scan; next >= 0;)
+		{
+			used[next] = true;
+			order[numOrdered++] = next;
+			const vec3& c = centroids[next];
+			centroidSum += c;
+			lower = vec3(MIN(lower.x, c.x), MIN(lower.y, c.y), MIN(lower.z, c.z));
+			upper = vec3(MAX(upper.x, c.x), MAX(upper.y, c.y), MAX(upper.z, c.z));
+			const uint32_t* tri = indices + 3 * next;
+			for(int j = 0; j < 3; ++j)
+			{
+				if(owner[tri[j]] != numMeshlets)
+				{
+					owner[tri[j]] = numMeshlets;
+					members[numMembers++] = tri[j];
+				}
+			}
+
+			int numInCluster = numOrdered - clusterStart;
+			if(numInCluster >= maxTriangles) break;
+
+			// the neighbour adding the fewest vertices, nearest the middle
+			vec3 middle = centroidSum / float(numInCluster);
+			next = -1;
+			int fewestAdded = 4;
+			float nearest = FLT_MAX;
+			for(int m = 0; m < numMembers; ++m)
+			{
+				int v = members[m];
+				for(int k = offsets[v]; k < offsets[v + 1]; ++k)
+				{
+					int t = adjacency[k];
+					if(used[t]) continue;
+					const uint32_t* candidate = indices + 3 * t;
+					int added = (owner[candidate[0]] != numMeshlets) + (owner[candidate[1]] != numMeshlets) +
+						(owner[candidate[2]] != numMeshlets);
+					if(numMembers + added > maxVertices || added > fewestAdded) continue;
+					vec3 offset = centroids[t] - middle;
+					float distance = dot(offset, offset);
+					if(added < fewestAdded || distance < nearest)
+					{
+						next = t;
+						fewestAdded = added;
+						nearest = distance;
+					}
+				}
+			}
+
+			// Seams split the mesh into islands that share no vertices, and
+			// clusters would end at each one's edge. Failing a neighbour, the
+			// nearest of the next few triangles not yet taken will do, if
+			// it's no further away than the cluster is wide.
+			if(next < 0)
+			{
+				vec3 size = upper - lower;
+				nearest = dot(size, size);
+				int looked = 0;
+				for(int t = scan; t < numTriangles && looked < MESHLET_SEARCH_WINDOW; ++t)
+				{
+					if(used[t]) continue;
+					looked++;
+					const uint32_t* candidate = indices + 3 * t;
+					int added = (owner[candidate[0]] != numMeshlets) + (owner[candidate[1]] != numMeshlets) +
+						(owner[candidate[2]] != numMeshlets);
+					if(numMembers + added > maxVertices) continue;
+					vec3 offset = centroids[t] - middle;
+					float distance = dot(offset, offset);
+					if(distance < nearest)
+					{
+						next = t;
+						nearest = distance;
+					}
+				}
+			}
+		}
+
+	}
+	clusterStarts[numMeshlets] = numTriangles;
+
+	uint32_t* reordered = new uint32_t[numTriangles * 3];
+	for(int i = 0; i < numTriangles; ++i)
+		memcpy(reordered + 3 * i, indices + 3 * order[i], sizeof(uint32_t) * 3);
+	memcpy(indices, reordered, sizeof(uint32_t) * numTriangles * 3);
+
+	// Clusters are grown for culling, which undoes the cache order the
+	// triangles came in, so each one's are put back into it. Vertices are
+	// numbered within the cluster for that, so it costs no more for being
+	// done a cluster at a time.
+	int* local = owner;
+	memset(local, -1, sizeof(int) * numVertices);
+	uint32_t* localIndices = reordered;
+	for(int i = 0; i < numMeshlets; ++i)
+	{
+		uint32_t* first = indices + 3 * clusterStarts[i];
+		int count = 3 * (clusterStarts[i + 1] - clusterStarts[i]);
+		int numLocal = 0;
+		for(int j = 0; j < count; ++j)
+		{
+			if(local[first[j]] < 0)
+			{
+				local[first[j]] = numLocal;
+				members[numLocal++] = first[j];
+			}
+			localIndices[j] = local[first[j]];
+		}
+		optimize_vertex_cache(localIndices, count, numLocal);
+		for(int j = 0; j < count; ++j)
+			first[j] = members[localIndices[j]];
+		for(int j = 0; j < numLocal; ++j)
+			local[members[j]] = -1;
+
+		Meshlet meshlet;
+		meshlet.startIndex = 3 * clusterStarts[i];
+		meshlet.numIndices = count;
+		compute_meshlet_bounds(indices, positions, &meshlet);
+		meshlet.startIndex += firstIndex;
+		meshlets.Push(meshlet);
+	}
+	delete[] reordered;
+
+	delete[] clusterStarts;
+	delete[] members;
+	delete[] owner;
+	delete[] order;
+	delete[] used;
+	delete[] centroids;
+	delete[] adjacency;
+	delete[] offsets;
+
+	return numMeshlets;
+}
+
+int cull_meshlets(const Meshlet* meshlets, int numMeshlets, const mat4x4& transform, const Frustum& frustum,
+	const vec3& viewPosition, bool cullBackfaces, IndexRange* ranges)
+{
+	// spheres grow by however much the transform scales
+	vec4 axisX = transform * vec4(1.0f, 0.0f, 0.0f, 0.0f);
+	vec4 axisY = transform * vec4(0.0f, 1.0f, 0.0f, 0.0f);
+	vec4 axisZ = transform * vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	float scale = MAX(length(vec3(axisX.x, axisX.y, axisX.z)), MAX(length(vec3(axisY.x, axisY.y, axisY.z)),
+		length(vec3(axisZ.x, axisZ.y, axisZ.z))));
+
+	int numRanges = 0;
+	for(int i = 0; i < numMeshlets; ++i)
+	{
+		const Meshlet& meshlet = meshlets[i];
+		vec3 center = transform * meshlet.center;
+		float radius = meshlet.radius * scale;
+
+		bool visible = true;
+		for(int j = 0; j < 6 && visible; ++j)
+			visible = dot(center, frustum.planeNormals[j]) + radius >= frustum.planeDots[j];
+
+		// Every normal in the cone points away from the viewer from anywhere
+		// in the sphere once the view direction is closer to the axis than
+		// the cone is wide, allowing for the sphere's radius.
+		if(visible && cullBackfaces && meshlet.coneCutoff < 1.0f)
+		{
+			vec4 turned = transform * vec4(meshlet.coneAxis, 0.0f);
+			vec3 axis = normalize(vec3(turned.x, turned.y, turned.z));
+			vec3 view = center - viewPosition;
+			visible = dot(view, axis) < meshlet.coneCutoff * length(view) + radius;
+		}
+		if(!visible) continue;
+
+		IndexRange* last = (numRanges > 0)? &ranges[numRanges - 1] : nullptr;
+		if(last && last->startIndex + last->numIndices == meshlet.startIndex)
+		{
+			last->numIndices += meshlet.numIndices;
+		}
+		else
+		{
+			ranges[numRanges].startIndex = meshlet.startIndex;
+			ranges[numRanges].numIndices = meshlet.numIndices;
+			numRanges++;
+		}
+	}
+	return numRanges;
+}
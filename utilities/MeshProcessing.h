@@ -0,0 +1,203 @@
+#ifndef MESH_PROCESSING_H
+#define MESH_PROCESSING_H
+
+#include "GLMath.h"
+#include "DataTypes.h"
+
+#include "collections/AutoArray.h"
+
+class JobPool;
+class Frustum;
+
+// Steps run over indexed triangle meshes after they're loaded, each working
+// on plain arrays in place so they can be chained in any order.
+
+// WELDING
+//-------------------------------------------------------------------------------------------------
+
+// Merges vertices whose positions fall in the same cell of a grid
+// positionEpsilon wide, and whose normals and texture coordinates do the same
+// on a grid attributeEpsilon wide. An epsilon of zero only merges values that
+// are exactly equal. Vertices just either side of a cell boundary stay apart,
+// however close they are, which is the price of welding in linear time.
+//
+// The surviving vertices keep their order and are moved to the front of the
+// arrays, elements are renumbered to match, and the return is how many
+// vertices are left. With a pool, the vertices are welded in chunks that are
+// then merged, which gives exactly the same result.
+int weld_vertices(
+	vec4* positions,
+	vec3* normals,
+	vec2* texcoords,
+	int numVertices,
+	uint32_t* elements,
+	int numElements,
+	float positionEpsilon,
+	float attributeEpsilon,
+	JobPool* pool = nullptr);
+
+// TRIANGLE ORDER
+//-------------------------------------------------------------------------------------------------
+
+// Reorders triangles so that each one reuses as many vertices as it can from
+// the last few drawn, which the GPU keeps transformed in a small cache. This
+// is Tom Forsyth's greedy method, so it runs in about linear time, and it
+// doesn't depend on the size of any particular GPU's cache. Vertices are
+// numbered below numVertices.
+void optimize_vertex_cache(uint32_t* indices, int numIndices, int numVertices);
+
+// Reorders clusters of triangles, as cut by optimize_vertex_cache, so that
+// the ones facing outward from the middle of the mesh come first and hide
+// what's drawn after them, after Sander, Nehab and Barczak's linear-speed
+// method. Clusters are made smaller where each piece, simulated with its own
+// empty cache, misses no more than threshold times as often per triangle as
+// the run it was cut from; 1.05 is a good place to start. That only holds
+// within a cluster: whatever the cache kept from one cluster to the next is
+// lost once they're reordered, so the whole mesh can do worse than threshold,
+// and the last piece of each run isn't held to it.
+void optimize_overdraw(uint32_t* indices, int numIndices, const vec4* positions, int numVertices, float threshold);
+
+// Renumbers vertices in the order they're first used, so they're fetched
+// from memory front to back, and drops any that are never used. The arrays
+// are rearranged in place and the return is how many vertices are left.
+int optimize_vertex_fetch(vec4* positions, vec3* normals, vec2* texcoords, int numVertices,
+	uint32_t* indices, int numIndices);
+
+// Runs all three of the above, the first two over each run of triangles
+// starting at startIndices separately so materials keep their ranges, and
+// returns how many vertices are left.
+int optimize_mesh(vec4* positions, vec3* normals, vec2* texcoords, int numVertices,
+	uint32_t* indices, int numIndices, const int* startIndices, int numRanges);
+
+struct VertexCacheStats
+{
+	float acmr; // vertices transformed per triangle, from 0.5 at best to 3
+	float atvr; // vertices transformed per vertex used, 1 at best
+};
+
+// runs the indices through a first in, first out cache of the given size,
+// like the ones in most GPUs
+VertexCacheStats analyze_vertex_cache(const uint32_t* indices, int numIndices, int numVertices, int cacheSize = 16);
+
+// LEVELS OF DETAIL
+//-------------------------------------------------------------------------------------------------
+
+static const int MAX_MESH_LODS = 5;
+
+// Simplifies triangles by collapsing edges in order of least quadric error,
+// Garland and Heckbert's method with texture coordinates and normals taken
+// into the error as well as position. Vertices only ever merge into other
+// vertices, so the result indexes the same vertex arrays. Vertices on open
+// borders and on seams, where a position is shared by vertices with
+// different texture coordinates or normals, never move, so neither holes nor
+// cracks open up, and the border between two materials simplified apart
+// stays matched.
+//
+// Stops once there are no more than targetIndices indices or the next
+// collapse would move the surface further than maxError, in model units,
+// which only counts distance; the attributes just decide the order. Writes the
+// result to result, which has room for numIndices, and returns its count,
+// with the error reached in error.
+int simplify_mesh(uint32_t* result, const uint32_t* indices, int numIndices,
+	const vec4* positions, const vec3* normals, const vec2* texcoords, int numVertices,
+	int targetIndices, float maxError, float* error);
+
+struct LodLevel
+{
+	int startIndex;
+	int numIndices;
+	float error; // in model units
+};
+
+// Appends levels of detail after the full detail triangles, which are all of
+// indices to begin with, each with about half the triangles of the level
+// before. Each material range is simplified on its own so materials keep
+// their triangles. The chain stops at maxLevels, counting full detail and at
+// most MAX_MESH_LODS, once a level would stray further than maxError, or once
+// simplifying stalls. rangeStarts gets numRanges starts for every level, and
+// the return is how many levels there are.
+int build_lod_chain(AutoArray<uint32_t>& indices, const int* startIndices, int numRanges,
+	const vec4* positions, const vec3* normals, const vec2* texcoords, int numVertices,
+	float maxError, int maxLevels, LodLevel* levels, int* rangeStarts);
+
+// Picks the coarsest level whose error covers no more than maxPixelError
+// pixels at the given distance, on a screen viewportHeight pixels tall with
+// fov in degrees.
+int select_lod(const float* errors, int numLevels, float distance, float fov, int viewportHeight, float maxPixelError);
+
+// PACKING
+//-------------------------------------------------------------------------------------------------
+
+// A vertex in 16 bytes rather than 36. The position is in 16-bit steps
+// across the mesh's bounds and the texture coordinate in 16-bit steps across
+// the range the mesh uses, so both come out between 0 and 1 when read as
+// normalized integers, and are scaled and offset back by VertexQuantization.
+// The normal is folded onto an octahedron and flattened to two signed values.
+struct PackedVertex
+{
+	uint16_t position[4]; // w is only there to keep what follows aligned
+	uint16_t texcoord[2];
+	int16_t normal[2];
+};
+
+struct VertexQuantization
+{
+	vec3 positionOffset;
+	vec3 positionScale;
+	vec2 texcoordOffset;
+	vec2 texcoordScale;
+};
+
+VertexQuantization compute_vertex_quantization(const vec4* positions, const vec2* texcoords, int numVertices);
+void pack_vertices(PackedVertex* result, const vec4* positions, const vec3* normals, const vec2* texcoords,
+	int numVertices, const VertexQuantization& quantization);
+void unpack_vertices(vec4* positions, vec3* normals, vec2* texcoords, const PackedVertex* packed,
+	int numVertices, const VertexQuantization& quantization);
+
+// unit normals to and from two values between -1 and 1
+vec2 encode_octahedral(const vec3& normal);
+vec3 decode_octahedral(const vec2& encoded);
+
+// MESHLETS
+//-------------------------------------------------------------------------------------------------
+
+static const int MESHLET_MAX_VERTICES = 64;
+static const int MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	int startIndex;
+	int numIndices;
+	vec3 center; // of a sphere around all its triangles
+	float radius;
+	vec3 coneAxis; // which way its triangles face, on average
+	float coneCutoff; // sine of how far the furthest strays from the axis, or 1 if too far to cull by
+};
+
+// Reorders triangles into clusters of no more than maxVertices vertices and
+// maxTriangles triangles each, and appends a Meshlet for each cluster, with
+// starts offset by firstIndex so they can point into a bigger index array.
+// A cluster grows from its first triangle by the neighbour that adds the
+// fewest vertices, nearest the middle when that's a tie, so clusters stay
+// compact and cull well, and then each cluster's triangles are put in vertex
+// cache order. Vertex numbering isn't touched, so optimize_vertex_fetch is
+// best run again afterwards. Returns how many clusters were made.
+int build_meshlets(uint32_t* indices, int numIndices, const vec4* positions, int numVertices,
+	int maxVertices, int maxTriangles, int firstIndex, AutoArray<Meshlet>& meshlets);
+
+struct IndexRange
+{
+	int startIndex;
+	int numIndices;
+};
+
+// Drops meshlets that are outside the frustum once placed by transform,
+// which may rotate, move and scale evenly, and if cullBackfaces is set, those
+// whose every triangle faces away from viewPosition. What's left is written
+// to ranges as runs of indices, with neighbouring meshlets merged into one
+// run, and the return is how many runs there are; ranges needs room for
+// numMeshlets of them.
+int cull_meshlets(const Meshlet* meshlets, int numMeshlets, const mat4x4& transform, const Frustum& frustum,
+	const vec3& viewPosition, bool cullBackfaces, IndexRange* ranges);
+
+#endif
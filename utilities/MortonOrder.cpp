@@ -0,0 +1,103 @@
+#include "MortonOrder.h"
+
+#include "Hashing.h"
+#include "NumberMacros.h"
+
+#include <cstring>
+
+// Each point gets the cell it falls in along each axis of the bounds, and the
+// interleaved codes are radix sorted a digit at a time. A thousand cells a
+// side is finer than any cache line cares about and needs only three passes;
+// digits every code shares, as when the points are bunched up, are skipped.
+
+static const int CELL_BITS = 10;
+static const int RADIX_BITS = 10;
+static const int RADIX_SIZE = 1 << RADIX_BITS;
+static const int BLOCK_SIZE = 256;
+
+void morton_order(const vec3* positions, int count, int* order)
+{
+	if(count <= 0) return;
+
+	vec3 min = positions[0];
+	vec3 max = positions[0];
+	for(int i = 1; i < count; ++i)
+	{
+		const vec3& p = positions[i];
+		min.x = MIN(min.x, p.x); max.x = MAX(max.x, p.x);
+		min.y = MIN(min.y, p.y); max.y = MAX(max.y, p.y);
+		min.z = MIN(min.z, p.z); max.z = MAX(max.z, p.z);
+	}
+
+	const float cells = float((1 << CELL_BITS) - 1);
+	vec3 extent = max - min;
+	vec3 scale;
+	scale.x = (extent.x > 0.0f)? cells / extent.x : 0.0f;
+	scale.y = (extent.y > 0.0f)? cells / extent.y : 0.0f;
+	scale.z = (extent.z > 0.0f)? cells / extent.z : 0.0f;
+
+	uint64_t* codes = new uint64_t[count];
+	uint64_t* sortedCodes = new uint64_t[count];
+	int* sortedOrder = new int[count];
+
+	for(int start = 0; start < count; start += BLOCK_SIZE)
+	{
+		int n = MIN(count - start, BLOCK_SIZE);
+		uint32_t x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+		for(int i = 0; i < n; ++i)
+		{
+			const vec3& p = positions[start + i];
+			x[i] = uint32_t((p.x - min.x) * scale.x);
+			y[i] = uint32_t((p.y - min.y) * scale.y);
+			z[i] = uint32_t((p.z - min.z) * scale.z);
+		}
+		morton_encode_3d(x, y, z, n, codes + start);
+	}
+
+	// sort back and forth between the two sets of arrays
+	int* current = order;
+	for(int i = 0; i < count; ++i)
+		current[i] = i;
+
+	int* counts = new int[RADIX_SIZE];
+	for(int shift = 0; shift < 3 * CELL_BITS; shift += RADIX_BITS)
+	{
+		memset(counts, 0, sizeof(int) * RADIX_SIZE);
+		for(int i = 0; i < count; ++i)
+			counts[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+		if(counts[(codes[0] >> shift) & (RADIX_SIZE - 1)] == count)
+			continue;
+
+		int total = 0;
+		for(int i = 0; i < RADIX_SIZE; ++i)
+		{
+			int c = counts[i];
+			counts[i] = total;
+			total += c;
+		}
+		for(int i = 0; i < count; ++i)
+		{
+			int slot = counts[(codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+			sortedCodes[slot] = codes[i];
+			sortedOrder[slot] = current[i];
+		}
+
+		uint64_t* tempCodes = codes;
+		codes = sortedCodes;
+		sortedCodes = tempCodes;
+		int* tempOrder = current;
+		current = sortedOrder;
+		sortedOrder = tempOrder;
+	}
+
+	if(current != order)
+	{
+		memcpy(order, current, sizeof(int) * count);
+		sortedOrder = current;
+	}
+
+	delete[] counts;
+	delete[] codes;
+	delete[] sortedCodes;
+	delete[] sortedOrder;
+}
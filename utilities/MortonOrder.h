@@ -0,0 +1,26 @@
+#ifndef MORTON_ORDER_H
+#define MORTON_ORDER_H
+
+#include "GLMath.h"
+
+// Puts points in order along a Z-order curve through their bounds, so that
+// points near each other in space end up near each other in memory. Arrays
+// of entities or particles stored in that order touch far fewer cache lines
+// when they're walked by neighbourhood, as in collision and flocking passes.
+// The order only needs redoing every so often, as things drift apart.
+
+// fills order with the indices of the points, in curve order
+void morton_order(const vec3* positions, int count, int* order);
+
+// rearranges the items so that item i is the one that was at order[i],
+// using scratch as room for count of them
+template<typename T>
+void apply_order(T* items, const int* order, int count, T* scratch)
+{
+	for(int i = 0; i < count; ++i)
+		scratch[i] = items[order[i]];
+	for(int i = 0; i < count; ++i)
+		items[i] = scratch[i];
+}
+
+#endif
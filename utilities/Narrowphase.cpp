@@ -0,0 +1,637 @@
+#include "Narrowphase.h"
+
+#include "SIMD.h"
+#include "NumberMacros.h"
+#include "concurrent/JobPool.h"
+
+#include <float.h>
+#include <math.h>
+
+static const int LANES = 4;
+
+// pairs past the end of the list repeat the last pair, and are masked off
+// when the results are written out
+static int lane_pair(int base, int lane, int end)
+{
+	return MIN(base + lane, end - 1);
+}
+
+// Sphere-Sphere...............................................................
+
+static int collide_sphere_range(const Sphere* spheres, const ProxyPair* pairs, int begin, int end, ContactRecord* contacts)
+{
+	int numContacts = 0;
+	for(int base = begin; base < end; base += LANES)
+	{
+		float ax[LANES], ay[LANES], az[LANES], ar[LANES];
+		float bx[LANES], by[LANES], bz[LANES], br[LANES];
+		for(int lane = 0; lane < LANES; ++lane)
+		{
+			const ProxyPair& pair = pairs[lane_pair(base, lane, end)];
+			const Sphere& a = spheres[pair.proxyA];
+			const Sphere& b = spheres[pair.proxyB];
+			ax[lane] = a.position.x;
+			ay[lane] = a.position.y;
+			az[lane] = a.position.z;
+			ar[lane] = a.radius;
+			bx[lane] = b.position.x;
+			by[lane] = b.position.y;
+			bz[lane] = b.position.z;
+			br[lane] = b.radius;
+		}
+
+		float4 dx = load_float4(bx) - load_float4(ax);
+		float4 dy = load_float4(by) - load_float4(ay);
+		float4 dz = load_float4(bz) - load_float4(az);
+		float4 radiusA = load_float4(ar);
+		float4 radii = radiusA + load_float4(br);
+
+		float4 distanceSquared = dot3(dx, dy, dz, dx, dy, dz);
+		int hits = move_mask(distanceSquared <= radii * radii) & ((1 << MIN(LANES, end - base)) - 1);
+		if(hits == 0) continue;
+
+		// coincident centres get an arbitrary upward normal
+		float4 distance = vsqrt(distanceSquared);
+		mask4 apart = distance > float4(1.0e-6f);
+		float4 inverse = float4(1.0f) / vmax(distance, float4(1.0e-6f));
+		float4 nx = select(apart, dx * inverse, float4(0.0f));
+		float4 ny = select(apart, dy * inverse, float4(1.0f));
+		float4 nz = select(apart, dz * inverse, float4(0.0f));
+		float4 depth = radii - distance;
+		float4 reach = radiusA - depth * 0.5f;
+
+		float out[7][LANES];
+		store_float4(out[0], nx);
+		store_float4(out[1], ny);
+		store_float4(out[2], nz);
+		store_float4(out[3], depth);
+		store_float4(out[4], load_float4(ax) + nx * reach);
+		store_float4(out[5], load_float4(ay) + ny * reach);
+		store_float4(out[6], load_float4(az) + nz * reach);
+
+		for(int lane = 0; lane < LANES; ++lane)
+		{
+			if(!(hits & (1 << lane))) continue;
+			ContactRecord& contact = contacts[numContacts++];
+			contact.pair = base + lane;
+			contact.normal = vec3(out[0][lane], out[1][lane], out[2][lane]);
+			contact.depth = out[3][lane];
+			contact.point = vec3(out[4][lane], out[5][lane], out[6][lane]);
+		}
+	}
+	return numContacts;
+}
+
+// OBB-Sphere..................................................................
+
+static int collide_obb_sphere_range(const OBB* obbs, const Sphere* spheres, const ProxyPair* pairs, int begin, int end, ContactRecord* contacts)
+{
+	int numContacts = 0;
+	for(int base = begin; base < end; base += LANES)
+	{
+		float c[3][LANES], e[3][LANES], axes[3][3][LANES];
+		float p[3][LANES], r[LANES];
+		for(int lane = 0; lane < LANES; ++lane)
+		{
+			const ProxyPair& pair = pairs[lane_pair(base, lane, end)];
+			const OBB& obb = obbs[pair.proxyA];
+			const Sphere& sphere = spheres[pair.proxyB];
+			c[0][lane] = obb.center.x;
+			c[1][lane] = obb.center.y;
+			c[2][lane] = obb.center.z;
+			e[0][lane] = obb.extents.x;
+			e[1][lane] = obb.extents.y;
+			e[2][lane] = obb.extents.z;
+			for(int i = 0; i < 3; ++i)
+			{
+				axes[i][0][lane] = obb.axes[i].x;
+				axes[i][1][lane] = obb.axes[i].y;
+				axes[i][2][lane] = obb.axes[i].z;
+			}
+			p[0][lane] = sphere.position.x;
+			p[1][lane] = sphere.position.y;
+			p[2][lane] = sphere.position.z;
+			r[lane] = sphere.radius;
+		}
+
+		float4 dx = load_float4(p[0]) - load_float4(c[0]);
+		float4 dy = load_float4(p[1]) - load_float4(c[1]);
+		float4 dz = load_float4(p[2]) - load_float4(c[2]);
+		float4 radius = load_float4(r);
+
+		// clamp the sphere centre into the box, in the box's frame
+		float4 axis[3][3];
+		float4 local[3], clamped[3], extents[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int k = 0; k < 3; ++k)
+				axis[i][k] = load_float4(axes[i][k]);
+			extents[i] = load_float4(e[i]);
+			local[i] = dot3(axis[i][0], axis[i][1], axis[i][2], dx, dy, dz);
+			clamped[i] = vmax(vmin(local[i], extents[i]), -extents[i]);
+		}
+
+		float4 closest[3];
+		float4 offset[3];
+		for(int k = 0; k < 3; ++k)
+		{
+			closest[k] = load_float4(c[k]) + axis[0][k] * clamped[0] + axis[1][k] * clamped[1] + axis[2][k] * clamped[2];
+			offset[k] = load_float4(p[k]) - closest[k];
+		}
+		float4 distanceSquared = dot3(offset[0], offset[1], offset[2], offset[0], offset[1], offset[2]);
+		int hits = move_mask(distanceSquared <= radius * radius) & ((1 << MIN(LANES, end - base)) - 1);
+		if(hits == 0) continue;
+
+		// a centre inside the box gets pushed out through the nearest face
+		float4 nearestGap = extents[0] - vabs(local[0]);
+		float4 faceSign = select(local[0] < float4(0.0f), float4(-1.0f), float4(1.0f));
+		float4 face[3] = { axis[0][0] * faceSign, axis[0][1] * faceSign, axis[0][2] * faceSign };
+		for(int i = 1; i < 3; ++i)
+		{
+			float4 gap = extents[i] - vabs(local[i]);
+			mask4 nearer = gap < nearestGap;
+			float4 sign = select(local[i] < float4(0.0f), float4(-1.0f), float4(1.0f));
+			nearestGap = select(nearer, gap, nearestGap);
+			for(int k = 0; k < 3; ++k)
+				face[k] = select(nearer, axis[i][k] * sign, face[k]);
+		}
+
+		// test containment in the box's frame, since rebuilding the clamped
+		// point in world space leaves rounding error on centres that are inside
+		mask4 inside = vabs(local[0]) <= extents[0];
+		for(int i = 1; i < 3; ++i)
+			inside = inside & (vabs(local[i]) <= extents[i]);
+
+		float4 distance = vsqrt(distanceSquared);
+		float4 inverse = float4(1.0f) / vmax(distance, float4(1.0e-6f));
+
+		float out[7][LANES];
+		float4 depth = select(inside, radius + nearestGap, radius - distance);
+		store_float4(out[3], depth);
+		for(int k = 0; k < 3; ++k)
+		{
+			float4 normal = select(inside, face[k], offset[k] * inverse);
+			float4 surface = select(inside, load_float4(p[k]) + face[k] * nearestGap, closest[k]);
+			store_float4(out[k], normal);
+			store_float4(out[4 + k], surface - normal * (depth * 0.5f));
+		}
+
+		for(int lane = 0; lane < LANES; ++lane)
+		{
+			if(!(hits & (1 << lane))) continue;
+			ContactRecord& contact = contacts[numContacts++];
+			contact.pair = base + lane;
+			contact.normal = vec3(out[0][lane], out[1][lane], out[2][lane]);
+			contact.depth = out[3][lane];
+			contact.point = vec3(out[4][lane], out[5][lane], out[6][lane]);
+		}
+	}
+	return numContacts;
+}
+
+// OBB-OBB.....................................................................
+
+static float get_extent(const OBB& obb, int axis)
+{
+	return (axis == 0) ? obb.extents.x : (axis == 1) ? obb.extents.y : obb.extents.z;
+}
+
+static float sign_of(float x)
+{
+	return (x < 0.0f) ? -1.0f : 1.0f;
+}
+
+// works out the normal and a contact point once the lanes have settled on
+// the axis of least penetration: 0-2 are faces of A, 3-5 faces of B, and
+// the rest are edge pairs numbered 6 + 3 * i + j for axis i of A and j of B
+static void finish_obb_contact(const OBB& a, const OBB& b, int axis, float depth, ContactRecord* contact)
+{
+	vec3 d = b.center - a.center;
+	vec3 n;
+	if(axis < 3)
+	{
+		n = a.axes[axis] * sign_of(dot(a.axes[axis], d));
+	}
+	else if(axis < 6)
+	{
+		n = b.axes[axis - 3] * sign_of(dot(b.axes[axis - 3], d));
+	}
+	else
+	{
+		n = normalize(cross(a.axes[(axis - 6) / 3], b.axes[(axis - 6) % 3]));
+		n *= sign_of(dot(n, d));
+	}
+
+	// the corner of each box that reaches furthest into the other
+	vec3 cornerA = a.center;
+	vec3 cornerB = b.center;
+	for(int i = 0; i < 3; ++i)
+	{
+		cornerA += a.axes[i] * (sign_of(dot(a.axes[i], n)) * get_extent(a, i));
+		cornerB -= b.axes[i] * (sign_of(dot(b.axes[i], n)) * get_extent(b, i));
+	}
+
+	vec3 point;
+	if(axis < 3)
+	{
+		point = cornerB + n * (depth * 0.5f);
+	}
+	else if(axis < 6)
+	{
+		point = cornerA - n * (depth * 0.5f);
+	}
+	else
+	{
+		// slide each corner back to the middle of the edge along the axis
+		int i = (axis - 6) / 3;
+		int j = (axis - 6) % 3;
+		vec3 edgeA = a.axes[i] * get_extent(a, i);
+		vec3 edgeB = b.axes[j] * get_extent(b, j);
+		vec3 middleA = cornerA - a.axes[i] * (sign_of(dot(a.axes[i], n)) * get_extent(a, i));
+		vec3 middleB = cornerB + b.axes[j] * (sign_of(dot(b.axes[j], n)) * get_extent(b, j));
+
+		vec3 onA, onB;
+		closest_points_segment_segment(middleA - edgeA, middleA + edgeA, middleB - edgeB, middleB + edgeB, &onA, &onB);
+		point = (onA + onB) * 0.5f;
+	}
+
+	contact->normal = n;
+	contact->depth = depth;
+	contact->point = point;
+}
+
+static int collide_obb_range(const OBB* obbs, const ProxyPair* pairs, int begin, int end, ContactRecord* contacts)
+{
+	// edge axes are only taken when clearly shallower than a face axis,
+	// since faces give much steadier contacts for resting boxes
+	const float edgeBias = 0.95f;
+	const float parallelEpsilon = 1.0e-6f;
+
+	int numContacts = 0;
+	for(int base = begin; base < end; base += LANES)
+	{
+		float ca[3][LANES], ea[3][LANES], aa[3][3][LANES];
+		float cb[3][LANES], eb[3][LANES], ab[3][3][LANES];
+		for(int lane = 0; lane < LANES; ++lane)
+		{
+			const ProxyPair& pair = pairs[lane_pair(base, lane, end)];
+			const OBB& a = obbs[pair.proxyA];
+			const OBB& b = obbs[pair.proxyB];
+			for(int k = 0; k < 3; ++k)
+			{
+				ca[k][lane] = (&a.center.x)[k];
+				ea[k][lane] = (&a.extents.x)[k];
+				cb[k][lane] = (&b.center.x)[k];
+				eb[k][lane] = (&b.extents.x)[k];
+				for(int i = 0; i < 3; ++i)
+				{
+					aa[i][k][lane] = (&a.axes[i].x)[k];
+					ab[i][k][lane] = (&b.axes[i].x)[k];
+				}
+			}
+		}
+
+		float4 axesA[3][3], axesB[3][3], EA[3], EB[3], D[3];
+		for(int k = 0; k < 3; ++k)
+		{
+			EA[k] = load_float4(ea[k]);
+			EB[k] = load_float4(eb[k]);
+			D[k] = load_float4(cb[k]) - load_float4(ca[k]);
+			for(int i = 0; i < 3; ++i)
+			{
+				axesA[i][k] = load_float4(aa[i][k]);
+				axesB[i][k] = load_float4(ab[i][k]);
+			}
+		}
+
+		// the same fifteen axes as intersect_obb_obb, with the rotation
+		// between the boxes padded so near parallel edges can't cancel out
+		float4 C[3][3], absC[3][3];
+		float4 AD[3], BD[3];
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int j = 0; j < 3; ++j)
+			{
+				C[i][j] = dot3(axesA[i][0], axesA[i][1], axesA[i][2], axesB[j][0], axesB[j][1], axesB[j][2]);
+				absC[i][j] = vabs(C[i][j]) + parallelEpsilon;
+			}
+			AD[i] = dot3(axesA[i][0], axesA[i][1], axesA[i][2], D[0], D[1], D[2]);
+			BD[i] = dot3(axesB[i][0], axesB[i][1], axesB[i][2], D[0], D[1], D[2]);
+		}
+
+		int separated = 0;
+		float4 bestDepth = float4(FLT_MAX);
+		float4 bestAxis = float4(0.0f);
+
+		for(int i = 0; i < 3; ++i)
+		{
+			float4 t = vabs(AD[i]);
+			float4 r = EA[i] + EB[0] * absC[i][0] + EB[1] * absC[i][1] + EB[2] * absC[i][2];
+			separated |= move_mask(t > r);
+			float4 depth = r - t;
+			mask4 better = depth < bestDepth;
+			bestDepth = select(better, depth, bestDepth);
+			bestAxis = select(better, float4(float(i)), bestAxis);
+		}
+
+		for(int j = 0; j < 3; ++j)
+		{
+			float4 t = vabs(BD[j]);
+			float4 r = EA[0] * absC[0][j] + EA[1] * absC[1][j] + EA[2] * absC[2][j] + EB[j];
+			separated |= move_mask(t > r);
+			float4 depth = r - t;
+			mask4 better = depth < bestDepth;
+			bestDepth = select(better, depth, bestDepth);
+			bestAxis = select(better, float4(float(3 + j)), bestAxis);
+		}
+
+		if(separated == 0xF) continue;
+
+		float4 bestFaceDepth = bestDepth;
+		for(int i = 0; i < 3; ++i)
+		{
+			int i1 = (i + 1) % 3;
+			int i2 = (i + 2) % 3;
+			for(int j = 0; j < 3; ++j)
+			{
+				int j1 = (j + 1) % 3;
+				int j2 = (j + 2) % 3;
+
+				float4 t = vabs(AD[i2] * C[i1][j] - AD[i1] * C[i2][j]);
+				float4 rA = EA[i1] * absC[i2][j] + EA[i2] * absC[i1][j];
+				float4 rB = EB[j1] * absC[i][j2] + EB[j2] * absC[i][j1];
+				separated |= move_mask(t > rA + rB);
+
+				// the cross product of two unit axes has length sin(theta),
+				// and parallel edges give no axis at all
+				float4 lengthSquared = float4(1.0f) - C[i][j] * C[i][j];
+				mask4 valid = lengthSquared > float4(1.0e-6f);
+				float4 depth = (rA + rB - t) / vsqrt(vmax(lengthSquared, float4(1.0e-6f)));
+				mask4 better = valid & (depth < bestDepth) & (depth < bestFaceDepth * edgeBias);
+				bestDepth = select(better, depth, bestDepth);
+				bestAxis = select(better, float4(float(6 + 3 * i + j)), bestAxis);
+			}
+		}
+
+		int hits = ~separated & ((1 << MIN(LANES, end - base)) - 1);
+		if(hits == 0) continue;
+
+		float depths[LANES], axes[LANES];
+		store_float4(depths, bestDepth);
+		store_float4(axes, bestAxis);
+		for(int lane = 0; lane < LANES; ++lane)
+		{
+			if(!(hits & (1 << lane))) continue;
+			const ProxyPair& pair = pairs[base + lane];
+			ContactRecord& contact = contacts[numContacts++];
+			contact.pair = base + lane;
+			finish_obb_contact(obbs[pair.proxyA], obbs[pair.proxyB], int(axes[lane]), depths[lane], &contact);
+		}
+	}
+	return numContacts;
+}
+
+// Swept Pairs.................................................................
+
+// sweeps are branchy enough that they're done a pair at a time, so the
+// batching here is only in spreading the pairs over threads
+
+static vec3 get_motion(const vec3* motions, int index)
+{
+	return (motions != nullptr) ? motions[index] : VEC3_ZERO;
+}
+
+static int sweep_sphere_range(const Sphere* spheres, const vec3* motions, const ProxyPair* pairs, int begin, int end,
+	ImpactRecord* impacts)
+{
+	int numImpacts = 0;
+	for(int i = begin; i < end; ++i)
+	{
+		const ProxyPair& pair = pairs[i];
+		const Sphere& a = spheres[pair.proxyA];
+		const Sphere& b = spheres[pair.proxyB];
+		vec3 motionA = get_motion(motions, pair.proxyA);
+		vec3 motionB = get_motion(motions, pair.proxyB);
+
+		// B's centre as a point moving against a sphere of both radii
+		vec3 motion = motionB - motionA;
+		vec3 between = b.position - a.position;
+		float radius = a.radius + b.radius;
+
+		float qa = dot(motion, motion);
+		float qb = dot(between, motion);
+		float qc = dot(between, between) - radius * radius;
+
+		float t;
+		if(qc <= 0.0f)
+		{
+			t = 0.0f;
+		}
+		else
+		{
+			// already apart and not closing
+			if(qb >= 0.0f || qa < 1.0e-12f) continue;
+			float discriminant = qb * qb - qa * qc;
+			if(discriminant < 0.0f) continue;
+			t = (-qb - sqrt(discriminant)) / qa;
+			if(t > 1.0f) continue;
+		}
+
+		vec3 centerA = a.position + t * motionA;
+		vec3 d = (b.position + t * motionB) - centerA;
+		float distance = length(d);
+
+		ImpactRecord& impact = impacts[numImpacts++];
+		impact.pair = i;
+		impact.t = t;
+		impact.normal = (distance > 1.0e-6f) ? d / distance : UNIT_Y;
+		impact.point = centerA + a.radius * impact.normal;
+	}
+	return numImpacts;
+}
+
+static int sweep_obb_sphere_range(const OBB* obbs, const vec3* obbMotions, const Sphere* spheres, const vec3* sphereMotions,
+	const ProxyPair* pairs, int begin, int end, ImpactRecord* impacts)
+{
+	int numImpacts = 0;
+	for(int i = begin; i < end; ++i)
+	{
+		const ProxyPair& pair = pairs[i];
+		vec3 motionA = get_motion(obbMotions, pair.proxyA);
+		vec3 motion = get_motion(sphereMotions, pair.proxyB) - motionA;
+
+		float t;
+		vec3 point, normal;
+		if(!sweep_sphere_obb(spheres[pair.proxyB], motion, obbs[pair.proxyA], &t, &point, &normal)) continue;
+
+		ImpactRecord& impact = impacts[numImpacts++];
+		impact.pair = i;
+		impact.t = t;
+		impact.normal = normal;
+		impact.point = point + t * motionA;
+	}
+	return numImpacts;
+}
+
+// Threaded Batches............................................................
+
+// each chunk of pairs writes its records into its own slice of the output,
+// and the slices are packed together once every chunk is done
+template<typename Kernel, typename Record>
+struct PairTask
+{
+	Kernel kernel;
+	Record* records;
+	int* chunkCounts;
+	int grainSize;
+
+	void operator()(int begin, int end)
+	{
+		chunkCounts[begin / grainSize] = kernel(begin, end, records + begin);
+	}
+};
+
+template<typename Kernel, typename Record>
+static int run_pair_task(JobPool* pool, const Kernel& kernel, int numPairs, Record* records)
+{
+	// a multiple of the lane count, so only the last chunk has a partial batch
+	const int grainSize = 256;
+
+	int numChunks = (numPairs + grainSize - 1) / grainSize;
+	if(numChunks == 0) return 0;
+
+	PairTask<Kernel, Record> task;
+	task.kernel = kernel;
+	task.records = records;
+	task.chunkCounts = new int[numChunks];
+	task.grainSize = grainSize;
+	pool->ParallelFor(numPairs, grainSize, task);
+
+	int numRecords = 0;
+	for(int chunk = 0; chunk < numChunks; ++chunk)
+	{
+		const Record* slice = records + chunk * grainSize;
+		for(int i = 0; i < task.chunkCounts[chunk]; ++i)
+			records[numRecords++] = slice[i];
+	}
+	delete[] task.chunkCounts;
+
+	return numRecords;
+}
+
+struct SphereKernel
+{
+	const Sphere* spheres;
+	const ProxyPair* pairs;
+
+	int operator()(int begin, int end, ContactRecord* contacts) const
+	{
+		return collide_sphere_range(spheres, pairs, begin, end, contacts);
+	}
+};
+
+struct OBBSphereKernel
+{
+	const OBB* obbs;
+	const Sphere* spheres;
+	const ProxyPair* pairs;
+
+	int operator()(int begin, int end, ContactRecord* contacts) const
+	{
+		return collide_obb_sphere_range(obbs, spheres, pairs, begin, end, contacts);
+	}
+};
+
+struct OBBKernel
+{
+	const OBB* obbs;
+	const ProxyPair* pairs;
+
+	int operator()(int begin, int end, ContactRecord* contacts) const
+	{
+		return collide_obb_range(obbs, pairs, begin, end, contacts);
+	}
+};
+
+int collide_sphere_pairs(const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts)
+{
+	return collide_sphere_range(spheres, pairs, 0, numPairs, contacts);
+}
+
+int collide_sphere_pairs(JobPool* pool, const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts)
+{
+	SphereKernel kernel = { spheres, pairs };
+	return run_pair_task(pool, kernel, numPairs, contacts);
+}
+
+int collide_obb_sphere_pairs(const OBB* obbs, const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts)
+{
+	return collide_obb_sphere_range(obbs, spheres, pairs, 0, numPairs, contacts);
+}
+
+int collide_obb_sphere_pairs(JobPool* pool, const OBB* obbs, const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts)
+{
+	OBBSphereKernel kernel = { obbs, spheres, pairs };
+	return run_pair_task(pool, kernel, numPairs, contacts);
+}
+
+int collide_obb_pairs(const OBB* obbs, const ProxyPair* pairs, int numPairs, ContactRecord* contacts)
+{
+	return collide_obb_range(obbs, pairs, 0, numPairs, contacts);
+}
+
+int collide_obb_pairs(JobPool* pool, const OBB* obbs, const ProxyPair* pairs, int numPairs, ContactRecord* contacts)
+{
+	OBBKernel kernel = { obbs, pairs };
+	return run_pair_task(pool, kernel, numPairs, contacts);
+}
+
+struct SphereSweepKernel
+{
+	const Sphere* spheres;
+	const vec3* motions;
+	const ProxyPair* pairs;
+
+	int operator()(int begin, int end, ImpactRecord* impacts) const
+	{
+		return sweep_sphere_range(spheres, motions, pairs, begin, end, impacts);
+	}
+};
+
+struct OBBSphereSweepKernel
+{
+	const OBB* obbs;
+	const vec3* obbMotions;
+	const Sphere* spheres;
+	const vec3* sphereMotions;
+	const ProxyPair* pairs;
+
+	int operator()(int begin, int end, ImpactRecord* impacts) const
+	{
+		return sweep_obb_sphere_range(obbs, obbMotions, spheres, sphereMotions, pairs, begin, end, impacts);
+	}
+};
+
+int sweep_sphere_pairs(const Sphere* spheres, const vec3* motions, const ProxyPair* pairs, int numPairs, ImpactRecord* impacts)
+{
+	return sweep_sphere_range(spheres, motions, pairs, 0, numPairs, impacts);
+}
+
+int sweep_sphere_pairs(JobPool* pool, const Sphere* spheres, const vec3* motions, const ProxyPair* pairs, int numPairs, ImpactRecord* impacts)
+{
+	SphereSweepKernel kernel = { spheres, motions, pairs };
+	return run_pair_task(pool, kernel, numPairs, impacts);
+}
+
+int sweep_obb_sphere_pairs(const OBB* obbs, const vec3* obbMotions, const Sphere* spheres, const vec3* sphereMotions,
+	const ProxyPair* pairs, int numPairs, ImpactRecord* impacts)
+{
+	return sweep_obb_sphere_range(obbs, obbMotions, spheres, sphereMotions, pairs, 0, numPairs, impacts);
+}
+
+int sweep_obb_sphere_pairs(JobPool* pool, const OBB* obbs, const vec3* obbMotions, const Sphere* spheres, const vec3* sphereMotions,
+	const ProxyPair* pairs, int numPairs, ImpactRecord* impacts)
+{
+	OBBSphereSweepKernel kernel = { obbs, obbMotions, spheres, sphereMotions, pairs };
+	return run_pair_task(pool, kernel, numPairs, impacts);
+}
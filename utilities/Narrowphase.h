@@ -0,0 +1,55 @@
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "Collision.h"
+
+class JobPool;
+
+// Batched contact generation over the pair lists that come out of a
+// broadphase. Pairs are tested four at a time, one per SIMD lane, and the
+// pool versions spread the batches over worker threads as well.
+
+struct ContactRecord
+{
+	int pair;    // index into the pair list
+	vec3 normal; // points from A toward B
+	vec3 point;  // halfway between the two surfaces
+	float depth;
+};
+
+struct ImpactRecord
+{
+	int pair;    // index into the pair list
+	float t;     // fraction of the motions travelled before touching
+	vec3 normal; // points from A toward B
+	vec3 point;  // on A at the time of impact
+};
+
+// contacts must have room for numPairs records; the number written is
+// returned, in the same order as the pairs that produced them
+
+int collide_sphere_pairs(const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts);
+int collide_sphere_pairs(JobPool* pool, const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts);
+
+// proxyA indexes the boxes and proxyB the spheres
+int collide_obb_sphere_pairs(const OBB* obbs, const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts);
+int collide_obb_sphere_pairs(JobPool* pool, const OBB* obbs, const Sphere* spheres, const ProxyPair* pairs, int numPairs, ContactRecord* contacts);
+
+int collide_obb_pairs(const OBB* obbs, const ProxyPair* pairs, int numPairs, ContactRecord* contacts);
+int collide_obb_pairs(JobPool* pool, const OBB* obbs, const ProxyPair* pairs, int numPairs, ContactRecord* contacts);
+
+// continuous versions, for shapes moving by a whole step's motion: a record
+// is written for each pair that touches somewhere along the way, and pairs
+// that start out touching report a t of zero. Motions are indexed like the
+// shapes, and a null motion list means those shapes stand still.
+
+int sweep_sphere_pairs(const Sphere* spheres, const vec3* motions, const ProxyPair* pairs, int numPairs, ImpactRecord* impacts);
+int sweep_sphere_pairs(JobPool* pool, const Sphere* spheres, const vec3* motions, const ProxyPair* pairs, int numPairs, ImpactRecord* impacts);
+
+// proxyA indexes the boxes and proxyB the spheres
+int sweep_obb_sphere_pairs(const OBB* obbs, const vec3* obbMotions, const Sphere* spheres, const vec3* sphereMotions,
+	const ProxyPair* pairs, int numPairs, ImpactRecord* impacts);
+int sweep_obb_sphere_pairs(JobPool* pool, const OBB* obbs, const vec3* obbMotions, const Sphere* spheres, const vec3* sphereMotions,
+	const ProxyPair* pairs, int numPairs, ImpactRecord* impacts);
+
+#endif
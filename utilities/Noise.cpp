@@ -1,5 +1,7 @@
 #include "Noise.h"
 
+#include "SIMD.h"
+
 #include <math.h>
 
 namespace
@@ -530,3 +532,331 @@ double octave_simplex_noise_4d(double numOctaves, double persistence, double sca
 
     return sum / combinedAmplitude;
 }
+
+// BATCHED SIMPLEX NOISE
+//----------------------------------------------------------------------------------------------------
+
+static const int LANES = 4;
+
+// the gradient picked by each hashed value, so a lookup skips the modulo and
+// the integer to float conversion
+struct GradientTable
+{
+	float x[256], y[256], z[256];
+
+	GradientTable()
+	{
+		for(int i = 0; i < 256; ++i)
+		{
+			const int* gradient = gradient3D[i % 12];
+			x[i] = gradient[0];
+			y[i] = gradient[1];
+			z[i] = gradient[2];
+		}
+	}
+};
+
+static const GradientTable gradients;
+
+// a corner's share of the sample, which is zero outside its radius
+static inline float4 corner_falloff(float4 t, float4 dotted)
+{
+	t = vmax(t, float4(0.0f));
+	t = t * t;
+	return t * t * dotted;
+}
+
+static float4 simplex_noise_2d(float4 x, float4 y)
+{
+	const float F2 = 0.5f * (sqrtf(3.0f) - 1.0f);
+	const float G2 = (3.0f - sqrtf(3.0f)) / 6.0f;
+
+	// skew to find the cell, then unskew its origin
+	float4 s = (x + y) * F2;
+	float4 i = vfloor(x + s);
+	float4 j = vfloor(y + s);
+	float4 t = (i + j) * G2;
+	float4 x0 = x - (i - t);
+	float4 y0 = y - (j - t);
+
+	// which of the two triangles in the cell
+	mask4 lower = x0 > y0;
+	float4 i1 = select(lower, float4(1.0f), float4(0.0f));
+	float4 j1 = float4(1.0f) - i1;
+
+	float4 x1 = x0 - i1 + G2;
+	float4 y1 = y0 - j1 + G2;
+	float4 x2 = x0 - 1.0f + 2.0f * G2;
+	float4 y2 = y0 - 1.0f + 2.0f * G2;
+
+	// hash the corners a lane at a time
+	float cells[4][LANES];
+	store_float4(cells[0], i);
+	store_float4(cells[1], j);
+	store_float4(cells[2], i1);
+	store_float4(cells[3], j1);
+
+	float gx[3][LANES], gy[3][LANES];
+	for(int lane = 0; lane < LANES; ++lane)
+	{
+		int ii = int(cells[0][lane]) & 255;
+		int jj = int(cells[1][lane]) & 255;
+		int di = int(cells[2][lane]);
+		int dj = int(cells[3][lane]);
+		int gi[3] =
+		{
+			permutations[ii      + permutations[jj     ]],
+			permutations[ii + di + permutations[jj + dj]],
+			permutations[ii + 1  + permutations[jj + 1 ]],
+		};
+		for(int corner = 0; corner < 3; ++corner)
+		{
+			gx[corner][lane] = gradients.x[gi[corner]];
+			gy[corner][lane] = gradients.y[gi[corner]];
+		}
+	}
+
+	float4 n0 = corner_falloff(float4(0.5f) - x0 * x0 - y0 * y0, load_float4(gx[0]) * x0 + load_float4(gy[0]) * y0);
+	float4 n1 = corner_falloff(float4(0.5f) - x1 * x1 - y1 * y1, load_float4(gx[1]) * x1 + load_float4(gy[1]) * y1);
+	float4 n2 = corner_falloff(float4(0.5f) - x2 * x2 - y2 * y2, load_float4(gx[2]) * x2 + load_float4(gy[2]) * y2);
+	return (n0 + n1 + n2) * 70.0f;
+}
+
+static float4 simplex_noise_3d(float4 x, float4 y, float4 z)
+{
+	const float F3 = 1.0f / 3.0f;
+	const float G3 = 1.0f / 6.0f;
+
+	float4 s = (x + y + z) * F3;
+	float4 i = vfloor(x + s);
+	float4 j = vfloor(y + s);
+	float4 k = vfloor(z + s);
+	float4 t = (i + j + k) * G3;
+	float4 x0 = x - (i - t);
+	float4 y0 = y - (j - t);
+	float4 z0 = z - (k - t);
+
+	// the same choice of tetrahedron as the scalar version, as masks: the
+	// second corner steps along the largest axis and the third along all but
+	// the smallest
+	const float4 one(1.0f), zero(0.0f);
+	mask4 xy = x0 >= y0;
+	mask4 yz = y0 >= z0;
+	mask4 xz = x0 >= z0;
+	float4 i1 = select(xy & xz, one, zero);
+	float4 j1 = select(y0 > x0, select(yz, one, zero), zero);
+	float4 k1 = one - i1 - j1;
+	float4 i2 = select(xy | xz, one, zero);
+	float4 j2 = select((y0 > x0) | yz, one, zero);
+	float4 k2 = select((z0 > y0) | (z0 > x0), one, zero);
+
+	float4 x1 = x0 - i1 + G3;
+	float4 y1 = y0 - j1 + G3;
+	float4 z1 = z0 - k1 + G3;
+	float4 x2 = x0 - i2 + 2.0f * G3;
+	float4 y2 = y0 - j2 + 2.0f * G3;
+	float4 z2 = z0 - k2 + 2.0f * G3;
+	float4 x3 = x0 - 1.0f + 3.0f * G3;
+	float4 y3 = y0 - 1.0f + 3.0f * G3;
+	float4 z3 = z0 - 1.0f + 3.0f * G3;
+
+	float cells[9][LANES];
+	const float4 stored[9] = { i, j, k, i1, j1, k1, i2, j2, k2 };
+	for(int c = 0; c < 9; ++c)
+		store_float4(cells[c], stored[c]);
+
+	float gx[4][LANES], gy[4][LANES], gz[4][LANES];
+	for(int lane = 0; lane < LANES; ++lane)
+	{
+		int ii = int(cells[0][lane]) & 255;
+		int jj = int(cells[1][lane]) & 255;
+		int kk = int(cells[2][lane]) & 255;
+		int offsets[3][3] =
+		{
+			{ int(cells[3][lane]), int(cells[4][lane]), int(cells[5][lane]) },
+			{ int(cells[6][lane]), int(cells[7][lane]), int(cells[8][lane]) },
+			{ 1, 1, 1 },
+		};
+		int gi[4];
+		gi[0] = permutations[ii + permutations[jj + permutations[kk]]];
+		for(int corner = 1; corner < 4; ++corner)
+		{
+			const int* o = offsets[corner - 1];
+			gi[corner] = permutations[ii + o[0] + permutations[jj + o[1] + permutations[kk + o[2]]]];
+		}
+		for(int corner = 0; corner < 4; ++corner)
+		{
+			gx[corner][lane] = gradients.x[gi[corner]];
+			gy[corner][lane] = gradients.y[gi[corner]];
+			gz[corner][lane] = gradients.z[gi[corner]];
+		}
+	}
+
+	float4 n0 = corner_falloff(float4(0.5f) - x0 * x0 - y0 * y0 - z0 * z0,
+		load_float4(gx[0]) * x0 + load_float4(gy[0]) * y0 + load_float4(gz[0]) * z0);
+	float4 n1 = corner_falloff(float4(0.5f) - x1 * x1 - y1 * y1 - z1 * z1,
+		load_float4(gx[1]) * x1 + load_float4(gy[1]) * y1 + load_float4(gz[1]) * z1);
+	float4 n2 = corner_falloff(float4(0.5f) - x2 * x2 - y2 * y2 - z2 * z2,
+		load_float4(gx[2]) * x2 + load_float4(gy[2]) * y2 + load_float4(gz[2]) * z2);
+	float4 n3 = corner_falloff(float4(0.5f) - x3 * x3 - y3 * y3 - z3 * z3,
+		load_float4(gx[3]) * x3 + load_float4(gy[3]) * y3 + load_float4(gz[3]) * z3);
+	return (n0 + n1 + n2 + n3) * 32.0f;
+}
+
+// sums the octaves for four samples, each octave at a higher frequency and
+// lower amplitude than the last, scaled back into range at the end
+template<typename Sampler>
+static float4 fractal_noise(const FractalNoise& fractal, Sampler& sample)
+{
+	float4 sum(0.0f);
+	float frequency = fractal.frequency;
+	float amplitude = 1.0f;
+	float combinedAmplitude = 0.0f;
+
+	for(int octave = 0; octave < fractal.numOctaves; ++octave)
+	{
+		float4 n = sample(frequency);
+		if(fractal.type == FRACTAL_RIDGED)
+		{
+			n = float4(1.0f) - vabs(n);
+			n = n * n;
+		}
+		sum = sum + n * amplitude;
+		combinedAmplitude += amplitude;
+		frequency *= fractal.lacunarity;
+		amplitude *= fractal.persistence;
+	}
+
+	if(combinedAmplitude == 0.0f) return sum;
+	return sum * (1.0f / combinedAmplitude);
+}
+
+struct Sampler2D
+{
+	float4 x, y;
+
+	float4 operator()(float frequency) const
+	{
+		return simplex_noise_2d(x * frequency, y * frequency);
+	}
+};
+
+struct Sampler3D
+{
+	float4 x, y, z;
+
+	float4 operator()(float frequency) const
+	{
+		return simplex_noise_3d(x * frequency, y * frequency, z * frequency);
+	}
+};
+
+// the last few samples of a list that doesn't fill the lanes go through
+// padded copies
+static void load_tail(const float* in, int count, float padded[LANES])
+{
+	for(int lane = 0; lane < LANES; ++lane)
+		padded[lane] = (lane < count) ? in[lane] : 0.0f;
+}
+
+static void store_tail(float4 values, int count, float* out)
+{
+	float padded[LANES];
+	store_float4(padded, values);
+	for(int lane = 0; lane < count; ++lane)
+		out[lane] = padded[lane];
+}
+
+void fractal_noise_2d(const FractalNoise& fractal, const float* x, const float* y, int count, float* out)
+{
+	Sampler2D sampler;
+	int base = 0;
+	for(; base + LANES <= count; base += LANES)
+	{
+		sampler.x = load_float4(x + base);
+		sampler.y = load_float4(y + base);
+		store_float4(out + base, fractal_noise(fractal, sampler));
+	}
+	if(base < count)
+	{
+		float px[LANES], py[LANES];
+		load_tail(x + base, count - base, px);
+		load_tail(y + base, count - base, py);
+		sampler.x = load_float4(px);
+		sampler.y = load_float4(py);
+		store_tail(fractal_noise(fractal, sampler), count - base, out + base);
+	}
+}
+
+void fractal_noise_3d(const FractalNoise& fractal, const float* x, const float* y, const float* z, int count, float* out)
+{
+	Sampler3D sampler;
+	int base = 0;
+	for(; base + LANES <= count; base += LANES)
+	{
+		sampler.x = load_float4(x + base);
+		sampler.y = load_float4(y + base);
+		sampler.z = load_float4(z + base);
+		store_float4(out + base, fractal_noise(fractal, sampler));
+	}
+	if(base < count)
+	{
+		float px[LANES], py[LANES], pz[LANES];
+		load_tail(x + base, count - base, px);
+		load_tail(y + base, count - base, py);
+		load_tail(z + base, count - base, pz);
+		sampler.x = load_float4(px);
+		sampler.y = load_float4(py);
+		sampler.z = load_float4(pz);
+		store_tail(fractal_noise(fractal, sampler), count - base, out + base);
+	}
+}
+
+void fill_noise_grid_2d(const FractalNoise& fractal, float x, float y, float step, int width, int height, float* out)
+{
+	static const float laneOffsets[LANES] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	float4 offsets = load_float4(laneOffsets) * step;
+
+	Sampler2D sampler;
+	for(int row = 0; row < height; ++row)
+	{
+		float* rowOut = out + row * width;
+		sampler.y = float4(y + row * step);
+		for(int column = 0; column < width; column += LANES)
+		{
+			sampler.x = offsets + (x + column * step);
+			float4 values = fractal_noise(fractal, sampler);
+			if(column + LANES <= width)
+				store_float4(rowOut + column, values);
+			else
+				store_tail(values, width - column, rowOut + column);
+		}
+	}
+}
+
+void fill_noise_grid_3d(const FractalNoise& fractal, float x, float y, float z, float step,
+	int width, int height, int depth, float* out)
+{
+	static const float laneOffsets[LANES] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	float4 offsets = load_float4(laneOffsets) * step;
+
+	Sampler3D sampler;
+	for(int layer = 0; layer < depth; ++layer)
+	{
+		sampler.z = float4(z + layer * step);
+		for(int row = 0; row < height; ++row)
+		{
+			float* rowOut = out + (layer * height + row) * width;
+			sampler.y = float4(y + row * step);
+			for(int column = 0; column < width; column += LANES)
+			{
+				sampler.x = offsets + (x + column * step);
+				float4 values = fractal_noise(fractal, sampler);
+				if(column + LANES <= width)
+					store_float4(rowOut + column, values);
+				else
+					store_tail(values, width - column, rowOut + column);
+			}
+		}
+	}
+}
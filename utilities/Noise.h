@@ -9,4 +9,33 @@ double simplex_noise_4d(double x, double y, double z, double w);
 
 double octave_simplex_noise_4d(double numOctaves, double persistence, double scale, double x, double y, double z, double w);
 
+// Batched float versions of the simplex noise above, for filling height maps
+// and volumes. Samples go through four at a time in SIMD lanes, and only the
+// gradient table lookups are done one lane at a time.
+
+enum FractalType
+{
+	FRACTAL_FBM,    // octaves summed, in [-1, 1]
+	FRACTAL_RIDGED, // octaves folded into sharp crests, in [0, 1]
+};
+
+struct FractalNoise
+{
+	FractalType type;
+	int numOctaves;
+	float frequency;   // of the first octave
+	float lacunarity;  // how much the frequency grows each octave
+	float persistence; // how much the amplitude shrinks each octave
+};
+
+// samples at arbitrary points
+void fractal_noise_2d(const FractalNoise& fractal, const float* x, const float* y, int count, float* out);
+void fractal_noise_3d(const FractalNoise& fractal, const float* x, const float* y, const float* z, int count, float* out);
+
+// samples a grid of points step apart starting at the given corner, with
+// x varying fastest, then y, then z
+void fill_noise_grid_2d(const FractalNoise& fractal, float x, float y, float step, int width, int height, float* out);
+void fill_noise_grid_3d(const FractalNoise& fractal, float x, float y, float z, float step,
+	int width, int height, int depth, float* out);
+
 #endif
@@ -0,0 +1,465 @@
+#include "OcclusionBuffer.h"
+
+#include "SIMD.h"
+#include "NumberMacros.h"
+#include "concurrent/JobPool.h"
+
+#include <float.h>
+#include <math.h>
+
+static const float FAR_DEPTH = 1.0f;
+
+// clipping against the near plane can turn one triangle into two
+static const int MAX_SPLIT_TRIANGLES = 2;
+
+OcclusionBuffer::OcclusionBuffer(int width, int height):
+	triangles(nullptr),
+	triangleCount(0),
+	triangleCapacity(0)
+{
+	tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	this->width = tilesX * TILE_SIZE;
+	this->height = tilesY * TILE_SIZE;
+
+	int numTiles = tilesX * tilesY;
+	depths = new float[numTiles * TILE_PIXELS];
+	tileNearest = new float[numTiles];
+	tileFurthest = new float[numTiles];
+
+	Begin(MAT_I);
+}
+
+OcclusionBuffer::~OcclusionBuffer()
+{
+	delete[] depths;
+	delete[] tileNearest;
+	delete[] tileFurthest;
+	delete[] triangles;
+}
+
+void OcclusionBuffer::Begin(const mat4x4& viewProjection)
+{
+	this->viewProjection = viewProjection;
+	occluders.Clear();
+	triangleCount = 0;
+
+	int numTiles = tilesX * tilesY;
+	for(int i = 0; i < numTiles * TILE_PIXELS; ++i)
+		depths[i] = FAR_DEPTH;
+	for(int i = 0; i < numTiles; ++i)
+	{
+		tileNearest[i] = FAR_DEPTH;
+		tileFurthest[i] = FAR_DEPTH;
+	}
+}
+
+void OcclusionBuffer::AddOccluder(const vec3* positions, const uint16_t* indices, int numIndices, const mat4x4& model)
+{
+	Occluder occluder;
+	occluder.positions = positions;
+	occluder.indices = indices;
+	occluder.numIndices = numIndices;
+	occluder.wideIndices = false;
+	occluder.modelViewProjection = viewProjection * model;
+	occluders.Push(occluder);
+}
+
+void OcclusionBuffer::AddOccluder(const vec3* positions, const uint32_t* indices, int numIndices, const mat4x4& model)
+{
+	Occluder occluder;
+	occluder.positions = positions;
+	occluder.indices = indices;
+	occluder.numIndices = numIndices;
+	occluder.wideIndices = true;
+	occluder.modelViewProjection = viewProjection * model;
+	occluders.Push(occluder);
+}
+
+float OcclusionBuffer::GetDepth(int x, int y) const
+{
+	int tile = (y / TILE_SIZE) * tilesX + x / TILE_SIZE;
+	return depths[tile * TILE_PIXELS + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+}
+
+// Triangle Setup..............................................................
+
+bool OcclusionBuffer::SetupTriangle(const vec4& a, const vec4& b, const vec4& c, ScreenTriangle* out) const
+{
+	// to pixels, with y flipped so row 0 is the top of the screen
+	const vec4* clip[3] = { &a, &b, &c };
+	float x[3], y[3], z[3];
+	for(int i = 0; i < 3; ++i)
+	{
+		float inverseW = 1.0f / clip[i]->w;
+		x[i] = (0.5f + 0.5f * clip[i]->x * inverseW) * width;
+		y[i] = (0.5f - 0.5f * clip[i]->y * inverseW) * height;
+		z[i] = clip[i]->z * inverseW;
+	}
+
+	// the flip turns front faces clockwise, which gives them a negative area
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if(area > -1.0e-6f) return false;
+
+	// swap two corners so the area, and every edge function inside, is positive
+	float temp;
+	temp = x[1]; x[1] = x[2]; x[2] = temp;
+	temp = y[1]; y[1] = y[2]; y[2] = temp;
+	temp = z[1]; z[1] = z[2]; z[2] = temp;
+	area = -area;
+
+	out->nearest = MIN(MIN(z[0], z[1]), z[2]);
+	out->furthest = MAX(MAX(z[0], z[1]), z[2]);
+	if(out->nearest > FAR_DEPTH) return false;
+
+	float minX = MIN(MIN(x[0], x[1]), x[2]);
+	float maxX = MAX(MAX(x[0], x[1]), x[2]);
+	float minY = MIN(MIN(y[0], y[1]), y[2]);
+	float maxY = MAX(MAX(y[0], y[1]), y[2]);
+	out->minX = MAX(int(ceil(minX - 0.5f)), 0);
+	out->maxX = MIN(int(floor(maxX - 0.5f)), width - 1);
+	out->minY = MAX(int(ceil(minY - 0.5f)), 0);
+	out->maxY = MIN(int(floor(maxY - 0.5f)), height - 1);
+	if(out->minX > out->maxX || out->minY > out->maxY) return false;
+
+	// each edge function is offset to its value at the pixel corner furthest
+	// outside the edge, so only pixels the triangle covers completely pass
+	for(int i = 0; i < 3; ++i)
+	{
+		int j = (i + 1) % 3;
+		out->edgeX[i] = y[i] - y[j];
+		out->edgeY[i] = x[j] - x[i];
+		out->edgeC[i] = x[i] * y[j] - x[j] * y[i]
+			- 0.5f * (fabs(out->edgeX[i]) + fabs(out->edgeY[i]));
+	}
+
+	// the depth plane, pushed back by the most it changes within half a pixel
+	// so every pixel gets the furthest depth the triangle has inside it
+	out->depthX = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	out->depthY = ((x[1] - x[0]) * (z[2] - z[0]) - (x[2] - x[0]) * (z[1] - z[0])) / area;
+	out->depthC = z[0] - out->depthX * x[0] - out->depthY * y[0]
+		+ 0.5f * (fabs(out->depthX) + fabs(out->depthY));
+
+	return true;
+}
+
+template<typename IndexType>
+int OcclusionBuffer::SetupTriangles(const Occluder& occluder, const IndexType* indices, ScreenTriangle* out) const
+{
+	const mat4x4& transform = occluder.modelViewProjection;
+	const vec3* positions = occluder.positions;
+
+	int count = 0;
+	for(int i = 0; i + 2 < occluder.numIndices; i += 3)
+	{
+		vec4 clip[3];
+		for(int j = 0; j < 3; ++j)
+			clip[j] = transform * vec4(positions[indices[i + j]], 1.0f);
+
+		// skip triangles wholly outside one of the side planes
+		if(clip[0].x > clip[0].w && clip[1].x > clip[1].w && clip[2].x > clip[2].w) continue;
+		if(clip[0].x < -clip[0].w && clip[1].x < -clip[1].w && clip[2].x < -clip[2].w) continue;
+		if(clip[0].y > clip[0].w && clip[1].y > clip[1].w && clip[2].y > clip[2].w) continue;
+		if(clip[0].y < -clip[0].w && clip[1].y < -clip[1].w && clip[2].y < -clip[2].w) continue;
+
+		// clip against the near plane, where z = -w
+		float distances[3];
+		int numInside = 0;
+		for(int j = 0; j < 3; ++j)
+		{
+			distances[j] = clip[j].z + clip[j].w;
+			if(distances[j] > 0.0f) ++numInside;
+		}
+
+		if(numInside == 3)
+		{
+			count += SetupTriangle(clip[0], clip[1], clip[2], out + count);
+			continue;
+		}
+		if(numInside == 0) continue;
+
+		vec4 polygon[4];
+		int numPoints = 0;
+		for(int j = 0; j < 3; ++j)
+		{
+			int k = (j + 1) % 3;
+			if(distances[j] > 0.0f)
+				polygon[numPoints++] = clip[j];
+			if((distances[j] > 0.0f) != (distances[k] > 0.0f))
+			{
+				float t = distances[j] / (distances[j] - distances[k]);
+				polygon[numPoints++] = clip[j] + t * (clip[k] - clip[j]);
+			}
+		}
+		for(int j = 2; j < numPoints; ++j)
+			count += SetupTriangle(polygon[0], polygon[j - 1], polygon[j], out + count);
+	}
+	return count;
+}
+
+int OcclusionBuffer::SetupOccluder(const Occluder& occluder, ScreenTriangle* out) const
+{
+	if(occluder.wideIndices)
+		return SetupTriangles(occluder, static_cast<const uint32_t*>(occluder.indices), out);
+	else
+		return SetupTriangles(occluder, static_cast<const uint16_t*>(occluder.indices), out);
+}
+
+// Rasterization...............................................................
+
+void OcclusionBuffer::DrawTriangle(const ScreenTriangle& triangle, int tileX, int tileY)
+{
+	int tile = tileY * tilesX + tileX;
+
+	// nothing in the tile is further away than the whole triangle
+	if(triangle.nearest >= tileFurthest[tile]) return;
+
+	int firstRow = MAX(triangle.minY - tileY * TILE_SIZE, 0);
+	int lastRow = MIN(triangle.maxY - tileY * TILE_SIZE, TILE_SIZE - 1);
+
+	float4 furthest(triangle.furthest);
+	float4 zero(0.0f);
+	const float offsetValues[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+	float4 offsets = load_float4(offsetValues);
+
+	bool written = false;
+	float* tileDepths = depths + tile * TILE_PIXELS;
+	for(int row = firstRow; row <= lastRow; ++row)
+	{
+		float4 y(float(tileY * TILE_SIZE + row) + 0.5f);
+		for(int column = 0; column < TILE_SIZE; column += 4)
+		{
+			float4 x = offsets + float(tileX * TILE_SIZE + column);
+
+			float4 e0 = float4(triangle.edgeX[0]) * x + float4(triangle.edgeY[0]) * y + triangle.edgeC[0];
+			float4 e1 = float4(triangle.edgeX[1]) * x + float4(triangle.edgeY[1]) * y + triangle.edgeC[1];
+			float4 e2 = float4(triangle.edgeX[2]) * x + float4(triangle.edgeY[2]) * y + triangle.edgeC[2];
+			mask4 inside = (e0 > zero) & (e1 > zero) & (e2 > zero);
+			if(move_mask(inside) == 0) continue;
+
+			float4 depth = float4(triangle.depthX) * x + float4(triangle.depthY) * y + triangle.depthC;
+			depth = vmin(depth, furthest);
+
+			float* pixels = tileDepths + row * TILE_SIZE + column;
+			float4 old = load_float4(pixels);
+			store_float4(pixels, select(inside, vmin(old, depth), old));
+			written = true;
+		}
+	}
+
+	if(!written) return;
+
+	float4 nearest = load_float4(tileDepths);
+	float4 furthestInTile = nearest;
+	for(int i = 4; i < TILE_PIXELS; i += 4)
+	{
+		float4 d = load_float4(tileDepths + i);
+		nearest = vmin(nearest, d);
+		furthestInTile = vmax(furthestInTile, d);
+	}
+	float lanesNearest[4], lanesFurthest[4];
+	store_float4(lanesNearest, nearest);
+	store_float4(lanesFurthest, furthestInTile);
+	tileNearest[tile] = MIN(MIN(lanesNearest[0], lanesNearest[1]), MIN(lanesNearest[2], lanesNearest[3]));
+	tileFurthest[tile] = MAX(MAX(lanesFurthest[0], lanesFurthest[1]), MAX(lanesFurthest[2], lanesFurthest[3]));
+}
+
+void OcclusionBuffer::RasterizeTileRows(int firstRow, int endRow)
+{
+	int top = firstRow * TILE_SIZE;
+	int bottom = endRow * TILE_SIZE - 1;
+
+	// triangles are drawn in the order they were added, so the result
+	// doesn't depend on how the rows were split up
+	for(int i = 0; i < triangleCount; ++i)
+	{
+		const ScreenTriangle& triangle = triangles[i];
+		if(triangle.maxY < top || triangle.minY > bottom) continue;
+
+		int firstTileY = MAX(triangle.minY / TILE_SIZE, firstRow);
+		int lastTileY = MIN(triangle.maxY / TILE_SIZE, endRow - 1);
+		int firstTileX = triangle.minX / TILE_SIZE;
+		int lastTileX = triangle.maxX / TILE_SIZE;
+		for(int tileY = firstTileY; tileY <= lastTileY; ++tileY)
+		{
+			for(int tileX = firstTileX; tileX <= lastTileX; ++tileX)
+				DrawTriangle(triangle, tileX, tileY);
+		}
+	}
+}
+
+// each occluder writes its triangles into its own slice of the list, and the
+// slices are packed together once they're all done
+struct OccluderSetupTask
+{
+	const OcclusionBuffer* buffer;
+	const int* starts;
+	int* counts;
+
+	void operator()(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+			counts[i] = buffer->SetupOccluder(buffer->occluders[i], buffer->triangles + starts[i]);
+	}
+};
+
+struct RasterizeTask
+{
+	OcclusionBuffer* buffer;
+
+	void operator()(int begin, int end)
+	{
+		buffer->RasterizeTileRows(begin, end);
+	}
+};
+
+void OcclusionBuffer::Rasterize(JobPool* pool)
+{
+	int numOccluders = int(occluders.Count());
+	if(numOccluders == 0) return;
+
+	int* starts = new int[numOccluders];
+	int* counts = new int[numOccluders];
+	int total = 0;
+	for(int i = 0; i < numOccluders; ++i)
+	{
+		starts[i] = total;
+		total += MAX_SPLIT_TRIANGLES * (occluders[i].numIndices / 3);
+	}
+	if(total > triangleCapacity)
+	{
+		delete[] triangles;
+		triangleCapacity = total;
+		triangles = new ScreenTriangle[triangleCapacity];
+	}
+
+	OccluderSetupTask setup = { this, starts, counts };
+	if(pool != nullptr)
+		pool->ParallelFor(numOccluders, 1, setup);
+	else
+		setup(0, numOccluders);
+
+	triangleCount = 0;
+	for(int i = 0; i < numOccluders; ++i)
+	{
+		for(int j = 0; j < counts[i]; ++j)
+			triangles[triangleCount++] = triangles[starts[i] + j];
+	}
+	delete[] starts;
+	delete[] counts;
+
+	// no two rows of tiles share a pixel, so they're drawn independently
+	RasterizeTask rasterize = { this };
+	if(pool != nullptr)
+		pool->ParallelFor(tilesY, 1, rasterize);
+	else
+		rasterize(0, tilesY);
+}
+
+// Occlusion Tests.............................................................
+
+bool OcclusionBuffer::TestAABB(const AABB& bounds) const
+{
+	// the box's screen rectangle at the depth of its nearest corner stands in
+	// for the box, which covers at least as much as the box itself does
+
+	float minX = FLT_MAX, maxX = -FLT_MAX;
+	float minY = FLT_MAX, maxY = -FLT_MAX;
+	float nearest = FLT_MAX;
+	int numBehind = 0;
+	for(int i = 0; i < 8; ++i)
+	{
+		vec3 corner = bounds.center;
+		corner.x += (i & 1) ? bounds.extents.x : -bounds.extents.x;
+		corner.y += (i & 2) ? bounds.extents.y : -bounds.extents.y;
+		corner.z += (i & 4) ? bounds.extents.z : -bounds.extents.z;
+
+		vec4 clip = viewProjection * vec4(corner, 1.0f);
+
+		if(clip.z < -clip.w || clip.w <= 0.0f)
+		{
+			++numBehind;
+			continue;
+		}
+
+		float inverseW = 1.0f / clip.w;
+		float x = (0.5f + 0.5f * clip.x * inverseW) * width;
+		float y = (0.5f - 0.5f * clip.y * inverseW) * height;
+		minX = MIN(minX, x);
+		maxX = MAX(maxX, x);
+		minY = MIN(minY, y);
+		maxY = MAX(maxY, y);
+		nearest = MIN(nearest, clip.z * inverseW);
+	}
+
+	// a box reaching past the near plane is right in front of the viewer
+	if(numBehind == 8) return false;
+	if(numBehind > 0) return true;
+	if(nearest > FAR_DEPTH) return false;
+
+	// every pixel the rectangle touches at all
+	int left = MAX(int(floor(minX)), 0);
+	int right = MIN(int(floor(maxX)), width - 1);
+	int top = MAX(int(floor(minY)), 0);
+	int bottom = MIN(int(floor(maxY)), height - 1);
+	if(left > right || top > bottom) return false;
+
+	float4 boxDepth(nearest);
+	const float columnValues[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+	float4 columns = load_float4(columnValues);
+
+	for(int tileY = top / TILE_SIZE; tileY <= bottom / TILE_SIZE; ++tileY)
+	{
+		for(int tileX = left / TILE_SIZE; tileX <= right / TILE_SIZE; ++tileX)
+		{
+			int tile = tileY * tilesX + tileX;
+
+			// in front of everything in the tile, or behind all of it
+			if(nearest < tileNearest[tile]) return true;
+			if(nearest >= tileFurthest[tile]) continue;
+
+			int x0 = tileX * TILE_SIZE;
+			int y0 = tileY * TILE_SIZE;
+			int firstRow = MAX(top - y0, 0);
+			int lastRow = MIN(bottom - y0, TILE_SIZE - 1);
+			float4 first(float(MAX(left - x0, 0)));
+			float4 last(float(MIN(right - x0, TILE_SIZE - 1)));
+
+			const float* tileDepths = depths + tile * TILE_PIXELS;
+			for(int row = firstRow; row <= lastRow; ++row)
+			{
+				for(int column = 0; column < TILE_SIZE; column += 4)
+				{
+					float4 x = columns + float(column);
+					mask4 covered = (x >= first) & (x <= last);
+					mask4 behind = load_float4(tileDepths + row * TILE_SIZE + column) > boxDepth;
+					if(move_mask(covered & behind) != 0) return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+struct OcclusionTestTask
+{
+	const OcclusionBuffer* buffer;
+	const AABB* bounds;
+	bool* visible;
+
+	void operator()(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+			visible[i] = buffer->TestAABB(bounds[i]);
+	}
+};
+
+void OcclusionBuffer::TestAABBs(const AABB* bounds, int count, bool* visible, JobPool* pool) const
+{
+	OcclusionTestTask task = { this, bounds, visible };
+	if(pool != nullptr)
+		pool->ParallelFor(count, 64, task);
+	else
+		task(0, count);
+}
@@ -0,0 +1,100 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include "Collision.h"
+#include "DataTypes.h"
+#include "GLMath.h"
+
+#include "collections/AutoArray.h"
+
+class JobPool;
+
+// Software depth buffer for culling objects hidden behind large occluders
+// like terrain and level statics. Occluder meshes are rasterized at low
+// resolution into 8x8 pixel tiles, four pixels at a time, and each tile keeps
+// the nearest and furthest depth written to it so most box tests never look
+// at single pixels. Occluders are drawn so they cover no more than they
+// really do, and boxes are tested so they cover at least as much, which means
+// an object is only ever culled when it truly can't be seen. It doesn't touch
+// the GPU, so it runs just the same without a window.
+
+class OcclusionBuffer
+{
+public:
+	// the size is rounded up to a whole number of tiles
+	OcclusionBuffer(int width, int height);
+	~OcclusionBuffer();
+
+	// clears the buffer and drops the last frame's occluders; viewProjection
+	// is an OpenGL style matrix, where depth increases away from the viewer
+	void Begin(const mat4x4& viewProjection);
+
+	// triangles are counter-clockwise when front facing, and back faces are
+	// skipped. The vertex and index data must stay alive until Rasterize.
+	void AddOccluder(const vec3* positions, const uint16_t* indices, int numIndices, const mat4x4& model);
+	void AddOccluder(const vec3* positions, const uint32_t* indices, int numIndices, const mat4x4& model);
+
+	// draws every occluder added since Begin; with a pool, triangle setup is
+	// split by occluder and drawing by rows of tiles
+	void Rasterize(JobPool* pool = nullptr);
+
+	bool TestAABB(const AABB& bounds) const;
+	void TestAABBs(const AABB* bounds, int count, bool* visible, JobPool* pool = nullptr) const;
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	int GetTriangleCount() const { return triangleCount; }
+
+	// normalized device depth at a pixel, with row 0 at the top
+	float GetDepth(int x, int y) const;
+
+private:
+	static const int TILE_SIZE = 8;
+	static const int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+	struct Occluder
+	{
+		const vec3* positions;
+		const void* indices;
+		int numIndices;
+		bool wideIndices;
+		mat4x4 modelViewProjection;
+	};
+
+	// a triangle ready to rasterize, with edge functions that are positive
+	// inside and a depth plane, both in pixels
+	struct ScreenTriangle
+	{
+		float edgeX[3], edgeY[3], edgeC[3];
+		float depthX, depthY, depthC;
+		float nearest, furthest;
+		int minX, minY, maxX, maxY;
+	};
+
+	int width, height;
+	int tilesX, tilesY;
+	float* depths;      // tile by tile, each tile row by row
+	float* tileNearest;
+	float* tileFurthest;
+
+	mat4x4 viewProjection;
+	AutoArray<Occluder> occluders;
+	ScreenTriangle* triangles;
+	int triangleCount, triangleCapacity;
+
+	OcclusionBuffer(const OcclusionBuffer&);
+	OcclusionBuffer& operator = (const OcclusionBuffer&);
+
+	template<typename IndexType>
+	int SetupTriangles(const Occluder& occluder, const IndexType* indices, ScreenTriangle* out) const;
+	int SetupOccluder(const Occluder& occluder, ScreenTriangle* out) const;
+	bool SetupTriangle(const vec4& a, const vec4& b, const vec4& c, ScreenTriangle* out) const;
+	void RasterizeTileRows(int firstRow, int endRow);
+	void DrawTriangle(const ScreenTriangle& triangle, int tileX, int tileY);
+
+	friend struct OccluderSetupTask;
+	friend struct RasterizeTask;
+	friend struct OcclusionTestTask;
+};
+
+#endif
@@ -1,10 +1,12 @@
 #include "RandomDistribution.h"
 
+#include "SIMD.h"
+
 #include <math.h>
 
 #define M_PI    3.14159265358979323846
 
-namespace random {
+namespace rng {
 
 // DISCRETE DISTRIBUTIONS
 //-------------------------------------------------------------------------------------------------
@@ -21,43 +23,43 @@ namespace random {
  */
 
 // use 0.0 < p < 1.0
-long bernoulli(double p)
+long bernoulli(double p, Stream* stream)
 {
-	return (uniform_real() < 1.0 - p)? 0 : 1;
+	return (uniform_real(stream) < 1.0 - p)? 0 : 1;
 }
 
 // use n > 0 and 0.0 < p < 1.0
-long binomial(long k, double p)
+long binomial(long k, double p, Stream* stream)
 {
 	long x = 0;
 	for(long i = 0; i < k; ++i)
-		x += bernoulli(p);
+		x += bernoulli(p, stream);
 	return x;
 }
 
 // use 0.0 < p < 1.0
-long geometric(double p)
+long geometric(double p, Stream* stream)
 {
-	return log(uniform_real()) / log(p);
+	return log(uniform_real(stream)) / log(p);
 }
 
 // use n > 0 and 0.0 < p < 1.0
-long pascal(long k, double p)
+long pascal(long k, double p, Stream* stream)
 {
 	long x = 0;
 	for(long i = 0; i < k; ++i)
-		x += geometric(p);
+		x += geometric(p, stream);
 	return x;
 }
 
 // use m > 0
-long poisson(double m)
+long poisson(double m, Stream* stream)
 {
 	double t = 0.0;
 	long x = 0;
 	while(t < m)
 	{
-		t += -log(uniform_real()); // add exponential(1.0)
+		t += -log(uniform_real(stream)); // add exponential(1.0)
 		x++;
 	}
 	return x - 1;
@@ -77,17 +79,17 @@ long poisson(double m)
  */
 
 // use lambda > 0
-double exponential(double lambda)
+double exponential(double lambda, Stream* stream)
 {
-	return -log(uniform_real()) / lambda;
+	return -log(uniform_real(stream)) / lambda;
 }
 
 // use k > 0, lambda > 0
-double erlang(int k, double lambda)
+double erlang(int k, double lambda, Stream* stream)
 {
 	double x = 0.0;
 	for(int i = 0; i < k; ++i)
-		x += exponential(lambda);
+		x += exponential(lambda, stream);
 	return x;
 }
 
@@ -98,7 +100,7 @@ double erlang(int k, double lambda)
  * alternate version uses two random numbers:
  *   return sqrt(-2.0 * log(random_uniform())) * sin(M_TAU * uniform_real());
  */
-static double random_normal()
+static double random_normal(Stream* stream)
 {
 	const double p0 = 0.322232431088;     const double q0 = 0.099348462606;
 	const double p1 = 1.0;                const double q1 = 0.588581570495;
@@ -106,7 +108,7 @@ static double random_normal()
 	const double p3 = 0.204231210245e-1;  const double q3 = 0.103537752850;
 	const double p4 = 0.453642210148e-4;  const double q4 = 0.385607006340e-2;
 
-	double u = uniform_real();
+	double u = uniform_real(stream);
 
 	double t = (u < 0.5)? sqrt(-2.0 * log(u)) : sqrt(-2.0 * log(1.0 - u));
 
@@ -117,30 +119,30 @@ static double random_normal()
 }
 
 // use sigma > 0.0
-double gaussian(double mu, double sigma)
+double gaussian(double mu, double sigma, Stream* stream)
 {
-	return mu + sigma * random_normal();
+	return mu + sigma * random_normal(stream);
 }
 
 // use k > 0
-double chi_squared(int k)
+double chi_squared(int k, Stream* stream)
 {
     double w = 0.0;
     for(int i = 0; i < k; ++i)
     {
-    	double z = random_normal();
+    	double z = random_normal(stream);
     	w += z * z;
     }
     return w;
 }
 
 // use gamma > 0.0
-double cauchy(double mu, double gamma)
+double cauchy(double mu, double gamma, Stream* stream)
 {
-	return mu + gamma * tan(M_PI * (uniform_real() - 0.5));
+	return mu + gamma * tan(M_PI * (uniform_real(stream) - 0.5));
 }
 
-double gamma(double theta, double kappa)
+double gamma(double theta, double kappa, Stream* stream)
 {
 	int int_kappa = (int)kappa;
 	double frac_kappa = kappa - (double)int_kappa;
@@ -148,7 +150,7 @@ double gamma(double theta, double kappa)
 	// integer part
 	double x_int = 0.0;
 	for(int i = 0; i < int_kappa; ++i)
-	   x_int += -log(uniform_real()); // add exponential(1.0)
+	   x_int += -log(uniform_real(stream)); // add exponential(1.0)
 
 	// fractional part
 	double x_frac;
@@ -159,10 +161,10 @@ double gamma(double theta, double kappa)
 		double b = (exp(1.0) + frac_kappa) / exp(1.0);
 		while(true)
 		{
-			double u = uniform_real();
+			double u = uniform_real(stream);
 			double p = b * u;
 
-			double uu = uniform_real();
+			double uu = uniform_real(stream);
 
 			if(p <= 1.0)
 			{
@@ -181,21 +183,123 @@ double gamma(double theta, double kappa)
 }
 
 // use sigma > 0.0
-double log_normal(double mu, double sigma)
+double log_normal(double mu, double sigma, Stream* stream)
 {
-	return exp(mu + sigma * random_normal());
+	return exp(mu + sigma * random_normal(stream));
 }
 
 // use lambda > 0.0
-double inverse_gaussian(double mu, double lambda)
+double inverse_gaussian(double mu, double lambda, Stream* stream)
 {
-	double s = random_normal();
+	double s = random_normal(stream);
 	double t = s * s; // chi_squared(1)
 	double u = mu + 0.5 * t * mu * mu / lambda - (0.5 * mu / lambda)
 	         * sqrt(4.0 * mu * lambda * t + mu * mu * t * t);
-	double v = uniform_real();
+	double v = uniform_real(stream);
 
 	return (v < mu / (mu + u))? u : mu * mu / u;
 }
 
-} // namespace random
+// FILLING ARRAYS
+//-------------------------------------------------------------------------------------------------
+
+// The uniforms come in as [0, 1), so 1 - u is what goes to the logarithm.
+
+// Box-Muller, which turns each pair of uniforms into a pair of normals; the
+// first four of every eight give the radii and the last four the angles
+void gaussian_fill(float* out, int count, float mu, float sigma, Stream* stream)
+{
+	int whole = count & ~7;
+	uniform_fill(out, whole, 0.0f, 1.0f, stream);
+
+	float rest[8];
+	if(whole < count)
+		uniform_fill(rest, 8, 0.0f, 1.0f, stream);
+
+	for(int i = 0; i < count; i += 8)
+	{
+		float* block = (i < whole)? out + i : rest;
+		float4 u1 = load_float4(block);
+		float4 u2 = load_float4(block + 4);
+
+		float4 radius = vsqrt(vlog(float4(1.0f) - u1) * -2.0f) * sigma;
+		float4 sine, cosine;
+		vsincos(u2 * float(2.0 * M_PI), &sine, &cosine);
+		store_float4(block, radius * cosine + mu);
+		store_float4(block + 4, radius * sine + mu);
+	}
+
+	for(int i = whole; i < count; ++i)
+		out[i] = rest[i - whole];
+}
+
+// use lambda > 0
+void exponential_fill(float* out, int count, float lambda, Stream* stream)
+{
+	uniform_fill(out, count, 0.0f, 1.0f, stream);
+
+	float4 scale = -1.0f / lambda;
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		float4 u = load_float4(out + i);
+		store_float4(out + i, vlog(float4(1.0f) - u) * scale);
+	}
+	for(; i < count; ++i)
+		out[i] = -logf(1.0f - out[i]) / lambda;
+}
+
+// use gamma > 0
+void cauchy_fill(float* out, int count, float mu, float gamma, Stream* stream)
+{
+	uniform_fill(out, count, 0.0f, 1.0f, stream);
+
+	int i = 0;
+	for(; i + 4 <= count; i += 4)
+	{
+		float4 u = load_float4(out + i);
+		float4 sine, cosine;
+		vsincos((u - 0.5f) * float(M_PI), &sine, &cosine);
+		store_float4(out + i, sine / cosine * gamma + mu);
+	}
+	for(; i < count; ++i)
+		out[i] = mu + gamma * tanf(float(M_PI) * (out[i] - 0.5f));
+}
+
+// Inverse of the cumulative distribution, walked up from zero, which takes
+// one uniform per value rather than the m or so poisson uses. Past where
+// e^-m runs out of range this falls back on poisson.
+void poisson_fill(long* out, int count, double m, Stream* stream)
+{
+	if(m > 700.0)
+	{
+		for(int i = 0; i < count; ++i)
+			out[i] = poisson(m, stream);
+		return;
+	}
+
+	double start = exp(-m);
+	float u[256];
+	for(int i = 0; i < count; i += 256)
+	{
+		int n = count - i;
+		if(n > 256) n = 256;
+		uniform_fill(u, n, 0.0f, 1.0f, stream);
+
+		for(int j = 0; j < n; ++j)
+		{
+			double p = start;
+			double cumulative = p;
+			long x = 0;
+			while(u[j] > cumulative && p > 0.0)
+			{
+				x++;
+				p *= m / x;
+				cumulative += p;
+			}
+			out[i + j] = x;
+		}
+	}
+}
+
+} // namespace rng
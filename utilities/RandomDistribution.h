@@ -3,27 +3,41 @@
 
 #include "RandomUniform.h"
 
-namespace random {
+namespace rng {
+
+// Like the uniform functions, these draw from the stream given, or from the
+// shared generator without one.
 
 //--- DISCRETE DISTRIBUTIONS ----------------------------------------------------------------------
 
-long bernoulli(double p);
-long binomial(long k, double p);
-long geometric(double p);
-long pascal(long k, double p);
-long poisson(double m);
+long bernoulli(double p, Stream* stream = nullptr);
+long binomial(long k, double p, Stream* stream = nullptr);
+long geometric(double p, Stream* stream = nullptr);
+long pascal(long k, double p, Stream* stream = nullptr);
+long poisson(double m, Stream* stream = nullptr);
 
 //--- CONTINUOUS DISTRIBUTIONS --------------------------------------------------------------------
 
-double exponential(double lambda);
-double erlang(int k, double lambda);
-double gaussian(double mu, double sigma);
-double chi_squared(int k);
-double cauchy(double mu, double gamma);
-double gamma(double theta, double kappa);
-double log_normal(double mu, double sigma);
-double inverse_gaussian(double mu, double lambda);
+double exponential(double lambda, Stream* stream = nullptr);
+double erlang(int k, double lambda, Stream* stream = nullptr);
+double gaussian(double mu, double sigma, Stream* stream = nullptr);
+double chi_squared(int k, Stream* stream = nullptr);
+double cauchy(double mu, double gamma, Stream* stream = nullptr);
+double gamma(double theta, double kappa, Stream* stream = nullptr);
+double log_normal(double mu, double sigma, Stream* stream = nullptr);
+double inverse_gaussian(double mu, double lambda, Stream* stream = nullptr);
+
+//--- FILLING ARRAYS ------------------------------------------------------------------------------
+
+// These fill a whole array at once, four values to a step where they can,
+// from uniform_fill. For a given seed they give the same values every time,
+// though not the ones a loop over the functions above would.
+
+void gaussian_fill(float* out, int count, float mu, float sigma, Stream* stream = nullptr);
+void exponential_fill(float* out, int count, float lambda, Stream* stream = nullptr);
+void cauchy_fill(float* out, int count, float mu, float gamma, Stream* stream = nullptr);
+void poisson_fill(long* out, int count, double m, Stream* stream = nullptr);
 
-} // namespace random
+} // namespace rng
 
 #endif
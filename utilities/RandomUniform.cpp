@@ -1,6 +1,8 @@
 #include "RandomUniform.h"
 
-namespace random {
+#include "SIMD.h"
+
+namespace rng {
 
 #define MT_LENGTH 624
 #define MT_IA 379
@@ -157,22 +159,230 @@ static unsigned long mt_random()
 	return r;
 }
 
-int integer_range(int min, int max)
+int integer_range(int min, int max, Stream* stream)
 {
+	if(stream)
+	{
+		// scale the top bits into the range, rather than taking a remainder
+		// that favours the low end
+		uint64_t range = uint64_t(int64_t(max) - int64_t(min) + 1);
+		return int(int64_t(min) + int64_t(((next(stream) >> 32) * range) >> 32));
+	}
 	return min + int(mt_random() % (unsigned long)(max - min + 1));
 }
 
-double real_range(double min, double max)
+double real_range(double min, double max, Stream* stream)
 {
-	double d = double(mt_random()) / 4294967296.0;
-	return min + d * (max - min);
+	return min + uniform_real(stream) * (max - min);
 }
 
-double uniform_real()
+double uniform_real(Stream* stream)
 {
+	if(stream)
+	{
+		// the top 53 bits fill a double's mantissa
+		return double(next(stream) >> 11) * (1.0 / 9007199254740992.0);
+	}
 	return double(mt_random()) / 4294967296.0;
 }
 
+// XOSHIRO256**
+//-------------------------------------------------------------------------------------------------
+// xoshiro256** and splitmix64 by David Blackman and Sebastiano Vigna, who
+// dedicated them to the public domain. http://prng.di.unimi.it/
+
+static uint64_t splitmix64(uint64_t* x)
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotate_left(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+void seed_stream(Stream* stream, uint64_t seed)
+{
+	// splitmix64 never gives four zeros in a row, which is the one state
+	// xoshiro can't leave
+	for(int i = 0; i < 4; ++i)
+		stream->state[i] = splitmix64(&seed);
+}
+
+uint64_t next(Stream* stream)
+{
+	uint64_t* s = stream->state;
+	uint64_t result = rotate_left(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotate_left(s[3], 45);
+
+	return result;
+}
+
+void jump(Stream* stream)
+{
+	static const uint64_t polynomial[4] =
+	{
+		0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull,
+		0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull,
+	};
+
+	uint64_t jumped[4] = { 0, 0, 0, 0 };
+	for(int i = 0; i < 4; ++i)
+	{
+		for(int b = 0; b < 64; ++b)
+		{
+			if(polynomial[i] & (uint64_t(1) << b))
+			{
+				for(int j = 0; j < 4; ++j)
+					jumped[j] ^= stream->state[j];
+			}
+			next(stream);
+		}
+	}
+
+	for(int j = 0; j < 4; ++j)
+		stream->state[j] = jumped[j];
+}
+
+Stream split(Stream* stream)
+{
+	Stream result = *stream;
+	jump(stream);
+	return result;
+}
+
+// FOUR STREAMS SIDE BY SIDE
+//-------------------------------------------------------------------------------------------------
+
+// Each step gives 64 bits from each of four streams, which make eight
+// floats with 24 bits apiece, the most a float in [0, 1) can hold evenly.
+// With SSE2 the streams are kept two to a register, with the multiplies done
+// as shifts and adds, since there's no 64-bit multiply.
+
+#if defined(SIMD_SSE)
+
+struct StreamLanes
+{
+	__m128i state[4][2]; // word, then pair of streams
+};
+
+static void load_lanes(StreamLanes* lanes, const Stream* streams)
+{
+	for(int i = 0; i < 4; ++i)
+	{
+		for(int pair = 0; pair < 2; ++pair)
+		{
+			const uint64_t* a = streams[2 * pair].state;
+			const uint64_t* b = streams[2 * pair + 1].state;
+			lanes->state[i][pair] = _mm_set_epi64x(b[i], a[i]);
+		}
+	}
+}
+
+static inline __m128i rotate_left(__m128i x, int k)
+{
+	return _mm_or_si128(_mm_slli_epi64(x, k), _mm_srli_epi64(x, 64 - k));
+}
+
+static inline __m128 next_floats(StreamLanes* lanes, int pair)
+{
+	__m128i* s[4] = { &lanes->state[0][pair], &lanes->state[1][pair], &lanes->state[2][pair], &lanes->state[3][pair] };
+
+	__m128i times5 = _mm_add_epi64(*s[1], _mm_slli_epi64(*s[1], 2));
+	__m128i rotated = rotate_left(times5, 7);
+	__m128i result = _mm_add_epi64(rotated, _mm_slli_epi64(rotated, 3));
+	__m128i t = _mm_slli_epi64(*s[1], 17);
+
+	*s[2] = _mm_xor_si128(*s[2], *s[0]);
+	*s[3] = _mm_xor_si128(*s[3], *s[1]);
+	*s[1] = _mm_xor_si128(*s[1], *s[2]);
+	*s[0] = _mm_xor_si128(*s[0], *s[3]);
+	*s[2] = _mm_xor_si128(*s[2], t);
+	*s[3] = rotate_left(*s[3], 45);
+
+	__m128 whole = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+	return _mm_mul_ps(whole, _mm_set1_ps(1.0f / 16777216.0f));
+}
+
+static void next_floats(StreamLanes* lanes, float4* first, float4* second)
+{
+	first->v = next_floats(lanes, 0);
+	second->v = next_floats(lanes, 1);
+}
+
+#else
+
+struct StreamLanes
+{
+	Stream streams[4];
+};
+
+static void load_lanes(StreamLanes* lanes, const Stream* streams)
+{
+	for(int i = 0; i < 4; ++i)
+		lanes->streams[i] = streams[i];
+}
+
+static void next_floats(StreamLanes* lanes, float4* first, float4* second)
+{
+	float values[8];
+	for(int i = 0; i < 4; ++i)
+	{
+		uint64_t x = next(&lanes->streams[i]);
+		values[2 * i] = float(uint32_t(x) >> 8) * (1.0f / 16777216.0f);
+		values[2 * i + 1] = float(uint32_t(x >> 32) >> 8) * (1.0f / 16777216.0f);
+	}
+	*first = load_float4(values);
+	*second = load_float4(values + 4);
+}
+
+#endif
+
+void uniform_fill(float* out, int count, float min, float max, Stream* stream)
+{
+	Stream streams[4];
+	for(int i = 0; i < 4; ++i)
+	{
+		uint64_t seed;
+		if(stream) seed = next(stream);
+		else seed = (uint64_t(mt_random() & 0xFFFFFFFF) << 32) | (mt_random() & 0xFFFFFFFF);
+		seed_stream(&streams[i], seed);
+	}
+
+	StreamLanes lanes;
+	load_lanes(&lanes, streams);
+
+	float4 scale = max - min;
+	float4 offset = min;
+	float4 first, second;
+	int i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		next_floats(&lanes, &first, &second);
+		store_float4(out + i, first * scale + offset);
+		store_float4(out + i + 4, second * scale + offset);
+	}
+	if(i < count)
+	{
+		float rest[8];
+		next_floats(&lanes, &first, &second);
+		store_float4(rest, first * scale + offset);
+		store_float4(rest + 4, second * scale + offset);
+		for(int j = 0; i < count; ++i, ++j)
+			out[i] = rest[j];
+	}
+}
+
 // UNIQUE RANDOM NUMBER PERMUTATION
 //-------------------------------------------------------------------------------------------------
 
@@ -195,4 +405,4 @@ unsigned int unique_int()
 	return permute_sequence((permute_sequence(sequenceIndex++) + sequenceOffset) ^ 0x5BF03635ul);
 }
 
-} // namespace random
+} // namespace rng
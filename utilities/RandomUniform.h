@@ -1,16 +1,45 @@
 #ifndef RANDOM_UNIFORM_H
 #define RANDOM_UNIFORM_H
 
-namespace random {
+#include "DataTypes.h"
 
+namespace rng {
+
+// A xoshiro256** generator that lives wherever its owner wants, instead of
+// the shared state behind reseed. Each thread, task or entity can keep its
+// own, so nothing has to be locked and the same seed always gives the same
+// numbers no matter how work was scheduled. Jumping skips a stream ahead
+// by 2^128 numbers, far more than any one stream will ever use, which is
+// how independent streams are made from one seed.
+struct Stream
+{
+	uint64_t state[4];
+};
+
+void seed_stream(Stream* stream, uint64_t seed);
+uint64_t next(Stream* stream);
+void jump(Stream* stream);
+
+// hands back a stream starting where this one is, and jumps this one past
+// everything the returned stream could use
+Stream split(Stream* stream);
+
+// These use the shared generator when no stream is given, which is only
+// safe from one thread at a time.
 void reseed(unsigned long seed);
-int integer_range(int min, int max);
-double real_range(double min, double max);
-double uniform_real();
+int integer_range(int min, int max, Stream* stream = nullptr);
+double real_range(double min, double max, Stream* stream = nullptr);
+double uniform_real(Stream* stream = nullptr);
+
+// Fills count floats in [min, max) at once, from four generators run side
+// by side. They're seeded from the stream, or from the shared generator
+// without one, so a seed still gives the same values every time, though not
+// the ones a loop over real_range would.
+void uniform_fill(float* out, int count, float min, float max, Stream* stream = nullptr);
 
-void reseed_unique();
+void reseed_unique(unsigned long seedBase, unsigned long seedOffset);
 unsigned int unique_int();
 
-} // namespace random
+} // namespace rng
 
 #endif
@@ -0,0 +1,307 @@
+#include "RayBatch.h"
+
+#include "SIMD.h"
+#include "NumberMacros.h"
+
+#include <float.h>
+
+static const int LANES = 4;
+static const float laneOffsets[LANES] = { 0.0f, 1.0f, 2.0f, 3.0f };
+
+static int padded_count(int count)
+{
+	return (count + LANES - 1) / LANES * LANES;
+}
+
+// Kernels.....................................................................
+
+// both kernels take rays and shapes one component per lane, and set hit in
+// the lanes where the ray touches the shape no further than maxDistance
+
+static float4 ray_sphere_kernel(const float4 origin[3], const float4 direction[3], float4 maxDistance,
+	const float4 center[3], float4 radiusSquared, mask4* hit)
+{
+	float4 mx = origin[0] - center[0];
+	float4 my = origin[1] - center[1];
+	float4 mz = origin[2] - center[2];
+	float4 a = dot3(direction[0], direction[1], direction[2], direction[0], direction[1], direction[2]);
+	float4 b = dot3(mx, my, mz, direction[0], direction[1], direction[2]);
+	float4 c = dot3(mx, my, mz, mx, my, mz) - radiusSquared;
+	float4 discriminant = b * b - a * c;
+
+	// starting inside counts as a hit right away, and otherwise the ray has
+	// to be heading toward the centre and the quadratic needs real roots
+	mask4 inside = c <= float4(0.0f);
+	mask4 crossing = (b < float4(0.0f)) & (discriminant >= float4(0.0f));
+	float4 t = select(inside, float4(0.0f), (-b - vsqrt(vmax(discriminant, float4(0.0f)))) / a);
+	*hit = (inside | crossing) & (t <= maxDistance);
+	return t;
+}
+
+static float4 ray_obb_kernel(const float4 origin[3], const float4 direction[3], float4 maxDistance,
+	const float4 center[3], const float4 extents[3], const float4 axes[3][3], mask4* hit)
+{
+	float4 dx = origin[0] - center[0];
+	float4 dy = origin[1] - center[1];
+	float4 dz = origin[2] - center[2];
+
+	// clip the ray against each pair of slabs in the box's frame. A ray
+	// running parallel to a slab gets a tiny direction instead, which still
+	// puts both ends of the slab at the same side when it starts outside.
+	const float4 epsilon(1.0e-12f);
+	float4 tMin(0.0f);
+	float4 tMax = maxDistance;
+	for(int i = 0; i < 3; ++i)
+	{
+		float4 local = dot3(axes[i][0], axes[i][1], axes[i][2], dx, dy, dz);
+		float4 slope = dot3(axes[i][0], axes[i][1], axes[i][2], direction[0], direction[1], direction[2]);
+		slope = select(vabs(slope) < epsilon, epsilon, slope);
+		float4 inverse = float4(1.0f) / slope;
+		float4 t1 = (-extents[i] - local) * inverse;
+		float4 t2 = (extents[i] - local) * inverse;
+		tMin = vmax(tMin, vmin(t1, t2));
+		tMax = vmin(tMax, vmax(t1, t2));
+	}
+	*hit = (tMin <= tMax) & (tMin <= maxDistance);
+	return tMin;
+}
+
+// Batches.....................................................................
+
+void build_sphere_batch(SphereBatch* batch, const Sphere* spheres, int count)
+{
+	destroy_sphere_batch(batch);
+
+	// one block for all the arrays, with the padding zeroed so loads past
+	// the end read something harmless
+	int stride = padded_count(count);
+	float* block = new float[4 * MAX(stride, LANES)]();
+	for(int i = 0; i < 3; ++i)
+		batch->centers[i] = block + i * stride;
+	batch->radiiSquared = block + 3 * stride;
+	batch->count = count;
+
+	for(int i = 0; i < count; ++i)
+	{
+		batch->centers[0][i] = spheres[i].position.x;
+		batch->centers[1][i] = spheres[i].position.y;
+		batch->centers[2][i] = spheres[i].position.z;
+		batch->radiiSquared[i] = spheres[i].radius * spheres[i].radius;
+	}
+}
+
+void destroy_sphere_batch(SphereBatch* batch)
+{
+	// the centres come first in the block, so they own it
+	delete[] batch->centers[0];
+	batch->centers[0] = nullptr;
+	batch->radiiSquared = nullptr;
+	batch->count = 0;
+}
+
+void build_obb_batch(OBBBatch* batch, const OBB* obbs, int count)
+{
+	destroy_obb_batch(batch);
+
+	int stride = padded_count(count);
+	float* block = new float[15 * MAX(stride, LANES)]();
+	for(int i = 0; i < 3; ++i)
+	{
+		batch->centers[i] = block + i * stride;
+		batch->extents[i] = block + (3 + i) * stride;
+		for(int j = 0; j < 3; ++j)
+			batch->axes[i][j] = block + (6 + 3 * i + j) * stride;
+	}
+	batch->count = count;
+
+	for(int i = 0; i < count; ++i)
+	{
+		const OBB& obb = obbs[i];
+		batch->centers[0][i] = obb.center.x;
+		batch->centers[1][i] = obb.center.y;
+		batch->centers[2][i] = obb.center.z;
+		batch->extents[0][i] = obb.extents.x;
+		batch->extents[1][i] = obb.extents.y;
+		batch->extents[2][i] = obb.extents.z;
+		for(int j = 0; j < 3; ++j)
+		{
+			batch->axes[j][0][i] = obb.axes[j].x;
+			batch->axes[j][1][i] = obb.axes[j].y;
+			batch->axes[j][2][i] = obb.axes[j].z;
+		}
+	}
+}
+
+void destroy_obb_batch(OBBBatch* batch)
+{
+	delete[] batch->centers[0];
+	batch->centers[0] = nullptr;
+	batch->count = 0;
+}
+
+// One Ray, Many Shapes........................................................
+
+static void broadcast_ray(const Ray& ray, float4 origin[3], float4 direction[3])
+{
+	origin[0] = float4(ray.origin.x);
+	origin[1] = float4(ray.origin.y);
+	origin[2] = float4(ray.origin.z);
+	direction[0] = float4(ray.direction.x);
+	direction[1] = float4(ray.direction.y);
+	direction[2] = float4(ray.direction.z);
+}
+
+// each lane keeps its own nearest hit, and the lanes are compared at the end
+static int nearest_lane(float4 nearest, float4 nearestIndex, float* distance)
+{
+	float distances[LANES], indices[LANES];
+	store_float4(distances, nearest);
+	store_float4(indices, nearestIndex);
+
+	int best = -1;
+	for(int lane = 0; lane < LANES; ++lane)
+	{
+		int index = int(indices[lane]);
+		if(index < 0) continue;
+		if(best < 0 || distances[lane] < *distance || (distances[lane] == *distance && index < best))
+		{
+			best = index;
+			*distance = distances[lane];
+		}
+	}
+	return best;
+}
+
+int intersect_ray_spheres(const Ray& ray, const SphereBatch& batch, float* distance)
+{
+	float4 origin[3], direction[3];
+	broadcast_ray(ray, origin, direction);
+	float4 maxDistance(ray.maxDistance);
+	float4 count(float(batch.count));
+
+	float4 nearest(FLT_MAX);
+	float4 nearestIndex(-1.0f);
+	for(int base = 0; base < batch.count; base += LANES)
+	{
+		float4 center[3];
+		for(int i = 0; i < 3; ++i)
+			center[i] = load_float4(batch.centers[i] + base);
+
+		mask4 hit;
+		float4 t = ray_sphere_kernel(origin, direction, maxDistance, center, load_float4(batch.radiiSquared + base), &hit);
+
+		float4 index = float4(float(base)) + load_float4(laneOffsets);
+		mask4 closer = hit & (index < count) & (t < nearest);
+		nearest = select(closer, t, nearest);
+		nearestIndex = select(closer, index, nearestIndex);
+	}
+	return nearest_lane(nearest, nearestIndex, distance);
+}
+
+int intersect_ray_obbs(const Ray& ray, const OBBBatch& batch, float* distance)
+{
+	float4 origin[3], direction[3];
+	broadcast_ray(ray, origin, direction);
+	float4 maxDistance(ray.maxDistance);
+	float4 count(float(batch.count));
+
+	float4 nearest(FLT_MAX);
+	float4 nearestIndex(-1.0f);
+	for(int base = 0; base < batch.count; base += LANES)
+	{
+		float4 center[3], extents[3], axes[3][3];
+		for(int i = 0; i < 3; ++i)
+		{
+			center[i] = load_float4(batch.centers[i] + base);
+			extents[i] = load_float4(batch.extents[i] + base);
+			for(int j = 0; j < 3; ++j)
+				axes[i][j] = load_float4(batch.axes[i][j] + base);
+		}
+
+		mask4 hit;
+		float4 t = ray_obb_kernel(origin, direction, maxDistance, center, extents, axes, &hit);
+
+		float4 index = float4(float(base)) + load_float4(laneOffsets);
+		mask4 closer = hit & (index < count) & (t < nearest);
+		nearest = select(closer, t, nearest);
+		nearestIndex = select(closer, index, nearestIndex);
+	}
+	return nearest_lane(nearest, nearestIndex, distance);
+}
+
+// Packets of Rays, One Shape..................................................
+
+RayPacket make_ray_packet(const Ray* rays, int count)
+{
+	RayPacket packet;
+	for(int lane = 0; lane < LANES; ++lane)
+	{
+		if(lane < count)
+		{
+			const Ray& ray = rays[lane];
+			packet.origins[0][lane] = ray.origin.x;
+			packet.origins[1][lane] = ray.origin.y;
+			packet.origins[2][lane] = ray.origin.z;
+			packet.directions[0][lane] = ray.direction.x;
+			packet.directions[1][lane] = ray.direction.y;
+			packet.directions[2][lane] = ray.direction.z;
+			packet.maxDistances[lane] = ray.maxDistance;
+		}
+		else
+		{
+			// a negative reach rules out even starting inside
+			for(int i = 0; i < 3; ++i)
+			{
+				packet.origins[i][lane] = 0.0f;
+				packet.directions[i][lane] = 0.0f;
+			}
+			packet.maxDistances[lane] = -1.0f;
+		}
+	}
+	return packet;
+}
+
+static void load_packet(const RayPacket& packet, float4 origin[3], float4 direction[3])
+{
+	for(int i = 0; i < 3; ++i)
+	{
+		origin[i] = load_float4(packet.origins[i]);
+		direction[i] = load_float4(packet.directions[i]);
+	}
+}
+
+int intersect_ray_packet_sphere(const RayPacket& packet, const Sphere& sphere, float distances[4])
+{
+	float4 origin[3], direction[3];
+	load_packet(packet, origin, direction);
+	float4 maxDistance = load_float4(packet.maxDistances);
+
+	float4 center[3] = { float4(sphere.position.x), float4(sphere.position.y), float4(sphere.position.z) };
+
+	mask4 hit;
+	float4 t = ray_sphere_kernel(origin, direction, maxDistance, center, float4(sphere.radius * sphere.radius), &hit);
+	store_float4(distances, select(hit, t, maxDistance));
+	return move_mask(hit);
+}
+
+int intersect_ray_packet_obb(const RayPacket& packet, const OBB& obb, float distances[4])
+{
+	float4 origin[3], direction[3];
+	load_packet(packet, origin, direction);
+	float4 maxDistance = load_float4(packet.maxDistances);
+
+	float4 center[3] = { float4(obb.center.x), float4(obb.center.y), float4(obb.center.z) };
+	float4 extents[3] = { float4(obb.extents.x), float4(obb.extents.y), float4(obb.extents.z) };
+	float4 axes[3][3];
+	for(int i = 0; i < 3; ++i)
+	{
+		axes[i][0] = float4(obb.axes[i].x);
+		axes[i][1] = float4(obb.axes[i].y);
+		axes[i][2] = float4(obb.axes[i].z);
+	}
+
+	mask4 hit;
+	float4 t = ray_obb_kernel(origin, direction, maxDistance, center, extents, axes, &hit);
+	store_float4(distances, select(hit, t, maxDistance));
+	return move_mask(hit);
+}
@@ -0,0 +1,59 @@
+#ifndef RAY_BATCH_H
+#define RAY_BATCH_H
+
+#include "Collision.h"
+
+// Ray queries over many shapes at once, for line of sight checks and mouse
+// picking. Shapes are copied into batches that keep each component in its own
+// array, with box axes worked out up front, so one ray is tested against four
+// shapes per SIMD step. The other way around, a packet of four coherent rays
+// is tested against a single shape. Distances are measured in multiples of
+// the ray direction, like RayHit, and a ray starting inside a shape hits it
+// at zero.
+
+struct SphereBatch
+{
+	float* centers[3];
+	float* radiiSquared;
+	int count;
+
+	SphereBatch(): radiiSquared(nullptr), count(0) { centers[0] = nullptr; }
+};
+
+struct OBBBatch
+{
+	float* centers[3];
+	float* extents[3];
+	float* axes[3][3]; // axis, then component
+	int count;
+
+	OBBBatch(): count(0) { centers[0] = nullptr; }
+};
+
+// four rays with each component in its own lane; unused lanes never hit
+struct RayPacket
+{
+	float origins[3][4];
+	float directions[3][4];
+	float maxDistances[4];
+};
+
+void build_sphere_batch(SphereBatch* batch, const Sphere* spheres, int count);
+void destroy_sphere_batch(SphereBatch* batch);
+void build_obb_batch(OBBBatch* batch, const OBB* obbs, int count);
+void destroy_obb_batch(OBBBatch* batch);
+
+// takes up to four rays
+RayPacket make_ray_packet(const Ray* rays, int count);
+
+// these return the index of the nearest shape hit within the ray's
+// maxDistance, or -1 on a miss
+int intersect_ray_spheres(const Ray& ray, const SphereBatch& batch, float* distance);
+int intersect_ray_obbs(const Ray& ray, const OBBBatch& batch, float* distance);
+
+// these return a mask with a bit set for each ray that hits; rays that miss
+// get their maxDistance back
+int intersect_ray_packet_sphere(const RayPacket& packet, const Sphere& sphere, float distances[4]);
+int intersect_ray_packet_obb(const RayPacket& packet, const OBB& obb, float distances[4]);
+
+#endif
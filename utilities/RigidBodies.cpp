@@ -0,0 +1,1016 @@
+#include "RigidBodies.h"
+
+#include "Maths.h"
+#include "Narrowphase.h"
+#include "NumberMacros.h"
+#include "Sorting.h"
+#include "concurrent/JobPool.h"
+
+#include <float.h>
+#include <math.h>
+
+// total gap at which a pair of shapes starts producing contacts; points
+// inside it but not yet touching only stop bodies closing the gap too fast
+static const float CONTACT_MARGIN = 0.02f;
+
+// overlap that's left alone, so resting contacts don't flicker in and out
+static const float LINEAR_SLOP = 0.005f;
+static const float BAUMGARTE = 0.2f;
+static const float MAX_CORRECTION = 0.2f;
+
+// how close a new point has to be to one from the last step to inherit
+// its impulses, measured in body A's frame
+static const float MATCH_DISTANCE = 0.05f;
+
+// the normal has to lie this close to a face axis for a box pair to be
+// treated as a face contact and clipped, rather than a single edge point
+static const float FACE_ALIGNMENT = 0.995f;
+
+static const float DEFAULT_FRICTION = 0.5f;
+static const float LINEAR_SLEEP_TOLERANCE = 0.05f;
+static const float ANGULAR_SLEEP_TOLERANCE = 0.05f;
+static const float TIME_TO_SLEEP = 0.5f;
+
+template<typename T>
+static void grow_array(T*& array, int count, int newCapacity)
+{
+	T* grown = new T[newCapacity];
+	for(int i = 0; i < count; ++i) grown[i] = array[i];
+	delete[] array;
+	array = grown;
+}
+
+static float get_component(const vec3& v, int axis)
+{
+	return (axis == 0) ? v.x : (axis == 1) ? v.y : v.z;
+}
+
+static vec3 transform_inertia(const vec3* rows, const vec3& v)
+{
+	return vec3(dot(rows[0], v), dot(rows[1], v), dot(rows[2], v));
+}
+
+static size_t pair_key(int bodyA, int bodyB)
+{
+	// half the bits of the key for each body
+	return (size_t(bodyA) << (sizeof(size_t) * 4)) | size_t(bodyB);
+}
+
+static void compute_basis(const vec3& normal, vec3* tangent1, vec3* tangent2)
+{
+	if(fabs(normal.x) >= 0.57735f)
+		*tangent1 = normalize(vec3(normal.y, -normal.x, 0.0f));
+	else
+		*tangent1 = normalize(vec3(0.0f, normal.z, -normal.y));
+	*tangent2 = cross(normal, *tangent1);
+}
+
+RigidBodyWorld::RigidBodyWorld(int initialCapacity):
+	bodyCount(0),
+	capacity(0),
+	positions(nullptr),
+	orientations(nullptr),
+	linearVelocities(nullptr),
+	angularVelocities(nullptr),
+	inverseMasses(nullptr),
+	inverseInertias(nullptr),
+	worldInverseInertias(nullptr),
+	frictions(nullptr),
+	shapeTypes(nullptr),
+	extents(nullptr),
+	proxies(nullptr),
+	sleepTimes(nullptr),
+	awake(nullptr),
+	spheres(nullptr),
+	boxes(nullptr),
+	islandIds(nullptr),
+	islandBodies(nullptr),
+	broadphase(initialCapacity),
+	manifoldTable(initialCapacity),
+	gravity(0.0f, -9.8f, 0.0f),
+	iterations(10)
+{
+	Grow(MAX(initialCapacity, 1));
+}
+
+RigidBodyWorld::~RigidBodyWorld()
+{
+	delete[] positions;
+	delete[] orientations;
+	delete[] linearVelocities;
+	delete[] angularVelocities;
+	delete[] inverseMasses;
+	delete[] inverseInertias;
+	delete[] worldInverseInertias;
+	delete[] frictions;
+	delete[] shapeTypes;
+	delete[] extents;
+	delete[] proxies;
+	delete[] sleepTimes;
+	delete[] awake;
+	delete[] spheres;
+	delete[] boxes;
+	delete[] islandIds;
+	delete[] islandBodies;
+}
+
+void RigidBodyWorld::Grow(int newCapacity)
+{
+	grow_array(positions, bodyCount, newCapacity);
+	grow_array(orientations, bodyCount, newCapacity);
+	grow_array(linearVelocities, bodyCount, newCapacity);
+	grow_array(angularVelocities, bodyCount, newCapacity);
+	grow_array(inverseMasses, bodyCount, newCapacity);
+	grow_array(inverseInertias, bodyCount, newCapacity);
+	grow_array(worldInverseInertias, 3 * bodyCount, 3 * newCapacity);
+	grow_array(frictions, bodyCount, newCapacity);
+	grow_array(shapeTypes, bodyCount, newCapacity);
+	grow_array(extents, bodyCount, newCapacity);
+	grow_array(proxies, bodyCount, newCapacity);
+	grow_array(sleepTimes, bodyCount, newCapacity);
+	grow_array(awake, bodyCount, newCapacity);
+	grow_array(spheres, bodyCount, newCapacity);
+	grow_array(boxes, bodyCount, newCapacity);
+
+	// these are rebuilt every step, so there's nothing to copy
+	delete[] islandIds;
+	delete[] islandBodies;
+	islandIds = new int[newCapacity];
+	islandBodies = new int[newCapacity];
+
+	capacity = newCapacity;
+}
+
+int RigidBodyWorld::AddSphere(const vec3& position, float radius, float mass)
+{
+	return AddBody(position, QUAT_I, SHAPE_SPHERE, vec3(radius, radius, radius), mass);
+}
+
+int RigidBodyWorld::AddBox(const vec3& position, const quaternion& orientation, const vec3& extents, float mass)
+{
+	return AddBody(position, orientation, SHAPE_BOX, extents, mass);
+}
+
+int RigidBodyWorld::AddBody(const vec3& position, const quaternion& orientation, uint8_t shape, const vec3& size, float mass)
+{
+	if(bodyCount == capacity) Grow(capacity * 2);
+
+	int body = bodyCount++;
+	positions[body] = position;
+	orientations[body] = normalize(orientation);
+	linearVelocities[body] = VEC3_ZERO;
+	angularVelocities[body] = VEC3_ZERO;
+	frictions[body] = DEFAULT_FRICTION;
+	shapeTypes[body] = shape;
+	extents[body] = size;
+	sleepTimes[body] = 0.0f;
+	awake[body] = mass > 0.0f;
+
+	if(mass > 0.0f)
+	{
+		inverseMasses[body] = 1.0f / mass;
+
+		vec3 inertia;
+		if(shape == SHAPE_SPHERE)
+		{
+			inertia = vec3(0.4f * mass * size.x * size.x);
+		}
+		else
+		{
+			vec3 s = size * size;
+			inertia = vec3(s.y + s.z, s.x + s.z, s.x + s.y) * (mass / 3.0f);
+		}
+		inverseInertias[body] = vec3(1.0f) / inertia;
+	}
+	else
+	{
+		inverseMasses[body] = 0.0f;
+		inverseInertias[body] = VEC3_ZERO;
+	}
+
+	UpdateShapes(body);
+	proxies[body] = broadphase.CreateProxy(ComputeBounds(body), (void*) (intptr_t) body);
+
+	return body;
+}
+
+void RigidBodyWorld::SetVelocity(int body, const vec3& linear, const vec3& angular)
+{
+	if(inverseMasses[body] == 0.0f) return;
+
+	linearVelocities[body] = linear;
+	angularVelocities[body] = angular;
+	Wake(body);
+}
+
+void RigidBodyWorld::ApplyImpulse(int body, const vec3& impulse, const vec3& point)
+{
+	if(inverseMasses[body] == 0.0f) return;
+
+	linearVelocities[body] += impulse * inverseMasses[body];
+	angularVelocities[body] += transform_inertia(worldInverseInertias + 3 * body, cross(point - positions[body], impulse));
+	Wake(body);
+}
+
+void RigidBodyWorld::Wake(int body)
+{
+	if(inverseMasses[body] == 0.0f) return;
+
+	awake[body] = true;
+	sleepTimes[body] = 0.0f;
+}
+
+void RigidBodyWorld::UpdateShapes(int body)
+{
+	const quaternion& orientation = orientations[body];
+	vec3 axes[3] = { orientation * UNIT_X, orientation * UNIT_Y, orientation * UNIT_Z };
+
+	// R * diagonal * transpose(R), with the columns of R being the axes
+	const vec3& d = inverseInertias[body];
+	vec3* rows = worldInverseInertias + 3 * body;
+	rows[0] = axes[0] * (d.x * axes[0].x) + axes[1] * (d.y * axes[1].x) + axes[2] * (d.z * axes[2].x);
+	rows[1] = axes[0] * (d.x * axes[0].y) + axes[1] * (d.y * axes[1].y) + axes[2] * (d.z * axes[2].y);
+	rows[2] = axes[0] * (d.x * axes[0].z) + axes[1] * (d.y * axes[1].z) + axes[2] * (d.z * axes[2].z);
+
+	float inflate = CONTACT_MARGIN * 0.5f;
+	if(shapeTypes[body] == SHAPE_SPHERE)
+	{
+		spheres[body].position = positions[body];
+		spheres[body].radius = extents[body].x + inflate;
+	}
+	else
+	{
+		OBB& box = boxes[body];
+		box.center = positions[body];
+		box.extents = extents[body] + inflate;
+		box.axes[0] = axes[0];
+		box.axes[1] = axes[1];
+		box.axes[2] = axes[2];
+	}
+}
+
+AABB RigidBodyWorld::ComputeBounds(int body) const
+{
+	if(shapeTypes[body] == SHAPE_SPHERE)
+	{
+		AABB bounds;
+		bounds.center = spheres[body].position;
+		bounds.extents = vec3(spheres[body].radius);
+		return bounds;
+	}
+	return compute_bounds(boxes[body]);
+}
+
+// Pairs.......................................................................
+
+void RigidBodyWorld::UpdatePairs(float deltaTime)
+{
+	for(int i = 0; i < bodyCount; ++i)
+	{
+		// static bodies are never awake
+		if(!awake[i]) continue;
+		broadphase.MoveProxy(proxies[i], ComputeBounds(i), linearVelocities[i] * deltaTime);
+	}
+
+	newPairs.Clear();
+	broadphase.UpdatePairs(newPairs);
+
+	for(size_t i = 0, n = newPairs.Count(); i < n; ++i)
+	{
+		int a = (int) (intptr_t) broadphase.GetUserData(newPairs[i].proxyA);
+		int b = (int) (intptr_t) broadphase.GetUserData(newPairs[i].proxyB);
+		if(a > b)
+		{
+			int temp = a;
+			a = b;
+			b = temp;
+		}
+		if(inverseMasses[a] == 0.0f && inverseMasses[b] == 0.0f) continue;
+
+		size_t key = pair_key(a, b);
+		if(manifoldTable.Lookup(key) != 0) continue;
+
+		Manifold manifold = {};
+		manifold.bodyA = a;
+		manifold.bodyB = b;
+		manifold.friction = 0.0f;
+		manifold.numPoints = 0;
+		manifolds.Push(manifold);
+		manifoldTable.Insert(key, manifolds.Count());
+	}
+
+	// drop the pairs whose fat bounds have come apart
+	for(int i = int(manifolds.Count()) - 1; i >= 0; --i)
+	{
+		const Manifold& manifold = manifolds[i];
+		AABB boundsA = broadphase.GetFatAABB(proxies[manifold.bodyA]);
+		AABB boundsB = broadphase.GetFatAABB(proxies[manifold.bodyB]);
+		if(!intersect_aabb_aabb(boundsA, boundsB))
+			RemoveManifold(i);
+	}
+}
+
+void RigidBodyWorld::RemoveManifold(int index)
+{
+	manifoldTable.Delete(pair_key(manifolds[index].bodyA, manifolds[index].bodyB));
+
+	int last = int(manifolds.Count()) - 1;
+	if(index != last)
+	{
+		manifolds[index] = manifolds[last];
+		manifoldTable.Insert(pair_key(manifolds[index].bodyA, manifolds[index].bodyB), index + 1);
+	}
+
+	Manifold removed;
+	manifolds.Pop(&removed);
+}
+
+// Contacts....................................................................
+
+struct ContactCandidate
+{
+	vec3 position;
+	float depth;
+};
+
+// keeps the part of the polygon where dot(p, normal) <= offset
+static int clip_polygon(const vec3* in, int count, const vec3& normal, float offset, vec3* out)
+{
+	int numOut = 0;
+	for(int i = 0; i < count; ++i)
+	{
+		const vec3& p = in[i];
+		const vec3& q = in[(i + 1) % count];
+		float dp = dot(p, normal) - offset;
+		float dq = dot(q, normal) - offset;
+		if(dp <= 0.0f)
+			out[numOut++] = p;
+		if((dp < 0.0f && dq > 0.0f) || (dp > 0.0f && dq < 0.0f))
+			out[numOut++] = p + (q - p) * (dp / (dp - dq));
+	}
+	return numOut;
+}
+
+// cuts down to four points: the deepest, the one furthest from it, and then
+// the two which make the largest triangles on either side of that line
+static int reduce_candidates(ContactCandidate* candidates, int count, const vec3& normal)
+{
+	if(count <= 4) return count;
+
+	int chosen[4];
+	chosen[0] = 0;
+	for(int i = 1; i < count; ++i)
+		if(candidates[i].depth > candidates[chosen[0]].depth) chosen[0] = i;
+
+	const vec3& first = candidates[chosen[0]].position;
+	float furthest = -1.0f;
+	for(int i = 0; i < count; ++i)
+	{
+		vec3 d = candidates[i].position - first;
+		float distanceSquared = dot(d, d);
+		if(distanceSquared > furthest)
+		{
+			furthest = distanceSquared;
+			chosen[1] = i;
+		}
+	}
+
+	vec3 edge = candidates[chosen[1]].position - first;
+	float most = -FLT_MAX, least = FLT_MAX;
+	chosen[2] = chosen[3] = chosen[0];
+	for(int i = 0; i < count; ++i)
+	{
+		float area = dot(cross(edge, candidates[i].position - first), normal);
+		if(area > most)
+		{
+			most = area;
+			chosen[2] = i;
+		}
+		if(area < least)
+		{
+			least = area;
+			chosen[3] = i;
+		}
+	}
+
+	ContactCandidate reduced[4];
+	for(int i = 0; i < 4; ++i)
+		reduced[i] = candidates[chosen[i]];
+	for(int i = 0; i < 4; ++i)
+		candidates[i] = reduced[i];
+	return 4;
+}
+
+// for boxes resting face to face a single point can't hold them level, so
+// the face of the other box is clipped against the sides of the face the
+// normal came from, which gives up to four points. edge contacts return
+// zero, and keep the narrowphase's point.
+static int clip_box_contacts(const OBB& a, const OBB& b, vec3* normal, ContactCandidate* candidates)
+{
+	float alignA = 0.0f, alignB = 0.0f;
+	int faceA = 0, faceB = 0;
+	for(int i = 0; i < 3; ++i)
+	{
+		float d = fabs(dot(*normal, a.axes[i]));
+		if(d > alignA)
+		{
+			alignA = d;
+			faceA = i;
+		}
+		d = fabs(dot(*normal, b.axes[i]));
+		if(d > alignB)
+		{
+			alignB = d;
+			faceB = i;
+		}
+	}
+	if(MAX(alignA, alignB) < FACE_ALIGNMENT) return 0;
+
+	bool flip = alignB > alignA + 1.0e-3f;
+	const OBB& reference = flip ? b : a;
+	const OBB& incident = flip ? a : b;
+	int face = flip ? faceB : faceA;
+
+	// the reference face normal points out toward the incident box
+	vec3 towardIncident = flip ? -*normal : *normal;
+	vec3 faceNormal = reference.axes[face];
+	if(dot(faceNormal, towardIncident) < 0.0f) faceNormal = -faceNormal;
+	vec3 faceCenter = reference.center + faceNormal * get_component(reference.extents, face);
+
+	// the incident face is the one turned most against the reference face
+	int incidentFace = 0;
+	float best = -1.0f;
+	for(int i = 0; i < 3; ++i)
+	{
+		float d = fabs(dot(faceNormal, incident.axes[i]));
+		if(d > best)
+		{
+			best = d;
+			incidentFace = i;
+		}
+	}
+	vec3 incidentNormal = incident.axes[incidentFace];
+	if(dot(incidentNormal, faceNormal) > 0.0f) incidentNormal = -incidentNormal;
+	vec3 incidentCenter = incident.center + incidentNormal * get_component(incident.extents, incidentFace);
+
+	int u = (incidentFace + 1) % 3;
+	int v = (incidentFace + 2) % 3;
+	vec3 du = incident.axes[u] * get_component(incident.extents, u);
+	vec3 dv = incident.axes[v] * get_component(incident.extents, v);
+
+	vec3 polygon[8], clipped[8];
+	polygon[0] = incidentCenter + du + dv;
+	polygon[1] = incidentCenter - du + dv;
+	polygon[2] = incidentCenter - du - dv;
+	polygon[3] = incidentCenter + du - dv;
+	int count = 4;
+
+	for(int i = 1; i < 3 && count > 0; ++i)
+	{
+		int side = (face + i) % 3;
+		vec3 axis = reference.axes[side];
+		float centre = dot(axis, reference.center);
+		float extent = get_component(reference.extents, side);
+		count = clip_polygon(polygon, count, axis, centre + extent, clipped);
+		count = clip_polygon(clipped, count, -axis, extent - centre, polygon);
+	}
+
+	int numCandidates = 0;
+	for(int i = 0; i < count; ++i)
+	{
+		float separation = dot(polygon[i] - faceCenter, faceNormal);
+		if(separation > CONTACT_MARGIN) continue;
+
+		// halfway between the incident point and the reference face
+		ContactCandidate& candidate = candidates[numCandidates++];
+		candidate.position = polygon[i] - faceNormal * (separation * 0.5f);
+		candidate.depth = -separation;
+	}
+
+	*normal = flip ? -faceNormal : faceNormal;
+	return reduce_candidates(candidates, numCandidates, faceNormal);
+}
+
+void RigidBodyWorld::UpdateManifold(Manifold& manifold, const ContactRecord* record)
+{
+	if(record == nullptr)
+	{
+		manifold.numPoints = 0;
+		return;
+	}
+
+	int a = manifold.bodyA;
+	int b = manifold.bodyB;
+
+	// the narrowphase always has the box first in box-sphere pairs
+	bool swapped = shapeTypes[a] == SHAPE_SPHERE && shapeTypes[b] == SHAPE_BOX;
+	vec3 normal = swapped ? -record->normal : record->normal;
+
+	ContactCandidate candidates[8];
+	int numCandidates = 0;
+	if(shapeTypes[a] == SHAPE_BOX && shapeTypes[b] == SHAPE_BOX)
+	{
+		OBB boxA = boxes[a];
+		OBB boxB = boxes[b];
+		boxA.extents = extents[a];
+		boxB.extents = extents[b];
+		numCandidates = clip_box_contacts(boxA, boxB, &normal, candidates);
+	}
+	if(numCandidates == 0)
+	{
+		candidates[0].position = record->point;
+		candidates[0].depth = record->depth - CONTACT_MARGIN;
+		numCandidates = 1;
+	}
+
+	// points close to one from the last step carry over its impulses, so the
+	// solver starts out near where it finished
+	ContactPoint old[MAX_MANIFOLD_POINTS];
+	int numOld = manifold.numPoints;
+	for(int i = 0; i < numOld; ++i)
+		old[i] = manifold.points[i];
+	vec3 oldTangents[2] = { manifold.tangents[0], manifold.tangents[1] };
+
+	vec3 tangents[2];
+	compute_basis(normal, &tangents[0], &tangents[1]);
+
+	quaternion inverseA = invert_quat(orientations[a]);
+	for(int i = 0; i < numCandidates; ++i)
+	{
+		ContactPoint& point = manifold.points[i];
+		const vec3& position = candidates[i].position;
+		point.localA = inverseA * (position - positions[a]);
+		point.offsetA = position - positions[a];
+		point.offsetB = position - positions[b];
+		point.depth = candidates[i].depth;
+		point.normalImpulse = 0.0f;
+		point.tangentImpulses[0] = 0.0f;
+		point.tangentImpulses[1] = 0.0f;
+
+		int match = -1;
+		float closest = MATCH_DISTANCE * MATCH_DISTANCE;
+		for(int j = 0; j < numOld; ++j)
+		{
+			vec3 d = old[j].localA - point.localA;
+			float distanceSquared = dot(d, d);
+			if(distanceSquared < closest)
+			{
+				closest = distanceSquared;
+				match = j;
+			}
+		}
+		if(match != -1)
+		{
+			// friction goes through world space, since the tangents may have turned
+			vec3 friction = oldTangents[0] * old[match].tangentImpulses[0] + oldTangents[1] * old[match].tangentImpulses[1];
+			point.normalImpulse = old[match].normalImpulse;
+			point.tangentImpulses[0] = dot(friction, tangents[0]);
+			point.tangentImpulses[1] = dot(friction, tangents[1]);
+		}
+	}
+
+	manifold.normal = normal;
+	manifold.tangents[0] = tangents[0];
+	manifold.tangents[1] = tangents[1];
+	manifold.friction = sqrt(frictions[a] * frictions[b]);
+	manifold.numPoints = numCandidates;
+}
+
+struct ManifoldTask
+{
+	RigidBodyWorld* world;
+	const int* tested;
+	const int* recordIndices;
+	const ContactRecord* records;
+
+	void operator()(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+		{
+			const ContactRecord* record = (recordIndices[i] != -1) ? &records[recordIndices[i]] : nullptr;
+			world->UpdateManifold(world->manifolds[tested[i]], record);
+		}
+	}
+};
+
+void RigidBodyWorld::Collide(JobPool* pool)
+{
+	// pairs where both bodies sleep, or one sleeps against a static body,
+	// keep their contacts from before they fell asleep
+	int numManifolds = int(manifolds.Count());
+	int counts[3] = {};
+	for(int i = 0; i < numManifolds; ++i)
+	{
+		const Manifold& manifold = manifolds[i];
+		if(!awake[manifold.bodyA] && !awake[manifold.bodyB]) continue;
+		counts[shapeTypes[manifold.bodyA] + shapeTypes[manifold.bodyB]] += 1;
+	}
+
+	// the pairs are grouped into sphere-sphere, box-sphere and box-box,
+	// which the shape types sum to
+	int starts[3] = { 0, counts[0], counts[0] + counts[1] };
+	int numTested = starts[2] + counts[2];
+	if(numTested == 0) return;
+
+	ProxyPair* pairs = new ProxyPair[numTested];
+	int* tested = new int[numTested];
+	int filled[3] = { starts[0], starts[1], starts[2] };
+	for(int i = 0; i < numManifolds; ++i)
+	{
+		const Manifold& manifold = manifolds[i];
+		if(!awake[manifold.bodyA] && !awake[manifold.bodyB]) continue;
+
+		int group = shapeTypes[manifold.bodyA] + shapeTypes[manifold.bodyB];
+		int slot = filled[group]++;
+		pairs[slot].proxyA = manifold.bodyA;
+		pairs[slot].proxyB = manifold.bodyB;
+		if(group == 1 && shapeTypes[manifold.bodyA] == SHAPE_SPHERE)
+		{
+			pairs[slot].proxyA = manifold.bodyB;
+			pairs[slot].proxyB = manifold.bodyA;
+		}
+		tested[slot] = i;
+	}
+
+	ContactRecord* records = new ContactRecord[numTested];
+	int numRecords[3];
+	if(pool != nullptr)
+	{
+		numRecords[0] = collide_sphere_pairs(pool, spheres, pairs, counts[0], records);
+		numRecords[1] = collide_obb_sphere_pairs(pool, boxes, spheres, pairs + starts[1], counts[1], records + starts[1]);
+		numRecords[2] = collide_obb_pairs(pool, boxes, pairs + starts[2], counts[2], records + starts[2]);
+	}
+	else
+	{
+		numRecords[0] = collide_sphere_pairs(spheres, pairs, counts[0], records);
+		numRecords[1] = collide_obb_sphere_pairs(boxes, spheres, pairs + starts[1], counts[1], records + starts[1]);
+		numRecords[2] = collide_obb_pairs(boxes, pairs + starts[2], counts[2], records + starts[2]);
+	}
+
+	int* recordIndices = new int[numTested];
+	for(int i = 0; i < numTested; ++i)
+		recordIndices[i] = -1;
+	for(int group = 0; group < 3; ++group)
+	{
+		for(int i = 0; i < numRecords[group]; ++i)
+		{
+			int record = starts[group] + i;
+			recordIndices[starts[group] + records[record].pair] = record;
+		}
+	}
+
+	ManifoldTask task = { this, tested, recordIndices, records };
+	if(pool != nullptr)
+		pool->ParallelFor(numTested, 64, task);
+	else
+		task(0, numTested);
+
+	delete[] pairs;
+	delete[] tested;
+	delete[] records;
+	delete[] recordIndices;
+}
+
+// Islands.....................................................................
+
+int RigidBodyWorld::FindRoot(int body)
+{
+	int root = body;
+	while(islandIds[root] != root)
+		root = islandIds[root];
+
+	// point everything on the way straight at the root
+	while(islandIds[body] != root)
+	{
+		int next = islandIds[body];
+		islandIds[body] = root;
+		body = next;
+	}
+	return root;
+}
+
+struct IslandIsLarger
+{
+	bool operator()(const RigidBodyWorld::Island& a, const RigidBodyWorld::Island& b) const
+	{
+		return a.numBodies > b.numBodies;
+	}
+};
+
+void RigidBodyWorld::BuildIslands()
+{
+	for(int i = 0; i < bodyCount; ++i)
+		islandIds[i] = i;
+
+	// only moving bodies join islands, so a static floor doesn't chain every
+	// pile resting on it into one island
+	int numManifolds = int(manifolds.Count());
+	for(int i = 0; i < numManifolds; ++i)
+	{
+		const Manifold& manifold = manifolds[i];
+		if(manifold.numPoints == 0) continue;
+		if(inverseMasses[manifold.bodyA] == 0.0f || inverseMasses[manifold.bodyB] == 0.0f) continue;
+
+		int rootA = FindRoot(manifold.bodyA);
+		int rootB = FindRoot(manifold.bodyB);
+		if(rootA != rootB)
+			islandIds[MAX(rootA, rootB)] = MIN(rootA, rootB);
+	}
+
+	// an island is solved if any body in it is awake, which wakes the rest
+	const int ASLEEP = -1;
+	const int AWAKE = -2;
+	int* rootIslands = new int[bodyCount];
+	for(int i = 0; i < bodyCount; ++i)
+		rootIslands[i] = ASLEEP;
+	for(int i = 0; i < bodyCount; ++i)
+	{
+		if(inverseMasses[i] == 0.0f) continue;
+		int root = FindRoot(i);
+		if(awake[i]) rootIslands[root] = AWAKE;
+	}
+
+	islands.Clear();
+	for(int i = 0; i < bodyCount; ++i)
+	{
+		if(inverseMasses[i] == 0.0f)
+		{
+			islandIds[i] = -1;
+			continue;
+		}
+
+		int root = islandIds[i];
+		if(rootIslands[root] == AWAKE)
+		{
+			Island island = { 0, 0, 0, 0 };
+			rootIslands[root] = int(islands.Count());
+			islands.Push(island);
+		}
+		islandIds[i] = rootIslands[root];
+		if(islandIds[i] != ASLEEP)
+			islands[islandIds[i]].numBodies += 1;
+	}
+	delete[] rootIslands;
+
+	for(int i = 0; i < numManifolds; ++i)
+	{
+		const Manifold& manifold = manifolds[i];
+		if(manifold.numPoints == 0) continue;
+		int body = (inverseMasses[manifold.bodyA] != 0.0f) ? manifold.bodyA : manifold.bodyB;
+		if(islandIds[body] != ASLEEP)
+			islands[islandIds[body]].numManifolds += 1;
+	}
+
+	int numIslands = int(islands.Count());
+	int totalManifolds = 0;
+	for(int i = 0, totalBodies = 0; i < numIslands; ++i)
+	{
+		islands[i].firstBody = totalBodies;
+		islands[i].firstManifold = totalManifolds;
+		totalBodies += islands[i].numBodies;
+		totalManifolds += islands[i].numManifolds;
+		islands[i].numBodies = 0;
+		islands[i].numManifolds = 0;
+	}
+
+	for(int i = 0; i < bodyCount; ++i)
+	{
+		if(islandIds[i] < 0) continue;
+		Island& island = islands[islandIds[i]];
+		islandBodies[island.firstBody + island.numBodies++] = i;
+		if(!awake[i])
+		{
+			awake[i] = true;
+			sleepTimes[i] = 0.0f;
+		}
+	}
+
+	islandManifolds.Clear();
+	for(int i = 0; i < totalManifolds; ++i)
+		islandManifolds.Push(0);
+	for(int i = 0; i < numManifolds; ++i)
+	{
+		const Manifold& manifold = manifolds[i];
+		if(manifold.numPoints == 0) continue;
+		int body = (inverseMasses[manifold.bodyA] != 0.0f) ? manifold.bodyA : manifold.bodyB;
+		if(islandIds[body] < 0) continue;
+		Island& island = islands[islandIds[body]];
+		islandManifolds[island.firstManifold + island.numManifolds++] = i;
+	}
+
+	// the biggest islands go out first, so one doesn't end up running alone
+	// after the small ones are done
+	if(numIslands > 1)
+		quick_sort(islands.First(), numIslands, IslandIsLarger());
+}
+
+// Solver......................................................................
+
+struct IslandTask
+{
+	RigidBodyWorld* world;
+	float deltaTime;
+
+	void operator()(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+			world->SolveIsland(world->islands[i], deltaTime);
+	}
+};
+
+void RigidBodyWorld::Step(float deltaTime, JobPool* pool)
+{
+	if(deltaTime <= 0.0f) return;
+
+	UpdatePairs(deltaTime);
+	Collide(pool);
+	BuildIslands();
+
+	IslandTask task = { this, deltaTime };
+	if(pool != nullptr)
+		pool->ParallelFor(int(islands.Count()), 1, task);
+	else
+		task(0, int(islands.Count()));
+}
+
+static float effective_mass(float inverseMassA, float inverseMassB, const vec3* inertiaA, const vec3* inertiaB,
+	const vec3& offsetA, const vec3& offsetB, const vec3& direction)
+{
+	vec3 angularA = cross(transform_inertia(inertiaA, cross(offsetA, direction)), offsetA);
+	vec3 angularB = cross(transform_inertia(inertiaB, cross(offsetB, direction)), offsetB);
+	float k = inverseMassA + inverseMassB + dot(angularA + angularB, direction);
+	return (k > 0.0f) ? 1.0f / k : 0.0f;
+}
+
+void RigidBodyWorld::SolveIsland(const Island& island, float deltaTime)
+{
+	const int* bodies = islandBodies + island.firstBody;
+	const int* contacts = islandManifolds.First() + island.firstManifold;
+	float inverseDeltaTime = 1.0f / deltaTime;
+
+	for(int i = 0; i < island.numBodies; ++i)
+		linearVelocities[bodies[i]] += gravity * deltaTime;
+
+	// work out each point's effective masses and target velocity, and apply
+	// the impulses carried over from the last step. a static body in a
+	// manifold has zero inverse mass and inertia, so reading it is harmless,
+	// but it's never written since other islands read it at the same time.
+	for(int i = 0; i < island.numManifolds; ++i)
+	{
+		Manifold& manifold = manifolds[contacts[i]];
+		int a = manifold.bodyA;
+		int b = manifold.bodyB;
+		float inverseMassA = inverseMasses[a];
+		float inverseMassB = inverseMasses[b];
+		const vec3* inertiaA = worldInverseInertias + 3 * a;
+		const vec3* inertiaB = worldInverseInertias + 3 * b;
+
+		vec3 linearA = linearVelocities[a], angularA = angularVelocities[a];
+		vec3 linearB = linearVelocities[b], angularB = angularVelocities[b];
+		for(int j = 0; j < manifold.numPoints; ++j)
+		{
+			ContactPoint& point = manifold.points[j];
+			point.normalMass = effective_mass(inverseMassA, inverseMassB, inertiaA, inertiaB, point.offsetA, point.offsetB, manifold.normal);
+			for(int k = 0; k < 2; ++k)
+				point.tangentMasses[k] = effective_mass(inverseMassA, inverseMassB, inertiaA, inertiaB, point.offsetA, point.offsetB, manifold.tangents[k]);
+
+			// a gap may be closed within the step but no faster, and overlap
+			// is pushed out a fraction at a time
+			if(point.depth < 0.0f)
+				point.targetVelocity = point.depth * inverseDeltaTime;
+			else if(point.depth > LINEAR_SLOP)
+				point.targetVelocity = BAUMGARTE * MIN(point.depth - LINEAR_SLOP, MAX_CORRECTION) * inverseDeltaTime;
+			else
+				point.targetVelocity = 0.0f;
+
+			vec3 impulse = manifold.normal * point.normalImpulse
+				+ manifold.tangents[0] * point.tangentImpulses[0]
+				+ manifold.tangents[1] * point.tangentImpulses[1];
+			linearA -= impulse * inverseMassA;
+			angularA -= transform_inertia(inertiaA, cross(point.offsetA, impulse));
+			linearB += impulse * inverseMassB;
+			angularB += transform_inertia(inertiaB, cross(point.offsetB, impulse));
+		}
+		if(inverseMassA != 0.0f)
+		{
+			linearVelocities[a] = linearA;
+			angularVelocities[a] = angularA;
+		}
+		if(inverseMassB != 0.0f)
+		{
+			linearVelocities[b] = linearB;
+			angularVelocities[b] = angularB;
+		}
+	}
+
+	for(int iteration = 0; iteration < iterations; ++iteration)
+	{
+		// alternate the order each pass so bias from solving one contact
+		// before another doesn't build up along tall stacks
+		for(int n = 0; n < island.numManifolds; ++n)
+		{
+			int i = (iteration & 1) ? island.numManifolds - 1 - n : n;
+			Manifold& manifold = manifolds[contacts[i]];
+			int a = manifold.bodyA;
+			int b = manifold.bodyB;
+			float inverseMassA = inverseMasses[a];
+			float inverseMassB = inverseMasses[b];
+			const vec3* inertiaA = worldInverseInertias + 3 * a;
+			const vec3* inertiaB = worldInverseInertias + 3 * b;
+
+			vec3 linearA = linearVelocities[a], angularA = angularVelocities[a];
+			vec3 linearB = linearVelocities[b], angularB = angularVelocities[b];
+
+			// friction first, so the normal impulses have the last word on
+			// keeping the bodies apart
+			for(int j = 0; j < manifold.numPoints; ++j)
+			{
+				ContactPoint& point = manifold.points[j];
+				float limit = manifold.friction * point.normalImpulse;
+				for(int k = 0; k < 2; ++k)
+				{
+					const vec3& tangent = manifold.tangents[k];
+					vec3 relative = linearB + cross(angularB, point.offsetB) - linearA - cross(angularA, point.offsetA);
+					float lambda = -dot(relative, tangent) * point.tangentMasses[k];
+
+					float previous = point.tangentImpulses[k];
+					point.tangentImpulses[k] = clamp(previous + lambda, -limit, limit);
+					vec3 impulse = tangent * (point.tangentImpulses[k] - previous);
+
+					linearA -= impulse * inverseMassA;
+					angularA -= transform_inertia(inertiaA, cross(point.offsetA, impulse));
+					linearB += impulse * inverseMassB;
+					angularB += transform_inertia(inertiaB, cross(point.offsetB, impulse));
+				}
+			}
+
+			for(int j = 0; j < manifold.numPoints; ++j)
+			{
+				ContactPoint& point = manifold.points[j];
+				vec3 relative = linearB + cross(angularB, point.offsetB) - linearA - cross(angularA, point.offsetA);
+				float lambda = (point.targetVelocity - dot(relative, manifold.normal)) * point.normalMass;
+
+				float previous = point.normalImpulse;
+				point.normalImpulse = MAX(previous + lambda, 0.0f);
+				vec3 impulse = manifold.normal * (point.normalImpulse - previous);
+
+				linearA -= impulse * inverseMassA;
+				angularA -= transform_inertia(inertiaA, cross(point.offsetA, impulse));
+				linearB += impulse * inverseMassB;
+				angularB += transform_inertia(inertiaB, cross(point.offsetB, impulse));
+			}
+
+			if(inverseMassA != 0.0f)
+			{
+				linearVelocities[a] = linearA;
+				angularVelocities[a] = angularA;
+			}
+			if(inverseMassB != 0.0f)
+			{
+				linearVelocities[b] = linearB;
+				angularVelocities[b] = angularB;
+			}
+		}
+	}
+
+	float minSleepTime = FLT_MAX;
+	for(int i = 0; i < island.numBodies; ++i)
+	{
+		int body = bodies[i];
+		const vec3& linear = linearVelocities[body];
+		const vec3& angular = angularVelocities[body];
+
+		positions[body] += linear * deltaTime;
+
+		quaternion& orientation = orientations[body];
+		quaternion spin = quaternion(angular.x, angular.y, angular.z, 0.0f) * orientation;
+		float h = 0.5f * deltaTime;
+		orientation = normalize(quaternion(
+			orientation.x + h * spin.x,
+			orientation.y + h * spin.y,
+			orientation.z + h * spin.z,
+			orientation.w + h * spin.w));
+
+		UpdateShapes(body);
+
+		if(dot(linear, linear) > LINEAR_SLEEP_TOLERANCE * LINEAR_SLEEP_TOLERANCE
+			|| dot(angular, angular) > ANGULAR_SLEEP_TOLERANCE * ANGULAR_SLEEP_TOLERANCE)
+			sleepTimes[body] = 0.0f;
+		else
+			sleepTimes[body] += deltaTime;
+		minSleepTime = MIN(minSleepTime, sleepTimes[body]);
+	}
+
+	// the island only sleeps as a whole, once every body in it has been
+	// still for long enough
+	if(minSleepTime >= TIME_TO_SLEEP)
+	{
+		for(int i = 0; i < island.numBodies; ++i)
+		{
+			int body = bodies[i];
+			awake[body] = false;
+			linearVelocities[body] = VEC3_ZERO;
+			angularVelocities[body] = VEC3_ZERO;
+		}
+	}
+}
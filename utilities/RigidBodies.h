@@ -0,0 +1,145 @@
+#ifndef RIGID_BODIES_H
+#define RIGID_BODIES_H
+
+#include "AABBTree.h"
+#include "Collision.h"
+#include "DataTypes.h"
+
+#include "collections/AutoArray.h"
+#include "collections/IntegerHashTable.h"
+
+class JobPool;
+struct ContactRecord;
+
+// Rigid body dynamics for spheres and boxes. Body state lives in parallel
+// arrays indexed by body. Each step finds touching pairs with an AABBTree
+// broadphase and the batched narrowphase, joins touching bodies into islands
+// with a union-find, and solves every island with sequential impulses. No two
+// islands share a moving body, so whole islands are handed to worker threads,
+// and an island that has come to rest sleeps until something disturbs it.
+
+class RigidBodyWorld
+{
+public:
+	enum ShapeType
+	{
+		SHAPE_SPHERE,
+		SHAPE_BOX,
+	};
+
+	explicit RigidBodyWorld(int initialCapacity = 64);
+	~RigidBodyWorld();
+
+	// a mass of zero makes a static body, which never moves
+	int AddSphere(const vec3& position, float radius, float mass);
+	int AddBox(const vec3& position, const quaternion& orientation, const vec3& extents, float mass);
+
+	// without a pool the whole step runs on the calling thread
+	void Step(float deltaTime, JobPool* pool = nullptr);
+
+	void SetGravity(const vec3& value) { gravity = value; }
+	void SetIterations(int count) { iterations = count; }
+	void SetFriction(int body, float value) { frictions[body] = value; }
+	void SetVelocity(int body, const vec3& linear, const vec3& angular);
+	void ApplyImpulse(int body, const vec3& impulse, const vec3& point);
+	void Wake(int body);
+
+	int GetBodyCount() const { return bodyCount; }
+	ShapeType GetShapeType(int body) const { return ShapeType(shapeTypes[body]); }
+	vec3 GetPosition(int body) const { return positions[body]; }
+	quaternion GetOrientation(int body) const { return orientations[body]; }
+	vec3 GetLinearVelocity(int body) const { return linearVelocities[body]; }
+	vec3 GetAngularVelocity(int body) const { return angularVelocities[body]; }
+	bool IsAwake(int body) const { return awake[body]; }
+
+	// counts from the last step
+	int GetIslandCount() const { return int(islands.Count()); }
+	int GetManifoldCount() const { return int(manifolds.Count()); }
+
+private:
+	static const int MAX_MANIFOLD_POINTS = 4;
+
+	struct ContactPoint
+	{
+		vec3 localA;     // in body A's frame, for matching points between steps
+		vec3 offsetA, offsetB;
+		float depth;
+		float normalImpulse;
+		float tangentImpulses[2];
+		float normalMass;
+		float tangentMasses[2];
+		float targetVelocity;
+	};
+
+	struct Manifold
+	{
+		int bodyA, bodyB;
+		vec3 normal; // points from A toward B
+		vec3 tangents[2];
+		float friction;
+		int numPoints;
+		ContactPoint points[MAX_MANIFOLD_POINTS];
+	};
+
+	struct Island
+	{
+		int firstBody, numBodies;
+		int firstManifold, numManifolds;
+	};
+
+	// body state
+	int bodyCount, capacity;
+	vec3* positions;
+	quaternion* orientations;
+	vec3* linearVelocities;
+	vec3* angularVelocities;
+	float* inverseMasses;
+	vec3* inverseInertias;      // diagonal, in the body's frame
+	vec3* worldInverseInertias; // three rows per body
+	float* frictions;
+	uint8_t* shapeTypes;
+	vec3* extents;              // the radius is in x for spheres
+	int* proxies;
+	float* sleepTimes;
+	bool* awake;
+
+	// world space shapes, enlarged by the contact margin, for the narrowphase
+	Sphere* spheres;
+	OBB* boxes;
+
+	// union-find parents while building islands, then each body's island
+	int* islandIds;
+	int* islandBodies;
+
+	AABBTree broadphase;
+	AutoArray<ProxyPair> newPairs;
+	AutoArray<Manifold> manifolds;
+	IntegerHashTable manifoldTable; // body pair key to manifold index + 1
+	AutoArray<Island> islands;
+	AutoArray<int> islandManifolds;
+
+	vec3 gravity;
+	int iterations;
+
+	RigidBodyWorld(const RigidBodyWorld&);
+	RigidBodyWorld& operator = (const RigidBodyWorld&);
+
+	int AddBody(const vec3& position, const quaternion& orientation, uint8_t shape, const vec3& size, float mass);
+	void Grow(int newCapacity);
+	void UpdateShapes(int body);
+	AABB ComputeBounds(int body) const;
+
+	void UpdatePairs(float deltaTime);
+	void RemoveManifold(int index);
+	void Collide(JobPool* pool);
+	void UpdateManifold(Manifold& manifold, const ContactRecord* record);
+	void BuildIslands();
+	int FindRoot(int body);
+	void SolveIsland(const Island& island, float deltaTime);
+
+	friend struct ManifoldTask;
+	friend struct IslandTask;
+	friend struct IslandIsLarger;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Four-wide float vectors for the batched kernels: collision, ray batches,
+// occlusion rasterizing, noise, hashing and random number fills. These map
+// onto SSE when the compiler targets it, and otherwise fall back to plain
+// arrays so the same kernels still build and run everywhere, just one lane at
+// a time.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE
+#endif
+
+#if defined(SIMD_SSE)
+#include <emmintrin.h>
+#else
+#include <math.h>
+#endif
+
+#if defined(SIMD_SSE)
+
+struct float4
+{
+	__m128 v;
+
+	float4() {}
+	float4(float x): v(_mm_set1_ps(x)) {}
+	explicit float4(__m128 v): v(v) {}
+};
+
+struct mask4
+{
+	__m128 v;
+
+	mask4() {}
+	explicit mask4(__m128 v): v(v) {}
+};
+
+inline float4 load_float4(const float* p) { return float4(_mm_loadu_ps(p)); }
+inline void store_float4(float* p, float4 a) { _mm_storeu_ps(p, a.v); }
+
+inline float4 operator + (float4 a, float4 b) { return float4(_mm_add_ps(a.v, b.v)); }
+inline float4 operator - (float4 a, float4 b) { return float4(_mm_sub_ps(a.v, b.v)); }
+inline float4 operator * (float4 a, float4 b) { return float4(_mm_mul_ps(a.v, b.v)); }
+inline float4 operator / (float4 a, float4 b) { return float4(_mm_div_ps(a.v, b.v)); }
+inline float4 operator - (float4 a) { return float4(_mm_sub_ps(_mm_setzero_ps(), a.v)); }
+
+inline float4 vmin(float4 a, float4 b) { return float4(_mm_min_ps(a.v, b.v)); }
+inline float4 vmax(float4 a, float4 b) { return float4(_mm_max_ps(a.v, b.v)); }
+inline float4 vabs(float4 a) { return float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+inline float4 vsqrt(float4 a) { return float4(_mm_sqrt_ps(a.v)); }
+
+// truncates and then steps down where that rounded up, which holds for
+// anything that fits in a 32-bit integer
+inline float4 vfloor(float4 a)
+{
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+	return float4(_mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f))));
+}
+
+inline mask4 operator < (float4 a, float4 b) { return mask4(_mm_cmplt_ps(a.v, b.v)); }
+inline mask4 operator <= (float4 a, float4 b) { return mask4(_mm_cmple_ps(a.v, b.v)); }
+inline mask4 operator > (float4 a, float4 b) { return mask4(_mm_cmpgt_ps(a.v, b.v)); }
+inline mask4 operator >= (float4 a, float4 b) { return mask4(_mm_cmpge_ps(a.v, b.v)); }
+
+inline mask4 operator & (mask4 a, mask4 b) { return mask4(_mm_and_ps(a.v, b.v)); }
+inline mask4 operator | (mask4 a, mask4 b) { return mask4(_mm_or_ps(a.v, b.v)); }
+
+// picks from a in lanes where the mask is set and from b elsewhere
+inline float4 select(mask4 mask, float4 a, float4 b)
+{
+	return float4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+}
+
+// one bit per lane, lane 0 in the lowest bit
+inline int move_mask(mask4 mask) { return _mm_movemask_ps(mask.v); }
+
+// splits positive normal numbers into a power of two, which is returned,
+// and a mantissa in [1, 2)
+inline float4 vsplit_exponent(float4 a, float4* mantissa)
+{
+	__m128i bits = _mm_castps_si128(a.v);
+	__m128i exponent = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+	__m128i fraction = _mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF));
+	mantissa->v = _mm_castsi128_ps(_mm_or_si128(fraction, _mm_set1_epi32(0x3F800000)));
+	return float4(_mm_cvtepi32_ps(exponent));
+}
+
+#else
+
+struct float4
+{
+	float v[4];
+
+	float4() {}
+	float4(float x) { v[0] = v[1] = v[2] = v[3] = x; }
+};
+
+struct mask4
+{
+	bool v[4];
+};
+
+#define SIMD_LANEWISE(result, expression) \
+	for(int lane = 0; lane < 4; ++lane) result.v[lane] = (expression);
+
+inline float4 load_float4(const float* p) { float4 r; SIMD_LANEWISE(r, p[lane]) return r; }
+inline void store_float4(float* p, float4 a) { for(int lane = 0; lane < 4; ++lane) p[lane] = a.v[lane]; }
+
+inline float4 operator + (float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, a.v[lane] + b.v[lane]) return r; }
+inline float4 operator - (float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, a.v[lane] - b.v[lane]) return r; }
+inline float4 operator * (float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, a.v[lane] * b.v[lane]) return r; }
+inline float4 operator / (float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, a.v[lane] / b.v[lane]) return r; }
+inline float4 operator - (float4 a) { float4 r; SIMD_LANEWISE(r, -a.v[lane]) return r; }
+
+inline float4 vmin(float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, (a.v[lane] < b.v[lane]) ? a.v[lane] : b.v[lane]) return r; }
+inline float4 vmax(float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, (a.v[lane] > b.v[lane]) ? a.v[lane] : b.v[lane]) return r; }
+inline float4 vabs(float4 a) { float4 r; SIMD_LANEWISE(r, fabs(a.v[lane])) return r; }
+inline float4 vsqrt(float4 a) { float4 r; SIMD_LANEWISE(r, sqrt(a.v[lane])) return r; }
+inline float4 vfloor(float4 a) { float4 r; SIMD_LANEWISE(r, floor(a.v[lane])) return r; }
+
+inline mask4 operator < (float4 a, float4 b) { mask4 r; SIMD_LANEWISE(r, a.v[lane] < b.v[lane]) return r; }
+inline mask4 operator <= (float4 a, float4 b) { mask4 r; SIMD_LANEWISE(r, a.v[lane] <= b.v[lane]) return r; }
+inline mask4 operator > (float4 a, float4 b) { mask4 r; SIMD_LANEWISE(r, a.v[lane] > b.v[lane]) return r; }
+inline mask4 operator >= (float4 a, float4 b) { mask4 r; SIMD_LANEWISE(r, a.v[lane] >= b.v[lane]) return r; }
+
+inline mask4 operator & (mask4 a, mask4 b) { mask4 r; SIMD_LANEWISE(r, a.v[lane] && b.v[lane]) return r; }
+inline mask4 operator | (mask4 a, mask4 b) { mask4 r; SIMD_LANEWISE(r, a.v[lane] || b.v[lane]) return r; }
+
+inline float4 select(mask4 mask, float4 a, float4 b) { float4 r; SIMD_LANEWISE(r, mask.v[lane] ? a.v[lane] : b.v[lane]) return r; }
+
+inline int move_mask(mask4 mask)
+{
+	return int(mask.v[0]) | int(mask.v[1]) << 1 | int(mask.v[2]) << 2 | int(mask.v[3]) << 3;
+}
+
+inline float4 vsplit_exponent(float4 a, float4* mantissa)
+{
+	float4 r;
+	for(int lane = 0; lane < 4; ++lane)
+	{
+		int exponent;
+		mantissa->v[lane] = 2.0f * frexpf(a.v[lane], &exponent);
+		r.v[lane] = float(exponent - 1);
+	}
+	return r;
+}
+
+#undef SIMD_LANEWISE
+
+#endif
+
+inline float4 operator + (float4 a, float b) { return a + float4(b); }
+inline float4 operator - (float4 a, float b) { return a - float4(b); }
+inline float4 operator * (float4 a, float b) { return a * float4(b); }
+
+// natural logarithm of positive normal numbers, with Cephes' polynomial for
+// logf, which is good to a couple of bits in the last place
+inline float4 vlog(float4 a)
+{
+	float4 mantissa;
+	float4 exponent = vsplit_exponent(a, &mantissa);
+
+	// centre the mantissa on one, where the polynomial is most accurate
+	mask4 high = mantissa > float4(1.41421356f);
+	mantissa = select(high, mantissa * 0.5f, mantissa);
+	exponent = select(high, exponent + 1.0f, exponent);
+
+	float4 x = mantissa - 1.0f;
+	float4 z = x * x;
+	float4 p = float4(7.0376836292e-2f);
+	p = p * x + -1.1514610310e-1f;
+	p = p * x + 1.1676998740e-1f;
+	p = p * x + -1.2420140846e-1f;
+	p = p * x + 1.4249322787e-1f;
+	p = p * x + -1.6668057665e-1f;
+	p = p * x + 2.0000714765e-1f;
+	p = p * x + -2.4999993993e-1f;
+	p = p * x + 3.3333331174e-1f;
+
+	return x + (x * z * p - z * 0.5f) + exponent * 0.693147180559945f;
+}
+
+// sine and cosine together, also with Cephes' polynomials, after taking off
+// the nearest multiple of a quarter turn; fine for angles of a few turns
+inline void vsincos(float4 a, float4* sine, float4* cosine)
+{
+	float4 quarter = vfloor(a * 0.636619772367581f + 0.5f);
+
+	// pi / 2 split in three, so the reduction doesn't lose bits
+	float4 x = a - quarter * 1.5703125f;
+	x = x - quarter * 4.837512969970703125e-4f;
+	x = x - quarter * 7.54978995489188216e-8f;
+
+	float4 z = x * x;
+	float4 s = float4(-1.9515295891e-4f);
+	s = s * z + 8.3321608736e-3f;
+	s = s * z + -1.6666654611e-1f;
+	s = s * z * x + x;
+	float4 c = float4(2.443315711809948e-5f);
+	c = c * z + -1.388731625493765e-3f;
+	c = c * z + 4.166664568298827e-2f;
+	c = c * z * z - z * 0.5f + 1.0f;
+
+	// which quarter of the circle, from 0 to 3
+	float4 turn = quarter - vfloor(quarter * 0.25f) * 4.0f;
+	mask4 swap = ((turn > float4(0.5f)) & (turn < float4(1.5f))) | (turn > float4(2.5f));
+	mask4 negateSine = turn > float4(1.5f);
+	mask4 negateCosine = (turn > float4(0.5f)) & (turn < float4(2.5f));
+
+	float4 sx = select(swap, c, s);
+	float4 cx = select(swap, s, c);
+	*sine = select(negateSine, -sx, sx);
+	*cosine = select(negateCosine, -cx, cx);
+}
+
+// dot product of four pairs of vectors stored one component per register
+inline float4 dot3(float4 ax, float4 ay, float4 az, float4 bx, float4 by, float4 bz)
+{
+	return ax * bx + ay * by + az * bz;
+}
+
+#endif
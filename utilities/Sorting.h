@@ -1,6 +1,8 @@
 #ifndef SORTING_H
 #define SORTING_H
 
+#include <cstddef>
+
  /* Templated Sorting Algorithm Notes:
   *
   * templated ItemType proved to be faster than void* array and run-time size
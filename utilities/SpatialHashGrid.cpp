@@ -0,0 +1,296 @@
+#include "SpatialHashGrid.h"
+
+#include "Hashing.h"
+#include "BitManipulation.h"
+#include "NumberMacros.h"
+#include "Sorting.h"
+
+#include <math.h>
+#include <cstring>
+
+SpatialHashGrid::SpatialHashGrid(float cellSize):
+	cellSize(cellSize),
+	inverseCellSize(1.0f / cellSize),
+	count(0),
+	capacity(0),
+	tableSize(0),
+	uniqueSpan(0),
+	keys(nullptr),
+	cellStarts(nullptr),
+	sortedIndices(nullptr),
+	sortedPositions(nullptr)
+{}
+
+SpatialHashGrid::~SpatialHashGrid()
+{
+	delete[] keys;
+	delete[] cellStarts;
+	delete[] sortedIndices;
+	delete[] sortedPositions;
+}
+
+uint32_t SpatialHashGrid::CellKey(int x, int y, int z) const
+{
+	// morton_hash_3d interleaves ten bits per axis, so wrapping coordinates
+	// at 1024 keeps neighbouring cells in neighbouring slots of the table
+	uint32_t code = morton_hash_3d(x & 1023, y & 1023, z & 1023);
+	return code & (tableSize - 1);
+}
+
+void SpatialHashGrid::Build(const vec3* positions, int numPositions)
+{
+	count = numPositions;
+	if(count > capacity)
+	{
+		delete[] keys;
+		delete[] sortedIndices;
+		delete[] sortedPositions;
+
+		capacity = count;
+		keys = new uint32_t[capacity];
+		sortedIndices = new int[capacity];
+		sortedPositions = new vec3[capacity];
+	}
+
+	// keep roughly one table slot per point
+	int newTableSize = get_next_power_of_two(MAX(count, 64));
+	if(newTableSize != tableSize)
+	{
+		delete[] cellStarts;
+		tableSize = newTableSize;
+		cellStarts = new int[tableSize + 1];
+
+		// the low bits of a morton code hold at least a third of them from
+		// each axis, so cells differing by less than that many steps along
+		// any one axis land in different slots
+		int bits = 0;
+		while((2 << bits) <= tableSize) ++bits;
+		uniqueSpan = 1 << (bits / 3);
+	}
+	memset(cellStarts, 0, sizeof(int) * (tableSize + 1));
+
+	if(count == 0)
+	{
+		boundsMin = boundsMax = VEC3_ZERO;
+		return;
+	}
+
+	// count the points falling in each slot
+	boundsMin = boundsMax = positions[0];
+	for(int i = 0; i < count; ++i)
+	{
+		const vec3& p = positions[i];
+		boundsMin = vec3(MIN(boundsMin.x, p.x), MIN(boundsMin.y, p.y), MIN(boundsMin.z, p.z));
+		boundsMax = vec3(MAX(boundsMax.x, p.x), MAX(boundsMax.y, p.y), MAX(boundsMax.z, p.z));
+
+		uint32_t key = CellKey(
+			(int) floor(p.x * inverseCellSize),
+			(int) floor(p.y * inverseCellSize),
+			(int) floor(p.z * inverseCellSize));
+		keys[i] = key;
+		cellStarts[key + 1]++;
+	}
+
+	// prefix sum turns counts into the start of each slot's run
+	for(int i = 0; i < tableSize; ++i)
+		cellStarts[i + 1] += cellStarts[i];
+
+	// scatter into the flat array, borrowing the tail of each run as a cursor
+	for(int i = 0; i < count; ++i)
+	{
+		int slot = cellStarts[keys[i]]++;
+		sortedIndices[slot] = i;
+		sortedPositions[slot] = positions[i];
+	}
+
+	// the scatter shifted every start up by one run, so shift them back
+	for(int i = tableSize; i > 0; --i)
+		cellStarts[i] = cellStarts[i - 1];
+	cellStarts[0] = 0;
+}
+
+int SpatialHashGrid::GatherCells(const vec3& min, const vec3& max, uint32_t* cells) const
+{
+	int x0 = (int) floor(min.x * inverseCellSize);
+	int y0 = (int) floor(min.y * inverseCellSize);
+	int z0 = (int) floor(min.z * inverseCellSize);
+	int x1 = (int) floor(max.x * inverseCellSize);
+	int y1 = (int) floor(max.y * inverseCellSize);
+	int z1 = (int) floor(max.z * inverseCellSize);
+	return GatherCells(x0, y0, z0, x1, y1, z1, cells);
+}
+
+int SpatialHashGrid::GatherCells(int x0, int y0, int z0, int x1, int y1, int z1, uint32_t* cells) const
+{
+	long long numCells = (long long)(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+	if(numCells > MAX_CELLS_PER_QUERY) return -1;
+
+	int numKeys = 0;
+	for(int z = z0; z <= z1; ++z)
+		for(int y = y0; y <= y1; ++y)
+			for(int x = x0; x <= x1; ++x)
+				cells[numKeys++] = CellKey(x, y, z);
+
+	if(x1 - x0 < uniqueSpan && y1 - y0 < uniqueSpan && z1 - z0 < uniqueSpan)
+		return numKeys;
+
+	// distant cells can fold onto the same slot, so only visit each once
+	struct IsLess
+	{
+		bool operator()(uint32_t a, uint32_t b) const { return a < b; }
+	};
+	insertion_sort(cells, numKeys, IsLess());
+
+	int numUnique = 0;
+	for(int i = 0; i < numKeys; ++i)
+	{
+		if(numUnique == 0 || cells[numUnique - 1] != cells[i])
+			cells[numUnique++] = cells[i];
+	}
+	return numUnique;
+}
+
+int SpatialHashGrid::QueryRadius(const vec3& center, float radius, int* results, int maxResults) const
+{
+	if(count == 0) return 0;
+
+	float radiusSquared = radius * radius;
+	int numResults = 0;
+
+	uint32_t cells[MAX_CELLS_PER_QUERY];
+	int numCells = GatherCells(center - radius, center + radius, cells);
+	if(numCells < 0)
+	{
+		// the query covers so many cells that a linear scan is cheaper
+		for(int i = 0; i < count && numResults < maxResults; ++i)
+		{
+			vec3 d = sortedPositions[i] - center;
+			if(dot(d, d) <= radiusSquared)
+				results[numResults++] = sortedIndices[i];
+		}
+		return numResults;
+	}
+
+	for(int c = 0; c < numCells; ++c)
+	{
+		for(int i = cellStarts[cells[c]], end = cellStarts[cells[c] + 1]; i < end; ++i)
+		{
+			vec3 d = sortedPositions[i] - center;
+			if(dot(d, d) <= radiusSquared)
+			{
+				if(numResults == maxResults) return numResults;
+				results[numResults++] = sortedIndices[i];
+			}
+		}
+	}
+	return numResults;
+}
+
+int SpatialHashGrid::QueryNearest(const vec3& point, int k, int* results, float* distancesSquared) const
+{
+	if(count == 0 || k <= 0) return 0;
+	k = MIN(MIN(k, count), MAX_NEAREST);
+
+	// kept sorted nearest-first by insertion
+	float best[MAX_NEAREST];
+	int found = 0;
+
+	// grow the search box until it holds k points closer than its half-width,
+	// or until it covers everything in the grid
+	vec3 toMin = point - boundsMin;
+	vec3 toMax = boundsMax - point;
+	float maxReach = MAX(MAX(MAX(fabs(toMin.x), fabs(toMax.x)), MAX(fabs(toMin.y), fabs(toMax.y))), MAX(fabs(toMin.z), fabs(toMax.z)));
+
+	uint32_t cells[MAX_CELLS_PER_QUERY];
+	for(float reach = cellSize;; reach += cellSize)
+	{
+		found = 0;
+
+		int numCells = GatherCells(point - reach, point + reach, cells);
+		int numRuns = (numCells < 0) ? 1 : numCells;
+		for(int c = 0; c < numRuns; ++c)
+		{
+			int start = (numCells < 0) ? 0 : cellStarts[cells[c]];
+			int end = (numCells < 0) ? count : cellStarts[cells[c] + 1];
+			for(int i = start; i < end; ++i)
+			{
+				vec3 d = sortedPositions[i] - point;
+				float distance = dot(d, d);
+				if(found == k && distance >= best[k - 1]) continue;
+
+				int j = (found < k) ? found++ : k - 1;
+				for(; j > 0 && best[j - 1] > distance; --j)
+				{
+					best[j] = best[j - 1];
+					results[j] = results[j - 1];
+				}
+				best[j] = distance;
+				results[j] = sortedIndices[i];
+			}
+		}
+
+		// only points within the box's inscribed sphere are certain to be
+		// closer than anything outside the box
+		bool done = numCells < 0 || reach >= maxReach;
+		if(found == k && best[k - 1] <= reach * reach) done = true;
+		if(done) break;
+	}
+
+	if(distancesSquared != nullptr)
+	{
+		for(int i = 0; i < found; ++i)
+			distancesSquared[i] = best[i];
+	}
+
+	return found;
+}
+
+void SpatialHashGrid::FindPairs(float radius, AutoArray<ProxyPair>& pairs) const
+{
+	float radiusSquared = radius * radius;
+
+	// points are ordered by cell, so the neighbourhood of a whole cell is
+	// gathered once and reused for every point inside it
+	uint32_t cells[MAX_CELLS_PER_QUERY];
+	int numCells = 0;
+	int cellX = 0, cellY = 0, cellZ = 0;
+	bool haveCells = false;
+	int reach = (int) ceil(radius * inverseCellSize);
+
+	for(int i = 0; i < count; ++i)
+	{
+		const vec3& p = sortedPositions[i];
+
+		int x = (int) floor(p.x * inverseCellSize);
+		int y = (int) floor(p.y * inverseCellSize);
+		int z = (int) floor(p.z * inverseCellSize);
+		if(!haveCells || x != cellX || y != cellY || z != cellZ)
+		{
+			numCells = GatherCells(x - reach, y - reach, z - reach, x + reach, y + reach, z + reach, cells);
+			cellX = x;
+			cellY = y;
+			cellZ = z;
+			haveCells = true;
+		}
+
+		int numRuns = (numCells < 0) ? 1 : numCells;
+		for(int c = 0; c < numRuns; ++c)
+		{
+			int start = (numCells < 0) ? 0 : cellStarts[cells[c]];
+			int end = (numCells < 0) ? count : cellStarts[cells[c] + 1];
+
+			// each pair is reported once, from its lower sorted slot
+			for(int j = MAX(start, i + 1); j < end; ++j)
+			{
+				vec3 d = sortedPositions[j] - p;
+				if(dot(d, d) <= radiusSquared)
+				{
+					ProxyPair pair;
+					pair.proxyA = MIN(sortedIndices[i], sortedIndices[j]);
+					pair.proxyB = MAX(sortedIndices[i], sortedIndices[j]);
+					pairs.Push(pair);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef SPATIAL_HASH_GRID_H
+#define SPATIAL_HASH_GRID_H
+
+#include "Collision.h"
+#include "DataTypes.h"
+
+#include "collections/AutoArray.h"
+
+// Uniform grid over points, rebuilt from scratch every frame. Cells are keyed
+// by the morton code of their coordinates folded into a power-of-two table,
+// so nearby cells sit next to each other in memory, and a counting sort packs
+// all points into one flat array ordered by cell. Suited to large numbers of
+// similarly sized objects such as particles, projectiles and crowd agents.
+
+class SpatialHashGrid
+{
+public:
+	explicit SpatialHashGrid(float cellSize);
+	~SpatialHashGrid();
+
+	void Build(const vec3* positions, int count);
+
+	static const int MAX_NEAREST = 64;
+
+	// these return indices into the positions given to the last Build, and
+	// QueryNearest finds no more than MAX_NEAREST
+	int QueryRadius(const vec3& center, float radius, int* results, int maxResults) const;
+	int QueryNearest(const vec3& point, int k, int* results, float* distancesSquared = nullptr) const;
+	void FindPairs(float radius, AutoArray<ProxyPair>& pairs) const;
+
+	float GetCellSize() const { return cellSize; }
+	int GetCount() const { return count; }
+
+private:
+	static const int MAX_CELLS_PER_QUERY = 512;
+
+	float cellSize;
+	float inverseCellSize;
+
+	int count, capacity;
+	int tableSize;
+	int uniqueSpan; // boxes of cells no wider than this never share a slot
+	uint32_t* keys;
+	int* cellStarts;
+	int* sortedIndices;
+	vec3* sortedPositions;
+	vec3 boundsMin, boundsMax;
+
+	SpatialHashGrid(const SpatialHashGrid&);
+	SpatialHashGrid& operator = (const SpatialHashGrid&);
+
+	uint32_t CellKey(int x, int y, int z) const;
+	int GatherCells(const vec3& min, const vec3& max, uint32_t* cells) const;
+	int GatherCells(int x0, int y0, int z0, int x1, int y1, int z1, uint32_t* cells) const;
+};
+
+#endif
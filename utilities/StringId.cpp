@@ -0,0 +1,67 @@
+#include "StringId.h"
+
+#include "String.h"
+#include "Logging.h"
+
+#include "collections/IntegerHashTable.h"
+#include "concurrent/Mutex.h"
+
+#include <cstring>
+
+StringId::StringId(const char* s):
+	value(hash_64(s, strlen(s)))
+{}
+
+StringId::StringId(const String& s):
+	value(hash_64(s.Data(), s.Size()))
+{}
+
+// Ids can be interned while components register themselves, before main, so
+// the table is made on first use rather than with the other statics.
+
+namespace
+{
+	struct InternTable
+	{
+		IntegerHashTable texts; // id to its text
+		Mutex mutex;
+	};
+
+	InternTable& get_intern_table()
+	{
+		static InternTable table;
+		return table;
+	}
+}
+
+StringId intern_string(const char* s)
+{
+	size_t length = strlen(s);
+	StringId id(hash_64(s, length));
+
+	InternTable& table = get_intern_table();
+	table.mutex.Acquire();
+	const char* text = (const char*) table.texts.Lookup(id.value);
+	if(text == nullptr)
+	{
+		char* copy = new char[length + 1];
+		memcpy(copy, s, length + 1);
+		table.texts.Insert(id.value, (size_t) copy);
+	}
+	else if(strcmp(text, s) != 0)
+	{
+		LOG_ISSUE("The names %s and %s have the same id.", text, s);
+	}
+	table.mutex.Release();
+
+	return id;
+}
+
+const char* string_id_text(StringId id)
+{
+	InternTable& table = get_intern_table();
+	table.mutex.Acquire();
+	const char* text = (const char*) table.texts.Lookup(id.value);
+	table.mutex.Release();
+	return text;
+}
@@ -0,0 +1,37 @@
+#ifndef STRING_ID_H
+#define STRING_ID_H
+
+#include "Hashing.h"
+
+class String;
+
+// A name cut down to its 64-bit hash, so that looking names up is comparing
+// integers. Literals written "name"_id are hashed at compile time; other
+// strings are hashed when the id is made from them. Only interned ids keep
+// their text, to be looked up again for logging.
+struct StringId
+{
+	uint64_t value;
+
+	constexpr StringId(): value(0) {}
+	explicit constexpr StringId(uint64_t value): value(value) {}
+	StringId(const char* s);
+	StringId(const String& s);
+};
+
+constexpr bool operator == (StringId a, StringId b) { return a.value == b.value; }
+constexpr bool operator != (StringId a, StringId b) { return a.value != b.value; }
+constexpr bool operator < (StringId a, StringId b) { return a.value < b.value; }
+
+constexpr StringId operator "" _id(const char* s, size_t len)
+{
+	return StringId(hash_64_constant(s, len));
+}
+
+// hashes the string and keeps a copy of it, safe from any thread
+StringId intern_string(const char* s);
+
+// the text of an interned id, or null for one that never was
+const char* string_id_text(StringId id);
+
+#endif
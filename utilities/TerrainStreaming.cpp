@@ -0,0 +1,915 @@
+#include "TerrainStreaming.h"
+
+#include "Sorting.h"
+#include "Maths.h"
+#include "MeshProcessing.h"
+#include "NumberMacros.h"
+#include "concurrent/JobPool.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#elif defined(__unix__)
+#include <pthread.h>
+#endif
+
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+
+// Generation..................................................................
+
+TerrainChunk::TerrainChunk():
+	x(0),
+	z(0),
+	numVertices(0),
+	texcoords(nullptr),
+	morphs(nullptr),
+	nodeHeights(nullptr),
+	numNodes(0),
+	userData(nullptr)
+{
+	for(int i = 0; i < MAX_TERRAIN_LEVELS; ++i)
+		levelErrors[i] = 0.0f;
+}
+
+size_t TerrainChunk::GetSize() const
+{
+	return sizeof(TerrainChunk) + numVertices * (2 * sizeof(vec2) + sizeof(float)) + numNodes * 2 * sizeof(float);
+}
+
+static int count_nodes(int level, int numLevels)
+{
+	int side = 1 << (numLevels - 1 - level);
+	return side * side;
+}
+
+void generate_terrain_chunk(const TerrainSettings& settings, TerrainChunk* chunk)
+{
+	destroy_terrain_chunk(chunk);
+
+	int cells = settings.cellsPerSide;
+	float cellSize = settings.cellSize;
+	int firstX = chunk->x * cells;
+	int firstZ = chunk->z * cells;
+
+	// Sampling is done in whole cells so that edges shared with a neighbour
+	// land on exactly the same values.
+	FractalNoise noise = settings.noise;
+	noise.frequency *= cellSize;
+
+	int gridSide = cells + 1;
+	chunk->numVertices = gridSide * gridSide;
+	chunk->texcoords = new vec2[chunk->numVertices];
+	chunk->morphs = new vec2[chunk->numVertices];
+
+	Heightfield* field = &chunk->heightfield;
+	field->heights = new float[chunk->numVertices];
+	field->columns = gridSide;
+	field->rows = gridSide;
+	field->x = firstX * cellSize;
+	field->z = firstZ * cellSize;
+	field->cellSize = cellSize;
+	field->minHeight = FLT_MAX;
+	field->maxHeight = -FLT_MAX;
+
+	float* h = field->heights;
+	fill_noise_grid_2d(noise, float(firstX), float(firstZ), 1.0f, gridSide, gridSide, h);
+	for(int z = 0; z < gridSide; ++z)
+	{
+		for(int x = 0; x < gridSide; ++x)
+		{
+			int vertex = z * gridSide + x;
+			h[vertex] = settings.baseHeight + settings.amplitude * h[vertex];
+			chunk->texcoords[vertex] = vec2(x, z);
+			field->minHeight = MIN(field->minHeight, h[vertex]);
+			field->maxHeight = MAX(field->maxHeight, h[vertex]);
+		}
+	}
+
+	// A vertex drops out at the first level whose spacing doesn't divide
+	// both its coordinates, and its morph target is the height of that
+	// level's surface where it stood: halfway along the edge it sat on, or
+	// along the diagonal of the quad, which runs the same way as the one
+	// fill_terrain_lod_indices splits quads along.
+	int topStride = 1 << (settings.numLevels - 1);
+	for(int z = 0; z < gridSide; ++z)
+	{
+		for(int x = 0; x < gridSide; ++x)
+		{
+			int vertex = z * gridSide + x;
+			int bits = x | z | topStride;
+			int stride = bits & -bits;
+			if(stride == topStride)
+			{
+				chunk->morphs[vertex] = vec2(h[vertex], 0.0f);
+				continue;
+			}
+
+			bool oddX = (x / stride) & 1;
+			bool oddZ = (z / stride) & 1;
+			float target;
+			if(oddX && oddZ)
+				target = 0.5f * (h[vertex + stride * gridSide - stride] + h[vertex - stride * gridSide + stride]);
+			else if(oddX)
+				target = 0.5f * (h[vertex - stride] + h[vertex + stride]);
+			else
+				target = 0.5f * (h[vertex - stride * gridSide] + h[vertex + stride * gridSide]);
+			chunk->morphs[vertex] = vec2(target, float(stride));
+		}
+	}
+
+	// how far each level's surface is from the vertices it skips over
+	chunk->levelErrors[0] = 0.0f;
+	for(int level = 1; level < settings.numLevels; ++level)
+	{
+		int stride = 1 << level;
+		float scale = 1.0f / stride;
+		float error = 0.0f;
+		for(int z = 0; z < gridSide; ++z)
+		{
+			for(int x = 0; x < gridSide; ++x)
+			{
+				int quadX = MIN(x / stride, cells / stride - 1) * stride;
+				int quadZ = MIN(z / stride, cells / stride - 1) * stride;
+				float u = (x - quadX) * scale;
+				float v = (z - quadZ) * scale;
+
+				const float* corner = h + quadZ * gridSide + quadX;
+				float h0 = corner[0];
+				float h1 = corner[stride];
+				float h2 = corner[stride * gridSide + stride];
+				float h3 = corner[stride * gridSide];
+				float surface;
+				if(u + v <= 1.0f)
+					surface = h0 + u * (h1 - h0) + v * (h3 - h0);
+				else
+					surface = h2 + (1.0f - u) * (h3 - h2) + (1.0f - v) * (h1 - h2);
+
+				error = MAX(error, fabs(h[z * gridSide + x] - surface));
+			}
+		}
+		chunk->levelErrors[level] = error;
+	}
+
+	// node bounds, with the finest level read straight from the grid and
+	// each level after built from the one below
+	int quads = terrain_node_quads(settings);
+	chunk->numNodes = 0;
+	for(int level = 0; level < settings.numLevels; ++level)
+		chunk->numNodes += count_nodes(level, settings.numLevels);
+	chunk->nodeHeights = new float[2 * chunk->numNodes];
+
+	float* bounds = chunk->nodeHeights;
+	int nodesPerSide = cells / quads;
+	for(int nodeZ = 0; nodeZ < nodesPerSide; ++nodeZ)
+	{
+		for(int nodeX = 0; nodeX < nodesPerSide; ++nodeX)
+		{
+			float low = h[nodeZ * quads * gridSide + nodeX * quads];
+			float high = low;
+			for(int z = nodeZ * quads; z <= (nodeZ + 1) * quads; ++z)
+			{
+				for(int x = nodeX * quads; x <= (nodeX + 1) * quads; ++x)
+				{
+					low = MIN(low, h[z * gridSide + x]);
+					high = MAX(high, h[z * gridSide + x]);
+				}
+			}
+			bounds[0] = low;
+			bounds[1] = high;
+			bounds += 2;
+		}
+	}
+
+	const float* children = chunk->nodeHeights;
+	for(int level = 1; level < settings.numLevels; ++level)
+	{
+		int childrenPerSide = nodesPerSide;
+		nodesPerSide >>= 1;
+		for(int nodeZ = 0; nodeZ < nodesPerSide; ++nodeZ)
+		{
+			for(int nodeX = 0; nodeX < nodesPerSide; ++nodeX)
+			{
+				const float* child = children + 2 * (2 * nodeZ * childrenPerSide + 2 * nodeX);
+				const float* nextRow = child + 2 * childrenPerSide;
+				bounds[0] = MIN(MIN(child[0], child[2]), MIN(nextRow[0], nextRow[2]));
+				bounds[1] = MAX(MAX(child[1], child[3]), MAX(nextRow[1], nextRow[3]));
+				bounds += 2;
+			}
+		}
+		children += 2 * childrenPerSide * childrenPerSide;
+	}
+}
+
+void destroy_terrain_chunk(TerrainChunk* chunk)
+{
+	delete[] chunk->texcoords;
+	delete[] chunk->morphs;
+	delete[] chunk->nodeHeights;
+	delete[] chunk->heightfield.heights;
+	chunk->texcoords = nullptr;
+	chunk->morphs = nullptr;
+	chunk->nodeHeights = nullptr;
+	chunk->heightfield = Heightfield();
+	chunk->numVertices = 0;
+	chunk->numNodes = 0;
+}
+
+// Levels of Detail............................................................
+
+int terrain_node_quads(const TerrainSettings& settings)
+{
+	return settings.cellsPerSide >> (settings.numLevels - 1);
+}
+
+int count_terrain_lod_indices(const TerrainSettings& settings)
+{
+	int quads = terrain_node_quads(settings);
+	return 6 * quads * quads * settings.numLevels;
+}
+
+void fill_terrain_lod_indices(const TerrainSettings& settings, uint16_t* indices)
+{
+	int quads = terrain_node_quads(settings);
+	int half = quads / 2;
+	int gridSide = settings.cellsPerSide + 1;
+
+	// each quarter is reordered for the vertex cache on its own, so quarters
+	// can still be drawn separately
+	int quarterCount = 6 * half * half;
+	uint32_t* quarterIndices = new uint32_t[quarterCount];
+
+	for(int level = 0; level < settings.numLevels; ++level)
+	{
+		int stride = 1 << level;
+		for(int quarter = 0; quarter < 4; ++quarter)
+		{
+			int startX = (quarter & 1) * half;
+			int startZ = (quarter >> 1) * half;
+			uint32_t* out = quarterIndices;
+			for(int z = startZ; z < startZ + half; ++z)
+			{
+				for(int x = startX; x < startX + half; ++x)
+				{
+					uint32_t corner = stride * (z * gridSide + x);
+					uint32_t right = corner + stride;
+					uint32_t up = corner + stride * gridSide;
+					out[0] = corner;
+					out[1] = up;
+					out[2] = right;
+					out[3] = right;
+					out[4] = up;
+					out[5] = up + stride;
+					out += 6;
+				}
+			}
+
+			optimize_vertex_cache(quarterIndices, quarterCount, gridSide * gridSide);
+			for(int i = 0; i < quarterCount; ++i)
+				indices[i] = quarterIndices[i];
+			indices += quarterCount;
+		}
+	}
+
+	delete[] quarterIndices;
+}
+
+void compute_terrain_lod_ranges(const TerrainSettings& settings, const float* levelErrors,
+	float fov, int viewportHeight, float maxPixelError, float* ranges, float* morphStarts)
+{
+	// the fraction of its range a level spends looking like itself before
+	// it starts to slide toward the next one
+	const float morphStart = 0.7f;
+
+	// an error of one unit covers this many pixels at a distance of one unit
+	float pixelsPerUnit = viewportHeight / (2.0f * tan((M_PI / 180.0f) * fov * 0.5f));
+
+	float nodeSize = terrain_node_quads(settings) * settings.cellSize;
+	float heightRange = 2.0f * settings.amplitude;
+	float reached = 0.0f;
+	for(int level = 0; level < settings.numLevels - 1; ++level)
+	{
+		// The next level's error has to be small enough by the time this
+		// level starts sliding into it. And the slide can't start until every
+		// node of the level below, which can reach a node's diagonal past
+		// that level's range, has finished sliding into this one.
+		float start = MAX(reached, levelErrors[level + 1] * pixelsPerUnit / maxPixelError);
+		float range = MAX(start / morphStart, 2.0f * reached);
+		ranges[level] = range;
+		morphStarts[level] = morphStart * range;
+
+		float size = nodeSize * (1 << level);
+		reached = range + sqrt(2.0f * size * size + heightRange * heightRange);
+	}
+	ranges[settings.numLevels - 1] = FLT_MAX;
+	morphStarts[settings.numLevels - 1] = FLT_MAX;
+}
+
+struct LodSelection
+{
+	const TerrainSettings* settings;
+	const TerrainChunk* chunk;
+	vec3 viewPosition;
+	const float* ranges;
+	const Frustum* frustum;
+	AutoArray<TerrainNodeDraw>* draws;
+	TerrainLodStats* stats;
+
+	int quads;
+	float nodeSize;
+	int levelOffsets[MAX_TERRAIN_LEVELS]; // of each level's first node
+
+	AABB NodeBounds(int level, int nodeX, int nodeZ) const
+	{
+		int nodesPerSide = 1 << (settings->numLevels - 1 - level);
+		const float* heights = chunk->nodeHeights + 2 * (levelOffsets[level] + nodeZ * nodesPerSide + nodeX);
+		float size = nodeSize * (1 << level);
+		const Heightfield& field = chunk->heightfield;
+
+		AABB bounds;
+		bounds.extents = vec3(0.5f * size, 0.5f * (heights[1] - heights[0]), 0.5f * size);
+		bounds.center = vec3(field.x + nodeX * size, heights[0], field.z + nodeZ * size) + bounds.extents;
+		return bounds;
+	}
+
+	void Add(int level, int nodeX, int nodeZ, int quarter)
+	{
+		int quadsDrawn = (quarter < 0) ? quads : quads / 2;
+		int indicesPerLevel = 6 * quads * quads;
+
+		TerrainNodeDraw draw;
+		draw.chunk = chunk;
+		draw.level = level;
+		draw.firstVertex = (nodeZ * (settings->cellsPerSide + 1) + nodeX) * (quads << level);
+		draw.numIndices = 6 * quadsDrawn * quadsDrawn;
+		draw.firstIndex = level * indicesPerLevel + MAX(quarter, 0) * draw.numIndices;
+		draws->Push(draw);
+
+		if(stats)
+		{
+			stats->numDraws += 1;
+			stats->numVertices += (quadsDrawn + 1) * (quadsDrawn + 1);
+			stats->numTriangles += 2 * quadsDrawn * quadsDrawn;
+			stats->trianglesPerLevel[level] += 2 * quadsDrawn * quadsDrawn;
+		}
+	}
+
+	// false if the node is out of range for its level, for its parent to draw
+	// in its place
+	bool Select(int level, int nodeX, int nodeZ)
+	{
+		AABB bounds = NodeBounds(level, nodeX, nodeZ);
+		Sphere reach = { viewPosition, ranges[level] };
+		if(level < settings->numLevels - 1 && !intersect_sphere_aabb(reach, bounds))
+			return false;
+
+		if(frustum)
+		{
+			bool visible;
+			cull_frustum_aabb_list(*frustum, &bounds, 1, &visible);
+			if(!visible) return true;
+		}
+
+		Sphere finerReach = { viewPosition, (level > 0) ? ranges[level - 1] : 0.0f };
+		if(level == 0 || !intersect_sphere_aabb(finerReach, bounds))
+		{
+			Add(level, nodeX, nodeZ, -1);
+			return true;
+		}
+
+		for(int quarter = 0; quarter < 4; ++quarter)
+		{
+			int childX = 2 * nodeX + (quarter & 1);
+			int childZ = 2 * nodeZ + (quarter >> 1);
+			if(!Select(level - 1, childX, childZ))
+				Add(level, nodeX, nodeZ, quarter);
+		}
+		return true;
+	}
+};
+
+void select_terrain_lods(const TerrainSettings& settings, const TerrainChunk* chunk, const vec3& viewPosition,
+	const float* ranges, const Frustum* frustum, AutoArray<TerrainNodeDraw>* draws, TerrainLodStats* stats)
+{
+	LodSelection selection;
+	selection.settings = &settings;
+	selection.chunk = chunk;
+	selection.viewPosition = viewPosition;
+	selection.ranges = ranges;
+	selection.frustum = frustum;
+	selection.draws = draws;
+	selection.stats = stats;
+	selection.quads = terrain_node_quads(settings);
+	selection.nodeSize = selection.quads * settings.cellSize;
+
+	int offset = 0;
+	for(int level = 0; level < settings.numLevels; ++level)
+	{
+		selection.levelOffsets[level] = offset;
+		offset += count_nodes(level, settings.numLevels);
+	}
+
+	// the whole chunk is the one node at the top
+	selection.Select(settings.numLevels - 1, 0, 0);
+}
+
+// Generator Thread............................................................
+
+struct TerrainGenerator
+{
+	static const int MAX_BATCH = 64;
+
+	const TerrainSettings* settings;
+	TerrainChunk* batch[MAX_BATCH];
+
+	void operator()(int begin, int end)
+	{
+		for(int i = begin; i < end; ++i)
+			generate_terrain_chunk(*settings, batch[i]);
+	}
+
+	static void Main(TerrainStreamer* streamer) { streamer->GeneratorLoop(); }
+};
+
+#if defined(_WIN32)
+
+static DWORD WINAPI generator_main(LPVOID parameter)
+{
+	TerrainGenerator::Main((TerrainStreamer*) parameter);
+	return 0;
+}
+
+static void* start_thread(TerrainStreamer* streamer)
+{
+	return CreateThread(NULL, 0, generator_main, streamer, 0, NULL);
+}
+
+static void join_thread(void* thread)
+{
+	WaitForSingleObject((HANDLE) thread, INFINITE);
+	CloseHandle((HANDLE) thread);
+}
+
+#elif defined(__unix__)
+
+static void* generator_main(void* parameter)
+{
+	TerrainGenerator::Main((TerrainStreamer*) parameter);
+	return nullptr;
+}
+
+static void* start_thread(TerrainStreamer* streamer)
+{
+	pthread_t* thread = new pthread_t;
+	pthread_create(thread, NULL, generator_main, streamer);
+	return thread;
+}
+
+static void join_thread(void* thread)
+{
+	pthread_join(*(pthread_t*) thread, NULL);
+	delete (pthread_t*) thread;
+}
+
+#endif
+
+void TerrainStreamer::GeneratorLoop()
+{
+	// this is the only thread that hands work to the pool, and it joins in
+	// on every batch itself
+	TerrainGenerator generator;
+	generator.settings = &settings;
+
+	while(true)
+	{
+		requestSignal.Lock();
+		if(quit) break;
+
+		while(true)
+		{
+			int count = 0;
+			while(count < TerrainGenerator::MAX_BATCH && requests.Dequeue(generator.batch[count]))
+				++count;
+			if(count == 0) break;
+
+			pool->ParallelFor(count, 1, generator);
+			for(int i = 0; i < count; ++i)
+				results.Enqueue(generator.batch[i]);
+			flushSignal.Unlock();
+		}
+	}
+}
+
+// Streaming...................................................................
+
+static size_t chunk_key(int x, int z)
+{
+	// half the bits of the key for each coordinate
+	const int half = sizeof(size_t) * 4;
+	return (size_t(unsigned(x)) << half) | (size_t(unsigned(z)) & ((size_t(1) << half) - 1));
+}
+
+TerrainStreamer::TerrainStreamer(const TerrainSettings& settings, int viewRadius, int uploadBudget, size_t memoryCap, int numThreads):
+	settings(settings),
+	viewRadius(viewRadius),
+	uploadBudget(uploadBudget),
+	memoryCap(memoryCap),
+	memoryUsed(0),
+	frame(0),
+	uploadsLeft(0),
+	table(64),
+	nextEviction(0),
+	numPending(0),
+	requestSignal(1 << 20),
+	flushSignal(1 << 20),
+	thread(nullptr),
+	pool(nullptr),
+	quit(false)
+{
+	for(int i = 0; i < MAX_TERRAIN_LEVELS; ++i)
+		levelErrors[i] = 0.0f;
+
+	pool = new JobPool(numThreads);
+	thread = start_thread(this);
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	quit = true;
+	requestSignal.Unlock();
+	join_thread(thread);
+	delete pool;
+
+	// with the generator gone, whatever it hadn't got to can be taken back
+	TerrainChunk* chunk;
+	while(requests.Dequeue(chunk))
+	{
+		delete (Entry*) table.Lookup(chunk_key(chunk->x, chunk->z));
+		delete chunk;
+	}
+	CollectResults();
+
+	for(size_t i = 0; i < generated.Count(); ++i)
+	{
+		destroy_terrain_chunk(generated[i]->chunk);
+		delete generated[i]->chunk;
+		delete generated[i];
+	}
+	for(size_t i = 0; i < residents.Count(); ++i)
+	{
+		destroy_terrain_chunk(residents[i]->chunk);
+		delete residents[i]->chunk;
+		delete residents[i];
+	}
+	for(size_t i = 0; i < evicted.Count(); ++i)
+	{
+		destroy_terrain_chunk(evicted[i]->chunk);
+		delete evicted[i]->chunk;
+		delete evicted[i];
+	}
+}
+
+void TerrainStreamer::CollectResults()
+{
+	TerrainChunk* chunk;
+	while(results.Dequeue(chunk))
+	{
+		Entry* entry = (Entry*) table.Lookup(chunk_key(chunk->x, chunk->z));
+		entry->state = CHUNK_GENERATED;
+		entry->index = generated.Count();
+		generated.Push(entry);
+		memoryUsed += chunk->GetSize();
+		--numPending;
+
+		for(int i = 0; i < settings.numLevels; ++i)
+			levelErrors[i] = MAX(levelErrors[i], chunk->levelErrors[i]);
+	}
+}
+
+void TerrainStreamer::Request(int x, int z)
+{
+	TerrainChunk* chunk = new TerrainChunk;
+	chunk->x = x;
+	chunk->z = z;
+
+	Entry* entry = new Entry;
+	entry->chunk = chunk;
+	entry->state = CHUNK_PENDING;
+	entry->lastUsed = frame;
+	entry->index = -1;
+	table.Insert(chunk_key(x, z), (size_t) entry);
+
+	requests.Enqueue(chunk);
+	++numPending;
+}
+
+void TerrainStreamer::RemoveFromList(AutoArray<Entry*>& list, Entry* entry)
+{
+	Entry* last;
+	list.Pop(&last);
+	if(last != entry)
+	{
+		list[entry->index] = last;
+		last->index = entry->index;
+	}
+}
+
+struct MissingChunk
+{
+	int x, z;
+	int distanceSquared;
+};
+
+struct MissingChunkIsCloser
+{
+	bool operator()(const MissingChunk& a, const MissingChunk& b) const
+	{
+		return a.distanceSquared < b.distanceSquared;
+	}
+};
+
+void TerrainStreamer::Update(const vec3& position)
+{
+	// the renderer has let go of last frame's evictions by now
+	for(size_t i = 0; i < evicted.Count(); ++i)
+	{
+		Entry* entry = evicted[i];
+		table.Delete(chunk_key(entry->chunk->x, entry->chunk->z));
+		destroy_terrain_chunk(entry->chunk);
+		delete entry->chunk;
+		delete entry;
+	}
+	evicted.Clear();
+	nextEviction = 0;
+
+	++frame;
+	CollectResults();
+
+	// touch every chunk in view, and note the ones that aren't there yet
+	float chunkSize = settings.cellsPerSide * settings.cellSize;
+	int centerX = int(floor(position.x / chunkSize));
+	int centerZ = int(floor(position.z / chunkSize));
+
+	AutoArray<MissingChunk> missing;
+	for(int dz = -viewRadius; dz <= viewRadius; ++dz)
+	{
+		for(int dx = -viewRadius; dx <= viewRadius; ++dx)
+		{
+			int distanceSquared = dx * dx + dz * dz;
+			if(distanceSquared > viewRadius * viewRadius) continue;
+
+			Entry* entry = (Entry*) table.Lookup(chunk_key(centerX + dx, centerZ + dz));
+			if(entry != nullptr)
+			{
+				entry->lastUsed = frame;
+			}
+			else
+			{
+				MissingChunk chunk = { centerX + dx, centerZ + dz, distanceSquared };
+				missing.Push(chunk);
+			}
+		}
+	}
+
+	// keep only a few batches in flight, so chunks near a moving viewer
+	// don't queue up behind ones it's already left behind
+	int maxPending = 2 * pool->GetThreadCount();
+	if(missing.Count() > 0 && numPending < maxPending)
+	{
+		quick_sort(&missing[0], missing.Count(), MissingChunkIsCloser());
+		int numRequests = MIN(int(missing.Count()), maxPending - numPending);
+		for(int i = 0; i < numRequests; ++i)
+			Request(missing[i].x, missing[i].z);
+		requestSignal.Unlock();
+	}
+
+	Evict();
+	uploadsLeft = uploadBudget;
+}
+
+struct EntryIsOlder
+{
+	template<typename Entry>
+	bool operator()(const Entry* a, const Entry* b) const
+	{
+		return a->lastUsed < b->lastUsed;
+	}
+};
+
+void TerrainStreamer::Evict()
+{
+	if(memoryUsed <= memoryCap) return;
+
+	AutoArray<Entry*> candidates;
+	for(size_t i = 0; i < generated.Count(); ++i)
+	{
+		if(generated[i]->lastUsed != frame) candidates.Push(generated[i]);
+	}
+	for(size_t i = 0; i < residents.Count(); ++i)
+	{
+		if(residents[i]->lastUsed != frame) candidates.Push(residents[i]);
+	}
+	if(candidates.Count() == 0) return;
+	quick_sort(&candidates[0], candidates.Count(), EntryIsOlder());
+
+	for(size_t i = 0; i < candidates.Count() && memoryUsed > memoryCap; ++i)
+	{
+		Entry* entry = candidates[i];
+		memoryUsed -= entry->chunk->GetSize();
+
+		// chunks that were never uploaded have nothing for the renderer to
+		// release, so they can go straight away
+		if(entry->state == CHUNK_GENERATED)
+		{
+			RemoveFromList(generated, entry);
+			table.Delete(chunk_key(entry->chunk->x, entry->chunk->z));
+			destroy_terrain_chunk(entry->chunk);
+			delete entry->chunk;
+			delete entry;
+		}
+		else
+		{
+			RemoveFromList(residents, entry);
+			evicted.Push(entry);
+		}
+	}
+}
+
+TerrainChunk* TerrainStreamer::NextUpload()
+{
+	if(uploadsLeft <= 0) return nullptr;
+
+	// chunks that have drifted out of view wait until they come back, or
+	// until they're evicted
+	for(size_t i = 0; i < generated.Count(); ++i)
+	{
+		Entry* entry = generated[i];
+		if(entry->lastUsed != frame) continue;
+
+		RemoveFromList(generated, entry);
+		entry->state = CHUNK_RESIDENT;
+		entry->index = residents.Count();
+		residents.Push(entry);
+		--uploadsLeft;
+		return entry->chunk;
+	}
+	return nullptr;
+}
+
+TerrainChunk* TerrainStreamer::NextEviction()
+{
+	if(nextEviction >= int(evicted.Count())) return nullptr;
+	return evicted[nextEviction++]->chunk;
+}
+
+void TerrainStreamer::Flush()
+{
+	CollectResults();
+	while(numPending > 0)
+	{
+		flushSignal.Lock();
+		CollectResults();
+	}
+}
+
+// Ground Queries..............................................................
+
+const TerrainChunk* TerrainStreamer::FindChunk(int x, int z)
+{
+	// pending chunks are still being written by the generator
+	Entry* entry = (Entry*) table.Lookup(chunk_key(x, z));
+	if(entry == nullptr || entry->state == CHUNK_PENDING) return nullptr;
+	return entry->chunk;
+}
+
+const TerrainChunk* TerrainStreamer::FindChunkAt(float x, float z)
+{
+	float chunkSize = settings.cellsPerSide * settings.cellSize;
+	return FindChunk(int(floor(x / chunkSize)), int(floor(z / chunkSize)));
+}
+
+bool TerrainStreamer::GetHeight(float x, float z, float* height)
+{
+	const TerrainChunk* chunk = FindChunkAt(x, z);
+	return chunk && get_heightfield_height(chunk->heightfield, x, z, height);
+}
+
+bool TerrainStreamer::GetNormal(float x, float z, vec3* normal)
+{
+	const TerrainChunk* chunk = FindChunkAt(x, z);
+	return chunk && get_heightfield_normal(chunk->heightfield, x, z, normal);
+}
+
+void TerrainStreamer::GetHeights(const vec3* points, int count, float* heights)
+{
+	// nearby points tend to share a chunk, so the last one found is tried
+	// before looking in the table again
+	const TerrainChunk* chunk = nullptr;
+	for(int i = 0; i < count; ++i)
+	{
+		const Heightfield* field = chunk ? &chunk->heightfield : nullptr;
+		bool inside = field
+			&& points[i].x >= field->x && points[i].x <= field->x + (field->columns - 1) * field->cellSize
+			&& points[i].z >= field->z && points[i].z <= field->z + (field->rows - 1) * field->cellSize;
+		if(!inside)
+		{
+			chunk = FindChunkAt(points[i].x, points[i].z);
+			if(chunk == nullptr) continue;
+		}
+		sample_heightfield(chunk->heightfield, points + i, 1, heights + i);
+	}
+}
+
+bool TerrainStreamer::IntersectRay(const Ray& ray, float* distance, vec3* normal)
+{
+	// Only chunks in memory can be hit, so the ray is cut down to the
+	// rectangle of chunks around them before walking it chunk by chunk.
+	// Each chunk's own march finds the first hit inside it.
+	int lowX = INT_MAX, lowZ = INT_MAX, highX = INT_MIN, highZ = INT_MIN;
+	const AutoArray<Entry*>* lists[2] = { &generated, &residents };
+	for(int i = 0; i < 2; ++i)
+	{
+		for(size_t j = 0; j < lists[i]->Count(); ++j)
+		{
+			const TerrainChunk* chunk = (*lists[i])[j]->chunk;
+			lowX = MIN(lowX, chunk->x);
+			lowZ = MIN(lowZ, chunk->z);
+			highX = MAX(highX, chunk->x);
+			highZ = MAX(highZ, chunk->z);
+		}
+	}
+	if(lowX > highX) return false;
+
+	float chunkSize = settings.cellsPerSide * settings.cellSize;
+	float start = 0.0f;
+	float end = ray.maxDistance;
+	float origin[2] = { ray.origin.x, ray.origin.z };
+	float direction[2] = { ray.direction.x, ray.direction.z };
+	float lower[2] = { lowX * chunkSize, lowZ * chunkSize };
+	float upper[2] = { (highX + 1) * chunkSize, (highZ + 1) * chunkSize };
+	for(int i = 0; i < 2; ++i)
+	{
+		if(direction[i] == 0.0f)
+		{
+			if(origin[i] < lower[i] || origin[i] > upper[i]) return false;
+			continue;
+		}
+		float closest = (lower[i] - origin[i]) / direction[i];
+		float furthest = (upper[i] - origin[i]) / direction[i];
+		start = MAX(start, MIN(closest, furthest));
+		end = MIN(end, MAX(closest, furthest));
+	}
+	if(start > end) return false;
+
+	vec3 first = ray.origin + start * ray.direction;
+	int chunkX = MIN(MAX(int(floor(first.x / chunkSize)), lowX), highX);
+	int chunkZ = MIN(MAX(int(floor(first.z / chunkSize)), lowZ), highZ);
+
+	int stepX = (ray.direction.x > 0.0f) ? 1 : -1;
+	int stepZ = (ray.direction.z > 0.0f) ? 1 : -1;
+	float nextX = FLT_MAX;
+	float nextZ = FLT_MAX;
+	float deltaX = FLT_MAX;
+	float deltaZ = FLT_MAX;
+	if(ray.direction.x != 0.0f)
+	{
+		nextX = ((chunkX + (stepX > 0)) * chunkSize - ray.origin.x) / ray.direction.x;
+		deltaX = chunkSize / fabs(ray.direction.x);
+	}
+	if(ray.direction.z != 0.0f)
+	{
+		nextZ = ((chunkZ + (stepZ > 0)) * chunkSize - ray.origin.z) / ray.direction.z;
+		deltaZ = chunkSize / fabs(ray.direction.z);
+	}
+
+	while(true)
+	{
+		float exit = MIN(MIN(nextX, nextZ), end);
+
+		const TerrainChunk* chunk = FindChunk(chunkX, chunkZ);
+		if(chunk)
+		{
+			Ray piece = ray;
+			piece.maxDistance = exit;
+			if(intersect_ray_heightfield(chunk->heightfield, piece, distance, normal))
+				return true;
+		}
+
+		if(exit >= end) return false;
+
+		if(nextX < nextZ)
+		{
+			chunkX += stepX;
+			nextX += deltaX;
+		}
+		else
+		{
+			chunkZ += stepZ;
+			nextZ += deltaZ;
+		}
+	}
+}
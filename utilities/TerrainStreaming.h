@@ -0,0 +1,221 @@
+#ifndef TERRAIN_STREAMING_H
+#define TERRAIN_STREAMING_H
+
+#include "Collision.h"
+#include "GLMath.h"
+#include "Heightfield.h"
+#include "Noise.h"
+#include "DataTypes.h"
+
+#include "collections/AutoArray.h"
+#include "collections/IntegerHashTable.h"
+#include "concurrent/LinkedQueue.h"
+#include "concurrent/Semaphore.h"
+
+class JobPool;
+
+// The CPU half of an endless terrain made of square chunks. Chunks near the
+// viewer are generated on a background thread, handed back a few per frame
+// for the renderer to upload, and dropped least recently used first once
+// they take up more memory than allowed. Nothing here touches the graphics
+// API, so it runs just as well without a window.
+//
+// Each chunk is the root of a quadtree of detail levels, chosen CDLOD style:
+// every node is a grid of the same number of quads, spaced twice as far
+// apart at each level up, and a level is used out to a range past which the
+// next one up looks no worse on screen. Near the end of its range a level's
+// in-between vertices slide toward the next level's surface, so nothing pops
+// when the switch happens.
+
+static const int MAX_TERRAIN_LEVELS = 8;
+
+struct TerrainSettings
+{
+	int cellsPerSide; // at most 255, so vertices fit 16-bit indices
+	float cellSize;
+	float baseHeight;
+	float amplitude;
+	FractalNoise noise; // sampled in world units
+
+	// cellsPerSide has to divide evenly by 2 ^ numLevels, so that nodes at
+	// the finest level still split into quarters
+	int numLevels;
+};
+
+// one chunk's mesh, a grid of vertices shared between neighbouring cells,
+// whose heights are kept once in the heightfield
+struct TerrainChunk
+{
+	int x, z; // chunk coordinates, so the chunk starts at x * cellsPerSide * cellSize
+	int numVertices;
+	vec2* texcoords; // in cells from the chunk's corner, for a repeating texture
+
+	// for each vertex, the height it slides to before its level gives way to
+	// the next, and the spacing of the level where that happens
+	vec2* morphs;
+
+	// lowest and highest point of every quadtree node, finest level first
+	// and each level's nodes in rows along z
+	float* nodeHeights;
+	int numNodes;
+
+	// the furthest each level's surface strays from the full detail one
+	float levelErrors[MAX_TERRAIN_LEVELS];
+
+	// the height of every vertex, in the same order, which the renderer
+	// builds its vertices from and ground queries read
+	Heightfield heightfield;
+
+	// for the renderer to hang its buffers on
+	void* userData;
+
+	TerrainChunk();
+	size_t GetSize() const;
+};
+
+void generate_terrain_chunk(const TerrainSettings& settings, TerrainChunk* chunk);
+void destroy_terrain_chunk(TerrainChunk* chunk);
+
+// Levels of Detail............................................................
+
+// a node or a quarter of a node to draw: numIndices indices from firstIndex in
+// the list from fill_terrain_lod_indices, offset by firstVertex
+struct TerrainNodeDraw
+{
+	const TerrainChunk* chunk;
+	int level;
+	int firstVertex;
+	int firstIndex;
+	int numIndices;
+};
+
+struct TerrainLodStats
+{
+	int numDraws;
+	int numVertices;
+	int numTriangles;
+	int trianglesPerLevel[MAX_TERRAIN_LEVELS];
+};
+
+// quads across a node, at any level
+int terrain_node_quads(const TerrainSettings& settings);
+
+// one index list per level back to back, each counting vertices from the
+// corner of a node so any node at that level can draw with it, and each
+// split into a quarter of the list per quarter of the node
+int count_terrain_lod_indices(const TerrainSettings& settings);
+void fill_terrain_lod_indices(const TerrainSettings& settings, uint16_t* indices);
+
+// Works out how far from the viewer each level reaches, so that no level is
+// off from the full detail surface by more than maxPixelError pixels on a
+// screen viewportHeight pixels tall, with fov in degrees. Each level starts
+// sliding toward the next one at its morphStart. The coarsest level reaches
+// out forever.
+void compute_terrain_lod_ranges(const TerrainSettings& settings, const float* levelErrors,
+	float fov, int viewportHeight, float maxPixelError, float* ranges, float* morphStarts);
+
+// Walks a chunk's quadtree and adds what to draw at which level, leaving
+// out nodes outside the frustum if one's given. Stats are added to rather
+// than reset, so they can be summed over every chunk.
+void select_terrain_lods(const TerrainSettings& settings, const TerrainChunk* chunk, const vec3& viewPosition,
+	const float* ranges, const Frustum* frustum, AutoArray<TerrainNodeDraw>* draws, TerrainLodStats* stats);
+
+class TerrainStreamer
+{
+public:
+	// viewRadius is in chunks; zero threads picks one per core
+	TerrainStreamer(const TerrainSettings& settings, int viewRadius, int uploadBudget, size_t memoryCap, int numThreads = 0);
+	~TerrainStreamer();
+
+	// once a frame, before taking uploads and evictions: asks for missing
+	// chunks around the position, nearest first, and frees the chunks handed
+	// out by NextEviction since the last update
+	void Update(const vec3& position);
+
+	// newly generated chunks, no more than the upload budget each frame;
+	// null when there are none left for this frame
+	TerrainChunk* NextUpload();
+
+	// chunks over the memory cap, least recently used first, which stay
+	// valid until the next Update so the renderer can let go of them. Chunks
+	// in view are never evicted, even when they alone pass the cap.
+	TerrainChunk* NextEviction();
+
+	// every chunk that's been uploaded and not evicted
+	int GetResidentCount() const { return residents.Count(); }
+	TerrainChunk* GetResident(int index) const { return residents[index]->chunk; }
+
+	int GetPendingCount() const { return numPending; }
+	size_t GetMemoryUsed() const { return memoryUsed; }
+
+	// the worst of levelErrors over every chunk generated so far
+	const float* GetLevelErrors() const { return levelErrors; }
+
+	// Ground queries over every chunk that's been generated, for the same
+	// thread that calls Update. There's no ground where no chunk is loaded,
+	// so these return false there, and GetHeights leaves those heights alone.
+	bool GetHeight(float x, float z, float* height);
+	bool GetNormal(float x, float z, vec3* normal);
+	void GetHeights(const vec3* points, int count, float* heights);
+	bool IntersectRay(const Ray& ray, float* distance, vec3* normal);
+
+	// blocks until every chunk asked for so far has been generated, for
+	// loading screens and tests
+	void Flush();
+
+private:
+	enum ChunkState
+	{
+		CHUNK_PENDING,   // handed to the generator thread
+		CHUNK_GENERATED, // waiting to be uploaded
+		CHUNK_RESIDENT,
+	};
+
+	struct Entry
+	{
+		TerrainChunk* chunk;
+		ChunkState state;
+		unsigned int lastUsed; // frame number
+		int index;             // in the list for its state
+	};
+
+	TerrainSettings settings;
+	int viewRadius;
+	int uploadBudget;
+	size_t memoryCap;
+	size_t memoryUsed;
+	unsigned int frame;
+	int uploadsLeft;
+	float levelErrors[MAX_TERRAIN_LEVELS];
+
+	IntegerHashTable table; // chunk key to Entry*
+	AutoArray<Entry*> generated;
+	AutoArray<Entry*> residents;
+	AutoArray<Entry*> evicted;
+	int nextEviction;
+	int numPending;
+
+	// single producer and single consumer each way
+	LinkedQueue<TerrainChunk*> requests;
+	LinkedQueue<TerrainChunk*> results;
+	Semaphore requestSignal;
+	Semaphore flushSignal;
+	void* thread;
+	JobPool* pool;
+	volatile bool quit;
+
+	TerrainStreamer(const TerrainStreamer&);
+	TerrainStreamer& operator = (const TerrainStreamer&);
+
+	const TerrainChunk* FindChunk(int x, int z);
+	const TerrainChunk* FindChunkAt(float x, float z);
+	void CollectResults();
+	void Request(int x, int z);
+	void RemoveFromList(AutoArray<Entry*>& list, Entry* entry);
+	void Evict();
+	void GeneratorLoop();
+
+	friend struct TerrainGenerator;
+};
+
+#endif
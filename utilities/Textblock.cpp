@@ -13,12 +13,14 @@ Attribute::Attribute():
 
 Attribute::Attribute(const String& key, String* values, int numValues):
 	key(key),
+	id(key),
 	values(values),
 	numValues(numValues)
 {}
 
 Attribute::Attribute(const Attribute& attribute):
 	key(attribute.key),
+	id(attribute.id),
 	values(attribute.values),
 	numValues(attribute.numValues)
 {}
@@ -35,6 +37,7 @@ void Textblock::Add_Attribute(const String& name, String values[], int numValues
 {
 	Attribute attribute;
 	attribute.key = name;
+	attribute.id = StringId(name);
 	String* vals = new String[numValues];
 	COPY(values, vals, numValues);
 	attribute.values = vals;
@@ -42,20 +45,20 @@ void Textblock::Add_Attribute(const String& name, String values[], int numValues
 	attributes.Push(attribute);
 }
 
-Attribute* Textblock::Get_Attribute(const String& name) const
+Attribute* Textblock::Get_Attribute(StringId name) const
 {
 	FOR_ALL(attributes)
-		if(it->key == name) return it;
+		if(it->id == name) return it;
 
 	return nullptr;
 }
 
-bool Textblock::Has_Attribute(const String& name) const
+bool Textblock::Has_Attribute(StringId name) const
 {
 	return Get_Attribute(name) != nullptr;
 }
 
-bool Textblock::Get_Attribute_As_Bool(const String& name, bool* value) const
+bool Textblock::Get_Attribute_As_Bool(StringId name, bool* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -66,7 +69,7 @@ bool Textblock::Get_Attribute_As_Bool(const String& name, bool* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Int(const String& name, int* value) const
+bool Textblock::Get_Attribute_As_Int(StringId name, int* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -77,7 +80,7 @@ bool Textblock::Get_Attribute_As_Int(const String& name, int* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Float(const String& name, float* value) const
+bool Textblock::Get_Attribute_As_Float(StringId name, float* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -88,7 +91,7 @@ bool Textblock::Get_Attribute_As_Float(const String& name, float* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Double(const String& name, double* value) const
+bool Textblock::Get_Attribute_As_Double(StringId name, double* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -99,7 +102,7 @@ bool Textblock::Get_Attribute_As_Double(const String& name, double* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Vec2(const String& name, vec2* value) const
+bool Textblock::Get_Attribute_As_Vec2(StringId name, vec2* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -113,7 +116,7 @@ bool Textblock::Get_Attribute_As_Vec2(const String& name, vec2* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Vec3(const String& name, vec3* value) const
+bool Textblock::Get_Attribute_As_Vec3(StringId name, vec3* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -128,7 +131,7 @@ bool Textblock::Get_Attribute_As_Vec3(const String& name, vec3* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Vec4(const String& name, vec4* value) const
+bool Textblock::Get_Attribute_As_Vec4(StringId name, vec4* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -144,7 +147,7 @@ bool Textblock::Get_Attribute_As_Vec4(const String& name, vec4* value) const
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Quaternion(const String& name, quaternion* value) const
+bool Textblock::Get_Attribute_As_Quaternion(StringId name, quaternion* value) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && value != nullptr)
@@ -160,7 +163,7 @@ bool Textblock::Get_Attribute_As_Quaternion(const String& name, quaternion* valu
 	return false;
 }
 
-bool Textblock::Get_Attribute_As_Strings(const String& name, String** values, int* numValues) const
+bool Textblock::Get_Attribute_As_Strings(StringId name, String** values, int* numValues) const
 {
 	Attribute* attribute = Get_Attribute(name);
 	if(attribute != nullptr && values != nullptr)
@@ -180,13 +183,21 @@ void Textblock::Add_Child(Textblock* child)
 
 void Textblock::Remove_Child(const String& name)
 {
-	FOR_ALL(children)
+	// fill the gap with the last child, so no null entries are left behind
+	// for the other lookups to trip over
+	for(size_t i = 0; i < children.Count();)
 	{
-		Textblock* child = *it;
+		Textblock* child = children[i];
 		if(child->name == name)
 		{
 			delete child;
-			*it = nullptr;
+			Textblock* last;
+			children.Pop(&last);
+			if(i < children.Count()) children[i] = last;
+		}
+		else
+		{
+			++i;
 		}
 	}
 }
@@ -2,6 +2,7 @@
 #define TEXTBLOCK_H
 
 #include "String.h"
+#include "StringId.h"
 #include "GLMath.h"
 
 #include "collections/AutoArray.h"
@@ -10,6 +11,7 @@ class Attribute
 {
 public:
 	String key;
+	StringId id; // of the key
 	String* values;
 	int numValues;
 
@@ -31,17 +33,20 @@ public:
 	~Textblock();
 
 	void Add_Attribute(const String& name, String values[], int numValues);
-	bool Has_Attribute(const String& name) const;
-
-	bool Get_Attribute_As_Bool(const String& name, bool* value) const;
-	bool Get_Attribute_As_Int(const String& name, int* value) const;
-	bool Get_Attribute_As_Float(const String& name, float* value) const;
-	bool Get_Attribute_As_Double(const String& name, double* value) const;
-	bool Get_Attribute_As_Vec2(const String& name, vec2* value) const;
-	bool Get_Attribute_As_Vec3(const String& name, vec3* value) const;
-	bool Get_Attribute_As_Vec4(const String& name, vec4* value) const;
-	bool Get_Attribute_As_Quaternion(const String& name, quaternion* value) const;
-	bool Get_Attribute_As_Strings(const String& name, String** values, int* numValues = nullptr) const;
+
+	// attributes are found by id, so pass names as "name"_id where they're
+	// known up front
+	bool Has_Attribute(StringId name) const;
+
+	bool Get_Attribute_As_Bool(StringId name, bool* value) const;
+	bool Get_Attribute_As_Int(StringId name, int* value) const;
+	bool Get_Attribute_As_Float(StringId name, float* value) const;
+	bool Get_Attribute_As_Double(StringId name, double* value) const;
+	bool Get_Attribute_As_Vec2(StringId name, vec2* value) const;
+	bool Get_Attribute_As_Vec3(StringId name, vec3* value) const;
+	bool Get_Attribute_As_Vec4(StringId name, vec4* value) const;
+	bool Get_Attribute_As_Quaternion(StringId name, quaternion* value) const;
+	bool Get_Attribute_As_Strings(StringId name, String** values, int* numValues = nullptr) const;
 
 	void Add_Child(Textblock* child);
 	void Remove_Child(const String& name);
@@ -49,7 +54,7 @@ public:
 	Textblock* Get_Child_By_Name(const String& name) const;
 
 private:
-	Attribute* Get_Attribute(const String& name) const;
+	Attribute* Get_Attribute(StringId name) const;
 };
 
 #endif
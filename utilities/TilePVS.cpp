@@ -0,0 +1,801 @@
+#include "TilePVS.h"
+
+#include "Textblock.h"
+#include "Conversion.h"
+#include "Parsing.h"
+#include "NumberMacros.h"
+#include "concurrent/JobPool.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compression.................................................................
+
+// runs of zero bytes are stored as a zero and the length of the run, and
+// every other byte is stored as it is
+static int compress_bits(const uint8_t* bits, int numBytes, uint8_t* out)
+{
+	int size = 0;
+	for(int i = 0; i < numBytes;)
+	{
+		if(bits[i] != 0)
+		{
+			out[size++] = bits[i++];
+			continue;
+		}
+		int run = 1;
+		while(i + run < numBytes && bits[i + run] == 0 && run < 255) ++run;
+		out[size++] = 0;
+		out[size++] = run;
+		i += run;
+	}
+	return size;
+}
+
+// returns where the next set starts, and out can be null to skip over a set
+static const uint8_t* decompress_bits(const uint8_t* in, int numBytes, uint8_t* out)
+{
+	for(int i = 0; i < numBytes;)
+	{
+		if(*in != 0)
+		{
+			if(out != nullptr) out[i] = *in;
+			++in;
+			++i;
+			continue;
+		}
+		int run = in[1];
+		if(out != nullptr) memset(out + i, 0, run);
+		in += 2;
+		i += run;
+	}
+	return in;
+}
+
+// Baking......................................................................
+
+struct SightGrid
+{
+	const int* tiles;
+	int width, height;
+	int* solidSums; // summed area table of solid tiles, one wider and taller
+
+	bool IsSolid(int x, int z) const
+	{
+		return tiles[z * width + x] != 0;
+	}
+
+	// counts the solid tiles in an inclusive rectangle of cells
+	int CountSolid(int x0, int z0, int x1, int z1) const
+	{
+		int stride = width + 1;
+		return solidSums[(z1 + 1) * stride + x1 + 1] - solidSums[z0 * stride + x1 + 1]
+			- solidSums[(z1 + 1) * stride + x0] + solidSums[z0 * stride + x0];
+	}
+
+	// whether a tile stops sight, where the two cells being checked and
+	// anything off the grid don't
+	bool Blocks(int x, int z, int cellA, int cellB) const
+	{
+		if(x < 0 || z < 0 || x >= width || z >= height) return false;
+		int cell = z * width + x;
+		return cell != cellA && cell != cellB && tiles[cell] != 0;
+	}
+
+	static const int SAMPLES = 5;
+	static const int MAX_CORNERS = 96;
+
+	bool HasOpenWalk(int cellA, int cellB, uint8_t* columns) const;
+	bool IsLineBlocked(float x0, float z0, float x1, float z1, int cellA, int cellB) const;
+	bool IsLineClear(int px, int pz, int qx, int qz, int cellA, int cellB) const;
+	bool HasClearLine(int cellA, int cellB) const;
+	bool CanSee(int cellA, int cellB) const;
+};
+
+bool SightGrid::HasOpenWalk(int cellA, int cellB, uint8_t* columns) const
+{
+	// any line of sight steps from cell to cell only ever moving toward its
+	// end, and never leaves the convex hull of the two cells. So if no such
+	// walk gets through open tiles, the pair is certainly hidden. Coordinates
+	// here are flipped so the walk goes toward positive i and j.
+
+	int ax = cellA % width, az = cellA / width;
+	int bx = cellB % width, bz = cellB / width;
+	int stepX = (bx >= ax) ? 1 : -1;
+	int stepZ = (bz >= az) ? 1 : -1;
+	int spanX = abs(bx - ax);
+	int spanZ = abs(bz - az);
+	float slope = (spanX > 0) ? float(spanZ) / spanX : 0.0f;
+
+	uint8_t* previous = columns;
+	uint8_t* current = columns + height;
+	int previousLow = 0, previousHigh = -1;
+	for(int i = 0; i <= spanX; ++i)
+	{
+		// the cells in this column that the hull passes through, widened a
+		// little so rounding only ever lets in more
+		int low = 0, high = spanZ;
+		if(spanX > 0)
+		{
+			low = MAX(low, int(floor(slope * (i - 1) - 1.0e-3f)));
+			high = MIN(high, int(ceil(1.0f + slope * (i + 1) + 1.0e-3f)) - 1);
+		}
+
+		for(int j = low; j <= high; ++j)
+		{
+			bool reached = (i == 0 && j == 0);
+			if(j > low && current[j - 1]) reached = true;
+			if(j >= previousLow && j <= previousHigh && previous[j]) reached = true;
+
+			// walls can be reached, but not walked through
+			int cell = (az + stepZ * j) * width + ax + stepX * i;
+			if(cell == cellB) return reached;
+			current[j] = reached && (cell == cellA || tiles[cell] == 0);
+		}
+
+		uint8_t* swap = previous;
+		previous = current;
+		current = swap;
+		previousLow = low;
+		previousHigh = high;
+	}
+	return false;
+}
+
+bool SightGrid::IsLineBlocked(float x0, float z0, float x1, float z1, int cellA, int cellB) const
+{
+	// walks the cells the line passes through, after Amanatides and Woo's
+	// "A Fast Voxel Traversal Algorithm for Ray Tracing"
+
+	int x = int(x0);
+	int z = int(z0);
+	int endX = int(x1);
+	int endZ = int(z1);
+
+	float dx = x1 - x0;
+	float dz = z1 - z0;
+	int stepX = (dx > 0.0f) ? 1 : -1;
+	int stepZ = (dz > 0.0f) ? 1 : -1;
+	float tDeltaX = (dx != 0.0f) ? 1.0f / fabs(dx) : FLT_MAX;
+	float tDeltaZ = (dz != 0.0f) ? 1.0f / fabs(dz) : FLT_MAX;
+	float tMaxX = (dx != 0.0f) ? (float(x + (stepX > 0)) - x0) / dx : FLT_MAX;
+	float tMaxZ = (dz != 0.0f) ? (float(z + (stepZ > 0)) - z0) / dz : FLT_MAX;
+
+	int steps = abs(endX - x) + abs(endZ - z);
+	for(int i = 0; i < steps; ++i)
+	{
+		if(tMaxX < tMaxZ)
+		{
+			x += stepX;
+			tMaxX += tDeltaX;
+		}
+		else
+		{
+			z += stepZ;
+			tMaxZ += tDeltaZ;
+		}
+
+		int cell = z * width + x;
+		if(cell != cellA && cell != cellB && tiles[cell] != 0) return true;
+	}
+	return false;
+}
+
+// finds where a line through p going d crosses into and out of a cell,
+// counting a line that only touches it
+static bool clip_line(int px, int pz, int dx, int dz, int x, int z, double* enter, double* leave)
+{
+	double low = -DBL_MAX, high = DBL_MAX;
+	if(dx == 0)
+	{
+		if(px < x || px > x + 1) return false;
+	}
+	else
+	{
+		double t0 = double(x - px) / dx;
+		double t1 = double(x + 1 - px) / dx;
+		low = MAX(low, MIN(t0, t1));
+		high = MIN(high, MAX(t0, t1));
+	}
+	if(dz == 0)
+	{
+		if(pz < z || pz > z + 1) return false;
+	}
+	else
+	{
+		double t0 = double(z - pz) / dz;
+		double t1 = double(z + 1 - pz) / dz;
+		low = MAX(low, MIN(t0, t1));
+		high = MIN(high, MAX(t0, t1));
+	}
+	*enter = low;
+	*leave = high;
+	return low <= high;
+}
+
+bool SightGrid::IsLineClear(int px, int pz, int qx, int qz, int cellA, int cellB) const
+{
+	// the line through the grid points p and q, between where it leaves one
+	// cell and enters the other. It may touch solid tiles and run along their
+	// sides, but not pass inside them, between two that share a side, or
+	// through a corner where two of them meet diagonally. Every crossing is
+	// a ratio of whole numbers, and equal ratios divide out to equal doubles,
+	// so lines passing exactly through corners are found exactly.
+
+	int dx = qx - px;
+	int dz = qz - pz;
+	int ax = cellA % width, az = cellA / width;
+	int bx = cellB % width, bz = cellB / width;
+
+	double enterA, leaveA, enterB, leaveB;
+	if(!clip_line(px, pz, dx, dz, ax, az, &enterA, &leaveA)
+		|| !clip_line(px, pz, dx, dz, bx, bz, &enterB, &leaveB))
+		return false;
+
+	double start, end;
+	if(leaveA <= enterB)
+	{
+		start = leaveA;
+		end = enterB;
+	}
+	else if(leaveB <= enterA)
+	{
+		start = leaveB;
+		end = enterA;
+	}
+	else
+	{
+		return true;
+	}
+
+	// the first grid lines crossed at or after the start
+	int stepX = (dx > 0) ? 1 : -1;
+	int stepZ = (dz > 0) ? 1 : -1;
+	int x = 0, z = 0;
+	if(dx != 0)
+	{
+		x = int(floor(px + start * dx)) - stepX;
+		while(double(x - px) / dx < start) x += stepX;
+	}
+	if(dz != 0)
+	{
+		z = int(floor(pz + start * dz)) - stepZ;
+		while(double(z - pz) / dz < start) z += stepZ;
+	}
+
+	double t = start;
+	for(;;)
+	{
+		double nextX = (dx != 0) ? double(x - px) / dx : DBL_MAX;
+		double nextZ = (dz != 0) ? double(z - pz) / dz : DBL_MAX;
+		double next = MIN(nextX, nextZ);
+
+		// the piece up to the next crossing lies inside one tile, unless
+		// the line runs along a grid line and it lies between two
+		double until = MIN(next, end);
+		if(until > t)
+		{
+			double middle = 0.5 * (t + until);
+			int cx = int(floor(px + middle * dx));
+			int cz = int(floor(pz + middle * dz));
+			if(dx == 0)
+			{
+				if(Blocks(px - 1, cz, cellA, cellB) && Blocks(px, cz, cellA, cellB)) return false;
+			}
+			else if(dz == 0)
+			{
+				if(Blocks(cx, pz - 1, cellA, cellB) && Blocks(cx, pz, cellA, cellB)) return false;
+			}
+			else if(Blocks(cx, cz, cellA, cellB))
+			{
+				return false;
+			}
+		}
+		if(next > end) return true;
+
+		if(nextX == nextZ)
+		{
+			bool lowLeft = Blocks(x - 1, z - 1, cellA, cellB);
+			bool lowRight = Blocks(x, z - 1, cellA, cellB);
+			bool highLeft = Blocks(x - 1, z, cellA, cellB);
+			bool highRight = Blocks(x, z, cellA, cellB);
+			if(lowLeft == highRight && lowRight == highLeft && lowLeft != lowRight) return false;
+		}
+		if(nextX == next) x += stepX;
+		if(nextZ == next) z += stepZ;
+		t = next;
+	}
+}
+
+bool SightGrid::HasClearLine(int cellA, int cellB) const
+{
+	// if any line gets from one cell to the other, it can be slid and turned
+	// until it rests on two points without ever being blocked. Each point is
+	// a corner of one of the two cells or the outside corner of a solid
+	// tile, the only places a line can rest against, so only lines through
+	// two of those have to be tried. Corners outside the hull of the two
+	// cells can't be reached by any line between them.
+
+	int ax = cellA % width, az = cellA / width;
+	int bx = cellB % width, bz = cellB / width;
+	int spanX = bx - ax;
+	int spanZ = bz - az;
+
+	int corners[MAX_CORNERS][2];
+	int numCorners = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		corners[numCorners][0] = ax + (i & 1);
+		corners[numCorners][1] = az + (i >> 1);
+		++numCorners;
+		corners[numCorners][0] = bx + (i & 1);
+		corners[numCorners][1] = bz + (i >> 1);
+		++numCorners;
+	}
+
+	for(int z = MIN(az, bz); z <= MAX(az, bz) + 1; ++z)
+	{
+		for(int x = MIN(ax, bx); x <= MAX(ax, bx) + 1; ++x)
+		{
+			int solid = Blocks(x - 1, z - 1, cellA, cellB) + Blocks(x, z - 1, cellA, cellB)
+				+ Blocks(x - 1, z, cellA, cellB) + Blocks(x, z, cellA, cellB);
+			if(solid != 1) continue;
+
+			// the hull is the cell swept along the line between their
+			// centers, so look for a point on that line within half a cell
+			double low = 0.0, high = 1.0;
+			double offsetX = x - ax - 0.5;
+			double offsetZ = z - az - 0.5;
+			if(spanX != 0)
+			{
+				double t0 = (offsetX - 0.5) / spanX;
+				double t1 = (offsetX + 0.5) / spanX;
+				low = MAX(low, MIN(t0, t1));
+				high = MIN(high, MAX(t0, t1));
+			}
+			if(spanZ != 0)
+			{
+				double t0 = (offsetZ - 0.5) / spanZ;
+				double t1 = (offsetZ + 0.5) / spanZ;
+				low = MAX(low, MIN(t0, t1));
+				high = MIN(high, MAX(t0, t1));
+			}
+			if(low > high + 1.0e-9) continue;
+
+			// too cluttered to settle quickly, so err toward visible
+			if(numCorners == MAX_CORNERS) return true;
+			corners[numCorners][0] = x;
+			corners[numCorners][1] = z;
+			++numCorners;
+		}
+	}
+
+	for(int i = 0; i < numCorners; ++i)
+	{
+		for(int j = i + 1; j < numCorners; ++j)
+		{
+			if(corners[i][0] == corners[j][0] && corners[i][1] == corners[j][1]) continue;
+			if(IsLineClear(corners[i][0], corners[i][1], corners[j][0], corners[j][1], cellA, cellB))
+				return true;
+		}
+	}
+	return false;
+}
+
+bool SightGrid::CanSee(int cellA, int cellB) const
+{
+	int ax = cellA % width, az = cellA / width;
+	int bx = cellB % width, bz = cellB / width;
+
+	// neighbours always see each other
+	int dx = bx - ax;
+	int dz = bz - az;
+	if(abs(dx) <= 1 && abs(dz) <= 1) return true;
+
+	// nothing solid anywhere between them
+	if(CountSolid(MIN(ax, bx), MIN(az, bz), MAX(ax, bx), MAX(az, bz)) - IsSolid(bx, bz) == 0) return true;
+
+	// lines between a few points on the sides of the two cells that face
+	// each other settle most visible pairs quickly. They're kept just inside
+	// so no line runs along a grid line.
+	const float inset = 1.0e-3f;
+	float pointsA[2 * SAMPLES][2], pointsB[2 * SAMPLES][2];
+	int numPoints = 0;
+	for(int i = 0; i < SAMPLES; ++i)
+	{
+		float along = inset + (1.0f - 2.0f * inset) * i / (SAMPLES - 1);
+		if(dx != 0)
+		{
+			pointsA[numPoints][0] = ax + ((dx > 0) ? 1.0f - inset : inset);
+			pointsA[numPoints][1] = az + along;
+			pointsB[numPoints][0] = bx + ((dx > 0) ? inset : 1.0f - inset);
+			pointsB[numPoints][1] = bz + along;
+			++numPoints;
+		}
+		if(dz != 0)
+		{
+			pointsA[numPoints][0] = ax + along;
+			pointsA[numPoints][1] = az + ((dz > 0) ? 1.0f - inset : inset);
+			pointsB[numPoints][0] = bx + along;
+			pointsB[numPoints][1] = bz + ((dz > 0) ? inset : 1.0f - inset);
+			++numPoints;
+		}
+	}
+
+	for(int i = 0; i < numPoints; ++i)
+	{
+		for(int j = 0; j < numPoints; ++j)
+		{
+			if(!IsLineBlocked(pointsA[i][0], pointsA[i][1], pointsB[j][0], pointsB[j][1], cellA, cellB))
+				return true;
+		}
+	}
+
+	// only then is it worth searching for a line exactly, so that no pair
+	// is ever marked hidden when some line does get through
+	return HasClearLine(cellA, cellB);
+}
+
+struct BakeTask
+{
+	SightGrid grid;
+	int cellBytes;
+	uint8_t* visible; // cellBytes per cell
+
+	void operator()(int begin, int end)
+	{
+		int numCells = grid.width * grid.height;
+		uint8_t* columns = new uint8_t[2 * grid.height];
+		for(int a = begin; a < end; ++a)
+		{
+			uint8_t* row = visible + a * cellBytes;
+
+			// from inside a wall everything counts as visible
+			if(grid.tiles[a] != 0)
+			{
+				for(int b = 0; b < numCells; ++b)
+					SET_BIT(row[b >> 3], b & 7);
+				continue;
+			}
+
+			// only the pairs after this cell, which get mirrored afterward,
+			// except walls since their own rows don't say anything
+			SET_BIT(row[a >> 3], a & 7);
+			for(int b = 0; b < numCells; ++b)
+			{
+				if((b > a || grid.tiles[b] != 0) && grid.HasOpenWalk(a, b, columns) && grid.CanSee(a, b))
+					SET_BIT(row[b >> 3], b & 7);
+			}
+		}
+		delete[] columns;
+	}
+};
+
+TilePVS::TilePVS():
+	width(0),
+	height(0),
+	cellSize(1.0f),
+	numStatics(0),
+	offsets(nullptr),
+	data(nullptr),
+	dataSize(0)
+{}
+
+TilePVS::~TilePVS()
+{
+	Clear();
+}
+
+void TilePVS::Clear()
+{
+	delete[] offsets;
+	delete[] data;
+	offsets = nullptr;
+	data = nullptr;
+	dataSize = 0;
+	width = 0;
+	height = 0;
+	numStatics = 0;
+}
+
+void TilePVS::Bake(const int* tiles, int width, int height, const vec3& origin, float cellSize,
+	const AABB* statics, int numStatics, JobPool* pool)
+{
+	Clear();
+	this->width = width;
+	this->height = height;
+	this->origin = origin;
+	this->cellSize = cellSize;
+	this->numStatics = numStatics;
+
+	int numCells = width * height;
+	int cellBytes = (numCells + 7) / 8;
+	int staticBytes = (numStatics + 7) / 8;
+
+	BakeTask task;
+	task.grid.tiles = tiles;
+	task.grid.width = width;
+	task.grid.height = height;
+	task.grid.solidSums = new int[(width + 1) * (height + 1)];
+	task.cellBytes = cellBytes;
+	task.visible = new uint8_t[numCells * cellBytes];
+	memset(task.visible, 0, numCells * cellBytes);
+
+	int* sums = task.grid.solidSums;
+	int stride = width + 1;
+	for(int x = 0; x <= width; ++x) sums[x] = 0;
+	for(int z = 0; z < height; ++z)
+	{
+		sums[(z + 1) * stride] = 0;
+		for(int x = 0; x < width; ++x)
+		{
+			sums[(z + 1) * stride + x + 1] = sums[z * stride + x + 1] + sums[(z + 1) * stride + x]
+				- sums[z * stride + x] + (tiles[z * width + x] != 0);
+		}
+	}
+
+	if(pool != nullptr)
+		pool->ParallelFor(numCells, 1, task);
+	else
+		task(0, numCells);
+
+	// sight goes both ways, so fill in the pairs that were skipped
+	for(int a = 0; a < numCells; ++a)
+	{
+		if(tiles[a] != 0) continue;
+		const uint8_t* row = task.visible + a * cellBytes;
+		for(int b = a + 1; b < numCells; ++b)
+		{
+			if(test_visible(row, b) && tiles[b] == 0)
+				SET_BIT(task.visible[b * cellBytes + (a >> 3)], a & 7);
+		}
+	}
+
+	// a static is visible from wherever any cell it covers is, and one that
+	// reaches off the grid might be seen from anywhere
+	uint8_t* staticBits = new uint8_t[numCells * staticBytes];
+	memset(staticBits, 0, numCells * staticBytes);
+	for(int i = 0; i < numStatics; ++i)
+	{
+		vec3 min = (statics[i].center - statics[i].extents - origin) / cellSize;
+		vec3 max = (statics[i].center + statics[i].extents - origin) / cellSize;
+		int x0 = int(floor(min.x)), z0 = int(floor(min.z));
+		int x1 = int(floor(max.x)), z1 = int(floor(max.z));
+		bool offGrid = x0 < 0 || z0 < 0 || x1 >= width || z1 >= height;
+
+		for(int a = 0; a < numCells; ++a)
+		{
+			const uint8_t* row = task.visible + a * cellBytes;
+			bool seen = offGrid;
+			for(int z = z0; z <= z1 && !seen; ++z)
+			{
+				for(int x = x0; x <= x1 && !seen; ++x)
+					seen = test_visible(row, z * width + x);
+			}
+			if(seen) SET_BIT(staticBits[a * staticBytes + (i >> 3)], i & 7);
+		}
+	}
+
+	// pack both sets of every cell one after another
+	uint8_t* packed = new uint8_t[2 * numCells * (cellBytes + staticBytes)];
+	offsets = new int[numCells + 1];
+	int size = 0;
+	for(int a = 0; a < numCells; ++a)
+	{
+		offsets[a] = size;
+		size += compress_bits(task.visible + a * cellBytes, cellBytes, packed + size);
+		size += compress_bits(staticBits + a * staticBytes, staticBytes, packed + size);
+	}
+	offsets[numCells] = size;
+
+	dataSize = size;
+	data = new uint8_t[size];
+	memcpy(data, packed, size);
+
+	delete[] packed;
+	delete[] task.grid.solidSums;
+	delete[] task.visible;
+	delete[] staticBits;
+}
+
+// Lookup......................................................................
+
+int TilePVS::GetCell(const vec3& position) const
+{
+	if(offsets == nullptr) return -1;
+
+	vec3 local = (position - origin) / cellSize;
+	int x = int(floor(local.x));
+	int z = int(floor(local.z));
+	if(x < 0 || z < 0 || x >= width || z >= height) return -1;
+	return z * width + x;
+}
+
+void TilePVS::Decompress(int cell, int set, uint8_t* bits) const
+{
+	int cellBytes = (width * height + 7) / 8;
+	int staticBytes = (numStatics + 7) / 8;
+
+	const uint8_t* in = data + offsets[cell];
+	if(set == 0)
+	{
+		decompress_bits(in, cellBytes, bits);
+	}
+	else
+	{
+		in = decompress_bits(in, cellBytes, nullptr);
+		decompress_bits(in, staticBytes, bits);
+	}
+}
+
+void TilePVS::GetVisibleCells(int cell, uint8_t* bits) const
+{
+	Decompress(cell, 0, bits);
+}
+
+void TilePVS::GetVisibleStatics(int cell, uint8_t* bits) const
+{
+	Decompress(cell, 1, bits);
+}
+
+// Map Data....................................................................
+
+// whether a cell's packed sets expand to exactly the right number of bytes
+// without reading past the end, so Decompress can trust them
+static bool check_bits(const uint8_t* in, const uint8_t* end, int numBytes, const uint8_t** next)
+{
+	for(int i = 0; i < numBytes;)
+	{
+		if(in >= end) return false;
+		if(*in != 0)
+		{
+			++in;
+			++i;
+			continue;
+		}
+		if(end - in < 2 || in[1] == 0 || in[1] > numBytes - i) return false;
+		i += in[1];
+		in += 2;
+	}
+	*next = in;
+	return true;
+}
+
+static const char* hexDigits = "0123456789ABCDEF";
+
+static int hex_value(char c)
+{
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+void TilePVS::Save(Textblock* mapBlock) const
+{
+	Textblock* block = new Textblock;
+	block->name = "Visibility";
+
+	char number[32];
+	String value;
+
+	int_to_string(width, number);
+	value = number;
+	block->Add_Attribute("width", &value, 1);
+
+	int_to_string(height, number);
+	value = number;
+	block->Add_Attribute("height", &value, 1);
+
+	String coordinates[3];
+	const float components[3] = { origin.x, origin.y, origin.z };
+	for(int i = 0; i < 3; ++i)
+	{
+		float_to_string(components[i], number);
+		coordinates[i] = number;
+	}
+	block->Add_Attribute("origin", coordinates, 3);
+
+	float_to_string(cellSize, number);
+	value = number;
+	block->Add_Attribute("cellSize", &value, 1);
+
+	int_to_string(numStatics, number);
+	value = number;
+	block->Add_Attribute("statics", &value, 1);
+
+	int numCells = width * height;
+	String* sets = new String[numCells];
+	char* hex = new char[2 * (offsets[numCells] - offsets[0]) + 1];
+	for(int i = 0; i < numCells; ++i)
+	{
+		int length = 0;
+		for(int j = offsets[i]; j < offsets[i + 1]; ++j)
+		{
+			hex[length++] = hexDigits[data[j] >> 4];
+			hex[length++] = hexDigits[data[j] & 0xF];
+		}
+		hex[length] = '\0';
+		sets[i] = hex;
+	}
+	block->Add_Attribute("sets", sets, numCells);
+	delete[] hex;
+	delete[] sets;
+
+	mapBlock->Remove_Child("Visibility");
+	mapBlock->Add_Child(block);
+}
+
+bool TilePVS::Load(const Textblock* mapBlock)
+{
+	Clear();
+
+	const Textblock* block = mapBlock->Get_Child_By_Name("Visibility");
+	if(block == nullptr) return false;
+
+	String* sets;
+	int numSets;
+	if(!block->Get_Attribute_As_Int("width"_id, &width)
+		|| !block->Get_Attribute_As_Int("height"_id, &height)
+		|| !block->Get_Attribute_As_Vec3("origin"_id, &origin)
+		|| !block->Get_Attribute_As_Float("cellSize"_id, &cellSize)
+		|| !block->Get_Attribute_As_Int("statics"_id, &numStatics)
+		|| !block->Get_Attribute_As_Strings("sets"_id, &sets, &numSets)
+		|| width <= 0 || height <= 0 || numStatics < 0 || cellSize <= 0.0f
+		|| numSets != width * height)
+	{
+		Clear();
+		return false;
+	}
+
+	int numCells = numSets;
+	offsets = new int[numCells + 1];
+	dataSize = 0;
+	for(int i = 0; i < numCells; ++i)
+	{
+		if(sets[i].Size() % 2 != 0)
+		{
+			Clear();
+			return false;
+		}
+		offsets[i] = dataSize;
+		dataSize += int(sets[i].Size()) / 2;
+	}
+	offsets[numCells] = dataSize;
+
+	data = new uint8_t[dataSize];
+	for(int i = 0; i < numCells; ++i)
+	{
+		const char* hex = sets[i].Data();
+		for(int j = offsets[i]; j < offsets[i + 1]; ++j, hex += 2)
+		{
+			int high = hex_value(hex[0]);
+			int low = hex_value(hex[1]);
+			if(high < 0 || low < 0)
+			{
+				Clear();
+				return false;
+			}
+			data[j] = high << 4 | low;
+		}
+	}
+
+	int cellBytes = (numCells + 7) / 8;
+	int staticBytes = (numStatics + 7) / 8;
+	for(int i = 0; i < numCells; ++i)
+	{
+		const uint8_t* in = data + offsets[i];
+		const uint8_t* end = data + offsets[i + 1];
+		if(!check_bits(in, end, cellBytes, &in)
+			|| !check_bits(in, end, staticBytes, &in)
+			|| in != end)
+		{
+			Clear();
+			return false;
+		}
+	}
+
+	return true;
+}
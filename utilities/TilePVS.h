@@ -0,0 +1,73 @@
+#ifndef TILE_PVS_H
+#define TILE_PVS_H
+
+#include "BitManipulation.h"
+#include "Collision.h"
+#include "DataTypes.h"
+
+class JobPool;
+class Textblock;
+
+// Potentially visible sets for a tile map, baked offline. For every cell of
+// the map's tile grid it records which other cells, and which static
+// entities, can be seen from anywhere inside that cell. Solid tiles block
+// sight, and a pair is only ever marked hidden when no line at all gets from
+// one cell to the other past them, so the sets can say too much but never
+// too little. Each set is a bitset packed with zero run-length encoding, since
+// most of a big map can't be seen from any one place. At runtime the
+// camera's cell gives a set to prefilter the render queue before frustum
+// culling, and anything outside the grid is treated as visible.
+
+class TilePVS
+{
+public:
+	TilePVS();
+	~TilePVS();
+
+	// tiles holds width * height values in rows along z, and any nonzero
+	// tile blocks sight. Cell (0, 0) starts at origin and cells are cellSize
+	// across in x and z. Statics are matched to the cells their bounds cover.
+	void Bake(const int* tiles, int width, int height, const vec3& origin, float cellSize,
+		const AABB* statics, int numStatics, JobPool* pool = nullptr);
+	void Clear();
+
+	// -1 when the position is outside the grid
+	int GetCell(const vec3& position) const;
+
+	// expand a cell's sets into plain bitsets, which need room for
+	// (GetCellCount() + 7) / 8 and (GetStaticCount() + 7) / 8 bytes
+	void GetVisibleCells(int cell, uint8_t* bits) const;
+	void GetVisibleStatics(int cell, uint8_t* bits) const;
+
+	int GetCellCount() const { return width * height; }
+	int GetStaticCount() const { return numStatics; }
+	int GetCompressedSize() const { return dataSize; }
+
+	// stored as a Visibility child of the map block, one hex string per cell.
+	// Load fails on any set that doesn't unpack to exactly the right size.
+	void Save(Textblock* mapBlock) const;
+	bool Load(const Textblock* mapBlock);
+
+private:
+	int width, height;
+	vec3 origin;
+	float cellSize;
+	int numStatics;
+
+	// both sets for cell i are packed back to back starting at offsets[i]
+	int* offsets;
+	uint8_t* data;
+	int dataSize;
+
+	TilePVS(const TilePVS&);
+	TilePVS& operator = (const TilePVS&);
+
+	void Decompress(int cell, int set, uint8_t* bits) const;
+};
+
+inline bool test_visible(const uint8_t* bits, int index)
+{
+	return CHECK_BIT(bits[index >> 3], index & 7) != 0;
+}
+
+#endif
@@ -0,0 +1,776 @@
+#include "TriangleBVH.h"
+
+#include "NumberMacros.h"
+
+#include <math.h>
+#include <float.h>
+
+struct TriangleBVH::BuildTriangle
+{
+	vec3 vertices[3];
+	vec3 min, max;
+	vec3 centroid;
+	int id;
+};
+
+static inline float component(const vec3& v, int axis)
+{
+	return (&v.x)[axis];
+}
+
+static float half_surface_area(const vec3& min, const vec3& max)
+{
+	vec3 d = max - min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+static vec3 triangle_normal(const vec3* triangle)
+{
+	vec3 n = cross(triangle[1] - triangle[0], triangle[2] - triangle[0]);
+	float area = length(n);
+	return (area > 0.0f) ? n / area : vec3(0.0f, 0.0f, 1.0f);
+}
+
+// two-sided Moller-Trumbore test which also reports the barycentric
+// coordinates of the hit
+static bool intersect_ray_triangle_uv(const vec3& origin, const vec3& direction, const vec3* triangle,
+	float maxDistance, float* distance, float* u, float* v)
+{
+	vec3 edge1 = triangle[1] - triangle[0];
+	vec3 edge2 = triangle[2] - triangle[0];
+
+	vec3 pvec = cross(direction, edge2);
+	float det = dot(edge1, pvec);
+	if(det == 0.0f) return false;
+	float inverseDet = 1.0f / det;
+
+	vec3 tvec = origin - triangle[0];
+	float a = dot(tvec, pvec) * inverseDet;
+	if(a < 0.0f || a > 1.0f) return false;
+
+	vec3 qvec = cross(tvec, edge1);
+	float b = dot(direction, qvec) * inverseDet;
+	if(b < 0.0f || a + b > 1.0f) return false;
+
+	float t = dot(edge2, qvec) * inverseDet;
+	if(t < 0.0f || t >= maxDistance) return false;
+
+	*distance = t;
+	*u = a;
+	*v = b;
+	return true;
+}
+
+// slab test against node bounds grown by inflate on every side
+static bool intersect_ray_box(const float* min, const float* max, const vec3& origin, const vec3& inverse,
+	float inflate, float maxDistance)
+{
+	float t0x = (min[0] - inflate - origin.x) * inverse.x;
+	float t1x = (max[0] + inflate - origin.x) * inverse.x;
+	float t0y = (min[1] - inflate - origin.y) * inverse.y;
+	float t1y = (max[1] + inflate - origin.y) * inverse.y;
+	float t0z = (min[2] - inflate - origin.z) * inverse.z;
+	float t1z = (max[2] + inflate - origin.z) * inverse.z;
+
+	float tNear = fmax(fmax(fmin(t0x, t1x), fmin(t0y, t1y)), fmin(t0z, t1z));
+	float tFar = fmin(fmin(fmax(t0x, t1x), fmax(t0y, t1y)), fmax(t0z, t1z));
+	return tNear <= tFar && tFar >= 0.0f && tNear <= maxDistance;
+}
+
+TriangleBVH::TriangleBVH():
+	nodes(nullptr),
+	nodeCount(0),
+	vertices(nullptr),
+	triangleIds(nullptr),
+	triangleCount(0)
+{}
+
+TriangleBVH::~TriangleBVH()
+{
+	Clear();
+}
+
+void TriangleBVH::Clear()
+{
+	delete[] nodes;
+	delete[] vertices;
+	delete[] triangleIds;
+	nodes = nullptr;
+	vertices = nullptr;
+	triangleIds = nullptr;
+	nodeCount = 0;
+	triangleCount = 0;
+}
+
+template<typename IndexType>
+void TriangleBVH::BuildIndexed(const vec3* positions, int numVertices, const IndexType* indices, int numIndices)
+{
+	uint32_t limit = numVertices;
+	int count = 0;
+	BuildTriangle* triangles = new BuildTriangle[numIndices / 3];
+	for(int i = 0; i < numIndices / 3; ++i)
+	{
+		const IndexType* corners = indices + 3 * i;
+		if(corners[0] >= limit || corners[1] >= limit || corners[2] >= limit)
+			continue;
+
+		BuildTriangle& triangle = triangles[count++];
+		for(int j = 0; j < 3; ++j)
+			triangle.vertices[j] = positions[corners[j]];
+
+		const vec3* v = triangle.vertices;
+		triangle.min = vec3(MIN(MIN(v[0].x, v[1].x), v[2].x), MIN(MIN(v[0].y, v[1].y), v[2].y), MIN(MIN(v[0].z, v[1].z), v[2].z));
+		triangle.max = vec3(MAX(MAX(v[0].x, v[1].x), v[2].x), MAX(MAX(v[0].y, v[1].y), v[2].y), MAX(MAX(v[0].z, v[1].z), v[2].z));
+		triangle.centroid = (triangle.min + triangle.max) * 0.5f;
+		triangle.id = i;
+	}
+	BuildFromTriangles(triangles, count);
+	delete[] triangles;
+}
+
+void TriangleBVH::Build(const vec3* positions, int numVertices, const uint32_t* indices, int numIndices)
+{
+	BuildIndexed(positions, numVertices, indices, numIndices);
+}
+
+void TriangleBVH::Build(const vec3* positions, int numVertices, const uint16_t* indices, int numIndices)
+{
+	BuildIndexed(positions, numVertices, indices, numIndices);
+}
+
+void TriangleBVH::BuildFromTriangles(BuildTriangle* triangles, int count)
+{
+	Clear();
+	if(count == 0) return;
+
+	// a binary tree with at least one triangle per leaf never needs more
+	// than this many nodes
+	nodes = new Node[2 * count - 1];
+	nodeCount = 1;
+	Subdivide(triangles, 0, 0, count, 0);
+
+	// copy triangles out in leaf order
+	triangleCount = count;
+	vertices = new vec3[3 * count];
+	triangleIds = new int[count];
+	for(int i = 0; i < count; ++i)
+	{
+		vertices[3 * i + 0] = triangles[i].vertices[0];
+		vertices[3 * i + 1] = triangles[i].vertices[1];
+		vertices[3 * i + 2] = triangles[i].vertices[2];
+		triangleIds[i] = triangles[i].id;
+	}
+}
+
+void TriangleBVH::Subdivide(BuildTriangle* triangles, int nodeIndex, int start, int end, int depth)
+{
+	int count = end - start;
+
+	vec3 boundsMin = triangles[start].min;
+	vec3 boundsMax = triangles[start].max;
+	vec3 centroidMin = triangles[start].centroid;
+	vec3 centroidMax = triangles[start].centroid;
+	for(int i = start + 1; i < end; ++i)
+	{
+		const BuildTriangle& t = triangles[i];
+		boundsMin = vec3(MIN(boundsMin.x, t.min.x), MIN(boundsMin.y, t.min.y), MIN(boundsMin.z, t.min.z));
+		boundsMax = vec3(MAX(boundsMax.x, t.max.x), MAX(boundsMax.y, t.max.y), MAX(boundsMax.z, t.max.z));
+		centroidMin = vec3(MIN(centroidMin.x, t.centroid.x), MIN(centroidMin.y, t.centroid.y), MIN(centroidMin.z, t.centroid.z));
+		centroidMax = vec3(MAX(centroidMax.x, t.centroid.x), MAX(centroidMax.y, t.centroid.y), MAX(centroidMax.z, t.centroid.z));
+	}
+
+	Node& node = nodes[nodeIndex];
+	for(int i = 0; i < 3; ++i)
+	{
+		node.min[i] = component(boundsMin, i);
+		node.max[i] = component(boundsMax, i);
+	}
+	node.axis = 0;
+	node.pad = 0;
+
+	// find the cheapest of the planes between bins on every axis
+	int bestAxis = -1;
+	int bestBin = 0;
+	float bestCost = FLT_MAX;
+	if(count > 1 && depth < MAX_DEPTH - 1)
+	{
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			float low = component(centroidMin, axis);
+			float extent = component(centroidMax, axis) - low;
+			if(extent <= 0.0f) continue;
+			float scale = NUM_BINS / extent * 0.99999f;
+
+			int binCounts[NUM_BINS] = {};
+			vec3 binMin[NUM_BINS], binMax[NUM_BINS];
+			for(int i = 0; i < NUM_BINS; ++i)
+			{
+				binMin[i] = vec3(FLT_MAX);
+				binMax[i] = vec3(-FLT_MAX);
+			}
+			for(int i = start; i < end; ++i)
+			{
+				const BuildTriangle& t = triangles[i];
+				int bin = MIN(int((component(t.centroid, axis) - low) * scale), NUM_BINS - 1);
+				binCounts[bin]++;
+				binMin[bin] = vec3(MIN(binMin[bin].x, t.min.x), MIN(binMin[bin].y, t.min.y), MIN(binMin[bin].z, t.min.z));
+				binMax[bin] = vec3(MAX(binMax[bin].x, t.max.x), MAX(binMax[bin].y, t.max.y), MAX(binMax[bin].z, t.max.z));
+			}
+
+			// sweep from the left then the right to get both sides of each plane
+			float leftArea[NUM_BINS - 1];
+			int leftCount[NUM_BINS - 1];
+			vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+			int sweepCount = 0;
+			for(int i = 0; i < NUM_BINS - 1; ++i)
+			{
+				sweepCount += binCounts[i];
+				if(binCounts[i] > 0)
+				{
+					sweepMin = vec3(MIN(sweepMin.x, binMin[i].x), MIN(sweepMin.y, binMin[i].y), MIN(sweepMin.z, binMin[i].z));
+					sweepMax = vec3(MAX(sweepMax.x, binMax[i].x), MAX(sweepMax.y, binMax[i].y), MAX(sweepMax.z, binMax[i].z));
+				}
+				leftCount[i] = sweepCount;
+				leftArea[i] = (sweepCount > 0) ? half_surface_area(sweepMin, sweepMax) : 0.0f;
+			}
+
+			sweepMin = vec3(FLT_MAX);
+			sweepMax = vec3(-FLT_MAX);
+			sweepCount = 0;
+			for(int i = NUM_BINS - 1; i > 0; --i)
+			{
+				sweepCount += binCounts[i];
+				if(binCounts[i] > 0)
+				{
+					sweepMin = vec3(MIN(sweepMin.x, binMin[i].x), MIN(sweepMin.y, binMin[i].y), MIN(sweepMin.z, binMin[i].z));
+					sweepMax = vec3(MAX(sweepMax.x, binMax[i].x), MAX(sweepMax.y, binMax[i].y), MAX(sweepMax.z, binMax[i].z));
+				}
+				if(sweepCount == 0 || leftCount[i - 1] == 0) continue;
+
+				float cost = leftArea[i - 1] * leftCount[i - 1] + half_surface_area(sweepMin, sweepMax) * sweepCount;
+				if(cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+	}
+
+	// stop splitting once a leaf would be cheaper to test than the two halves
+	// plus the cost of stepping into them
+	const float traversalCost = 1.0f;
+	float leafCost = half_surface_area(boundsMin, boundsMax) * count;
+	float splitCost = half_surface_area(boundsMin, boundsMax) * traversalCost + bestCost;
+	bool makeLeaf = count == 1 || depth >= MAX_DEPTH - 1
+		|| (count <= MAX_LEAF_TRIANGLES && splitCost >= leafCost);
+
+	int middle = start;
+	if(!makeLeaf && bestAxis >= 0)
+	{
+		float low = component(centroidMin, bestAxis);
+		float extent = component(centroidMax, bestAxis) - low;
+		float scale = NUM_BINS / extent * 0.99999f;
+
+		int i = start;
+		int j = end - 1;
+		while(i <= j)
+		{
+			int bin = MIN(int((component(triangles[i].centroid, bestAxis) - low) * scale), NUM_BINS - 1);
+			if(bin < bestBin)
+			{
+				++i;
+			}
+			else
+			{
+				BuildTriangle temp = triangles[i];
+				triangles[i] = triangles[j];
+				triangles[j] = temp;
+				--j;
+			}
+		}
+		middle = i;
+		node.axis = bestAxis;
+	}
+
+	if(!makeLeaf && (middle == start || middle == end))
+	{
+		// all the centroids coincide, so any split of the list is as good
+		middle = start + count / 2;
+		vec3 extents = boundsMax - boundsMin;
+		node.axis = (extents.x > extents.y && extents.x > extents.z) ? 0 : (extents.y > extents.z) ? 1 : 2;
+	}
+
+	if(makeLeaf)
+	{
+		node.offset = start;
+		node.count = count;
+		return;
+	}
+
+	// the left child follows its parent directly, the right child comes after
+	// the whole left subtree
+	node.count = 0;
+	int left = nodeCount++;
+	Subdivide(triangles, left, start, middle, depth + 1);
+	int right = nodeCount++;
+	nodes[nodeIndex].offset = right;
+	Subdivide(triangles, right, middle, end, depth + 1);
+}
+
+AABB TriangleBVH::GetBounds() const
+{
+	AABB bounds;
+	if(nodeCount == 0)
+	{
+		bounds.center = VEC3_ZERO;
+		bounds.extents = VEC3_ZERO;
+		return bounds;
+	}
+
+	vec3 min(nodes[0].min[0], nodes[0].min[1], nodes[0].min[2]);
+	vec3 max(nodes[0].max[0], nodes[0].max[1], nodes[0].max[2]);
+	bounds.center = (min + max) * 0.5f;
+	bounds.extents = (max - min) * 0.5f;
+	return bounds;
+}
+
+bool TriangleBVH::IntersectRay(const Ray& ray, RayHit* hit) const
+{
+	hit->distance = ray.maxDistance;
+	hit->triangle = -1;
+	if(nodeCount == 0) return false;
+
+	vec3 inverse = 1.0f / ray.direction;
+	bool negative[3] = { ray.direction.x < 0.0f, ray.direction.y < 0.0f, ray.direction.z < 0.0f };
+
+	int stack[2 * MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const Node& node = nodes[stack[--top]];
+		if(!intersect_ray_box(node.min, node.max, ray.origin, inverse, 0.0f, hit->distance)) continue;
+
+		if(node.IsLeaf())
+		{
+			for(int i = node.offset, end = node.offset + node.count; i < end; ++i)
+			{
+				float distance, u, v;
+				if(intersect_ray_triangle_uv(ray.origin, ray.direction, vertices + 3 * i, hit->distance, &distance, &u, &v))
+				{
+					hit->distance = distance;
+					hit->triangle = triangleIds[i];
+					hit->u = u;
+					hit->v = v;
+				}
+			}
+		}
+		else
+		{
+			// push the far child first so the near one is visited first
+			int index = int(&node - nodes);
+			int near = index + 1;
+			int far = node.offset;
+			if(negative[node.axis])
+			{
+				near = node.offset;
+				far = index + 1;
+			}
+			stack[top++] = far;
+			stack[top++] = near;
+		}
+	}
+
+	return hit->triangle != -1;
+}
+
+bool TriangleBVH::IntersectRayAny(const Ray& ray) const
+{
+	if(nodeCount == 0) return false;
+
+	vec3 inverse = 1.0f / ray.direction;
+
+	int stack[2 * MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		int index = stack[--top];
+		const Node& node = nodes[index];
+		if(!intersect_ray_box(node.min, node.max, ray.origin, inverse, 0.0f, ray.maxDistance)) continue;
+
+		if(node.IsLeaf())
+		{
+			for(int i = node.offset, end = node.offset + node.count; i < end; ++i)
+			{
+				float distance, u, v;
+				if(intersect_ray_triangle_uv(ray.origin, ray.direction, vertices + 3 * i, ray.maxDistance, &distance, &u, &v))
+					return true;
+			}
+		}
+		else
+		{
+			stack[top++] = node.offset;
+			stack[top++] = index + 1;
+		}
+	}
+
+	return false;
+}
+
+void TriangleBVH::IntersectRays(const Ray* rays, int count, RayHit* hits) const
+{
+	const int PACKET_SIZE = 4;
+
+	for(int base = 0; base < count; base += PACKET_SIZE)
+	{
+		int packetSize = MIN(PACKET_SIZE, count - base);
+		const Ray* packet = rays + base;
+		RayHit* packetHits = hits + base;
+
+		vec3 inverses[PACKET_SIZE];
+		for(int i = 0; i < packetSize; ++i)
+		{
+			inverses[i] = 1.0f / packet[i].direction;
+			packetHits[i].distance = packet[i].maxDistance;
+			packetHits[i].triangle = -1;
+		}
+		if(nodeCount == 0) continue;
+
+		// each stack entry carries the mask of rays still active below it in
+		// its low bits
+		int stack[2 * MAX_DEPTH];
+		int top = 0;
+		stack[top++] = (1 << packetSize) - 1;
+		while(top > 0)
+		{
+			int entry = stack[--top];
+			int index = entry >> PACKET_SIZE;
+			const Node& node = nodes[index];
+
+			int active = 0;
+			for(int i = 0; i < packetSize; ++i)
+			{
+				if(entry & (1 << i) && intersect_ray_box(node.min, node.max, packet[i].origin, inverses[i], 0.0f, packetHits[i].distance))
+					active |= 1 << i;
+			}
+			if(active == 0) continue;
+
+			if(node.IsLeaf())
+			{
+				for(int t = node.offset, end = node.offset + node.count; t < end; ++t)
+				{
+					const vec3* triangle = vertices + 3 * t;
+					for(int i = 0; i < packetSize; ++i)
+					{
+						if(!(active & (1 << i))) continue;
+
+						float distance, u, v;
+						if(intersect_ray_triangle_uv(packet[i].origin, packet[i].direction, triangle, packetHits[i].distance, &distance, &u, &v))
+						{
+							packetHits[i].distance = distance;
+							packetHits[i].triangle = triangleIds[t];
+							packetHits[i].u = u;
+							packetHits[i].v = v;
+						}
+					}
+				}
+			}
+			else
+			{
+				// order the children by the direction of the first active ray
+				int first = 0;
+				while(!(active & (1 << first))) ++first;
+
+				int near = index + 1;
+				int far = node.offset;
+				if(component(packet[first].direction, node.axis) < 0.0f)
+				{
+					near = node.offset;
+					far = index + 1;
+				}
+				stack[top++] = far << PACKET_SIZE | active;
+				stack[top++] = near << PACKET_SIZE | active;
+			}
+		}
+	}
+}
+
+template<typename TriangleCallback>
+void TriangleBVH::QueryBox(const vec3& min, const vec3& max, TriangleCallback& callback) const
+{
+	if(nodeCount == 0) return;
+
+	int stack[2 * MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		int index = stack[--top];
+		const Node& node = nodes[index];
+		if(node.min[0] > max.x || node.max[0] < min.x
+		|| node.min[1] > max.y || node.max[1] < min.y
+		|| node.min[2] > max.z || node.max[2] < min.z)
+			continue;
+
+		if(node.IsLeaf())
+		{
+			for(int i = node.offset, end = node.offset + node.count; i < end; ++i)
+			{
+				if(!callback(i)) return;
+			}
+		}
+		else
+		{
+			stack[top++] = node.offset;
+			stack[top++] = index + 1;
+		}
+	}
+}
+
+int TriangleBVH::OverlapSphere(const Sphere& sphere, TriangleContact* contacts, int maxContacts) const
+{
+	struct SphereOverlap
+	{
+		const vec3* vertices;
+		const int* triangleIds;
+		Sphere sphere;
+		TriangleContact* contacts;
+		int maxContacts;
+		int found;
+
+		bool operator()(int index)
+		{
+			const vec3* triangle = vertices + 3 * index;
+			vec3 closest = closest_point_on_triangle(sphere.position, triangle[0], triangle[1], triangle[2]);
+			vec3 d = sphere.position - closest;
+			float distanceSquared = dot(d, d);
+			if(distanceSquared > sphere.radius * sphere.radius) return true;
+
+			float distance = sqrt(distanceSquared);
+			TriangleContact& contact = contacts[found++];
+			contact.point = closest;
+			contact.normal = (distance > 1.0e-6f) ? d / distance : triangle_normal(triangle);
+			contact.depth = sphere.radius - distance;
+			contact.triangle = triangleIds[index];
+			return found < maxContacts;
+		}
+	};
+
+	if(maxContacts <= 0) return 0;
+
+	SphereOverlap overlap;
+	overlap.vertices = vertices;
+	overlap.triangleIds = triangleIds;
+	overlap.sphere = sphere;
+	overlap.contacts = contacts;
+	overlap.maxContacts = maxContacts;
+	overlap.found = 0;
+	QueryBox(sphere.position - sphere.radius, sphere.position + sphere.radius, overlap);
+	return overlap.found;
+}
+
+int TriangleBVH::OverlapCapsule(const Capsule& capsule, TriangleContact* contacts, int maxContacts) const
+{
+	struct CapsuleOverlap
+	{
+		const vec3* vertices;
+		const int* triangleIds;
+		Capsule capsule;
+		TriangleContact* contacts;
+		int maxContacts;
+		int found;
+
+		bool operator()(int index)
+		{
+			const vec3* triangle = vertices + 3 * index;
+			vec3 onSegment, onTriangle;
+			float distanceSquared = closest_points_segment_triangle(capsule.start, capsule.end,
+				triangle[0], triangle[1], triangle[2], &onSegment, &onTriangle);
+			if(distanceSquared > capsule.radius * capsule.radius) return true;
+
+			TriangleContact& contact = contacts[found++];
+			contact.point = onTriangle;
+			contact.triangle = triangleIds[index];
+
+			float distance = sqrt(distanceSquared);
+			if(distance > 1.0e-6f)
+			{
+				contact.normal = (onSegment - onTriangle) / distance;
+				contact.depth = capsule.radius - distance;
+			}
+			else
+			{
+				// the segment passes through the triangle, so push back toward
+				// whichever side its start lies on, far enough to clear the end
+				vec3 n = triangle_normal(triangle);
+				if(dot(capsule.start - triangle[0], n) < 0.0f) n = -n;
+				contact.normal = n;
+				contact.depth = capsule.radius - MIN(dot(capsule.end - triangle[0], n), 0.0f);
+			}
+			return found < maxContacts;
+		}
+	};
+
+	if(maxContacts <= 0) return 0;
+
+	vec3 min(MIN(capsule.start.x, capsule.end.x), MIN(capsule.start.y, capsule.end.y), MIN(capsule.start.z, capsule.end.z));
+	vec3 max(MAX(capsule.start.x, capsule.end.x), MAX(capsule.start.y, capsule.end.y), MAX(capsule.start.z, capsule.end.z));
+
+	CapsuleOverlap overlap;
+	overlap.vertices = vertices;
+	overlap.triangleIds = triangleIds;
+	overlap.capsule = capsule;
+	overlap.contacts = contacts;
+	overlap.maxContacts = maxContacts;
+	overlap.found = 0;
+	QueryBox(min - capsule.radius, max + capsule.radius, overlap);
+	return overlap.found;
+}
+
+bool TriangleBVH::SweepSphere(const Sphere& sphere, const vec3& motion, float* t, TriangleContact* contact) const
+{
+	if(nodeCount == 0) return false;
+
+	// the sphere's centre traces a ray, which hits the nodes grown by the radius
+	vec3 inverse = 1.0f / motion;
+	float best = 1.0f;
+	bool found = false;
+
+	int stack[2 * MAX_DEPTH];
+	int top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		int index = stack[--top];
+		const Node& node = nodes[index];
+		if(!intersect_ray_box(node.min, node.max, sphere.position, inverse, sphere.radius, best)) continue;
+
+		if(node.IsLeaf())
+		{
+			for(int i = node.offset, end = node.offset + node.count; i < end; ++i)
+			{
+				const vec3* triangle = vertices + 3 * i;
+				float hitTime;
+				vec3 point, normal;
+				if(sweep_sphere_triangle(sphere, motion, triangle[0], triangle[1], triangle[2], &hitTime, &point, &normal)
+					&& (!found || hitTime < best))
+				{
+					best = hitTime;
+					found = true;
+					contact->point = point;
+					contact->normal = normal;
+					contact->triangle = triangleIds[i];
+				}
+			}
+		}
+		else
+		{
+			int near = index + 1;
+			int far = node.offset;
+			if(component(motion, node.axis) < 0.0f)
+			{
+				near = node.offset;
+				far = index + 1;
+			}
+			stack[top++] = far;
+			stack[top++] = near;
+		}
+	}
+
+	if(found)
+	{
+		*t = best;
+
+		// only a sphere which starts out overlapping has any depth
+		vec3 d = sphere.position + best * motion - contact->point;
+		contact->depth = MAX(sphere.radius - length(d), 0.0f);
+	}
+	return found;
+}
+
+bool TriangleBVH::SweepCapsule(const Capsule& capsule, const vec3& motion, float* t, TriangleContact* contact) const
+{
+	// conservative advancement: step the capsule forward by the time it takes
+	// to close the current gap along the separating direction, which can
+	// never overshoot for a convex shape that only translates
+	struct CapsuleSweep
+	{
+		const vec3* vertices;
+		const int* triangleIds;
+		Capsule capsule;
+		vec3 motion;
+		float best;
+		bool found;
+		TriangleContact* contact;
+
+		bool operator()(int index)
+		{
+			const int MAX_ITERATIONS = 32;
+			const float tolerance = 1.0e-4f;
+
+			const vec3* triangle = vertices + 3 * index;
+			float time = 0.0f;
+			for(int i = 0; i < MAX_ITERATIONS; ++i)
+			{
+				vec3 offset = motion * time;
+				vec3 onSegment, onTriangle;
+				float distance = sqrt(closest_points_segment_triangle(capsule.start + offset, capsule.end + offset,
+					triangle[0], triangle[1], triangle[2], &onSegment, &onTriangle));
+				float gap = distance - capsule.radius;
+
+				vec3 n;
+				if(distance > 1.0e-6f)
+				{
+					n = (onSegment - onTriangle) / distance;
+				}
+				else
+				{
+					n = triangle_normal(triangle);
+					if(dot(motion, n) > 0.0f) n = -n;
+				}
+
+				// running out of iterations means it's still closing in on a
+				// graze that may never touch, so that isn't a hit
+				if(gap <= tolerance)
+				{
+					best = time;
+					found = true;
+					contact->point = onTriangle;
+					contact->normal = n;
+					contact->depth = MAX(-gap, 0.0f);
+					contact->triangle = triangleIds[index];
+					break;
+				}
+
+				// moving apart means the two can't meet
+				float approach = -dot(motion, n);
+				if(approach <= 0.0f) break;
+
+				time += gap / approach;
+				if(time > best) break;
+			}
+			return true;
+		}
+	};
+
+	vec3 start(MIN(capsule.start.x, capsule.end.x), MIN(capsule.start.y, capsule.end.y), MIN(capsule.start.z, capsule.end.z));
+	vec3 end(MAX(capsule.start.x, capsule.end.x), MAX(capsule.start.y, capsule.end.y), MAX(capsule.start.z, capsule.end.z));
+	vec3 min = vec3(MIN(start.x, start.x + motion.x), MIN(start.y, start.y + motion.y), MIN(start.z, start.z + motion.z));
+	vec3 max = vec3(MAX(end.x, end.x + motion.x), MAX(end.y, end.y + motion.y), MAX(end.z, end.z + motion.z));
+
+	CapsuleSweep sweep;
+	sweep.vertices = vertices;
+	sweep.triangleIds = triangleIds;
+	sweep.capsule = capsule;
+	sweep.motion = motion;
+	sweep.best = 1.0f;
+	sweep.found = false;
+	sweep.contact = contact;
+	QueryBox(min - capsule.radius, max + capsule.radius, sweep);
+
+	if(sweep.found) *t = sweep.best;
+	return sweep.found;
+}
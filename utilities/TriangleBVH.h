@@ -0,0 +1,99 @@
+#ifndef TRIANGLE_BVH_H
+#define TRIANGLE_BVH_H
+
+#include "Collision.h"
+#include "DataTypes.h"
+
+// Static bounding volume hierarchy over a triangle mesh, for picking, line of
+// sight and character collision against level geometry. It's built once with
+// binned surface area heuristic splits and laid out depth-first, so a node's
+// left child always directly follows it and only the right child's index has
+// to be stored. Triangles are copied into leaf order so a leaf's vertices are
+// contiguous in memory.
+
+struct RayHit
+{
+	float distance;
+	int triangle; // -1 on a miss
+	float u, v;   // barycentric coordinates of the hit
+};
+
+struct TriangleContact
+{
+	vec3 point;  // on the triangle
+	vec3 normal; // points from the triangle toward the query shape
+	float depth;
+	int triangle;
+};
+
+class TriangleBVH
+{
+public:
+	TriangleBVH();
+	~TriangleBVH();
+
+	// triangles are reported by their position in the index list divided by
+	// 3, and any with an index past numVertices are left out
+	void Build(const vec3* positions, int numVertices, const uint32_t* indices, int numIndices);
+	void Build(const vec3* positions, int numVertices, const uint16_t* indices, int numIndices);
+
+	bool IntersectRay(const Ray& ray, RayHit* hit) const;
+	bool IntersectRayAny(const Ray& ray) const;
+
+	// traces rays four at a time down the tree, sharing each node fetch
+	// between them, which pays off when the rays are coherent
+	void IntersectRays(const Ray* rays, int count, RayHit* hits) const;
+
+	// these fill at most maxContacts and return how many were found
+	int OverlapSphere(const Sphere& sphere, TriangleContact* contacts, int maxContacts) const;
+	int OverlapCapsule(const Capsule& capsule, TriangleContact* contacts, int maxContacts) const;
+
+	// t is the fraction of motion travelled before first contact
+	bool SweepSphere(const Sphere& sphere, const vec3& motion, float* t, TriangleContact* contact) const;
+	bool SweepCapsule(const Capsule& capsule, const vec3& motion, float* t, TriangleContact* contact) const;
+
+	AABB GetBounds() const;
+	int GetTriangleCount() const { return triangleCount; }
+	int GetNodeCount() const { return nodeCount; }
+
+private:
+	// interior nodes store the index of their right child in offset, and
+	// leaves store their first triangle with a nonzero count
+	struct Node
+	{
+		float min[3];
+		float max[3];
+		int32_t offset;
+		uint16_t count;
+		uint8_t axis;
+		uint8_t pad;
+
+		bool IsLeaf() const { return count != 0; }
+	};
+
+	struct BuildTriangle;
+
+	static const int MAX_DEPTH = 64;
+	static const int MAX_LEAF_TRIANGLES = 4;
+	static const int NUM_BINS = 16;
+
+	Node* nodes;
+	int nodeCount;
+	vec3* vertices;
+	int* triangleIds;
+	int triangleCount;
+
+	TriangleBVH(const TriangleBVH&);
+	TriangleBVH& operator = (const TriangleBVH&);
+
+	void Clear();
+	template<typename IndexType>
+	void BuildIndexed(const vec3* positions, int numVertices, const IndexType* indices, int numIndices);
+	void BuildFromTriangles(BuildTriangle* triangles, int count);
+	void Subdivide(BuildTriangle* triangles, int nodeIndex, int start, int end, int depth);
+
+	template<typename TriangleCallback>
+	void QueryBox(const vec3& min, const vec3& max, TriangleCallback& callback) const;
+};
+
+#endif
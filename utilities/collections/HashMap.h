@@ -18,6 +18,7 @@ public:
 		values = (T*) ::operator new[](sizeof(T) * initialCapacity);
 		keys = new char*[initialCapacity];
 		memset(keys, 0, sizeof(char*) * initialCapacity);
+		hashes = new uint64_t[initialCapacity];
 	}
 
 	~HashMap()
@@ -30,31 +31,35 @@ public:
 		::operator delete[](values);
 
 		delete[] keys;
+		delete[] hashes;
 	}
 
 	void Add(const char* key, const T& value)
 	{
-		size_t index = Hash_Key(key);
+		uint64_t hash = Hash_String(key);
+		size_t index = Hash_Key(key, hash);
 		if(index >= capacity)
 		{
 			Rehash();
-			index = Hash_Key(key);
+			index = Hash_Key(key, hash);
 		}
 
 		new(&values[index]) T(value);
 		keys[index] = (char*) key;
+		hashes[index] = hash;
 		++count;
 	}
 
 	T* Get(const char* key)
 	{
 		// find key
-		uint32_t curr = Hash_String(key);
+		uint64_t hash = Hash_String(key);
+		size_t curr = hash % capacity;
 
 		// linear probing, if necessary
 		for(int i = 0; i < MAX_CHAIN_LENGTH; ++i)
 		{
-			if(keys[curr] != nullptr && strcmp(keys[curr], key) == 0)
+			if(Matches(curr, key, hash))
 				return &values[curr];
 
 			curr = (curr + 1) % capacity;
@@ -66,12 +71,13 @@ public:
 	bool Remove(const char* key)
 	{
 		// find key
-		uint32_t curr = Hash_String(key);
+		uint64_t hash = Hash_String(key);
+		size_t curr = hash % capacity;
 
 		// linear probing, if necessary
 		for(int i = 0; i < MAX_CHAIN_LENGTH; ++i)
 		{
-			if(keys[curr] != nullptr && strcmp(keys[curr], key) == 0)
+			if(Matches(curr, key, hash))
 			{
 				// empty the bucket
 				keys[curr] = nullptr;
@@ -90,22 +96,28 @@ private:
 	static const int MAX_CHAIN_LENGTH = 8;
 
 	char** keys;
+	uint64_t* hashes; // of each key, so most mismatches skip the strcmp
 	T* values;
 	size_t capacity;
 	size_t count;
 
-	uint32_t Hash_String(const char* s)
+	uint64_t Hash_String(const char* s)
 	{
-		return murmur_hash(s, strlen(s), 0) % capacity;
+		return hash_64(s, strlen(s));
 	}
 
-	size_t Hash_Key(const char* key)
+	bool Matches(size_t index, const char* key, uint64_t hash)
+	{
+		return keys[index] != nullptr && hashes[index] == hash && strcmp(keys[index], key) == 0;
+	}
+
+	size_t Hash_Key(const char* key, uint64_t hash)
 	{
 		// if full, return immediately
 		if(count >= capacity / 2) return capacity;
 
 		// find the best index
-		uint32_t curr = Hash_String(key);
+		size_t curr = hash % capacity;
 
 		// linear probing
 		for(int i = 0; i < MAX_CHAIN_LENGTH; ++i)
@@ -113,7 +125,7 @@ private:
 			if(keys[curr] == nullptr)
 				return curr;
 
-			if(keys[curr] != nullptr && strcmp(keys[curr], key) == 0)
+			if(Matches(curr, key, hash))
 				return curr;
 
 			curr = (curr + 1) % capacity;
@@ -136,6 +148,9 @@ private:
 		keys = new char*[capacity];
 		memset(keys, 0, sizeof(char*) * capacity);
 
+		uint64_t* old_hashes = hashes;
+		hashes = new uint64_t[capacity];
+
 		// Rehash the elements
 		count = 0;
 		for(size_t i = 0; i < old_size; ++i)
@@ -154,6 +169,7 @@ private:
 		::operator delete[](old_values);
 
 		delete[] old_keys;
+		delete[] old_hashes;
 	}
 };
 
@@ -0,0 +1,171 @@
+#include "JobPool.h"
+
+#include "Interlocked.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#elif defined(__unix__)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+static const int MAX_WORKERS = 63;
+
+static int count_processors()
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif defined(__unix__)
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	return 1;
+#endif
+}
+
+static int pick_worker_count(int numThreads)
+{
+	if(numThreads <= 0) numThreads = count_processors();
+	int workers = numThreads - 1;
+	if(workers < 0) workers = 0;
+	if(workers > MAX_WORKERS) workers = MAX_WORKERS;
+	return workers;
+}
+
+struct JobPoolWorker
+{
+	static void Main(JobPool* pool) { pool->WorkerLoop(); }
+};
+
+#if defined(_WIN32)
+
+static DWORD WINAPI worker_main(LPVOID parameter)
+{
+	JobPoolWorker::Main((JobPool*) parameter);
+	return 0;
+}
+
+static void* start_thread(JobPool* pool)
+{
+	return CreateThread(NULL, 0, worker_main, pool, 0, NULL);
+}
+
+static void join_thread(void* thread)
+{
+	WaitForSingleObject((HANDLE) thread, INFINITE);
+	CloseHandle((HANDLE) thread);
+}
+
+#elif defined(__unix__)
+
+static void* worker_main(void* parameter)
+{
+	JobPoolWorker::Main((JobPool*) parameter);
+	return nullptr;
+}
+
+static void* start_thread(JobPool* pool)
+{
+	pthread_t* thread = new pthread_t;
+	pthread_create(thread, NULL, worker_main, pool);
+	return thread;
+}
+
+static void join_thread(void* thread)
+{
+	pthread_join(*(pthread_t*) thread, NULL);
+	delete (pthread_t*) thread;
+}
+
+#endif
+
+JobPool::JobPool(int numThreads):
+	numWorkers(pick_worker_count(numThreads)),
+	threads(nullptr),
+	startSignal(MAX_WORKERS),
+	doneSignal(MAX_WORKERS),
+	function(nullptr),
+	data(nullptr),
+	count(0),
+	grainSize(1),
+	nextChunk(0),
+	quit(false)
+{
+	threads = new void*[numWorkers + 1];
+	for(int i = 0; i < numWorkers; ++i)
+		threads[i] = start_thread(this);
+}
+
+JobPool::~JobPool()
+{
+	quit = true;
+	for(int i = 0; i < numWorkers; ++i)
+		startSignal.Unlock();
+	for(int i = 0; i < numWorkers; ++i)
+		join_thread(threads[i]);
+	delete[] threads;
+}
+
+void JobPool::WorkerLoop()
+{
+	while(true)
+	{
+		startSignal.Lock();
+		if(quit) break;
+		DoChunks();
+		doneSignal.Unlock();
+	}
+}
+
+void JobPool::DoChunks()
+{
+	// chunks are claimed one at a time, so a thread which falls behind just
+	// ends up taking fewer of them
+	int numChunks = (count + grainSize - 1) / grainSize;
+	while(true)
+	{
+		int chunk = INTERLOCKED_INCREMENT(&nextChunk) - 1;
+		if(chunk >= numChunks) break;
+
+		int begin = chunk * grainSize;
+		int end = (begin + grainSize < count) ? begin + grainSize : count;
+		function(data, begin, end);
+	}
+}
+
+void JobPool::Run(int count, int grainSize, JobFunction function, void* data)
+{
+	if(count <= 0) return;
+	if(grainSize < 1) grainSize = 1;
+
+	int numChunks = (count + grainSize - 1) / grainSize;
+	if(numWorkers == 0 || numChunks == 1)
+	{
+		// still chunked, since tasks may keep per-chunk results
+		for(int begin = 0; begin < count; begin += grainSize)
+			function(data, begin, (begin + grainSize < count) ? begin + grainSize : count);
+		return;
+	}
+
+	// the semaphores act as full barriers, so the workers see the job as
+	// it's set up here
+	this->function = function;
+	this->data = data;
+	this->count = count;
+	this->grainSize = grainSize;
+	nextChunk = 0;
+
+	int helpers = (numChunks - 1 < numWorkers) ? numChunks - 1 : numWorkers;
+	for(int i = 0; i < helpers; ++i)
+		startSignal.Unlock();
+
+	DoChunks();
+
+	for(int i = 0; i < helpers; ++i)
+		doneSignal.Lock();
+}
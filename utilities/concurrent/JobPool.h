@@ -0,0 +1,61 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include "Semaphore.h"
+
+// Fixed set of worker threads for splitting a loop across cores. The calling
+// thread joins in on the work and returns once every chunk is done, so a
+// ParallelFor reads like an ordinary loop to the code around it. Only one
+// thread may hand work to a pool at a time.
+
+class JobPool
+{
+public:
+	// zero threads picks one per core, counting the calling thread
+	explicit JobPool(int numThreads = 0);
+	~JobPool();
+
+	int GetThreadCount() const { return numWorkers + 1; }
+
+	// task is called as task(begin, end) over chunks of grainSize items
+	template<typename Task>
+	void ParallelFor(int count, int grainSize, Task& task);
+
+private:
+	typedef void (*JobFunction)(void* data, int begin, int end);
+
+	int numWorkers;
+	void** threads;
+	Semaphore startSignal;
+	Semaphore doneSignal;
+
+	JobFunction function;
+	void* data;
+	int count;
+	int grainSize;
+	volatile long nextChunk;
+	bool quit;
+
+	JobPool(const JobPool&);
+	JobPool& operator = (const JobPool&);
+
+	void Run(int count, int grainSize, JobFunction function, void* data);
+	void DoChunks();
+	void WorkerLoop();
+
+	template<typename Task>
+	static void CallTask(void* data, int begin, int end)
+	{
+		(*static_cast<Task*>(data))(begin, end);
+	}
+
+	friend struct JobPoolWorker;
+};
+
+template<typename Task>
+void JobPool::ParallelFor(int count, int grainSize, Task& task)
+{
+	Run(count, grainSize, CallTask<Task>, &task);
+}
+
+#endif
@@ -44,7 +44,7 @@ Semaphore::Semaphore(long maxCount)
 Semaphore::~Semaphore()
 {
 	sem_destroy((sem_t*) semaphore);
-	delete semaphore;
+	delete (sem_t*) semaphore;
 }
 
 void Semaphore::Lock()
@@ -111,28 +111,28 @@ bool WindowsWindow::Create(HINSTANCE instance)
 		Textblock block;
 		Textblock::Load_From_File("main.conf", &block);
 
-		block.Get_Attribute_As_Int("window_width", &width);
-		block.Get_Attribute_As_Int("window_height", &height);
-		if(block.Has_Attribute("renderer"))
+		block.Get_Attribute_As_Int("window_width"_id, &width);
+		block.Get_Attribute_As_Int("window_height"_id, &height);
+		if(block.Has_Attribute("renderer"_id))
 		{
 			String* values;
-			block.Get_Attribute_As_Strings("renderer", &values);
+			block.Get_Attribute_As_Strings("renderer"_id, &values);
 
 			String& renderName = values[0];
 			if(renderName == "DIRECTX") render_mode = RENDER_DX;
 			if(renderName == "OPENGL")  render_mode = RENDER_GL;
 		}
-		block.Get_Attribute_As_Bool("is_fullscreen", &fullscreen);
-		block.Get_Attribute_As_Bool("vertical_synchronization", &vertical_synchronization);
+		block.Get_Attribute_As_Bool("is_fullscreen"_id, &fullscreen);
+		block.Get_Attribute_As_Bool("vertical_synchronization"_id, &vertical_synchronization);
 
-		block.Get_Attribute_As_Float("texture_anisotropy", &texture_anisotropy);
+		block.Get_Attribute_As_Float("texture_anisotropy"_id, &texture_anisotropy);
 		if(block.Has_Child("OpenGL"))
 		{
 			Textblock* glConf = block.Get_Child_By_Name("OpenGL");
-			glConf->Get_Attribute_As_Bool("create_forward_compatible_context",
+			glConf->Get_Attribute_As_Bool("create_forward_compatible_context"_id,
 				&create_forward_compatible_context);
 		}
-		block.Get_Attribute_As_Bool("enable_debugging", &enable_debugging);
+		block.Get_Attribute_As_Bool("enable_debugging"_id, &enable_debugging);
 	}
 
 	// setup window class